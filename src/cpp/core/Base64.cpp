@@ -13,59 +13,171 @@
  *
  */
 
-#include <sstream>
+#include <core/Base64.hpp>
 
-#include <algorithm>
+#include <iostream>
+#include <vector>
 
-#include <boost/archive/iterators/base64_from_binary.hpp>
-#include <boost/archive/iterators/transform_width.hpp>
-#include <boost/archive/iterators/ostream_iterator.hpp>
+#include <boost/bind.hpp>
 
 #include <core/Error.hpp>
 #include <core/Log.hpp>
-#include <core/FileSerializer.hpp>
+#include <core/FilePath.hpp>
 
 namespace core {
 namespace base64 {
 
+namespace {
+
+const char * const kAlphabet =
+   "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
+
+// size of blocks read from input streams (must be a multiple of 3)
+const std::size_t kInputBlockSize = 3 * 16384;
+
+// Lookup table which maps each 12 bit input value to its two output
+// characters (so each 3 byte input group is encoded with two lookups)
+class PairTable
+{
+public:
+   PairTable()
+   {
+      for (std::size_t i = 0; i < 4096; i++)
+      {
+         pairs_[i * 2] = kAlphabet[i >> 6];
+         pairs_[i * 2 + 1] = kAlphabet[i & 0x3F];
+      }
+   }
+
+   const char* pair(unsigned int value) const
+   {
+      return pairs_ + (value * 2);
+   }
+
+private:
+   char pairs_[4096 * 2];
+};
+
+const PairTable& pairTable()
+{
+   static PairTable instance;
+   return instance;
+}
+
+// encode input into the output buffer, which must have room for
+// encodedLength(length) characters
+void encodeBlock(const unsigned char* pInput,
+                 std::size_t length,
+                 char* pOutput)
+{
+   const PairTable& table = pairTable();
+
+   const unsigned char* pEnd = pInput + (length - (length % 3));
+   for ( ; pInput < pEnd; pInput += 3)
+   {
+      unsigned int group = (static_cast<unsigned int>(pInput[0]) << 16) |
+                           (static_cast<unsigned int>(pInput[1]) << 8) |
+                            static_cast<unsigned int>(pInput[2]);
+
+      const char* pHigh = table.pair(group >> 12);
+      const char* pLow = table.pair(group & 0xFFF);
+      pOutput[0] = pHigh[0];
+      pOutput[1] = pHigh[1];
+      pOutput[2] = pLow[0];
+      pOutput[3] = pLow[1];
+      pOutput += 4;
+   }
+
+   // final partial group (padded with '=')
+   std::size_t remaining = length % 3;
+   if (remaining > 0)
+   {
+      unsigned int group = static_cast<unsigned int>(pInput[0]) << 16;
+      if (remaining == 2)
+         group |= static_cast<unsigned int>(pInput[1]) << 8;
+
+      pOutput[0] = kAlphabet[(group >> 18) & 0x3F];
+      pOutput[1] = kAlphabet[(group >> 12) & 0x3F];
+      pOutput[2] = (remaining == 2) ? kAlphabet[(group >> 6) & 0x3F] : '=';
+      pOutput[3] = '=';
+   }
+}
+
+void appendToString(std::string* pOutput, const char* pData, std::size_t size)
+{
+   pOutput->append(pData, size);
+}
+
+} // anonymous namespace
+
+std::size_t encodedLength(std::size_t length)
+{
+   return ((length + 2) / 3) * 4;
+}
+
 Error encode(const std::string& input, std::string* pOutput)
 {
-   using namespace boost::archive::iterators;
+   pOutput->resize(encodedLength(input.size()));
+   if (!input.empty())
+   {
+      encodeBlock(reinterpret_cast<const unsigned char*>(input.data()),
+                  input.size(),
+                  &((*pOutput)[0]));
+   }
 
+   return Success();
+}
+
+Error encode(std::istream& is,
+             const boost::function<void(const char*, std::size_t)>& onOutput)
+{
    try
    {
-      typedef base64_from_binary<transform_width<const char *,6,8> > b64_text;
-      std::stringstream os;
-      std::copy(b64_text(input.c_str()),
-                b64_text(input.c_str() + input.size()),
-                ostream_iterator<char>(os));
-
-      pOutput->clear();
-      pOutput->reserve(((input.size() * 4) / 3) + 3);
-      pOutput->append(os.str());
-
-      std::size_t mod = input.size() % 3;
-      if (mod == 1)
-         pOutput->append("==");
-      else if(mod == 2)
-         pOutput->append("=");
+      std::vector<char> input(kInputBlockSize);
+      std::vector<char> output(encodedLength(kInputBlockSize));
+      while (is.good())
+      {
+         is.read(&input[0], input.size());
+         std::size_t bytesRead = static_cast<std::size_t>(is.gcount());
+         if (bytesRead == 0)
+            break;
+
+         // a short read only occurs at the end of the stream so padding
+         // is only ever written for the last block
+         encodeBlock(reinterpret_cast<const unsigned char*>(&input[0]),
+                     bytesRead,
+                     &output[0]);
+         onOutput(&output[0], encodedLength(bytesRead));
+      }
+
+      if (is.bad())
+         return systemError(boost::system::errc::io_error, ERROR_LOCATION);
 
       return Success();
    }
-   CATCH_UNEXPECTED_EXCEPTION
-
-   // keep compiler happy
-   return Success();
+   catch(const std::exception& e)
+   {
+      Error error = systemError(boost::system::errc::io_error,
+                                ERROR_LOCATION);
+      error.addProperty("what", e.what());
+      return error;
+   }
 }
 
 Error encode(const FilePath& inputFile, std::string* pOutput)
 {
-   std::string contents;
-   Error error = core::readStringFromFile(inputFile, &contents);
+   boost::shared_ptr<std::istream> pIfs;
+   Error error = inputFile.open_r(&pIfs);
    if (error)
       return error;
 
-   return encode(contents, pOutput);
+   // encode directly into the output (sized up front from the file size)
+   pOutput->clear();
+   pOutput->reserve(encodedLength(static_cast<std::size_t>(inputFile.size())));
+   error = encode(*pIfs, boost::bind(appendToString, pOutput, _1, _2));
+   if (error)
+      error.addProperty("path", inputFile.absolutePath());
+   return error;
 }
 
 
@@ -74,4 +186,3 @@ Error encode(const FilePath& inputFile, std::string* pOutput)
 
 
 
-
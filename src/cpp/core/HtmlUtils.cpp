@@ -15,6 +15,9 @@
 
 #include <core/HtmlUtils.hpp>
 
+#include <cctype>
+#include <algorithm>
+
 #include <boost/format.hpp>
 #include <boost/algorithm/string/predicate.hpp>
 
@@ -35,33 +38,179 @@ std::string defaultTitle(const std::string& htmlContent)
 }
 
 
-Base64ImageFilter::Base64ImageFilter(const FilePath& basePath)
-   : boost::iostreams::regex_filter(
-       boost::regex(
-        "(<\\s*[Ii][Mm][Gg] [^\\>]*[Ss][Rr][Cc]\\s*=\\s*)([\"'])(.*?)(\\2)"),
-        boost::bind(&Base64ImageFilter::toBase64Image, this, _1)),
-     basePath_(basePath)
+namespace {
+
+// tags longer than this are passed through without being inspected
+const std::ptrdiff_t kMaxTagLength = 65536;
+
+enum TagScanResult
+{
+   TagIncomplete,
+   TagOther,
+   TagImage
+};
+
+bool isSpace(char ch)
 {
+   return ch == ' ' || ch == '\t' || ch == '\n' || ch == '\r' || ch == '\f';
 }
 
+const char* skipSpace(const char* p, const char* end)
+{
+   while (p < end && isSpace(*p))
+      p++;
+   return p;
+}
 
-std::string Base64ImageFilter::toBase64Image(const boost::cmatch& match)
+// scan the tag beginning at pTag for a quoted <img> src attribute
+TagScanResult scanImageTag(const char* pTag,
+                           const char* end,
+                           const char** pSrcBegin,
+                           const char** pSrcEnd)
 {
-   // extract image reference
-   std::string imgRef = match[3];
+   const char* p = skipSpace(pTag + 1, end);
 
+   // tag name must be img followed by whitespace
+   const char* kImg = "img";
+   for (std::size_t i = 0; i < 3; i++, p++)
+   {
+      if (p == end)
+         return TagIncomplete;
+      if (std::tolower(static_cast<unsigned char>(*p)) != kImg[i])
+         return TagOther;
+   }
+   if (p == end)
+      return TagIncomplete;
+   if (!isSpace(*p))
+      return TagOther;
+
+   // attributes
+   while (true)
+   {
+      p = skipSpace(p, end);
+      if (p == end)
+         return TagIncomplete;
+      if (*p == '>')
+         return TagOther;
+
+      const char* nameBegin = p;
+      while (p < end && !isSpace(*p) && *p != '=' && *p != '>')
+         p++;
+      if (p == end)
+         return TagIncomplete;
+      const char* nameEnd = p;
+
+      p = skipSpace(p, end);
+      if (p == end)
+         return TagIncomplete;
+      if (*p != '=')
+         continue;
+      else if (nameBegin == nameEnd)
+      {
+         p++;
+         continue;
+      }
+
+      p = skipSpace(p + 1, end);
+      if (p == end)
+         return TagIncomplete;
+
+      if (*p == '"' || *p == '\'')
+      {
+         const char* valueBegin = p + 1;
+         const char* valueEnd = std::find(valueBegin, end, *p);
+         if (valueEnd == end)
+            return TagIncomplete;
+
+         if (boost::algorithm::iequals(std::string(nameBegin, nameEnd), "src"))
+         {
+            *pSrcBegin = valueBegin;
+            *pSrcEnd = valueEnd;
+            return TagImage;
+         }
+
+         p = valueEnd + 1;
+      }
+      else
+      {
+         while (p < end && !isSpace(*p) && *p != '>')
+            p++;
+      }
+   }
+}
+
+} // anonymous namespace
+
+Base64ImageFilter::Base64ImageFilter(const FilePath& basePath)
+   : basePath_(basePath)
+{
+}
+
+void Base64ImageFilter::filter(const char* begin,
+                               const char* end,
+                               bool flush,
+                               const Writer& write)
+{
+   // if a tag was split across writes then scan it along with the new input
+   std::string input;
+   if (!pending_.empty())
+   {
+      input.swap(pending_);
+      input.append(begin, end);
+      begin = input.data();
+      end = begin + input.size();
+   }
+
+   const char* pos = begin;
+   while (pos < end)
+   {
+      const char* pTag = std::find(pos, end, '<');
+      if (pTag > pos)
+         write(pos, pTag - pos);
+      if (pTag == end)
+         break;
+
+      const char* pSrcBegin = NULL;
+      const char* pSrcEnd = NULL;
+      TagScanResult result = scanImageTag(pTag, end, &pSrcBegin, &pSrcEnd);
+      if (result == TagIncomplete && !flush && (end - pTag) < kMaxTagLength)
+      {
+         pending_.assign(pTag, end);
+         return;
+      }
+      else if (result == TagImage)
+      {
+         write(pTag, pSrcBegin - pTag);
+         writeImageRef(std::string(pSrcBegin, pSrcEnd), write);
+         pos = pSrcEnd;
+      }
+      else
+      {
+         write(pTag, 1);
+         pos = pTag + 1;
+      }
+   }
+}
+
+void Base64ImageFilter::writeImageRef(const std::string& imgRef,
+                                      const Writer& write)
+{
    // see if this is an image within the base directory. if it is then
    // base64 encode it
    FilePath imagePath = basePath_.childPath(imgRef);
-   if (imagePath.exists() &&
-       boost::algorithm::starts_with(imagePath.mimeContentType(), "image/"))
-   {     
-      std::string imageBase64;
-      Error error = core::base64::encode(imagePath, &imageBase64);
+   std::string mimeType = imagePath.mimeContentType();
+   if (imagePath.exists() && boost::algorithm::starts_with(mimeType, "image/"))
+   {
+      boost::shared_ptr<std::istream> pIfs;
+      Error error = imagePath.open_r(&pIfs);
       if (!error)
       {
-         imgRef = "data:" + imagePath.mimeContentType() + ";base64,";
-         imgRef.append(imageBase64);
+         std::string prefix = "data:" + mimeType + ";base64,";
+         write(prefix.data(), prefix.size());
+         error = core::base64::encode(*pIfs, write);
+         if (error)
+            LOG_ERROR(error);
+         return;
       }
       else
       {
@@ -69,8 +218,7 @@ std::string Base64ImageFilter::toBase64Image(const boost::cmatch& match)
       }
    }
 
-   // return the filtered result
-   return match[1] + match[2] + imgRef + match[4];
+   write(imgRef.data(), imgRef.size());
 }
 
 // convert fonts to base64
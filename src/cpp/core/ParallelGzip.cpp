@@ -0,0 +1,540 @@
+/*
+ * ParallelGzip.cpp
+ *
+ * Copyright (C) 2009-12 by RStudio, Inc.
+ *
+ * Unless you have received this program directly from RStudio pursuant
+ * to the terms of a commercial license agreement with RStudio, then
+ * this program is licensed to you under the terms of version 3 of the
+ * GNU Affero General Public License. This program is distributed WITHOUT
+ * ANY EXPRESS OR IMPLIED WARRANTY, INCLUDING THOSE OF NON-INFRINGEMENT,
+ * MERCHANTABILITY OR FITNESS FOR A PARTICULAR PURPOSE. Please refer to the
+ * AGPL (http://www.gnu.org/licenses/agpl-3.0.txt) for more details.
+ *
+ */
+
+#include <core/ParallelGzip.hpp>
+
+#include <zlib.h>
+
+#include <deque>
+#include <cstring>
+#include <algorithm>
+
+#include <boost/bind.hpp>
+#include <boost/utility.hpp>
+#include <boost/function.hpp>
+#include <boost/cstdint.hpp>
+
+#include <core/Log.hpp>
+#include <core/Error.hpp>
+#include <core/Thread.hpp>
+#include <core/BoostThread.hpp>
+
+namespace core {
+namespace gzip {
+
+// 1f 8b (magic), 08 (deflate), 04 (FEXTRA), mtime (4), xfl, os, xlen (2),
+// then the 'RS' subfield (id, length and the size of the member)
+const std::size_t kParallelHeaderSize = 20;
+
+namespace {
+
+const std::size_t kTrailerSize = 8;
+const std::size_t kBlockSize = 1024 * 1024;
+
+// number of blocks which may be pending for each worker thread
+const std::size_t kBlocksPerThread = 2;
+
+// the most a byte of deflated data can expand to when inflated
+const std::size_t kMaxExpansion = 1032;
+
+void append32(std::string* pOutput, boost::uint32_t value)
+{
+   for (int i = 0; i < 4; i++)
+      pOutput->push_back(static_cast<char>((value >> (8 * i)) & 0xff));
+}
+
+boost::uint32_t read32(const std::string& data, std::size_t pos)
+{
+   const unsigned char* p =
+            reinterpret_cast<const unsigned char*>(data.data() + pos);
+   return p[0] | (p[1] << 8) | (p[2] << 16) |
+          (static_cast<boost::uint32_t>(p[3]) << 24);
+}
+
+std::string memberHeader(boost::uint32_t memberSize)
+{
+   const char header[] = { '\x1f', '\x8b', '\x08', '\x04',
+                           '\0', '\0', '\0', '\0',
+                           '\0', '\xff',
+                           '\x08', '\0',
+                           'R', 'S', '\x04', '\0' };
+   std::string output(header, sizeof(header));
+   append32(&output, memberSize);
+   return output;
+}
+
+boost::uint32_t checksum(const std::string& data)
+{
+   return ::crc32(::crc32(0, Z_NULL, 0),
+                  reinterpret_cast<const Bytef*>(data.data()),
+                  static_cast<uInt>(data.size()));
+}
+
+std::size_t resolveThreads(std::size_t threads)
+{
+   if (threads == 0)
+      threads = boost::thread::hardware_concurrency();
+   return std::max(threads, static_cast<std::size_t>(1));
+}
+
+void throwFailure(const std::string& message)
+{
+   throw std::ios_base::failure("gzip: " + message);
+}
+
+struct Block
+{
+   Block() : done(false) {}
+   std::string input;
+   std::string output;
+   std::string error;
+   bool done;
+};
+
+typedef boost::shared_ptr<Block> BlockPtr;
+
+void compressBlock(int level, Block* pBlock)
+{
+   const std::string& input = pBlock->input;
+
+   z_stream zstream;
+   std::memset(&zstream, 0, sizeof(zstream));
+   if (::deflateInit2(&zstream, level, Z_DEFLATED, -MAX_WBITS, 8,
+                      Z_DEFAULT_STRATEGY) != Z_OK)
+   {
+      pBlock->error = "unable to initialize compression";
+      return;
+   }
+
+   // the header is rewritten below once the size of the member is known
+   std::string& output = pBlock->output;
+   output = memberHeader(0);
+   output.resize(kParallelHeaderSize +
+                 ::deflateBound(&zstream, static_cast<uLong>(input.size())));
+
+   zstream.next_in = reinterpret_cast<Bytef*>(
+                                       const_cast<char*>(input.data()));
+   zstream.avail_in = static_cast<uInt>(input.size());
+   zstream.next_out = reinterpret_cast<Bytef*>(&output[kParallelHeaderSize]);
+   zstream.avail_out = static_cast<uInt>(output.size() - kParallelHeaderSize);
+   int result = ::deflate(&zstream, Z_FINISH);
+   output.resize(kParallelHeaderSize + zstream.total_out);
+   ::deflateEnd(&zstream);
+
+   if (result != Z_STREAM_END)
+   {
+      pBlock->error = "compression failed";
+      return;
+   }
+
+   append32(&output, checksum(input));
+   append32(&output, static_cast<boost::uint32_t>(input.size()));
+   output.replace(0, kParallelHeaderSize,
+                  memberHeader(static_cast<boost::uint32_t>(output.size())));
+
+   // release the input as soon as we are done with it
+   std::string().swap(pBlock->input);
+}
+
+void decompressBlock(Block* pBlock)
+{
+   const std::string& input = pBlock->input;
+   std::size_t dataSize = input.size() - kParallelHeaderSize - kTrailerSize;
+   boost::uint32_t crc = read32(input, input.size() - kTrailerSize);
+   boost::uint32_t size = read32(input, input.size() - 4);
+
+   // don't trust the size in the trailer any further than the compressed
+   // data could possibly expand (it determines how much we allocate)
+   if (size > dataSize * kMaxExpansion)
+   {
+      pBlock->error = "invalid uncompressed size";
+      std::string().swap(pBlock->input);
+      return;
+   }
+
+   z_stream zstream;
+   std::memset(&zstream, 0, sizeof(zstream));
+   if (::inflateInit2(&zstream, -MAX_WBITS) != Z_OK)
+   {
+      pBlock->error = "unable to initialize decompression";
+      return;
+   }
+
+   std::string& output = pBlock->output;
+   output.resize(size);
+   zstream.next_in = reinterpret_cast<Bytef*>(
+                     const_cast<char*>(input.data() + kParallelHeaderSize));
+   zstream.avail_in = static_cast<uInt>(dataSize);
+   // zlib requires an output buffer even if there is no output
+   char empty;
+   zstream.next_out = reinterpret_cast<Bytef*>(output.empty() ? &empty :
+                                                                &output[0]);
+   zstream.avail_out = static_cast<uInt>(output.size());
+   int result = ::inflate(&zstream, Z_FINISH);
+   std::size_t totalOut = zstream.total_out;
+   ::inflateEnd(&zstream);
+
+   if (result != Z_STREAM_END || totalOut != size)
+      pBlock->error = "invalid compressed data";
+   else if (checksum(output) != crc)
+      pBlock->error = "crc mismatch";
+
+   std::string().swap(pBlock->input);
+}
+
+// processes blocks on worker threads (blocks are returned in the order
+// they were submitted)
+class BlockQueue : boost::noncopyable
+{
+public:
+   BlockQueue(const boost::function<void(Block*)>& process,
+              std::size_t threads)
+      : process_(process), stopping_(false)
+   {
+      // with a single thread blocks are processed on the calling thread
+      for (std::size_t i = 0; threads > 1 && i < threads; i++)
+      {
+         // blocks are also processed on the calling thread if no worker
+         // is available, so a failed launch isn't fatal
+         boost::thread* pThread = new boost::thread();
+         core::thread::safeLaunchThread(
+                     boost::bind(&BlockQueue::processBlocks, this), pThread);
+         if (pThread->joinable())
+            threads_.add_thread(pThread);
+         else
+            delete pThread;
+      }
+   }
+
+   ~BlockQueue()
+   {
+      try
+      {
+         LOCK_MUTEX(mutex_)
+         {
+            stopping_ = true;
+         }
+         END_LOCK_MUTEX
+         jobsCondition_.notify_all();
+
+         threads_.join_all();
+      }
+      CATCH_UNEXPECTED_EXCEPTION
+   }
+
+   void submit(BlockPtr pBlock)
+   {
+      if (threads_.size() == 0)
+      {
+         processBlock(pBlock.get());
+         pBlock->done = true;
+         blocks_.push_back(pBlock);
+         return;
+      }
+
+      LOCK_MUTEX(mutex_)
+      {
+         blocks_.push_back(pBlock);
+         jobs_.push_back(pBlock);
+      }
+      END_LOCK_MUTEX
+      jobsCondition_.notify_one();
+   }
+
+   // the number of blocks submitted but not yet taken
+   std::size_t pending()
+   {
+      boost::lock_guard<boost::mutex> lock(mutex_);
+      return blocks_.size();
+   }
+
+   bool nextIsDone()
+   {
+      boost::lock_guard<boost::mutex> lock(mutex_);
+      return !blocks_.empty() && blocks_.front()->done;
+   }
+
+   // take the next block (waiting for it to be processed). returns an
+   // empty pointer if there are no pending blocks
+   BlockPtr takeNext()
+   {
+      boost::unique_lock<boost::mutex> lock(mutex_);
+      if (blocks_.empty())
+         return BlockPtr();
+
+      BlockPtr pBlock = blocks_.front();
+      while (!pBlock->done)
+         doneCondition_.wait(lock);
+      blocks_.pop_front();
+      return pBlock;
+   }
+
+private:
+   // failures (e.g. running out of memory) are recorded in the block so
+   // they are reported to whoever takes it rather than leaving it pending
+   void processBlock(Block* pBlock)
+   {
+      try
+      {
+         process_(pBlock);
+      }
+      catch(const std::exception& e)
+      {
+         pBlock->error = e.what();
+      }
+      catch(...)
+      {
+         pBlock->error = "unexpected error";
+      }
+
+      if (!pBlock->error.empty())
+      {
+         std::string().swap(pBlock->input);
+         std::string().swap(pBlock->output);
+      }
+   }
+
+   void processBlocks()
+   {
+      try
+      {
+         BlockPtr pBlock;
+         while (takeJob(&pBlock))
+         {
+            processBlock(pBlock.get());
+
+            LOCK_MUTEX(mutex_)
+            {
+               pBlock->done = true;
+            }
+            END_LOCK_MUTEX
+            doneCondition_.notify_all();
+         }
+      }
+      CATCH_UNEXPECTED_EXCEPTION
+   }
+
+   bool takeJob(BlockPtr* pBlock)
+   {
+      boost::unique_lock<boost::mutex> lock(mutex_);
+      while (!stopping_)
+      {
+         if (!jobs_.empty())
+         {
+            *pBlock = jobs_.front();
+            jobs_.pop_front();
+            return true;
+         }
+
+         jobsCondition_.wait(lock);
+      }
+
+      return false;
+   }
+
+private:
+   boost::function<void(Block*)> process_;
+   boost::thread_group threads_;
+   boost::mutex mutex_;
+   boost::condition jobsCondition_;
+   boost::condition doneCondition_;
+   std::deque<BlockPtr> blocks_;
+   std::deque<BlockPtr> jobs_;
+   bool stopping_;
+};
+
+} // anonymous namespace
+
+bool isParallelCompressed(const char* data, std::size_t size)
+{
+   if (size < kParallelHeaderSize)
+      return false;
+
+   std::string expected = memberHeader(0);
+   return std::memcmp(data, expected.data(), 4) == 0 &&
+          std::memcmp(data + 10, expected.data() + 10, 6) == 0;
+}
+
+struct ParallelCompressor::Impl
+{
+   Impl(int level, std::size_t threads)
+      : maxPending(threads * kBlocksPerThread),
+        queue(boost::bind(compressBlock, level, _1), threads),
+        written(false)
+   {
+   }
+
+   std::size_t maxPending;
+   BlockQueue queue;
+   BlockPtr pBlock;
+   bool written;
+};
+
+ParallelCompressor::ParallelCompressor(int level, std::size_t threads)
+   : pImpl_(new Impl(level, resolveThreads(threads)))
+{
+}
+
+std::streamsize ParallelCompressor::addData(const char* s, std::streamsize n)
+{
+   if (!pImpl_->pBlock)
+   {
+      pImpl_->pBlock.reset(new Block());
+      pImpl_->pBlock->input.reserve(kBlockSize);
+   }
+
+   std::string& input = pImpl_->pBlock->input;
+   std::size_t count = std::min(static_cast<std::size_t>(n),
+                                kBlockSize - input.size());
+   input.append(s, count);
+
+   if (input.size() == kBlockSize)
+   {
+      pImpl_->queue.submit(pImpl_->pBlock);
+      pImpl_->pBlock.reset();
+   }
+
+   return count;
+}
+
+bool ParallelCompressor::nextBlock(bool all, std::string* pBlock)
+{
+   // unless we are finishing only wait for blocks if too many are pending
+   if (!all &&
+       !pImpl_->queue.nextIsDone() &&
+       pImpl_->queue.pending() <= pImpl_->maxPending)
+   {
+      return false;
+   }
+
+   BlockPtr pNext = pImpl_->queue.takeNext();
+   if (!pNext)
+      return false;
+
+   if (!pNext->error.empty())
+      throwFailure(pNext->error);
+
+   pImpl_->written = true;
+   pBlock->swap(pNext->output);
+   return true;
+}
+
+void ParallelCompressor::finish()
+{
+   // always write at least one member (an empty gzip file isn't valid)
+   if (pImpl_->pBlock || (!pImpl_->written && pImpl_->queue.pending() == 0))
+   {
+      if (!pImpl_->pBlock)
+         pImpl_->pBlock.reset(new Block());
+      pImpl_->queue.submit(pImpl_->pBlock);
+      pImpl_->pBlock.reset();
+   }
+}
+
+struct ParallelDecompressor::Impl
+{
+   explicit Impl(std::size_t threads)
+      : maxPending(threads * kBlocksPerThread),
+        queue(decompressBlock, threads),
+        inputEnded(false),
+        position(0)
+   {
+   }
+
+   std::size_t maxPending;
+   BlockQueue queue;
+   bool inputEnded;
+
+   // the block currently being read
+   BlockPtr pBlock;
+   std::size_t position;
+};
+
+ParallelDecompressor::ParallelDecompressor(std::size_t threads)
+   : pImpl_(new Impl(resolveThreads(threads)))
+{
+}
+
+std::size_t ParallelDecompressor::memberSize(const std::string& header,
+                                             std::streamsize count)
+{
+   if (!isParallelCompressed(header.data(), count))
+      throwFailure("invalid member header");
+
+   std::size_t size = read32(header, kParallelHeaderSize - 4);
+   if (size < kParallelHeaderSize + kTrailerSize)
+      throwFailure("invalid member size");
+
+   return size;
+}
+
+void ParallelDecompressor::truncated()
+{
+   throwFailure("unexpected end of compressed data");
+}
+
+bool ParallelDecompressor::needsInput() const
+{
+   return !pImpl_->inputEnded &&
+          pImpl_->queue.pending() < pImpl_->maxPending;
+}
+
+void ParallelDecompressor::addMember(std::string* pMember)
+{
+   BlockPtr pBlock(new Block());
+   pBlock->input.swap(*pMember);
+   pImpl_->queue.submit(pBlock);
+}
+
+void ParallelDecompressor::endInput()
+{
+   pImpl_->inputEnded = true;
+}
+
+std::streamsize ParallelDecompressor::readOutput(char* s, std::streamsize n)
+{
+   while (!pImpl_->pBlock ||
+          pImpl_->position == pImpl_->pBlock->output.size())
+   {
+      pImpl_->pBlock = pImpl_->queue.takeNext();
+      pImpl_->position = 0;
+      if (!pImpl_->pBlock)
+         return -1;
+
+      if (!pImpl_->pBlock->error.empty())
+         throwFailure(pImpl_->pBlock->error);
+   }
+
+   const std::string& output = pImpl_->pBlock->output;
+   std::size_t count = std::min(static_cast<std::size_t>(n),
+                                output.size() - pImpl_->position);
+   std::memcpy(s, output.data() + pImpl_->position, count);
+   pImpl_->position += count;
+   return count;
+}
+
+void ParallelDecompressor::reset()
+{
+   // discard any blocks which haven't been read
+   while (pImpl_->queue.takeNext())
+   {
+   }
+   pImpl_->pBlock.reset();
+   pImpl_->position = 0;
+   pImpl_->inputEnded = false;
+}
+
+} // namespace gzip
+} // namespace core
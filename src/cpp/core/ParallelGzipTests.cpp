@@ -0,0 +1,122 @@
+/*
+ * ParallelGzipTests.cpp
+ *
+ * Copyright (C) 2009-12 by RStudio, Inc.
+ *
+ * Unless you have received this program directly from RStudio pursuant
+ * to the terms of a commercial license agreement with RStudio, then
+ * this program is licensed to you under the terms of version 3 of the
+ * GNU Affero General Public License. This program is distributed WITHOUT
+ * ANY EXPRESS OR IMPLIED WARRANTY, INCLUDING THOSE OF NON-INFRINGEMENT,
+ * MERCHANTABILITY OR FITNESS FOR A PARTICULAR PURPOSE. Please refer to the
+ * AGPL (http://www.gnu.org/licenses/agpl-3.0.txt) for more details.
+ *
+ */
+
+#include <core/ParallelGzip.hpp>
+
+#include <sstream>
+#include <iostream>
+
+#include <boost/assert.hpp>
+#include <boost/iostreams/copy.hpp>
+#include <boost/iostreams/filter/gzip.hpp>
+#include <boost/iostreams/filtering_stream.hpp>
+
+#include <core/SafeConvert.hpp>
+
+namespace core {
+namespace gzip {
+
+namespace {
+
+std::string compress(const std::string& data, std::size_t threads)
+{
+   std::ostringstream output;
+   {
+      boost::iostreams::filtering_ostream stream;
+      stream.push(ParallelCompressor(6, threads));
+      stream.push(output);
+      stream.write(data.data(), data.size());
+   }
+   return output.str();
+}
+
+template <typename Decompressor>
+std::string decompress(const std::string& compressed,
+                       const Decompressor& decompressor)
+{
+   std::istringstream input(compressed);
+   boost::iostreams::filtering_istream stream;
+   stream.push(decompressor);
+   stream.push(input);
+
+   std::ostringstream output;
+   boost::iostreams::copy(stream, output);
+   return output.str();
+}
+
+} // anonymous namespace
+
+void runParallelGzipTests()
+{
+   // several blocks (the last one partial), a single small block, and
+   // no data at all
+   std::string large;
+   for (int i = 0; large.size() < 5 * 1024 * 1024 + 100; i++)
+      large += "value " + safe_convert::numberToString(i * 7919) + "\n";
+   std::string inputs[] = { large, "x <- 1\n", "" };
+
+   for (std::size_t i = 0; i < sizeof(inputs) / sizeof(inputs[0]); i++)
+   {
+      const std::string& data = inputs[i];
+
+      // the output is identical regardless of the number of threads used
+      std::string compressed = compress(data, 1);
+      BOOST_ASSERT(compressed == compress(data, 4));
+      BOOST_ASSERT(isParallelCompressed(compressed.data(), compressed.size()));
+
+      BOOST_ASSERT(decompress(compressed, ParallelDecompressor(1)) == data);
+      BOOST_ASSERT(decompress(compressed, ParallelDecompressor(4)) == data);
+
+      // readable by other gzip readers
+      BOOST_ASSERT(decompress(compressed,
+                              boost::iostreams::gzip_decompressor()) == data);
+   }
+
+   // output of other gzip writers isn't mistaken for ours
+   std::ostringstream gzipped;
+   {
+      boost::iostreams::filtering_ostream stream;
+      stream.push(boost::iostreams::gzip_compressor());
+      stream.push(gzipped);
+      stream << large;
+   }
+   BOOST_ASSERT(!isParallelCompressed(gzipped.str().data(),
+                                      gzipped.str().size()));
+
+   // truncated and corrupt data are errors
+   std::string compressed = compress(large, 2);
+   std::string corrupt = compressed;
+   corrupt[corrupt.size() / 2] ^= 0x55;
+   std::string oversized = compressed;
+   oversized.replace(oversized.size() - 4, 4, "\xff\xff\xff\x7f");
+   std::string invalid[] = { compressed.substr(0, compressed.size() - 10),
+                             corrupt, oversized };
+   for (std::size_t i = 0; i < sizeof(invalid) / sizeof(invalid[0]); i++)
+   {
+      bool failed = false;
+      try
+      {
+         decompress(invalid[i], ParallelDecompressor(2));
+      }
+      catch(const std::ios_base::failure&)
+      {
+         failed = true;
+      }
+      BOOST_ASSERT(failed);
+   }
+}
+
+} // namespace gzip
+} // namespace core
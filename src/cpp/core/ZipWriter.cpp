@@ -0,0 +1,814 @@
+/*
+ * ZipWriter.cpp
+ *
+ * Copyright (C) 2009-12 by RStudio, Inc.
+ *
+ * Unless you have received this program directly from RStudio pursuant
+ * to the terms of a commercial license agreement with RStudio, then
+ * this program is licensed to you under the terms of version 3 of the
+ * GNU Affero General Public License. This program is distributed WITHOUT
+ * ANY EXPRESS OR IMPLIED WARRANTY, INCLUDING THOSE OF NON-INFRINGEMENT,
+ * MERCHANTABILITY OR FITNESS FOR A PARTICULAR PURPOSE. Please refer to the
+ * AGPL (http://www.gnu.org/licenses/agpl-3.0.txt) for more details.
+ *
+ */
+
+#include <core/ZipWriter.hpp>
+
+#include <zlib.h>
+
+#include <cstring>
+#include <algorithm>
+
+#include <boost/bind.hpp>
+#include <boost/algorithm/string/trim.hpp>
+#include <boost/algorithm/string/case_conv.hpp>
+#include <boost/algorithm/string/predicate.hpp>
+#include <boost/algorithm/string/classification.hpp>
+#include <boost/date_time/posix_time/posix_time.hpp>
+#include <boost/date_time/c_local_time_adjustor.hpp>
+
+#include <core/Error.hpp>
+#include <core/Log.hpp>
+#include <core/FilePath.hpp>
+#include <core/Thread.hpp>
+
+namespace core {
+namespace zip {
+
+namespace {
+
+const boost::uint32_t kLocalHeaderSignature = 0x04034b50;
+const boost::uint32_t kDataDescriptorSignature = 0x08074b50;
+const boost::uint32_t kCentralHeaderSignature = 0x02014b50;
+const boost::uint32_t kZip64EndSignature = 0x06064b50;
+const boost::uint32_t kZip64LocatorSignature = 0x07064b50;
+const boost::uint32_t kEndSignature = 0x06054b50;
+
+const boost::uint16_t kMethodStored = 0;
+const boost::uint16_t kMethodDeflated = 8;
+
+// general purpose flags
+const boost::uint16_t kFlagDataDescriptor = 0x0008;
+const boost::uint16_t kFlagUtf8 = 0x0800;
+
+// versions (made by is unix so that the external attributes are modes)
+const boost::uint16_t kVersionDefault = 20;
+const boost::uint16_t kVersionZip64 = 45;
+const boost::uint16_t kVersionMadeBy = (3 << 8) | kVersionZip64;
+
+const boost::uint16_t kZip64ExtraId = 0x0001;
+const boost::uint16_t kMax16 = 0xffff;
+const boost::uint32_t kMax32 = 0xffffffff;
+
+// external attributes (unix mode in the high word, dos attributes low)
+const boost::uint32_t kFileAttributes = 0100644u << 16;
+const boost::uint32_t kDirectoryAttributes = (040755u << 16) | 0x10;
+
+// files up to this size are compressed in memory ahead of the writer (on
+// worker threads). larger files are compressed as they are written
+const boost::uintmax_t kMaxPrecompressSize = 4 * 1024 * 1024;
+
+// streamed files this large use zip64 (in case they grow once compressed)
+const boost::uintmax_t kZip64StreamSize = 0xff000000;
+
+// maximum number of worker threads and how many entries each can
+// compress ahead of the entry being written
+const std::size_t kMaxThreads = 4;
+const std::size_t kLookaheadPerThread = 2;
+
+const std::size_t kChunkSize = 64 * 1024;
+
+void append16(std::string* pOutput, boost::uint16_t value)
+{
+   pOutput->push_back(static_cast<char>(value & 0xff));
+   pOutput->push_back(static_cast<char>((value >> 8) & 0xff));
+}
+
+void append32(std::string* pOutput, boost::uint32_t value)
+{
+   append16(pOutput, static_cast<boost::uint16_t>(value & 0xffff));
+   append16(pOutput, static_cast<boost::uint16_t>((value >> 16) & 0xffff));
+}
+
+void append64(std::string* pOutput, boost::uint64_t value)
+{
+   append32(pOutput, static_cast<boost::uint32_t>(value & 0xffffffff));
+   append32(pOutput, static_cast<boost::uint32_t>((value >> 32) & 0xffffffff));
+}
+
+boost::uint32_t clamp32(boost::uintmax_t value)
+{
+   return static_cast<boost::uint32_t>(
+                     std::min(value, static_cast<boost::uintmax_t>(kMax32)));
+}
+
+// formats which are already compressed (and so are stored rather than
+// deflated). note that R data files are gzipped by default
+bool isCompressedFormat(const std::string& name)
+{
+   static const char * const kExtensions[] = {
+      ".zip", ".gz", ".tgz", ".bz2", ".xz", ".7z", ".rar", ".jar",
+      ".png", ".jpg", ".jpeg", ".gif", ".mp3", ".mp4", ".m4v", ".mov",
+      ".ogg", ".webm", ".docx", ".xlsx", ".pptx", ".rds", ".rda", ".rdata",
+      NULL
+   };
+
+   std::string lowerName = boost::algorithm::to_lower_copy(name);
+   for (const char * const* pExt = kExtensions; *pExt != NULL; pExt++)
+   {
+      if (boost::algorithm::ends_with(lowerName, *pExt))
+         return true;
+   }
+   return false;
+}
+
+void dosDateTime(std::time_t time,
+                 boost::uint16_t* pDate,
+                 boost::uint16_t* pTime)
+{
+   using namespace boost::posix_time;
+   typedef boost::date_time::c_local_adjustor<ptime> local_adj;
+
+   std::tm tm = to_tm(local_adj::utc_to_local(from_time_t(time)));
+
+   // dos dates start in 1980
+   if (tm.tm_year < 80)
+   {
+      *pDate = (1 << 5) | 1;
+      *pTime = 0;
+      return;
+   }
+
+   *pDate = static_cast<boost::uint16_t>(
+               ((tm.tm_year - 80) << 9) | ((tm.tm_mon + 1) << 5) | tm.tm_mday);
+   *pTime = static_cast<boost::uint16_t>(
+               (tm.tm_hour << 11) | (tm.tm_min << 5) | (tm.tm_sec / 2));
+}
+
+Error zlibError(int result, const ErrorLocation& location)
+{
+   Error error = systemError(boost::system::errc::io_error, location);
+   error.addProperty("zlib-error", result);
+   return error;
+}
+
+} // anonymous namespace
+
+struct ZipWriter::Entry
+{
+   enum State { Pending, Compressing, Ready };
+
+   Entry()
+      : index(0), directory(false), size(0), method(kMethodStored),
+        dosDate(0), dosTime(0), precompress(false), state(Pending),
+        crc(0), compressedSize(0), uncompressedSize(0), offset(0),
+        dataDescriptor(false), zip64(false)
+   {
+   }
+
+   std::size_t index;
+   FilePath path;
+   std::string name;
+   bool directory;
+   boost::uintmax_t size;
+   boost::uint16_t method;
+   boost::uint16_t dosDate;
+   boost::uint16_t dosTime;
+
+   // compressed ahead of time (state and results are guarded by mutex_)
+   bool precompress;
+   State state;
+   std::string data;
+   Error error;
+
+   boost::uint32_t crc;
+   boost::uintmax_t compressedSize;
+   boost::uintmax_t uncompressedSize;
+   boost::uintmax_t offset;
+   bool dataDescriptor;
+   bool zip64;
+};
+
+// Reads (and optionally deflates) the contents of an entry a chunk at a time
+struct ZipWriter::Stream : boost::noncopyable
+{
+   Stream()
+      : deflating(false),
+        crc(::crc32(0, Z_NULL, 0)),
+        compressedSize(0),
+        uncompressedSize(0),
+        eof(false),
+        buffer(kChunkSize)
+   {
+      std::memset(&zstream, 0, sizeof(zstream));
+   }
+
+   ~Stream()
+   {
+      if (deflating)
+         ::deflateEnd(&zstream);
+   }
+
+   Error open(const Entry& entry, int compressionLevel)
+   {
+      Error error = entry.path.open_r(&pIfs);
+      if (error)
+         return error;
+
+      if (entry.method == kMethodDeflated)
+      {
+         int result = ::deflateInit2(&zstream,
+                                     compressionLevel,
+                                     Z_DEFLATED,
+                                     -MAX_WBITS, // raw deflate (no header)
+                                     8,
+                                     Z_DEFAULT_STRATEGY);
+         if (result != Z_OK)
+            return zlibError(result, ERROR_LOCATION);
+         deflating = true;
+      }
+
+      return Success();
+   }
+
+   // read the next chunk of the file (appending it to the output)
+   Error read(std::string* pOutput)
+   {
+      pIfs->read(&buffer[0], buffer.size());
+      std::streamsize bytesRead = pIfs->gcount();
+      if (pIfs->bad())
+         return systemError(boost::system::errc::io_error, ERROR_LOCATION);
+      eof = pIfs->eof() || bytesRead == 0;
+
+      const Bytef* pData = reinterpret_cast<const Bytef*>(&buffer[0]);
+      crc = ::crc32(crc, pData, static_cast<uInt>(bytesRead));
+      uncompressedSize += bytesRead;
+
+      std::size_t previousSize = pOutput->size();
+      if (deflating)
+      {
+         zstream.next_in = const_cast<Bytef*>(pData);
+         zstream.avail_in = static_cast<uInt>(bytesRead);
+         int flush = eof ? Z_FINISH : Z_NO_FLUSH;
+         char output[16384];
+         do
+         {
+            zstream.next_out = reinterpret_cast<Bytef*>(output);
+            zstream.avail_out = sizeof(output);
+            int result = ::deflate(&zstream, flush);
+            if (result == Z_STREAM_ERROR)
+               return zlibError(result, ERROR_LOCATION);
+            pOutput->append(output, sizeof(output) - zstream.avail_out);
+         }
+         while (zstream.avail_out == 0);
+      }
+      else
+      {
+         pOutput->append(&buffer[0], bytesRead);
+      }
+      compressedSize += pOutput->size() - previousSize;
+
+      return Success();
+   }
+
+   boost::shared_ptr<std::istream> pIfs;
+   z_stream zstream;
+   bool deflating;
+   boost::uint32_t crc;
+   boost::uintmax_t compressedSize;
+   boost::uintmax_t uncompressedSize;
+   bool eof;
+   std::vector<char> buffer;
+};
+
+void ZipWriter::appendLocalHeader(const Entry& entry, std::string* pOutput)
+{
+   boost::uint16_t flags = kFlagUtf8;
+   if (entry.dataDescriptor)
+      flags |= kFlagDataDescriptor;
+
+   append32(pOutput, kLocalHeaderSignature);
+   append16(pOutput, entry.zip64 ? kVersionZip64 : kVersionDefault);
+   append16(pOutput, flags);
+   append16(pOutput, entry.method);
+   append16(pOutput, entry.dosTime);
+   append16(pOutput, entry.dosDate);
+
+   // the crc and sizes of streamed entries follow their data
+   if (entry.dataDescriptor)
+   {
+      append32(pOutput, 0);
+      append32(pOutput, entry.zip64 ? kMax32 : 0);
+      append32(pOutput, entry.zip64 ? kMax32 : 0);
+   }
+   else
+   {
+      append32(pOutput, entry.crc);
+      append32(pOutput, static_cast<boost::uint32_t>(entry.compressedSize));
+      append32(pOutput, static_cast<boost::uint32_t>(entry.uncompressedSize));
+   }
+
+   append16(pOutput, static_cast<boost::uint16_t>(entry.name.size()));
+   append16(pOutput, entry.zip64 ? 20 : 0);
+   pOutput->append(entry.name);
+
+   if (entry.zip64)
+   {
+      append16(pOutput, kZip64ExtraId);
+      append16(pOutput, 16);
+      append64(pOutput, 0);
+      append64(pOutput, 0);
+   }
+}
+
+void ZipWriter::appendDataDescriptor(const Entry& entry, std::string* pOutput)
+{
+   append32(pOutput, kDataDescriptorSignature);
+   append32(pOutput, entry.crc);
+   if (entry.zip64)
+   {
+      append64(pOutput, entry.compressedSize);
+      append64(pOutput, entry.uncompressedSize);
+   }
+   else
+   {
+      append32(pOutput, static_cast<boost::uint32_t>(entry.compressedSize));
+      append32(pOutput, static_cast<boost::uint32_t>(entry.uncompressedSize));
+   }
+}
+
+void ZipWriter::appendCentralHeader(const Entry& entry, std::string* pOutput)
+{
+   // zip64 extra field (only has values which don't fit in the header)
+   std::string extra;
+   if (entry.uncompressedSize >= kMax32)
+      append64(&extra, entry.uncompressedSize);
+   if (entry.compressedSize >= kMax32)
+      append64(&extra, entry.compressedSize);
+   if (entry.offset >= kMax32)
+      append64(&extra, entry.offset);
+   bool zip64 = entry.zip64 || !extra.empty();
+
+   boost::uint16_t flags = kFlagUtf8;
+   if (entry.dataDescriptor)
+      flags |= kFlagDataDescriptor;
+
+   append32(pOutput, kCentralHeaderSignature);
+   append16(pOutput, kVersionMadeBy);
+   append16(pOutput, zip64 ? kVersionZip64 : kVersionDefault);
+   append16(pOutput, flags);
+   append16(pOutput, entry.method);
+   append16(pOutput, entry.dosTime);
+   append16(pOutput, entry.dosDate);
+   append32(pOutput, entry.crc);
+   append32(pOutput, clamp32(entry.compressedSize));
+   append32(pOutput, clamp32(entry.uncompressedSize));
+   append16(pOutput, static_cast<boost::uint16_t>(entry.name.size()));
+   append16(pOutput, static_cast<boost::uint16_t>(
+                                 extra.empty() ? 0 : extra.size() + 4));
+   append16(pOutput, 0); // comment length
+   append16(pOutput, 0); // disk number
+   append16(pOutput, 0); // internal attributes
+   append32(pOutput, entry.directory ? kDirectoryAttributes : kFileAttributes);
+   append32(pOutput, clamp32(entry.offset));
+   pOutput->append(entry.name);
+
+   if (!extra.empty())
+   {
+      append16(pOutput, kZip64ExtraId);
+      append16(pOutput, static_cast<boost::uint16_t>(extra.size()));
+      pOutput->append(extra);
+   }
+}
+
+ZipWriter::ZipWriter(int compressionLevel, std::size_t maxThreads)
+   : compressionLevel_(compressionLevel),
+     maxThreads_(maxThreads),
+     lookahead_(0),
+     index_(0),
+     offset_(0),
+     started_(false),
+     finished_(false),
+     nextJob_(0),
+     stopping_(false)
+{
+   if (maxThreads_ == 0)
+   {
+      maxThreads_ = std::min(
+               static_cast<std::size_t>(boost::thread::hardware_concurrency()),
+               kMaxThreads);
+      maxThreads_ = std::max(maxThreads_, static_cast<std::size_t>(1));
+   }
+}
+
+ZipWriter::~ZipWriter()
+{
+   try
+   {
+      // stop the workers (they finish the entry they are compressing)
+      LOCK_MUTEX(mutex_)
+      {
+         stopping_ = true;
+      }
+      END_LOCK_MUTEX
+      entriesCondition_.notify_all();
+
+      threads_.join_all();
+   }
+   CATCH_UNEXPECTED_EXCEPTION
+}
+
+Error ZipWriter::add(const FilePath& filePath, const std::string& name)
+{
+   if (started_)
+   {
+      Error error = systemError(boost::system::errc::operation_not_permitted,
+                                ERROR_LOCATION);
+      error.addProperty("path", filePath.absolutePath());
+      return error;
+   }
+
+   if (!filePath.exists())
+      return fileNotFoundError(filePath, ERROR_LOCATION);
+
+   // trailing slashes would interfere with computing child entry names
+   FilePath rootPath(boost::algorithm::trim_right_copy_if(
+                           filePath.absolutePath(),
+                           boost::algorithm::is_any_of("/")));
+   std::string rootName = boost::algorithm::trim_right_copy_if(
+                           name,
+                           boost::algorithm::is_any_of("/"));
+
+   addEntry(rootPath, rootName);
+
+   if (rootPath.isDirectory())
+   {
+      return rootPath.childrenRecursive(
+            boost::bind(&ZipWriter::addChild, this, rootPath, rootName, _2));
+   }
+
+   return Success();
+}
+
+void ZipWriter::addChild(const FilePath& rootPath,
+                         const std::string& rootName,
+                         const FilePath& childPath)
+{
+   addEntry(childPath, rootName + "/" + childPath.relativePath(rootPath));
+}
+
+void ZipWriter::addEntry(const FilePath& filePath, const std::string& name)
+{
+   EntryPtr pEntry(new Entry());
+   pEntry->index = entries_.size();
+   pEntry->path = filePath;
+   pEntry->directory = filePath.isDirectory();
+   pEntry->name = pEntry->directory ? name + "/" : name;
+   dosDateTime(filePath.lastWriteTime(), &pEntry->dosDate, &pEntry->dosTime);
+
+   if (!pEntry->directory)
+   {
+      pEntry->size = filePath.size();
+      if (compressionLevel_ != 0 &&
+          pEntry->size > 0 &&
+          !isCompressedFormat(name))
+      {
+         pEntry->method = kMethodDeflated;
+      }
+
+      if (pEntry->size <= kMaxPrecompressSize)
+      {
+         pEntry->precompress = true;
+         jobs_.push_back(pEntry);
+      }
+   }
+
+   entries_.push_back(pEntry);
+}
+
+Error ZipWriter::next(std::string* pChunk)
+{
+   pChunk->clear();
+
+   if (!started_)
+      start();
+
+   while (pChunk->empty() && !finished_)
+   {
+      if (index_ < entries_.size())
+      {
+         EntryPtr pEntry = entries_[index_];
+         Error error = pEntry->precompress ?
+                              writePrecompressedEntry(pEntry, pChunk) :
+                              writeStreamedEntry(pEntry, pChunk);
+         if (error)
+            return error;
+      }
+      else
+      {
+         writeCentralDirectory(pChunk);
+         finished_ = true;
+      }
+   }
+
+   return Success();
+}
+
+Error ZipWriter::writeToFile(const FilePath& filePath)
+{
+   boost::shared_ptr<std::ostream> pOfs;
+   Error error = filePath.open_w(&pOfs);
+   if (error)
+      return error;
+
+   std::string chunk;
+   while (true)
+   {
+      error = next(&chunk);
+      if (error)
+         return error;
+
+      if (chunk.empty())
+         break;
+
+      pOfs->write(chunk.data(), chunk.size());
+      if (!pOfs->good())
+      {
+         error = systemError(boost::system::errc::io_error, ERROR_LOCATION);
+         error.addProperty("path", filePath.absolutePath());
+         return error;
+      }
+   }
+
+   return Success();
+}
+
+void ZipWriter::start()
+{
+   started_ = true;
+
+   std::size_t threads = std::min(maxThreads_, jobs_.size());
+   lookahead_ = std::max(threads, static_cast<std::size_t>(1)) *
+                kLookaheadPerThread;
+
+   for (std::size_t i = 0; i < threads; i++)
+   {
+      // entries are compressed on the writing thread if no worker is
+      // available, so a failed launch isn't fatal
+      boost::thread* pThread = new boost::thread();
+      core::thread::safeLaunchThread(
+                  boost::bind(&ZipWriter::compressEntries, this), pThread);
+      if (pThread->joinable())
+         threads_.add_thread(pThread);
+      else
+         delete pThread;
+   }
+}
+
+void ZipWriter::compressEntries()
+{
+   try
+   {
+      EntryPtr pEntry;
+      while (takeEntry(&pEntry))
+         compressEntry(pEntry);
+   }
+   CATCH_UNEXPECTED_EXCEPTION
+}
+
+bool ZipWriter::takeEntry(EntryPtr* pEntry)
+{
+   boost::unique_lock<boost::mutex> lock(mutex_);
+   while (!stopping_)
+   {
+      // skip entries which the writer compressed itself
+      while (nextJob_ < jobs_.size() &&
+             jobs_[nextJob_]->state != Entry::Pending)
+      {
+         nextJob_++;
+      }
+
+      if (nextJob_ == jobs_.size())
+         return false;
+
+      // only compress a limited number of entries ahead of the writer
+      if (jobs_[nextJob_]->index < index_ + lookahead_)
+      {
+         *pEntry = jobs_[nextJob_++];
+         (*pEntry)->state = Entry::Compressing;
+         return true;
+      }
+
+      entriesCondition_.wait(lock);
+   }
+
+   return false;
+}
+
+void ZipWriter::compressEntry(EntryPtr pEntry)
+{
+   std::string data;
+   Stream stream;
+   Error error;
+   try
+   {
+      error = stream.open(*pEntry, compressionLevel_);
+      while (!error && !stream.eof)
+         error = stream.read(&data);
+   }
+   catch(const std::exception& e)
+   {
+      error = systemError(boost::system::errc::io_error, ERROR_LOCATION);
+      error.addProperty("what", e.what());
+   }
+
+   if (error)
+      error.addProperty("path", pEntry->path.absolutePath());
+
+   LOCK_MUTEX(mutex_)
+   {
+      pEntry->data.swap(data);
+      pEntry->error = error;
+      pEntry->crc = stream.crc;
+      pEntry->compressedSize = stream.compressedSize;
+      pEntry->uncompressedSize = stream.uncompressedSize;
+      pEntry->state = Entry::Ready;
+   }
+   END_LOCK_MUTEX
+
+   entriesCondition_.notify_all();
+}
+
+void ZipWriter::finishEntry()
+{
+   LOCK_MUTEX(mutex_)
+   {
+      index_++;
+   }
+   END_LOCK_MUTEX
+
+   // let the workers move on to later entries
+   entriesCondition_.notify_all();
+}
+
+Error ZipWriter::writePrecompressedEntry(EntryPtr pEntry, std::string* pChunk)
+{
+   // wait for the entry to be compressed (compressing it here if no worker
+   // has picked it up yet)
+   bool compressHere = false;
+   try
+   {
+      boost::unique_lock<boost::mutex> lock(mutex_);
+      if (pEntry->state == Entry::Pending)
+      {
+         pEntry->state = Entry::Compressing;
+         compressHere = true;
+      }
+      else
+      {
+         while (pEntry->state != Entry::Ready)
+            entriesCondition_.wait(lock);
+      }
+   }
+   catch(const boost::thread_resource_error& e)
+   {
+      return Error(boost::thread_error::ec_from_exception(e), ERROR_LOCATION);
+   }
+
+   if (compressHere)
+      compressEntry(pEntry);
+
+   if (pEntry->error)
+      return pEntry->error;
+
+   std::size_t previousSize = pChunk->size();
+   pEntry->offset = offset_;
+   appendLocalHeader(*pEntry, pChunk);
+   pChunk->append(pEntry->data);
+   std::string().swap(pEntry->data);
+   offset_ += pChunk->size() - previousSize;
+
+   finishEntry();
+   return Success();
+}
+
+Error ZipWriter::writeStreamedEntry(EntryPtr pEntry, std::string* pChunk)
+{
+   std::size_t previousSize = pChunk->size();
+
+   // start the entry
+   if (!pStream_)
+   {
+      pEntry->offset = offset_;
+
+      // directories have no content
+      if (pEntry->directory)
+      {
+         appendLocalHeader(*pEntry, pChunk);
+         offset_ += pChunk->size() - previousSize;
+         finishEntry();
+         return Success();
+      }
+
+      pStream_.reset(new Stream());
+      Error error = pStream_->open(*pEntry, compressionLevel_);
+      if (error)
+      {
+         pStream_.reset();
+         return error;
+      }
+
+      pEntry->dataDescriptor = true;
+      pEntry->zip64 = pEntry->size >= kZip64StreamSize;
+      appendLocalHeader(*pEntry, pChunk);
+   }
+
+   // write the next chunk of its contents
+   Error error = pStream_->read(pChunk);
+   if (error)
+   {
+      error.addProperty("path", pEntry->path.absolutePath());
+      return error;
+   }
+
+   // finish the entry
+   if (pStream_->eof)
+   {
+      pEntry->crc = pStream_->crc;
+      pEntry->compressedSize = pStream_->compressedSize;
+      pEntry->uncompressedSize = pStream_->uncompressedSize;
+      pStream_.reset();
+
+      // the file grew beyond 4GB while it was being written
+      if (!pEntry->zip64 && (pEntry->compressedSize >= kMax32 ||
+                             pEntry->uncompressedSize >= kMax32))
+      {
+         error = systemError(boost::system::errc::file_too_large,
+                             ERROR_LOCATION);
+         error.addProperty("path", pEntry->path.absolutePath());
+         return error;
+      }
+
+      appendDataDescriptor(*pEntry, pChunk);
+      finishEntry();
+   }
+
+   offset_ += pChunk->size() - previousSize;
+   return Success();
+}
+
+void ZipWriter::writeCentralDirectory(std::string* pChunk)
+{
+   std::size_t previousSize = pChunk->size();
+   boost::uintmax_t directoryOffset = offset_;
+
+   for (std::vector<EntryPtr>::const_iterator it = entries_.begin();
+        it != entries_.end();
+        ++it)
+   {
+      appendCentralHeader(**it, pChunk);
+   }
+
+   boost::uintmax_t directorySize = pChunk->size() - previousSize;
+   boost::uintmax_t count = entries_.size();
+
+   // zip64 end of central directory record and locator
+   if (count >= kMax16 || directoryOffset >= kMax32 || directorySize >= kMax32)
+   {
+      boost::uintmax_t zip64EndOffset = directoryOffset + directorySize;
+
+      append32(pChunk, kZip64EndSignature);
+      append64(pChunk, 44); // size of the remainder of the record
+      append16(pChunk, kVersionMadeBy);
+      append16(pChunk, kVersionZip64);
+      append32(pChunk, 0);  // disk number
+      append32(pChunk, 0);  // disk with the central directory
+      append64(pChunk, count);
+      append64(pChunk, count);
+      append64(pChunk, directorySize);
+      append64(pChunk, directoryOffset);
+
+      append32(pChunk, kZip64LocatorSignature);
+      append32(pChunk, 0);  // disk with the zip64 end record
+      append64(pChunk, zip64EndOffset);
+      append32(pChunk, 1);  // total number of disks
+   }
+
+   // end of central directory record
+   boost::uint16_t count16 = static_cast<boost::uint16_t>(
+                     std::min(count, static_cast<boost::uintmax_t>(kMax16)));
+   append32(pChunk, kEndSignature);
+   append16(pChunk, 0);  // disk number
+   append16(pChunk, 0);  // disk with the central directory
+   append16(pChunk, count16);
+   append16(pChunk, count16);
+   append32(pChunk, clamp32(directorySize));
+   append32(pChunk, clamp32(directoryOffset));
+   append16(pChunk, 0);  // comment length
+
+   offset_ += pChunk->size() - previousSize;
+}
+
+} // namespace zip
+} // namespace core
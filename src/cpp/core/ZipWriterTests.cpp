@@ -0,0 +1,186 @@
+/*
+ * ZipWriterTests.cpp
+ *
+ * Copyright (C) 2009-12 by RStudio, Inc.
+ *
+ * Unless you have received this program directly from RStudio pursuant
+ * to the terms of a commercial license agreement with RStudio, then
+ * this program is licensed to you under the terms of version 3 of the
+ * GNU Affero General Public License. This program is distributed WITHOUT
+ * ANY EXPRESS OR IMPLIED WARRANTY, INCLUDING THOSE OF NON-INFRINGEMENT,
+ * MERCHANTABILITY OR FITNESS FOR A PARTICULAR PURPOSE. Please refer to the
+ * AGPL (http://www.gnu.org/licenses/agpl-3.0.txt) for more details.
+ *
+ */
+
+#include <core/ZipWriter.hpp>
+
+#include <zlib.h>
+
+#include <map>
+#include <cstring>
+#include <iostream>
+
+#include <boost/assert.hpp>
+#include <boost/filesystem.hpp>
+#include <boost/date_time/posix_time/posix_time.hpp>
+
+#include <core/Error.hpp>
+#include <core/FilePath.hpp>
+#include <core/FileSerializer.hpp>
+#include <core/SafeConvert.hpp>
+
+namespace core {
+namespace zip {
+
+namespace {
+
+boost::uint32_t read32(const std::string& data, std::size_t pos)
+{
+   const unsigned char* p =
+            reinterpret_cast<const unsigned char*>(data.data() + pos);
+   return p[0] | (p[1] << 8) | (p[2] << 16) | (p[3] << 24);
+}
+
+boost::uint16_t read16(const std::string& data, std::size_t pos)
+{
+   const unsigned char* p =
+            reinterpret_cast<const unsigned char*>(data.data() + pos);
+   return static_cast<boost::uint16_t>(p[0] | (p[1] << 8));
+}
+
+std::string inflateRaw(const std::string& compressed, std::size_t size)
+{
+   std::string output(size, '\0');
+   z_stream zstream;
+   std::memset(&zstream, 0, sizeof(zstream));
+   int result = ::inflateInit2(&zstream, -MAX_WBITS);
+   BOOST_ASSERT(result == Z_OK);
+   zstream.next_in = reinterpret_cast<Bytef*>(
+                                    const_cast<char*>(compressed.data()));
+   zstream.avail_in = static_cast<uInt>(compressed.size());
+   zstream.next_out = reinterpret_cast<Bytef*>(&output[0]);
+   zstream.avail_out = static_cast<uInt>(output.size());
+   result = ::inflate(&zstream, Z_FINISH);
+   BOOST_ASSERT(result == Z_STREAM_END);
+   ::inflateEnd(&zstream);
+   return output;
+}
+
+// read the entries of an archive using its central directory (verifying
+// the crc of each entry along the way)
+std::map<std::string, std::string> readArchive(const std::string& archive)
+{
+   std::size_t endPos = archive.size() - 22;
+   BOOST_ASSERT(read32(archive, endPos) == 0x06054b50);
+   std::size_t count = read16(archive, endPos + 10);
+   std::size_t pos = read32(archive, endPos + 16);
+
+   std::map<std::string, std::string> entries;
+   for (std::size_t i = 0; i < count; i++)
+   {
+      BOOST_ASSERT(read32(archive, pos) == 0x02014b50);
+      boost::uint16_t method = read16(archive, pos + 10);
+      boost::uint32_t crc = read32(archive, pos + 16);
+      boost::uint32_t compressedSize = read32(archive, pos + 20);
+      boost::uint32_t size = read32(archive, pos + 24);
+      std::size_t nameLength = read16(archive, pos + 28);
+      std::size_t extraLength = read16(archive, pos + 30);
+      std::size_t commentLength = read16(archive, pos + 32);
+      std::size_t localPos = read32(archive, pos + 42);
+      std::string name = archive.substr(pos + 46, nameLength);
+
+      BOOST_ASSERT(read32(archive, localPos) == 0x04034b50);
+      std::size_t dataPos = localPos + 30 + read16(archive, localPos + 26) +
+                            read16(archive, localPos + 28);
+      std::string data = archive.substr(dataPos, compressedSize);
+      if (method == 8)
+         data = inflateRaw(data, size);
+      BOOST_ASSERT(data.size() == size);
+      BOOST_ASSERT(::crc32(::crc32(0, Z_NULL, 0),
+                           reinterpret_cast<const Bytef*>(data.data()),
+                           static_cast<uInt>(data.size())) == crc);
+
+      entries[name] = data;
+      pos += 46 + nameLength + extraLength + commentLength;
+   }
+
+   return entries;
+}
+
+std::string writeArchive(const FilePath& dir, std::size_t threads)
+{
+   ZipWriter writer(6, threads);
+   Error error = writer.add(dir, "export");
+   BOOST_ASSERT(!error);
+
+   std::string archive, chunk;
+   do
+   {
+      error = writer.next(&chunk);
+      BOOST_ASSERT(!error);
+      archive.append(chunk);
+   }
+   while (!chunk.empty());
+
+   return archive;
+}
+
+} // anonymous namespace
+
+void runZipWriterTests()
+{
+   FilePath tempDir(boost::filesystem::temp_directory_path().string());
+   FilePath dir = tempDir.complete("rstudio-zip-writer-test");
+   Error error = dir.removeIfExists();
+   BOOST_ASSERT(!error);
+   error = dir.complete("sub/empty").ensureDirectory();
+   BOOST_ASSERT(!error);
+
+   // small files (compressed ahead on worker threads), an already
+   // compressed format (stored), an empty file, and a file large enough
+   // to be compressed as it is written
+   std::map<std::string, std::string> files;
+   files["export/a.R"] = "x <- 1\n";
+   files["export/empty.txt"] = "";
+   files["export/plot.png"] = std::string(1000, 'p');
+   for (int i = 0; i < 20; i++)
+   {
+      std::string name = "export/sub/f" + safe_convert::numberToString(i);
+      files[name] = std::string(1000 * i, 'a' + i);
+   }
+   std::string large;
+   for (int i = 0; large.size() < 6 * 1024 * 1024; i++)
+      large += "line " + safe_convert::numberToString(i * 7919) + "\n";
+   files["export/sub/large.csv"] = large;
+
+   for (std::map<std::string, std::string>::const_iterator it = files.begin();
+        it != files.end();
+        ++it)
+   {
+      error = writeStringToFile(dir.complete(it->first.substr(7)), it->second);
+      BOOST_ASSERT(!error);
+   }
+
+   // the archive is identical regardless of the number of threads used
+   std::string archive = writeArchive(dir, 1);
+   BOOST_ASSERT(archive == writeArchive(dir, 4));
+
+   std::map<std::string, std::string> entries = readArchive(archive);
+   BOOST_ASSERT(entries.size() == files.size() + 3);
+   BOOST_ASSERT(entries.count("export/") == 1);
+   BOOST_ASSERT(entries.count("export/sub/") == 1);
+   BOOST_ASSERT(entries.count("export/sub/empty/") == 1);
+   for (std::map<std::string, std::string>::const_iterator it = files.begin();
+        it != files.end();
+        ++it)
+   {
+      BOOST_ASSERT(entries[it->first] == it->second);
+   }
+
+   error = dir.remove();
+   BOOST_ASSERT(!error);
+}
+
+} // namespace zip
+} // namespace core
@@ -0,0 +1,404 @@
+/*
+ * MultipartFormParser.cpp
+ *
+ * Copyright (C) 2009-12 by RStudio, Inc.
+ *
+ * Unless you have received this program directly from RStudio pursuant
+ * to the terms of a commercial license agreement with RStudio, then
+ * this program is licensed to you under the terms of version 3 of the
+ * GNU Affero General Public License. This program is distributed WITHOUT
+ * ANY EXPRESS OR IMPLIED WARRANTY, INCLUDING THOSE OF NON-INFRINGEMENT,
+ * MERCHANTABILITY OR FITNESS FOR A PARTICULAR PURPOSE. Please refer to the
+ * AGPL (http://www.gnu.org/licenses/agpl-3.0.txt) for more details.
+ *
+ */
+
+#include <core/http/MultipartFormParser.hpp>
+
+#include <sstream>
+
+#include <boost/bind.hpp>
+#include <boost/regex.hpp>
+#include <boost/algorithm/string/trim.hpp>
+
+#include <core/Error.hpp>
+#include <core/Log.hpp>
+#include <core/http/Header.hpp>
+#include <core/system/System.hpp>
+
+namespace core {
+namespace http {
+
+namespace {
+
+// limit on the size of the headers of an individual part
+const std::size_t kMaxPartHeadersSize = 64 * 1024;
+
+// limit on the total size of the values of fields which aren't files
+const std::size_t kMaxFieldsSize = 1024 * 1024;
+
+const char * const kCRLF = "\r\n";
+
+std::string boundaryFromContentType(const std::string& contentType)
+{
+   std::string boundaryPrefix("boundary=");
+   size_t prefixLoc = contentType.find(boundaryPrefix);
+   if (prefixLoc == std::string::npos)
+      return std::string();
+
+   std::string boundary = contentType.substr(prefixLoc+boundaryPrefix.size(),
+                                             std::string::npos);
+   if (!boundary.empty() && boundary[0] == '"')
+   {
+      boundary = boundary.substr(1, boundary.find('"', 1) - 1);
+   }
+   else
+   {
+      boundary = boundary.substr(0, boundary.find(';'));
+      boost::algorithm::trim(boundary);
+   }
+   return boundary;
+}
+
+void removeSpooledFile(const FilePath& filePath)
+{
+   Error error = filePath.removeIfExists();
+   if (error)
+      LOG_ERROR(error);
+}
+
+Error invalidBodyError(const std::string& reason,
+                       const ErrorLocation& location)
+{
+   Error error = systemError(boost::system::errc::bad_message, location);
+   error.addProperty("reason", reason);
+   return error;
+}
+
+} // anonymous namespace
+
+MultipartFormParser::MultipartFormParser(const std::string& contentType,
+                                         const FilePath& spoolDir,
+                                         std::size_t maxFileSize)
+   : spoolDir_(spoolDir),
+     maxFileSize_(maxFileSize),
+     state_(Preamble),
+     partIgnored_(true),
+     partIsFile_(false),
+     partSize_(0),
+     fieldsSize_(0)
+{
+   // each delimiter is preceded by a CRLF (which we supply for the first
+   // delimiter so it can be matched in the same way as the others). we
+   // leave the delimiter empty if there is no boundary (parse fails)
+   std::string boundary = boundaryFromContentType(contentType);
+   if (!boundary.empty())
+      delimiter_ = std::string(kCRLF) + "--" + boundary;
+   buffer_ = kCRLF;
+}
+
+MultipartFormParser::~MultipartFormParser()
+{
+   try
+   {
+      discardPart();
+   }
+   catch(...)
+   {
+   }
+}
+
+Error MultipartFormParser::parse(const char* begin, const char* end)
+{
+   if (delimiter_.empty())
+      return invalidBodyError("missing boundary", ERROR_LOCATION);
+
+   if (state_ == Epilogue)
+      return Success();
+
+   buffer_.append(begin, end);
+   return parseBuffer();
+}
+
+Error MultipartFormParser::finish(Fields* pFields, Files* pFiles)
+{
+   pFields->insert(pFields->end(), fields_.begin(), fields_.end());
+   pFiles->insert(files_.begin(), files_.end());
+
+   if (state_ != Epilogue)
+   {
+      discardPart();
+      return invalidBodyError("incomplete body", ERROR_LOCATION);
+   }
+   else
+   {
+      return Success();
+   }
+}
+
+Error MultipartFormParser::parseBuffer()
+{
+   std::string::size_type pos = 0;
+   Error error;
+   bool progress = true;
+   while (progress && !error)
+   {
+      progress = false;
+      switch (state_)
+      {
+         case Preamble:
+         {
+            std::string::size_type delimPos = buffer_.find(delimiter_, pos);
+            if (delimPos != std::string::npos)
+            {
+               pos = delimPos + delimiter_.size();
+               state_ = Delimiter;
+               progress = true;
+            }
+            else if (buffer_.size() - pos >= delimiter_.size())
+            {
+               // retain enough to match a delimiter split across chunks
+               pos = buffer_.size() - delimiter_.size() + 1;
+            }
+            break;
+         }
+
+         case Delimiter:
+         {
+            if (buffer_.size() - pos < 2)
+               break;
+
+            // the final delimiter is followed by "--"
+            if (buffer_.compare(pos, 2, "--") == 0)
+            {
+               pos = buffer_.size();
+               state_ = Epilogue;
+               break;
+            }
+
+            // otherwise skip to the end of the line
+            std::string::size_type eolPos = buffer_.find(kCRLF, pos);
+            if (eolPos != std::string::npos)
+            {
+               pos = eolPos + 2;
+               state_ = PartHeaders;
+               progress = true;
+            }
+            else if (buffer_.size() - pos > kMaxPartHeadersSize)
+            {
+               error = invalidBodyError("invalid delimiter", ERROR_LOCATION);
+            }
+            break;
+         }
+
+         case PartHeaders:
+         {
+            std::string::size_type endPos;
+            if (buffer_.compare(pos, 2, kCRLF) == 0)
+               endPos = pos;
+            else
+               endPos = buffer_.find("\r\n\r\n", pos);
+
+            if (endPos != std::string::npos)
+            {
+               std::string headers = buffer_.substr(pos, endPos - pos);
+               pos = endPos + (endPos == pos ? 2 : 4);
+               error = beginPart(headers);
+               state_ = PartData;
+               progress = true;
+            }
+            else if (buffer_.size() - pos > kMaxPartHeadersSize)
+            {
+               error = invalidBodyError("part headers too large",
+                                        ERROR_LOCATION);
+            }
+            break;
+         }
+
+         case PartData:
+         {
+            std::string::size_type delimPos = buffer_.find(delimiter_, pos);
+            if (delimPos != std::string::npos)
+            {
+               error = writePartData(buffer_.data() + pos, delimPos - pos);
+               if (!error)
+                  error = endPart();
+               pos = delimPos + delimiter_.size();
+               state_ = Delimiter;
+               progress = true;
+            }
+            else if (buffer_.size() - pos >= delimiter_.size())
+            {
+               // write everything which can't be the start of a delimiter
+               std::size_t size = buffer_.size() - pos - delimiter_.size() + 1;
+               error = writePartData(buffer_.data() + pos, size);
+               pos += size;
+            }
+            break;
+         }
+
+         case Epilogue:
+         {
+            pos = buffer_.size();
+            break;
+         }
+      }
+   }
+
+   buffer_.erase(0, pos);
+   return error;
+}
+
+Error MultipartFormParser::beginPart(const std::string& headerText)
+{
+   partIgnored_ = true;
+   partIsFile_ = false;
+   partSize_ = 0;
+   partName_.clear();
+   partValue_.clear();
+   partFile_ = File();
+
+   // read the headers
+   Headers headers;
+   std::istringstream headerStream(headerText + kCRLF);
+   headerStream.unsetf(std::ios::skipws);
+   http::parseHeaders(headerStream, &headers);
+
+   // check for content-disposition
+   std::string cDisp = http::headerValue(headers, "Content-Disposition");
+   if (cDisp.empty())
+      return Success();
+
+   // parse values out of content disposition
+   static const boost::regex nameRegex("form-data; name=\"(.*)\"");
+   static const boost::regex filenameRegex(
+                           "form-data; name=\"(.*)\"; filename=\"(.*)\"");
+   boost::smatch nameMatch, fileMatch;
+   if (regex_match(cDisp, fileMatch, filenameRegex))
+   {
+      partIgnored_ = false;
+      partIsFile_ = true;
+      partName_ = fileMatch[1];
+      partFile_.name = fileMatch[2];
+      partFile_.contentType = http::headerValue(headers, "Content-Type");
+      if (partFile_.contentType.empty())
+         partFile_.contentType = "application/octet-stream";
+
+      // open the file we'll spool the contents to
+      if (!spoolDir_.empty())
+      {
+         FilePath spoolPath = spoolDir_.complete(
+                        "upload-" + core::system::generateShortenedUuid());
+         Error error = spoolPath.open_w(&pPartStream_);
+         if (error)
+            return error;
+
+         partFile_.path = spoolPath;
+         partFile_.pathOwner.reset(static_cast<void*>(NULL),
+                                   boost::bind(removeSpooledFile, spoolPath));
+      }
+   }
+   else if (regex_match(cDisp, nameMatch, nameRegex))
+   {
+      partIgnored_ = false;
+      partName_ = nameMatch[1];
+   }
+
+   return Success();
+}
+
+Error MultipartFormParser::writePartData(const char* data, std::size_t size)
+{
+   if (partIgnored_ || size == 0)
+      return Success();
+
+   if (!partIsFile_)
+   {
+      fieldsSize_ += size;
+      if (fieldsSize_ > kMaxFieldsSize)
+      {
+         discardPart();
+         return invalidBodyError("form fields too large", ERROR_LOCATION);
+      }
+
+      partValue_.append(data, size);
+      return Success();
+   }
+
+   // enforce the limit on file size as the data arrives
+   partSize_ += size;
+   if (maxFileSize_ > 0 && partSize_ > maxFileSize_)
+   {
+      Error error = systemError(boost::system::errc::file_too_large,
+                                ERROR_LOCATION);
+      error.addProperty("name", partFile_.name);
+      discardPart();
+      return error;
+   }
+
+   if (pPartStream_)
+   {
+      pPartStream_->write(data, size);
+      if (pPartStream_->fail())
+      {
+         Error error = systemError(boost::system::errc::io_error,
+                                   ERROR_LOCATION);
+         error.addProperty("path", partFile_.path);
+         discardPart();
+         return error;
+      }
+   }
+   else
+   {
+      partFile_.contents.append(data, size);
+   }
+
+   return Success();
+}
+
+Error MultipartFormParser::endPart()
+{
+   if (partIgnored_)
+      return Success();
+
+   if (partIsFile_)
+   {
+      if (pPartStream_)
+      {
+         pPartStream_->flush();
+         bool failed = pPartStream_->fail();
+         pPartStream_.reset();
+         if (failed)
+         {
+            Error error = systemError(boost::system::errc::io_error,
+                                      ERROR_LOCATION);
+            error.addProperty("path", partFile_.path);
+            discardPart();
+            return error;
+         }
+      }
+
+      files_.insert(std::make_pair(partName_, partFile_));
+   }
+   else
+   {
+      boost::algorithm::trim(partValue_);
+      fields_.push_back(std::make_pair(partName_, partValue_));
+   }
+
+   partIgnored_ = true;
+   partFile_ = File();
+   return Success();
+}
+
+void MultipartFormParser::discardPart()
+{
+   // releasing the file also removes anything spooled for it
+   pPartStream_.reset();
+   partFile_ = File();
+   partValue_.clear();
+   partIgnored_ = true;
+}
+
+} // namespace http
+} // namespace core
@@ -0,0 +1,275 @@
+/*
+ * PosixStreamFile.cpp
+ *
+ * Copyright (C) 2009-12 by RStudio, Inc.
+ *
+ * Unless you have received this program directly from RStudio pursuant
+ * to the terms of a commercial license agreement with RStudio, then
+ * this program is licensed to you under the terms of version 3 of the
+ * GNU Affero General Public License. This program is distributed WITHOUT
+ * ANY EXPRESS OR IMPLIED WARRANTY, INCLUDING THOSE OF NON-INFRINGEMENT,
+ * MERCHANTABILITY OR FITNESS FOR A PARTICULAR PURPOSE. Please refer to the
+ * AGPL (http://www.gnu.org/licenses/agpl-3.0.txt) for more details.
+ *
+ */
+
+#include <core/http/StreamFile.hpp>
+
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <unistd.h>
+#include <sys/stat.h>
+
+#ifdef __linux__
+#include <sys/sendfile.h>
+#endif
+
+#include <algorithm>
+
+#include <boost/bind.hpp>
+#include <boost/iostreams/device/back_inserter.hpp>
+#include <boost/iostreams/filter/gzip.hpp>
+#include <boost/iostreams/filtering_stream.hpp>
+
+#include <core/Error.hpp>
+#include <core/FilePath.hpp>
+#include <core/system/System.hpp>
+
+namespace core {
+namespace http {
+
+namespace {
+
+// size of chunks read from the file
+const std::size_t kChunkSize = 64 * 1024;
+
+void closeDescriptor(void* pFd)
+{
+   int* pDescriptor = static_cast<int*>(pFd);
+   ::close(*pDescriptor);
+   delete pDescriptor;
+}
+
+// the socket may be in non-blocking mode (asio puts descriptors into
+// non-blocking mode once they are used for async operations) so wait
+// for it to become writeable when the send buffer is full
+Error waitForWriteable(int socketFd)
+{
+   struct pollfd pfd;
+   pfd.fd = socketFd;
+   pfd.events = POLLOUT;
+   pfd.revents = 0;
+   return core::system::posixCall<int>(
+                  boost::bind(::poll, &pfd, 1, -1), ERROR_LOCATION);
+}
+
+Error writeAll(int socketFd, const char* data, std::size_t size)
+{
+   while (size > 0)
+   {
+      ssize_t written = core::system::posixCall<ssize_t>(
+                           boost::bind(::write, socketFd, data, size));
+      if (written == -1)
+      {
+         if (errno != EAGAIN && errno != EWOULDBLOCK)
+            return systemError(errno, ERROR_LOCATION);
+
+         Error error = waitForWriteable(socketFd);
+         if (error)
+            return error;
+      }
+      else
+      {
+         data += written;
+         size -= written;
+      }
+   }
+
+   return Success();
+}
+
+#ifdef __linux__
+
+Error sendFileDirect(int socketFd, const StreamFile& streamFile)
+{
+   // sendfile transfers at most 0x7ffff000 bytes per call
+   const boost::uintmax_t kMaxSend = 0x7ffff000;
+
+   off_t offset = streamFile.offset;
+   boost::uintmax_t remaining = streamFile.length;
+   while (remaining > 0)
+   {
+      std::size_t count = std::min(remaining, kMaxSend);
+      ssize_t sent = core::system::posixCall<ssize_t>(
+            boost::bind(::sendfile, socketFd, streamFile.fd, &offset, count));
+      if (sent == -1)
+      {
+         if (errno != EAGAIN && errno != EWOULDBLOCK)
+            return systemError(errno, ERROR_LOCATION);
+
+         Error error = waitForWriteable(socketFd);
+         if (error)
+            return error;
+      }
+      else if (sent == 0)
+      {
+         // the file was truncated after the response was populated
+         return systemError(EIO, ERROR_LOCATION);
+      }
+      else
+      {
+         remaining -= sent;
+      }
+   }
+
+   return Success();
+}
+
+#endif
+
+} // anonymous namespace
+
+Error openStreamFile(const FilePath& filePath, StreamFile* pStreamFile)
+{
+   int fd = ::open(filePath.absolutePath().c_str(), O_RDONLY);
+   if (fd == -1)
+   {
+      Error error = systemError(errno, ERROR_LOCATION);
+      error.addProperty("path", filePath.absolutePath());
+      return error;
+   }
+
+   // take ownership of the descriptor before anything else can fail
+   boost::shared_ptr<void> fdOwner(new int(fd), closeDescriptor);
+
+   struct stat st;
+   if (::fstat(fd, &st) == -1)
+   {
+      Error error = systemError(errno, ERROR_LOCATION);
+      error.addProperty("path", filePath.absolutePath());
+      return error;
+   }
+
+   if (S_ISDIR(st.st_mode))
+   {
+      Error error = systemError(EISDIR, ERROR_LOCATION);
+      error.addProperty("path", filePath.absolutePath());
+      return error;
+   }
+
+   pStreamFile->fd = fd;
+   pStreamFile->fdOwner = fdOwner;
+   pStreamFile->offset = 0;
+   pStreamFile->length = st.st_size;
+   pStreamFile->gzip = false;
+   return Success();
+}
+
+StreamFileReader::StreamFileReader(const StreamFile& streamFile)
+   : streamFile_(streamFile),
+     position_(streamFile.offset),
+     remaining_(streamFile.length),
+     buffer_(kChunkSize)
+{
+   if (streamFile_.gzip)
+   {
+      pGzipStream_.reset(new boost::iostreams::filtering_ostream());
+      pGzipStream_->push(boost::iostreams::gzip_compressor());
+      pGzipStream_->push(boost::iostreams::back_inserter(compressed_));
+   }
+}
+
+StreamFileReader::~StreamFileReader()
+{
+}
+
+Error StreamFileReader::next(std::string* pChunk)
+{
+   pChunk->clear();
+
+   try
+   {
+      while (pChunk->empty())
+      {
+         // end of the file -- flush any remaining compressed output
+         if (remaining_ == 0)
+         {
+            if (pGzipStream_ && !pGzipStream_->empty())
+               pGzipStream_->reset();
+            pChunk->swap(compressed_);
+            return Success();
+         }
+
+         // read the next chunk of the file
+         std::size_t count = std::min(remaining_,
+                                      static_cast<boost::uintmax_t>(
+                                                         buffer_.size()));
+         ssize_t bytesRead = core::system::posixCall<ssize_t>(
+                  boost::bind(::pread,
+                              streamFile_.fd,
+                              &buffer_[0],
+                              count,
+                              static_cast<off_t>(position_)));
+         if (bytesRead == -1)
+            return systemError(errno, ERROR_LOCATION);
+         else if (bytesRead == 0)
+            return systemError(EIO, ERROR_LOCATION);
+
+         position_ += bytesRead;
+         remaining_ -= bytesRead;
+
+         // return it as-is or accumulate it into the compressed output
+         if (pGzipStream_)
+         {
+            pGzipStream_->write(&buffer_[0], bytesRead);
+            pChunk->swap(compressed_);
+         }
+         else
+         {
+            pChunk->assign(&buffer_[0], bytesRead);
+         }
+      }
+   }
+   catch(const std::exception& e)
+   {
+      Error error = systemError(boost::system::errc::io_error,
+                                ERROR_LOCATION);
+      error.addProperty("what", e.what());
+      return error;
+   }
+
+   return Success();
+}
+
+Error sendStreamFile(int socketFd, const StreamFile& streamFile)
+{
+#ifdef __linux__
+   if (!streamFile.gzip)
+      return sendFileDirect(socketFd, streamFile);
+#endif
+
+   StreamFileReader reader(streamFile);
+   return sendStreamBody(socketFd, &reader);
+}
+
+Error sendStreamBody(int socketFd, StreamBody* pStreamBody)
+{
+   std::string chunk;
+   while (true)
+   {
+      Error error = pStreamBody->next(&chunk);
+      if (error)
+         return error;
+
+      if (chunk.empty())
+         return Success();
+
+      error = writeAll(socketFd, chunk.data(), chunk.size());
+      if (error)
+         return error;
+   }
+}
+
+} // namespace http
+} // namespace core
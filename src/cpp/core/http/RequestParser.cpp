@@ -16,314 +16,348 @@
 
 #include <core/http/RequestParser.hpp>
 
-#include <boost/lexical_cast.hpp>
+#include <cstring>
+#include <algorithm>
+
+#include <boost/algorithm/string/predicate.hpp>
+
+#include <core/Error.hpp>
+#include <core/Log.hpp>
+#include <core/http/MultipartFormParser.hpp>
 
 namespace core {
 namespace http {
 
+namespace {
+
+// limit on the size of the request line and headers
+const std::size_t kMaxHeaderSize = 1024 * 1024;
+
+// minimum amount the body grows by as it is received (we don't allocate the
+// full content length up front since it is supplied by the client)
+const std::size_t kMinBodyGrowth = 64 * 1024;
+
+// allowance for the fields and part headers which accompany an uploaded
+// file when checking the content length of a form against the file limit
+const std::size_t kMaxFormOverhead = 1024 * 1024;
+
+const char * const kCRLF = "\r\n";
+const char * const kEndOfHeaders = "\r\n\r\n";
+
+const char* findCRLF(const char* begin, const char* end)
+{
+  return std::search(begin, end, kCRLF, kCRLF + 2);
+}
+
+bool parseContentLength(const std::string& value, std::size_t* pLength)
+{
+  if (value.empty())
+    return false;
+
+  std::size_t length = 0;
+  for (std::string::const_iterator it = value.begin(); it != value.end(); ++it)
+  {
+    if (*it < '0' || *it > '9')
+      return false;
+
+    std::size_t next = (length * 10) + (*it - '0');
+    if (next < length)
+      return false;
+    length = next;
+  }
+
+  *pLength = length;
+  return true;
+}
+
+} // anonymous namespace
+
 RequestParser::RequestParser()
-  : state_(method_start), 
-    content_length_(0), 
-    parsing_content_length_(false), 
-    parsing_body_(false)
+  : content_length_(0),
+    body_received_(0),
+    parsing_body_(false),
+    form_max_file_size_(0)
 {
 }
 
 void RequestParser::reset()
 {
-  state_ = method_start;
+  header_buffer_.clear();
   content_length_ = 0 ;
-  parsing_content_length_ = false ;
+  body_received_ = 0 ;
   parsing_body_ = false ;
+  form_parser_.reset();
+}
+
+void RequestParser::setFormSpoolDir(const std::string& uriPrefix,
+                                    const FilePath& spoolDir,
+                                    std::size_t maxFileSize)
+{
+  form_uri_prefix_ = uriPrefix;
+  form_spool_dir_ = spoolDir;
+  form_max_file_size_ = maxFileSize;
 }
 
-RequestParser::status RequestParser::consume(Request& req, char input)
+RequestParser::status RequestParser::parse(Request& req,
+                                           const char* begin,
+                                           const char* end)
 {
-  switch (state_)
+  if (parsing_body_)
+    return receiveBody(req, begin, end);
+
+  if (begin == end)
+    return incomplete;
+
+  // fail fast on input which can't be the start of a request
+  if (header_buffer_.empty() && !is_token(*begin))
+    return error;
+
+  // look for the end of the headers (which may span chunks)
+  std::size_t searchPos = header_buffer_.size() > 3 ?
+                                          header_buffer_.size() - 3 : 0;
+  header_buffer_.append(begin, end);
+  std::string::size_type endPos = header_buffer_.find(kEndOfHeaders,
+                                                      searchPos);
+  if (endPos == std::string::npos)
+    return header_buffer_.size() > kMaxHeaderSize ? error : incomplete;
+
+  // parse headers
+  const char* pHeaders = header_buffer_.data();
+  std::size_t headersSize = endPos + 4;
+  status st = parseHeaders(req, pHeaders, pHeaders + headersSize);
+  if (st != complete || content_length_ == 0)
+    return st;
+
+  // spool multipart forms if requested
+  if (!form_spool_dir_.empty() &&
+      boost::algorithm::starts_with(req.uri(), form_uri_prefix_))
   {
-  case method_start:
-    if (!is_char(input) || is_ctl(input) || is_tspecial(input))
-    {
-      return error;
-    }
-    else
-    {
-      state_ = method;
-      req.method_.push_back(input);
-      return incomplete;
-    }
-  case method:
-    if (input == ' ')
-    {
-      state_ = uri;
-      return incomplete;
-    }
-    else if (!is_char(input) || is_ctl(input) || is_tspecial(input))
-    {
-      return error;
-    }
-    else
-    {
-      req.method_.push_back(input);
-      return incomplete;
-    }
-  case uri_start:
-    if (is_ctl(input))
-    {
-      return error;
-    }
-    else
-    {
-      state_ = uri;
-      req.uri_.push_back(input);
-      return incomplete;
-    }
-  case uri:
-    if (input == ' ')
-    {
-      state_ = http_version_h;
-      return incomplete;
-    }
-    else if (is_ctl(input))
-    {
-      return error;
-    }
-    else
-    {
-      req.uri_.push_back(input);
-      return incomplete;
-    }
-  case http_version_h:
-    if (input == 'H')
+    std::string contentType = req.headerValue("Content-Type");
+    if (boost::algorithm::starts_with(contentType, "multipart/form-data"))
     {
-      state_ = http_version_t_1;
-      return incomplete;
-    }
-    else
-    {
-      return error;
-    }
-  case http_version_t_1:
-    if (input == 'T')
-    {
-      state_ = http_version_t_2;
-      return incomplete;
-    }
-    else
-    {
-      return error;
-    }
-  case http_version_t_2:
-    if (input == 'T')
-    {
-      state_ = http_version_p;
-      return incomplete;
-    }
-    else
-    {
-      return error;
-    }
-  case http_version_p:
-    if (input == 'P')
-    {
-      state_ = http_version_slash;
-      return incomplete;
-    }
-    else
-    {
-      return error;
-    }
-  case http_version_slash:
-    if (input == '/')
-    {
-      req.httpVersionMajor_ = 0;
-      req.httpVersionMinor_ = 0;
-      state_ = http_version_major_start;
-      return incomplete;
-    }
-    else
-    {
-      return error;
-    }
-  case http_version_major_start:
-    if (is_digit(input))
-    {
-      req.httpVersionMajor_ = req.httpVersionMajor_ * 10 + input - '0';
-      state_ = http_version_major;
-      return incomplete;
-    }
-    else
-    {
-      return error;
-    }
-  case http_version_major:
-    if (input == '.')
-    {
-      state_ = http_version_minor_start;
-      return incomplete;
-    }
-    else if (is_digit(input))
-    {
-      req.httpVersionMajor_ = req.httpVersionMajor_ * 10 + input - '0';
-      return incomplete;
-    }
-    else
-    {
-      return error;
-    }
-  case http_version_minor_start:
-    if (is_digit(input))
-    {
-      req.httpVersionMinor_ = req.httpVersionMinor_ * 10 + input - '0';
-      state_ = http_version_minor;
-      return incomplete;
-    }
-    else
-    {
-      return error;
-    }
-  case http_version_minor:
-    if (input == '\r')
-    {
-      state_ = expecting_newline_1;
-      return incomplete;
-    }
-    else if (is_digit(input))
-    {
-      req.httpVersionMinor_ = req.httpVersionMinor_ * 10 + input - '0';
-      return incomplete;
-    }
-    else
-    {
-      return error;
-    }
-  case expecting_newline_1:
-    if (input == '\n')
-    {
-      state_ = header_line_start;
-      return incomplete;
-    }
-    else
-    {
-      return error;
-    }
-  case header_line_start:
-    if (input == '\r')
-    {
-      state_ = expecting_newline_3;
-      return incomplete;
-    }
-    else if (!req.headers_.empty() && (input == ' ' || input == '\t'))
-    {
-      state_ = header_lws;
-      return incomplete;
+      // reject uploads which can't be within the limit before spooling them
+      if (form_max_file_size_ > 0 &&
+          content_length_ > form_max_file_size_ + kMaxFormOverhead)
+      {
+        return error;
+      }
+
+      form_parser_.reset(new MultipartFormParser(contentType,
+                                                 form_spool_dir_,
+                                                 form_max_file_size_));
     }
-    else if (!is_char(input) || is_ctl(input) || is_tspecial(input))
-    {
+  }
+
+  // anything which followed the headers is the start of the body
+  parsing_body_ = true;
+  st = receiveBody(req, pHeaders + headersSize,
+                   pHeaders + header_buffer_.size());
+  std::string().swap(header_buffer_);
+  return st;
+}
+
+RequestParser::status RequestParser::parseHeaders(Request& req,
+                                                  const char* begin,
+                                                  const char* end)
+{
+  // request line: method
+  const char* p = begin;
+  const char* lineEnd = findCRLF(p, end);
+  const char* methodEnd = std::find(p, lineEnd, ' ');
+  if (methodEnd == p || methodEnd == lineEnd)
+    return error;
+  for (const char* c = p; c < methodEnd; ++c)
+  {
+    if (!is_token(*c))
       return error;
-    }
-    else
-    {
-      req.headers_.push_back(Header());
-      req.headers_.back().name.push_back(input);
-      state_ = header_name;
-      return incomplete;
-    }
-  case header_lws:
-    if (input == '\r')
-    {
-      state_ = expecting_newline_2;
-      return incomplete;
-    }
-    else if (input == ' ' || input == '\t')
-    {
-      return incomplete;
-    }
-    else if (is_ctl(input))
-    {
+  }
+  req.method_.assign(p, methodEnd);
+
+  // uri
+  p = methodEnd + 1;
+  const char* uriEnd = std::find(p, lineEnd, ' ');
+  if (uriEnd == p || uriEnd == lineEnd)
+    return error;
+  for (const char* c = p; c < uriEnd; ++c)
+  {
+    if (is_ctl(*c))
       return error;
-    }
-    else
-    {
-      state_ = header_value;
-      req.headers_.back().value.push_back(input);
-      return incomplete;
-    }
-  case header_name:
-    if (input == ':')
-    {
-      state_ = space_before_header_value;
-      
-      // look for special content-length state
-      if ( !req.headers_.back().name.compare("Content-Length") )
-         parsing_content_length_ = true ;
+  }
+  req.uri_.assign(p, uriEnd);
 
-      return incomplete;
-    }
-    else if (!is_char(input) || is_ctl(input) || is_tspecial(input))
-    {
+  // version
+  p = uriEnd + 1;
+  if (lineEnd - p < 8 || std::strncmp(p, "HTTP/", 5) != 0)
+    return error;
+  p += 5;
+  int major = 0, minor = 0;
+  const char* digitsBegin = p;
+  while (p < lineEnd && is_digit(*p))
+    major = major * 10 + (*p++ - '0');
+  if (p == digitsBegin || p == lineEnd || *p++ != '.')
+    return error;
+  digitsBegin = p;
+  while (p < lineEnd && is_digit(*p))
+    minor = minor * 10 + (*p++ - '0');
+  if (p == digitsBegin || p != lineEnd)
+    return error;
+  req.httpVersionMajor_ = major;
+  req.httpVersionMinor_ = minor;
+
+  // reserve storage for all of the headers up front (one per line, less
+  // the request line and the terminating empty line)
+  std::size_t lines = 0;
+  for (const char* c = begin; (c = findCRLF(c, end)) != end; c += 2)
+    lines++;
+  req.headers_.reserve(req.headers_.size() + (lines > 2 ? lines - 2 : 0));
+
+  // headers
+  p = lineEnd + 2;
+  while (true)
+  {
+    lineEnd = findCRLF(p, end);
+    if (lineEnd == end)
       return error;
-    }
-    else
-    {
-      req.headers_.back().name.push_back(input);
-      return incomplete;
-    }
-  case space_before_header_value:
-    if (input == ' ')
+
+    // empty line terminates headers
+    if (lineEnd == p)
+      break;
+
+    // continuation of the previous header's value
+    if (*p == ' ' || *p == '\t')
     {
-      state_ = header_value;
-      return incomplete;
+      if (req.headers_.empty())
+        return error;
+
+      while (p < lineEnd && (*p == ' ' || *p == '\t'))
+        ++p;
+      for (const char* c = p; c < lineEnd; ++c)
+      {
+        if (is_ctl(*c))
+          return error;
+      }
+      req.headers_.back().value.append(p, lineEnd);
     }
     else
     {
-      return error;
-    }
-  case header_value:
-    if (input == '\r')
-    {
-      state_ = expecting_newline_2;
+      const char* nameEnd = std::find(p, lineEnd, ':');
+      if (nameEnd == p || nameEnd == lineEnd)
+        return error;
+      for (const char* c = p; c < nameEnd; ++c)
+      {
+        if (!is_token(*c))
+          return error;
+      }
 
-      // if this header was Content-Length then save it
-      if (parsing_content_length_)
+      const char* value = nameEnd + 1;
+      while (value < lineEnd && (*value == ' ' || *value == '\t'))
+        ++value;
+      for (const char* c = value; c < lineEnd; ++c)
       {
-         content_length_ = boost::lexical_cast<int>(req.headers_.back().value);
-         parsing_content_length_ = false ;
+        if (is_ctl(*c))
+          return error;
       }
 
-      return incomplete;
-    }
-    else if (is_ctl(input))
-    {
-      return error;
-    }
-    else
-    {
-      req.headers_.back().value.push_back(input);
-      return incomplete;
-    }
-  case expecting_newline_2:
-    if (input == '\n')
-    {
-      state_ = header_line_start;
-      return incomplete;
-    }
-    else
-    {
-      return error;
-    }
-  case expecting_newline_3:
-    if ( input == '\n' )
-    {
-      return complete ;
+      req.headers_.push_back(Header());
+      Header& header = req.headers_.back();
+      header.name.assign(p, nameEnd);
+      header.value.assign(value, lineEnd);
     }
-    else
+
+    p = lineEnd + 2;
+  }
+
+  // look for the content length
+  for (std::vector<Header>::const_iterator it = req.headers_.begin();
+       it != req.headers_.end();
+       ++it)
+  {
+    if (boost::algorithm::iequals(it->name, "Content-Length"))
     {
-      return error ;
+      if (!parseContentLength(it->value, &content_length_))
+        return error;
     }
-  default:
+  }
+
+  return complete;
+}
+
+char* RequestParser::bodyBuffer(Request& req, std::size_t* pSize)
+{
+  if (!parsing_body_ || form_parser_ || body_received_ >= content_length_)
+    return NULL;
+
+  // grow the body geometrically as it is received
+  if (req.body_.size() <= body_received_)
+  {
+    std::size_t remaining = content_length_ - body_received_;
+    std::size_t growth = std::min(remaining,
+                                  std::max(kMinBodyGrowth, body_received_));
+    req.body_.resize(body_received_ + growth);
+  }
+
+  *pSize = req.body_.size() - body_received_;
+  return &(req.body_[body_received_]);
+}
+
+RequestParser::status RequestParser::bodyReceived(Request& req,
+                                                  std::size_t bytes)
+{
+  body_received_ = std::min(body_received_ + bytes, req.body_.size());
+  return body_received_ == content_length_ ? complete : incomplete;
+}
+
+RequestParser::status RequestParser::receiveBody(Request& req,
+                                                 const char* begin,
+                                                 const char* end)
+{
+  if (form_parser_)
+    return receiveFormData(req, begin, end);
+
+  while (begin < end)
+  {
+    std::size_t size = 0;
+    char* pBuffer = bodyBuffer(req, &size);
+    if (pBuffer == NULL)
+      break;
+
+    std::size_t bytes = std::min(size, static_cast<std::size_t>(end - begin));
+    std::memcpy(pBuffer, begin, bytes);
+    bodyReceived(req, bytes);
+    begin += bytes;
+  }
+
+  return body_received_ == content_length_ ? complete : incomplete;
+}
+
+RequestParser::status RequestParser::receiveFormData(Request& req,
+                                                     const char* begin,
+                                                     const char* end)
+{
+  std::size_t bytes = std::min(content_length_ - body_received_,
+                               static_cast<std::size_t>(end - begin));
+  Error parseError = form_parser_->parse(begin, begin + bytes);
+  if (parseError)
+  {
+    LOG_ERROR(parseError);
+    form_parser_.reset();
     return error;
   }
+
+  body_received_ += bytes;
+  if (body_received_ < content_length_)
+    return incomplete;
+
+  parseError = form_parser_->finish(&req.formFields_, &req.files_);
+  form_parser_.reset();
+  if (parseError)
+  {
+    LOG_ERROR(parseError);
+    return error;
+  }
+
+  req.parsedFormFields_ = true;
+  return complete;
 }
 
 bool RequestParser::is_char(int c)
@@ -0,0 +1,383 @@
+/*
+ * RequestParserTests.cpp
+ *
+ * Copyright (C) 2009-12 by RStudio, Inc.
+ *
+ * Unless you have received this program directly from RStudio pursuant
+ * to the terms of a commercial license agreement with RStudio, then
+ * this program is licensed to you under the terms of version 3 of the
+ * GNU Affero General Public License. This program is distributed WITHOUT
+ * ANY EXPRESS OR IMPLIED WARRANTY, INCLUDING THOSE OF NON-INFRINGEMENT,
+ * MERCHANTABILITY OR FITNESS FOR A PARTICULAR PURPOSE. Please refer to the
+ * AGPL (http://www.gnu.org/licenses/agpl-3.0.txt) for more details.
+ *
+ */
+
+#include <core/http/RequestParser.hpp>
+
+#include <cstring>
+#include <iostream>
+#include <algorithm>
+
+#include <boost/assert.hpp>
+#include <boost/filesystem.hpp>
+#include <boost/algorithm/string/replace.hpp>
+#include <boost/date_time/posix_time/posix_time.hpp>
+
+#include <core/Error.hpp>
+#include <core/FilePath.hpp>
+#include <core/FileSerializer.hpp>
+#include <core/SafeConvert.hpp>
+#include <core/system/System.hpp>
+
+namespace core {
+namespace http {
+
+namespace {
+
+const char * const kGetRequest =
+   "GET /rpc/console_input?x=1 HTTP/1.1\r\n"
+   "Host: localhost:8787\r\n"
+   "User-Agent: Mozilla/5.0 (X11; Linux x86_64)\r\n"
+   "Accept: text/html,application/xhtml+xml\r\n"
+   "Accept-Encoding: gzip, deflate\r\n"
+   "Cookie: user-id=jjallaire|Thu%2C%2001-Nov-2012; csrf-token=abc\r\n"
+   "X-RS-RID: 1234\r\n"
+   "\r\n";
+
+std::string postRequest(const std::string& body)
+{
+   return "POST /rpc/set_state HTTP/1.1\r\n"
+          "Host: localhost:8787\r\n"
+          "Content-Type: application/json\r\n"
+          "Content-Length: " + safe_convert::numberToString(body.size()) +
+          "\r\n\r\n" + body;
+}
+
+const char * const kBoundary = "----WebKitFormBoundaryx7Rb2uVSjSkW3Jc9";
+
+std::string uploadRequest(const std::string& contents,
+                          const std::string& uri = "/upload",
+                          const std::string& fieldValue = "~/data")
+{
+   std::string boundary = std::string("--") + kBoundary;
+   std::string body =
+      "preamble\r\n" + boundary + "\r\n"
+      "Content-Disposition: form-data; name=\"targetDirectory\"\r\n"
+      "\r\n"
+      + fieldValue + "\r\n" + boundary + "\r\n"
+      "Content-Disposition: form-data; name=\"file\"; "
+                                          "filename=\"data.bin\"\r\n"
+      "Content-Type: application/octet-stream\r\n"
+      "\r\n" + contents + "\r\n" + boundary + "--\r\n";
+
+   return "POST " + uri + " HTTP/1.1\r\n"
+          "Host: localhost:8787\r\n"
+          "Content-Type: multipart/form-data; boundary=" +
+          std::string(kBoundary) + "\r\n"
+          "Content-Length: " + safe_convert::numberToString(body.size()) +
+          "\r\n\r\n" + body;
+}
+
+// parse a request delivered in chunks of the specified size
+RequestParser::status parseInChunks(const std::string& input,
+                                    std::size_t chunkSize,
+                                    Request* pRequest,
+                                    const FilePath& spoolDir = FilePath(),
+                                    std::size_t maxFileSize = 0)
+{
+   RequestParser parser;
+   parser.setFormSpoolDir("/upload", spoolDir, maxFileSize);
+   RequestParser::status status = RequestParser::incomplete;
+   for (std::size_t pos = 0;
+        pos < input.size() && status == RequestParser::incomplete;
+        pos += chunkSize)
+   {
+      const char* begin = input.data() + pos;
+      std::size_t size = std::min(chunkSize, input.size() - pos);
+      status = parser.parse(*pRequest, begin, begin + size);
+   }
+   return status;
+}
+
+// parse a request reading the body directly into the request (as the
+// async connections do)
+RequestParser::status parseReadingBody(const std::string& input,
+                                       std::size_t chunkSize,
+                                       Request* pRequest)
+{
+   RequestParser parser;
+   RequestParser::status status = RequestParser::incomplete;
+   std::size_t pos = 0;
+   while (pos < input.size() && status == RequestParser::incomplete)
+   {
+      std::size_t size = std::min(chunkSize, input.size() - pos);
+      std::size_t bodySize = 0;
+      char* pBody = parser.bodyBuffer(*pRequest, &bodySize);
+      if (pBody != NULL)
+      {
+         size = std::min(size, bodySize);
+         std::memcpy(pBody, input.data() + pos, size);
+         status = parser.bodyReceived(*pRequest, size);
+      }
+      else
+      {
+         const char* begin = input.data() + pos;
+         status = parser.parse(*pRequest, begin, begin + size);
+      }
+      pos += size;
+   }
+   return status;
+}
+
+void verifyGetRequest(const Request& request)
+{
+   BOOST_ASSERT(request.method() == "GET");
+   BOOST_ASSERT(request.uri() == "/rpc/console_input?x=1");
+   BOOST_ASSERT(request.httpVersionMajor() == 1);
+   BOOST_ASSERT(request.httpVersionMinor() == 1);
+   BOOST_ASSERT(request.headers().size() == 6);
+   BOOST_ASSERT(request.host() == "localhost:8787");
+   BOOST_ASSERT(request.headerValue("X-RS-RID") == "1234");
+   BOOST_ASSERT(request.cookieValue("csrf-token") == "abc");
+   BOOST_ASSERT(request.body().empty());
+}
+
+void testChunking()
+{
+   std::string body(100000, 'x');
+   for (std::size_t i = 0; i < body.size(); i++)
+      body[i] = static_cast<char>('a' + (i % 26));
+   std::string post = postRequest(body);
+
+   std::size_t chunkSizes[] = { 1, 2, 3, 7, 64, 8192, 1000000 };
+   for (std::size_t i = 0; i < sizeof(chunkSizes) / sizeof(std::size_t); i++)
+   {
+      Request getRequest;
+      BOOST_ASSERT(parseInChunks(kGetRequest, chunkSizes[i], &getRequest) ==
+                   RequestParser::complete);
+      verifyGetRequest(getRequest);
+
+      Request postRequest;
+      BOOST_ASSERT(parseInChunks(post, chunkSizes[i], &postRequest) ==
+                   RequestParser::complete);
+      BOOST_ASSERT(postRequest.method() == "POST");
+      BOOST_ASSERT(postRequest.body() == body);
+
+      Request directRequest;
+      BOOST_ASSERT(parseReadingBody(post, chunkSizes[i], &directRequest) ==
+                   RequestParser::complete);
+      BOOST_ASSERT(directRequest.body() == body);
+   }
+}
+
+void testHeaders()
+{
+   // continuation lines, no space after the colon, and lowercase
+   // content-length
+   Request request;
+   std::string input = "PUT /upload HTTP/1.0\r\n"
+                       "X-Long: first\r\n"
+                       "  second\r\n"
+                       "content-length:3\r\n"
+                       "\r\n"
+                       "abcdef";
+   BOOST_ASSERT(parseInChunks(input, input.size(), &request) ==
+                RequestParser::complete);
+   BOOST_ASSERT(request.isHttp10());
+   BOOST_ASSERT(request.headerValue("X-Long") == "firstsecond");
+   BOOST_ASSERT(request.body() == "abc");
+}
+
+void testErrors()
+{
+   const char* invalid[] = {
+      " GET / HTTP/1.1\r\n\r\n",
+      "GET\r\n\r\n",
+      "GET / HTTX/1.1\r\n\r\n",
+      "GET / HTTP/1\r\n\r\n",
+      "GET / HTTP/1.1 \r\n\r\n",
+      "G(T / HTTP/1.1\r\n\r\n",
+      "GET / HTTP/1.1\r\n continued\r\n\r\n",
+      "GET / HTTP/1.1\r\nNo-Colon\r\n\r\n",
+      "GET / HTTP/1.1\r\nBad Name: x\r\n\r\n",
+      "GET / HTTP/1.1\r\nX: a\x01z\r\n\r\n",
+      "POST / HTTP/1.1\r\nContent-Length: 1x\r\n\r\n",
+      "POST / HTTP/1.1\r\nContent-Length: 99999999999999999999999\r\n\r\n"
+   };
+
+   for (std::size_t i = 0; i < sizeof(invalid) / sizeof(const char*); i++)
+   {
+      Request request;
+      BOOST_ASSERT(parseInChunks(invalid[i], 5, &request) ==
+                   RequestParser::error);
+   }
+
+   // headers which never terminate
+   Request request;
+   std::string endless = "GET / HTTP/1.1\r\nX: " + std::string(2000000, 'x');
+   BOOST_ASSERT(parseInChunks(endless, 8192, &request) ==
+                RequestParser::error);
+}
+
+void testFormSpooling()
+{
+   // file contents which contain partial delimiters
+   std::string contents;
+   for (int i = 0; i < 5000; i++)
+   {
+      contents.append("\r\n--");
+      contents.append(kBoundary, i % 20);
+      contents.push_back(static_cast<char>(i % 256));
+   }
+   std::string upload = uploadRequest(contents);
+
+   FilePath spoolDir(boost::filesystem::temp_directory_path().string());
+   spoolDir = spoolDir.complete("spool-" +
+                                core::system::generateShortenedUuid());
+   Error error = spoolDir.ensureDirectory();
+   BOOST_ASSERT(!error);
+
+   std::size_t chunkSizes[] = { 1, 7, 61, 8192, 1000000 };
+   for (std::size_t i = 0; i < sizeof(chunkSizes) / sizeof(std::size_t); i++)
+   {
+      FilePath spoolPath;
+      {
+         Request request;
+         BOOST_ASSERT(parseInChunks(upload, chunkSizes[i], &request,
+                                    spoolDir) == RequestParser::complete);
+         BOOST_ASSERT(request.body().empty());
+         BOOST_ASSERT(request.formFieldValue("targetDirectory") == "~/data");
+
+         const File& file = request.uploadedFile("file");
+         BOOST_ASSERT(file.name == "data.bin");
+         BOOST_ASSERT(file.spooled() && file.contents.empty());
+         BOOST_ASSERT(file.size() == contents.size());
+         std::string spooled;
+         error = readStringFromFile(file.path, &spooled);
+         BOOST_ASSERT(!error && spooled == contents);
+         spoolPath = file.path;
+      }
+
+      // the spooled file is removed along with the request
+      BOOST_ASSERT(!spoolPath.exists());
+
+      // the same request parsed in memory
+      Request request;
+      BOOST_ASSERT(parseInChunks(upload, chunkSizes[i], &request) ==
+                   RequestParser::complete);
+      BOOST_ASSERT(request.formFieldValue("targetDirectory") == "~/data");
+      BOOST_ASSERT(request.uploadedFile("file").contents == contents);
+   }
+
+   // a truncated body is an error and leaves nothing behind
+   std::string truncated = upload.substr(0, upload.size() - 10);
+   std::string::size_type lengthPos = truncated.find("Content-Length: ");
+   std::string::size_type lengthEnd = truncated.find("\r\n", lengthPos);
+   truncated.replace(lengthPos, lengthEnd - lengthPos,
+      "Content-Length: " + safe_convert::numberToString(
+                   truncated.size() - (truncated.find("\r\n\r\n") + 4)));
+   Request request;
+   BOOST_ASSERT(parseInChunks(truncated, 8192, &request, spoolDir) ==
+                RequestParser::error);
+   std::vector<FilePath> children;
+   error = spoolDir.children(&children);
+   BOOST_ASSERT(!error && children.empty());
+
+   // as are files which exceed the size limit (whether or not the content
+   // length gives them away)
+   Request tooLargeRequest;
+   BOOST_ASSERT(parseInChunks(upload, 8192, &tooLargeRequest, spoolDir,
+                              contents.size() - 1) == RequestParser::error);
+   std::string tooLarge = uploadRequest(std::string(3 * 1024 * 1024, 'x'));
+   Request tooLongRequest;
+   BOOST_ASSERT(parseInChunks(tooLarge, 8192, &tooLongRequest, spoolDir,
+                              1024) == RequestParser::error);
+   error = spoolDir.children(&children);
+   BOOST_ASSERT(!error && children.empty());
+
+   // as are fields whose values are too large to hold in memory
+   Request largeFieldRequest;
+   BOOST_ASSERT(parseInChunks(uploadRequest(contents,
+                                            "/upload",
+                                            std::string(2000000, 'x')),
+                              8192,
+                              &largeFieldRequest,
+                              spoolDir) == RequestParser::error);
+   error = spoolDir.children(&children);
+   BOOST_ASSERT(!error && children.empty());
+
+   // forms sent to other uris are received into the body as usual
+   Request otherRequest;
+   BOOST_ASSERT(parseInChunks(uploadRequest(contents, "/help/doc"),
+                              8192,
+                              &otherRequest,
+                              spoolDir,
+                              1024) == RequestParser::complete);
+   BOOST_ASSERT(!otherRequest.body().empty());
+   error = spoolDir.children(&children);
+   BOOST_ASSERT(!error && children.empty());
+
+   // and forms without a boundary
+   std::string noBoundary = upload;
+   boost::algorithm::replace_first(noBoundary,
+                                   "boundary=" + std::string(kBoundary),
+                                   "boundary=");
+   Request noBoundaryRequest;
+   BOOST_ASSERT(parseInChunks(noBoundary, 8192, &noBoundaryRequest,
+                              spoolDir) == RequestParser::error);
+
+   error = spoolDir.remove();
+   BOOST_ASSERT(!error);
+}
+
+double requestsPerSecond(const std::string& input, int iterations)
+{
+   using namespace boost::posix_time;
+
+   ptime start = microsec_clock::universal_time();
+   for (int i = 0; i < iterations; i++)
+   {
+      Request request;
+      RequestParser::status status = parseInChunks(input, 8192, &request);
+      BOOST_ASSERT(status == RequestParser::complete);
+   }
+   time_duration elapsed = microsec_clock::universal_time() - start;
+
+   return iterations / (std::max<long>(elapsed.total_microseconds(), 1) /
+                        1000000.0);
+}
+
+} // anonymous namespace
+
+
+void runRequestParserTests()
+{
+   testChunking();
+   testHeaders();
+   testErrors();
+   testFormSpooling();
+}
+
+// parse typical GET and POST requests (read in 8K chunks) repeatedly and
+// report the number of requests parsed per second
+void runRequestParserBenchmark(int iterations)
+{
+   std::string smallPost = postRequest(std::string(2048, 'x'));
+   std::string largePost = postRequest(std::string(4 * 1024 * 1024, 'x'));
+
+   std::cout << "GET: "
+             << static_cast<long>(requestsPerSecond(kGetRequest, iterations))
+             << " requests/s" << std::endl;
+   std::cout << "POST (2K): "
+             << static_cast<long>(requestsPerSecond(smallPost, iterations))
+             << " requests/s" << std::endl;
+   std::cout << "POST (4MB): "
+             << static_cast<long>(requestsPerSecond(largePost,
+                                                    std::max(iterations / 1000,
+                                                             1)))
+             << " requests/s" << std::endl;
+}
+
+} // namespace http
+} // namespace core
@@ -139,9 +139,96 @@ void Response::setDynamicHtml(const std::string& html,
    setBody(html);
 }
 
+namespace {
+
+// parse a single byte range (e.g. bytes=0-499, bytes=500-, bytes=-500) and
+// resolve it against the total size. returns false if it isn't satisfiable
+bool parseByteRange(const std::string& range,
+                    boost::uintmax_t total,
+                    boost::uintmax_t* pBegin,
+                    boost::uintmax_t* pEnd)
+{
+   boost::regex re("bytes=(\\d*)\\-(\\d*)");
+   boost::smatch match;
+   if (!boost::regex_match(range, match, re))
+      return false;
+
+   const boost::uintmax_t kNone = -1;
+   boost::uintmax_t begin = safe_convert::stringTo<boost::uintmax_t>(match[1],
+                                                                     kNone);
+   boost::uintmax_t end = safe_convert::stringTo<boost::uintmax_t>(match[2],
+                                                                   kNone);
+
+   // suffix range (the last n bytes)
+   if (begin == kNone)
+   {
+      if (end == kNone || end == 0)
+         return false;
+      begin = end < total ? total - end : 0;
+      end = total - 1;
+   }
+   else if (end == kNone || end >= total)
+   {
+      end = total - 1;
+   }
+
+   if (total == 0 || begin > end)
+      return false;
+
+   *pBegin = begin;
+   *pEnd = end;
+   return true;
+}
+
+} // anonymous namespace
+
 void Response::setRangeableFile(const FilePath& filePath,
                                 const Request& request)
 {
+#ifndef _WIN32
+   // open the file for streaming
+   StreamFile streamFile;
+   Error error = openStreamFile(filePath, &streamFile);
+   if (error)
+   {
+      setError(error);
+      return;
+   }
+
+   // set content type
+   setContentType(filePath.mimeContentType());
+   addHeader("Accept-Ranges", "bytes");
+
+   // no range requested so send the whole file
+   std::string range = request.headerValue("Range");
+   if (range.empty())
+   {
+      setStreamFile(streamFile);
+      return;
+   }
+
+   // determine the byte range
+   boost::uintmax_t total = streamFile.length;
+   boost::uintmax_t begin = 0, end = 0;
+   if (!parseByteRange(range, total, &begin, &end))
+   {
+      setStatusCode(http::status::RangeNotSatisfiable);
+      boost::format fmt("bytes */%1%");
+      addHeader("Content-Range", boost::str(fmt % total));
+      return;
+   }
+
+   // specify partial content
+   setStatusCode(http::status::PartialContent);
+   boost::format fmt("bytes %1%-%2%/%3%");
+   addHeader("Content-Range", boost::str(fmt % begin % end % total));
+
+   // send the range unencoded (the range refers to the unencoded file)
+   removeHeader("Content-Encoding");
+   streamFile.offset = begin;
+   streamFile.length = end - begin + 1;
+   setStreamFile(streamFile);
+#else
    // read the file in from disk
    std::string contents;
    Error error = core::readStringFromFile(filePath, &contents);
@@ -152,6 +239,7 @@ void Response::setRangeableFile(const FilePath& filePath,
    }
 
    setRangeableFile(contents, filePath.mimeContentType(), request);
+#endif
 }
 
 void Response::setRangeableFile(const std::string& contents,
@@ -214,6 +302,8 @@ void Response::setRangeableFile(const std::string& contents,
 void Response::setBodyUnencoded(const std::string& body)
 {
    removeHeader("Content-Encoding");
+   streamFile_ = StreamFile();
+   pStreamBody_.reset();
    body_ = body;
    setContentLength(body_.length());
 }
@@ -270,8 +360,39 @@ void Response::resetMembers()
 	statusCode_ = status::Ok ;
 	statusCodeStr_.clear() ;
 	statusMessage_.clear() ;
+   streamFile_ = StreamFile();
+   pStreamBody_.reset();
 }
    
+void Response::setStreamFile(const StreamFile& streamFile)
+{
+   body_.clear();
+   pStreamBody_.reset();
+   streamFile_ = streamFile;
+
+   // gzip as the file is streamed (since the compressed length isn't known
+   // up front the body is delimited by the connection closing)
+   if (contentEncoding() == kGzipEncoding)
+   {
+      streamFile_.gzip = true;
+      removeHeader("Content-Length");
+   }
+   else
+   {
+      streamFile_.gzip = false;
+      setHeader("Content-Length",
+                safe_convert::numberToString(streamFile_.length));
+   }
+}
+
+void Response::setStreamBody(boost::shared_ptr<StreamBody> pStreamBody)
+{
+   body_.clear();
+   streamFile_ = StreamFile();
+   pStreamBody_ = pStreamBody;
+   removeHeader("Content-Length");
+}
+
 void Response::removeCachingHeaders()
 {
    removeHeader("Expires");
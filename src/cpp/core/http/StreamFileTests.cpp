@@ -0,0 +1,163 @@
+/*
+ * StreamFileTests.cpp
+ *
+ * Copyright (C) 2009-12 by RStudio, Inc.
+ *
+ * Unless you have received this program directly from RStudio pursuant
+ * to the terms of a commercial license agreement with RStudio, then
+ * this program is licensed to you under the terms of version 3 of the
+ * GNU Affero General Public License. This program is distributed WITHOUT
+ * ANY EXPRESS OR IMPLIED WARRANTY, INCLUDING THOSE OF NON-INFRINGEMENT,
+ * MERCHANTABILITY OR FITNESS FOR A PARTICULAR PURPOSE. Please refer to the
+ * AGPL (http://www.gnu.org/licenses/agpl-3.0.txt) for more details.
+ *
+ */
+
+#include <core/http/StreamFile.hpp>
+
+#include <unistd.h>
+#include <sys/socket.h>
+
+#include <sstream>
+
+#include <boost/bind.hpp>
+#include <boost/assert.hpp>
+#include <boost/iostreams/copy.hpp>
+#include <boost/iostreams/filter/gzip.hpp>
+#include <boost/iostreams/filtering_stream.hpp>
+
+#include <core/Error.hpp>
+#include <core/FilePath.hpp>
+#include <core/FileSerializer.hpp>
+#include <core/SafeConvert.hpp>
+#include <core/BoostThread.hpp>
+#include <core/http/Request.hpp>
+#include <core/http/Response.hpp>
+
+namespace core {
+namespace http {
+
+namespace {
+
+void readAll(int fd, std::string* pOutput)
+{
+   char buffer[8192];
+   ssize_t bytesRead;
+   while ((bytesRead = ::read(fd, buffer, sizeof(buffer))) > 0)
+      pOutput->append(buffer, bytesRead);
+}
+
+// write the body of a response through a socket pair and return what
+// arrives at the other end (decompressing it if necessary)
+std::string transferBody(const Response& response)
+{
+   int fds[2];
+   int result = ::socketpair(AF_UNIX, SOCK_STREAM, 0, fds);
+   BOOST_ASSERT(result == 0);
+
+   std::string received;
+   boost::thread reader(boost::bind(readAll, fds[1], &received));
+
+   Error error = sendStreamFile(fds[0], response.streamFile());
+   BOOST_ASSERT(!error);
+   ::close(fds[0]);
+   reader.join();
+   ::close(fds[1]);
+
+   if (!response.streamFile().gzip)
+      return received;
+
+   std::istringstream compressed(received);
+   std::ostringstream decompressed;
+   boost::iostreams::filtering_istream gunzip;
+   gunzip.push(boost::iostreams::gzip_decompressor());
+   gunzip.push(compressed);
+   boost::iostreams::copy(gunzip, decompressed);
+   return decompressed.str();
+}
+
+void setRequestHeaders(const std::string& range, bool gzip, Request* pRequest)
+{
+   if (!range.empty())
+      pRequest->setHeader("Range", range);
+   if (gzip)
+      pRequest->setHeader("Accept-Encoding", "gzip");
+}
+
+void verifyRange(const FilePath& filePath,
+                 const std::string& contents,
+                 const std::string& range,
+                 std::size_t begin,
+                 std::size_t end)
+{
+   Request request;
+   setRequestHeaders(range, true, &request);
+   Response response;
+   response.setRangeableFile(filePath, request);
+   BOOST_ASSERT(response.statusCode() == status::PartialContent);
+   BOOST_ASSERT(!response.streamFile().gzip);
+   BOOST_ASSERT(response.contentLength() == end - begin + 1);
+   BOOST_ASSERT(transferBody(response) ==
+                contents.substr(begin, end - begin + 1));
+}
+
+} // anonymous namespace
+
+void runStreamFileTests()
+{
+   // a few megabytes of varied (but compressible) content
+   std::string contents;
+   for (int i = 0; contents.size() < 3 * 1024 * 1024; i++)
+      contents += "line " + safe_convert::numberToString(i * 7919) + "\n";
+
+   FilePath filePath("/tmp/rstudio-stream-file-test");
+   Error error = writeStringToFile(filePath, contents);
+   BOOST_ASSERT(!error);
+
+   // whole file (the body is not held in memory)
+   Response response;
+   error = response.setBody(filePath);
+   BOOST_ASSERT(!error);
+   BOOST_ASSERT(response.body().empty());
+   BOOST_ASSERT(response.contentLength() == contents.size());
+   BOOST_ASSERT(transferBody(response) == contents);
+
+   // compressed as it is streamed (the file may be removed once the
+   // response is populated)
+   Request gzipRequest;
+   setRequestHeaders("", true, &gzipRequest);
+   Response gzipResponse;
+   gzipResponse.setFile(filePath, gzipRequest);
+   BOOST_ASSERT(gzipResponse.streamFile().gzip);
+   BOOST_ASSERT(gzipResponse.headerValue("Content-Length").empty());
+   error = filePath.remove();
+   BOOST_ASSERT(!error);
+   BOOST_ASSERT(transferBody(gzipResponse) == contents);
+
+   error = writeStringToFile(filePath, contents);
+   BOOST_ASSERT(!error);
+
+   // byte ranges
+   std::size_t size = contents.size();
+   verifyRange(filePath, contents, "bytes=0-499", 0, 499);
+   verifyRange(filePath, contents, "bytes=1000-", 1000, size - 1);
+   verifyRange(filePath, contents, "bytes=-500", size - 500, size - 1);
+   verifyRange(filePath, contents, "bytes=100-99999999", 100, size - 1);
+
+   Request invalidRequest;
+   setRequestHeaders("bytes=99999999-", false, &invalidRequest);
+   Response invalidResponse;
+   invalidResponse.setRangeableFile(filePath, invalidRequest);
+   BOOST_ASSERT(invalidResponse.statusCode() == status::RangeNotSatisfiable);
+   BOOST_ASSERT(invalidResponse.streamFile().empty());
+
+   // assigning an in-memory body replaces the streamed one
+   response.setError(status::NotFound, "not found");
+   BOOST_ASSERT(response.streamFile().empty());
+
+   error = filePath.remove();
+   BOOST_ASSERT(!error);
+}
+
+} // namespace http
+} // namespace core
@@ -27,6 +27,7 @@
 
 #include <core/http/Header.hpp>
 #include <core/http/Request.hpp>
+#include <core/http/MultipartFormParser.hpp>
 #include <core/Log.hpp>
 #include <core/Error.hpp>
 
@@ -130,81 +131,11 @@ void parseMultipartForm(const std::string& contentType,
                         Fields* pFields,
                         Files* pFiles)
 {
-   // get the boundary token
-   std::string boundaryPrefix("boundary=");
-   std::string boundary;
-   size_t prefixLoc = contentType.find(boundaryPrefix);
-   if (prefixLoc != std::string::npos)
-   {
-      boundary = contentType.substr(prefixLoc+boundaryPrefix.size(),
-                                    std::string::npos);
-      boost::algorithm::trim(boundary);
-   }
-   
-   // extract the fields
-   size_t beginBoundaryLoc = body.find(boundary);
-   size_t endBoundaryLoc = body.find(boundary, 
-                                    beginBoundaryLoc+boundary.size());
-   while (endBoundaryLoc != std::string::npos)
-   {
-      // extract the part into a string stream
-      size_t beginPart = beginBoundaryLoc + boundary.size();
-      size_t partLength = (endBoundaryLoc - 1) - beginPart - 1;
-      std::istringstream partStream(body.substr(beginPart, partLength)); 
-      partStream.unsetf(std::ios::skipws);
-    
-      // read the headers
-      Headers headers ;
-      http::parseHeaders(partStream, &headers);
-      
-      // check for content-disposition
-      std::string cDisp = http::headerValue(headers,"Content-Disposition");
-      if (!cDisp.empty())
-      {
-         // parse values out of content disposition
-         std::string nameRegex("form-data; name=\"(.*)\"");
-         boost::smatch nameMatch;
-         if (regex_match(cDisp, nameMatch, boost::regex(nameRegex)))
-         {
-            // read the rest of the stream
-            std::ostringstream valueStream ;
-            std::copy(std::istream_iterator<char>(partStream),
-                      std::istream_iterator<char>(),
-                      std::ostream_iterator<char>(valueStream));
-                       
-            // check for filename
-            std::string filenameRegex(nameRegex + "; filename=\"(.*)\"");
-            boost::smatch fileMatch;
-            if (regex_match(cDisp, fileMatch, boost::regex(filenameRegex)))
-            {
-               std::string name(fileMatch[1]);
-               
-               File uploadedFile;
-               uploadedFile.name = fileMatch[2];
-               uploadedFile.contentType = http::headerValue(headers, 
-                                                            "Content-Type");
-               if (uploadedFile.contentType.empty())
-                  uploadedFile.contentType = "application/octet-stream";
-               
-               uploadedFile.contents = valueStream.str();
-               pFiles->insert(std::make_pair(name, uploadedFile));
-            }
-            // else process regular form field
-            else
-            {
-               std::string name(nameMatch[1]);
-               std::string value = valueStream.str();
-               boost::algorithm::trim(value);
-               pFields->push_back(std::make_pair(name, value));
-            }
-         }
-         
-      }
-                
-      // next boundary
-      beginBoundaryLoc = endBoundaryLoc;
-      endBoundaryLoc = body.find(boundary, beginBoundaryLoc+boundary.size());
-   }
+   // parse what we can of the body (an incomplete body yields whichever
+   // fields and files preceded the point where it was truncated)
+   MultipartFormParser parser(contentType);
+   parser.parse(body.data(), body.data() + body.size());
+   parser.finish(pFields, pFiles);
 }   
    
 
@@ -16,8 +16,11 @@
 #ifndef CORE_SYSTEM_BASE64_HPP
 #define CORE_SYSTEM_BASE64_HPP
 
+#include <iosfwd>
 #include <string>
 
+#include <boost/function.hpp>
+
 namespace core {
 
 class Error;
@@ -26,9 +29,17 @@ class FilePath;
 namespace base64 {
       
 
+// length of the encoded form of input of the specified length
+std::size_t encodedLength(std::size_t length);
+
 Error encode(const std::string& input, std::string* pOutput);
 Error encode(const FilePath& inputFile, std::string* pOutput);
 
+// encode the contents of a stream, passing the encoded output to onOutput
+// a block at a time (so the input never needs to be held in memory)
+Error encode(std::istream& is,
+             const boost::function<void(const char*, std::size_t)>& onOutput);
+
          
 } // namespace base64
 } // namespace core
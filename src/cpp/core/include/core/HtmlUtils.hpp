@@ -18,7 +18,12 @@
 
 #include <string>
 
+#include <boost/ref.hpp>
+#include <boost/bind.hpp>
 #include <boost/regex.hpp>
+#include <boost/function.hpp>
+#include <boost/iostreams/concepts.hpp>
+#include <boost/iostreams/operations.hpp>
 #include <boost/iostreams/filter/regex.hpp>
 
 #include <core/FilePath.hpp>
@@ -28,17 +33,48 @@ namespace html_utils {
    
 std::string defaultTitle(const std::string& htmlContent);
 
-// convert images to base64
-class Base64ImageFilter : public boost::iostreams::regex_filter
+// convert images to base64. the output is scanned for <img> tags in a
+// single pass as it is written and images are encoded directly into the
+// downstream sink (so only a tag split across writes is ever buffered)
+class Base64ImageFilter : public boost::iostreams::multichar_output_filter
 {
 public:
    explicit Base64ImageFilter(const FilePath& basePath);
 
+   template <typename Sink>
+   std::streamsize write(Sink& snk, const char* s, std::streamsize n)
+   {
+      filter(s, s + n, false, boost::bind(writeToSink<Sink>,
+                                          boost::ref(snk), _1, _2));
+      return n;
+   }
+
+   template <typename Sink>
+   void close(Sink& snk)
+   {
+      filter(NULL, NULL, true, boost::bind(writeToSink<Sink>,
+                                           boost::ref(snk), _1, _2));
+   }
+
 private:
-   std::string toBase64Image(const boost::cmatch& match);
+   typedef boost::function<void(const char*, std::size_t)> Writer;
+
+   template <typename Sink>
+   static void writeToSink(Sink& snk, const char* s, std::size_t n)
+   {
+      boost::iostreams::write(snk, s, n);
+   }
+
+   void filter(const char* begin,
+               const char* end,
+               bool flush,
+               const Writer& write);
+
+   void writeImageRef(const std::string& imgRef, const Writer& write);
 
 private:
    FilePath basePath_;
+   std::string pending_;
 };
 
 // convert fonts to base64
@@ -0,0 +1,198 @@
+/*
+ * ParallelGzip.hpp
+ *
+ * Copyright (C) 2009-12 by RStudio, Inc.
+ *
+ * Unless you have received this program directly from RStudio pursuant
+ * to the terms of a commercial license agreement with RStudio, then
+ * this program is licensed to you under the terms of version 3 of the
+ * GNU Affero General Public License. This program is distributed WITHOUT
+ * ANY EXPRESS OR IMPLIED WARRANTY, INCLUDING THOSE OF NON-INFRINGEMENT,
+ * MERCHANTABILITY OR FITNESS FOR A PARTICULAR PURPOSE. Please refer to the
+ * AGPL (http://www.gnu.org/licenses/agpl-3.0.txt) for more details.
+ *
+ */
+
+#ifndef CORE_PARALLEL_GZIP_HPP
+#define CORE_PARALLEL_GZIP_HPP
+
+#include <string>
+#include <iosfwd>
+
+#include <boost/shared_ptr.hpp>
+#include <boost/iostreams/categories.hpp>
+#include <boost/iostreams/operations.hpp>
+
+// Gzip compression and decompression using multiple threads. Data is split
+// into blocks which are compressed independently and written as separate
+// gzip members (so the output can be read by any gzip reader). Each member
+// records its size in an extra header field, which lets the decompressor
+// read ahead and inflate several blocks at once.
+//
+// Both classes are boost iostreams filters (errors are reported by throwing
+// std::ios_base::failure, as with the boost gzip filters).
+
+namespace core {
+namespace gzip {
+
+// size of the header of the members written by ParallelCompressor
+extern const std::size_t kParallelHeaderSize;
+
+// does the data begin with a member written by ParallelCompressor
+bool isParallelCompressed(const char* data, std::size_t size);
+
+class ParallelCompressor
+{
+public:
+   typedef char char_type;
+   struct category : boost::iostreams::multichar_output_filter_tag,
+                     boost::iostreams::closable_tag
+   {
+   };
+
+   // level is a zlib compression level. threads is the number of worker
+   // threads (0 for one per core, 1 to compress on the calling thread)
+   explicit ParallelCompressor(int level = 6, std::size_t threads = 0);
+
+   // COPYING: via compiler (copies share their state)
+
+   template <typename Sink>
+   std::streamsize write(Sink& sink, const char* s, std::streamsize n)
+   {
+      std::streamsize written = 0;
+      while (written < n)
+      {
+         written += addData(s + written, n - written);
+         writeBlocks(sink, false);
+      }
+      return n;
+   }
+
+   template <typename Sink>
+   void close(Sink& sink)
+   {
+      finish();
+      writeBlocks(sink, true);
+   }
+
+private:
+   template <typename Sink>
+   void writeBlocks(Sink& sink, bool all)
+   {
+      std::string block;
+      while (nextBlock(all, &block))
+         boost::iostreams::write(sink, block.data(), block.size());
+   }
+
+   // buffer data (returns the amount consumed, which stops at the end of
+   // a block)
+   std::streamsize addData(const char* s, std::streamsize n);
+
+   // get the next compressed block (if all is false then only if it is
+   // ready or too many blocks are pending)
+   bool nextBlock(bool all, std::string* pBlock);
+
+   void finish();
+
+private:
+   struct Impl;
+   boost::shared_ptr<Impl> pImpl_;
+};
+
+class ParallelDecompressor
+{
+public:
+   typedef char char_type;
+   struct category : boost::iostreams::multichar_input_filter_tag,
+                     boost::iostreams::closable_tag
+   {
+   };
+
+   // threads is the number of worker threads (0 for one per core, 1 to
+   // decompress on the calling thread)
+   explicit ParallelDecompressor(std::size_t threads = 0);
+
+   // COPYING: via compiler (copies share their state)
+
+   template <typename Source>
+   std::streamsize read(Source& source, char* s, std::streamsize n)
+   {
+      // keep the workers busy by reading members ahead
+      while (needsInput())
+      {
+         std::string member;
+         if (readMember(source, &member))
+            addMember(&member);
+         else
+            endInput();
+      }
+
+      return readOutput(s, n);
+   }
+
+   template <typename Source>
+   void close(Source&)
+   {
+      reset();
+   }
+
+private:
+   template <typename Source>
+   bool readMember(Source& source, std::string* pMember)
+   {
+      pMember->resize(kParallelHeaderSize);
+      std::streamsize count = readFully(source, &(*pMember)[0],
+                                        kParallelHeaderSize);
+      if (count <= 0)
+         return false;
+
+      std::size_t size = memberSize(*pMember, count);
+      pMember->resize(size);
+      std::streamsize remaining = size - kParallelHeaderSize;
+      if (readFully(source, &(*pMember)[kParallelHeaderSize], remaining) !=
+          remaining)
+      {
+         truncated();
+      }
+
+      return true;
+   }
+
+   template <typename Source>
+   static std::streamsize readFully(Source& source,
+                                    char* s,
+                                    std::streamsize n)
+   {
+      std::streamsize total = 0;
+      while (total < n)
+      {
+         std::streamsize count = boost::iostreams::read(source,
+                                                        s + total,
+                                                        n - total);
+         if (count <= 0)
+            break;
+         total += count;
+      }
+      return total;
+   }
+
+   // validate a member header and return the size of the member
+   static std::size_t memberSize(const std::string& header,
+                                 std::streamsize count);
+   static void truncated();
+
+   bool needsInput() const;
+   void addMember(std::string* pMember);
+   void endInput();
+   std::streamsize readOutput(char* s, std::streamsize n);
+   void reset();
+
+private:
+   struct Impl;
+   boost::shared_ptr<Impl> pImpl_;
+};
+
+} // namespace gzip
+} // namespace core
+
+#endif // CORE_PARALLEL_GZIP_HPP
@@ -0,0 +1,117 @@
+/*
+ * ZipWriter.hpp
+ *
+ * Copyright (C) 2009-12 by RStudio, Inc.
+ *
+ * Unless you have received this program directly from RStudio pursuant
+ * to the terms of a commercial license agreement with RStudio, then
+ * this program is licensed to you under the terms of version 3 of the
+ * GNU Affero General Public License. This program is distributed WITHOUT
+ * ANY EXPRESS OR IMPLIED WARRANTY, INCLUDING THOSE OF NON-INFRINGEMENT,
+ * MERCHANTABILITY OR FITNESS FOR A PARTICULAR PURPOSE. Please refer to the
+ * AGPL (http://www.gnu.org/licenses/agpl-3.0.txt) for more details.
+ *
+ */
+
+#ifndef CORE_ZIP_WRITER_HPP
+#define CORE_ZIP_WRITER_HPP
+
+#include <string>
+#include <vector>
+
+#include <boost/shared_ptr.hpp>
+#include <boost/scoped_ptr.hpp>
+
+#include <core/BoostThread.hpp>
+#include <core/http/StreamFile.hpp>
+
+// The zip writer produces a zip archive in chunks (so that it can be
+// streamed directly into an http response without a temporary file).
+// Entries are written in the order they are added; small files are
+// compressed ahead of time on worker threads while larger files are
+// compressed as they are written (using a data descriptor to record their
+// sizes and crc). Archives and entries larger than 4GB use zip64.
+
+namespace core {
+
+class Error;
+class FilePath;
+
+namespace zip {
+
+class ZipWriter : public http::StreamBody
+{
+public:
+   // compressionLevel is a zlib level (0 stores all files). maxThreads is
+   // the number of worker threads used for compression (0 to choose based
+   // on the number of cores)
+   explicit ZipWriter(int compressionLevel = 6, std::size_t maxThreads = 0);
+   virtual ~ZipWriter();
+
+   // COPYING: boost::noncopyable
+
+public:
+   // add a file or directory (directories are added recursively). the
+   // name is the path of the entry within the archive. all entries must be
+   // added before the archive is read
+   Error add(const FilePath& filePath, const std::string& name);
+
+   // read the next chunk of the archive (an empty chunk marks the end)
+   virtual Error next(std::string* pChunk);
+
+   // write the entire archive to a file
+   Error writeToFile(const FilePath& filePath);
+
+private:
+   struct Entry;
+   typedef boost::shared_ptr<Entry> EntryPtr;
+
+   void addEntry(const FilePath& filePath, const std::string& name);
+   void addChild(const FilePath& rootPath,
+                 const std::string& rootName,
+                 const FilePath& childPath);
+
+   void start();
+   void compressEntries();
+   bool takeEntry(EntryPtr* pEntry);
+   void compressEntry(EntryPtr pEntry);
+   void finishEntry();
+
+   Error writePrecompressedEntry(EntryPtr pEntry, std::string* pChunk);
+   Error writeStreamedEntry(EntryPtr pEntry, std::string* pChunk);
+   void writeCentralDirectory(std::string* pChunk);
+
+   static void appendLocalHeader(const Entry& entry, std::string* pOutput);
+   static void appendDataDescriptor(const Entry& entry, std::string* pOutput);
+   static void appendCentralHeader(const Entry& entry, std::string* pOutput);
+
+private:
+   struct Stream;
+
+   int compressionLevel_;
+   std::size_t maxThreads_;
+   std::size_t lookahead_;
+
+   // entries (and the index of the entry currently being written)
+   std::vector<EntryPtr> entries_;
+   std::size_t index_;
+   boost::uintmax_t offset_;
+   bool started_;
+   bool finished_;
+
+   // state of the streamed entry currently being written
+   boost::scoped_ptr<Stream> pStream_;
+
+   // worker threads and the precompressed entries waiting for them
+   boost::thread_group threads_;
+   boost::mutex mutex_;
+   boost::condition entriesCondition_;
+   std::vector<EntryPtr> jobs_;
+   std::size_t nextJob_;
+   bool stopping_;
+};
+
+} // namespace zip
+} // namespace core
+
+#endif // CORE_ZIP_WRITER_HPP
@@ -31,6 +31,7 @@
 #include <core/http/Request.hpp>
 #include <core/http/Response.hpp>
 #include <core/http/SocketUtils.hpp>
+#include <core/http/StreamFile.hpp>
 #include <core/http/RequestParser.hpp>
 #include <core/http/AsyncConnection.hpp>
 
@@ -57,7 +58,8 @@ public:
       : ioService_(ioService),
         socket_(ioService),
         handler_(handler),
-        responseFilter_(responseFilter)
+        responseFilter_(responseFilter),
+        readingBody_(false)
         
    {
    }
@@ -129,11 +131,12 @@ private:
       {
          if (!e)
          {
-            // parse next chunk
-            RequestParser::status status = requestParser_.parse(
-                                             request_,
-                                             buffer_.data(), 
-                                             buffer_.data() + bytesTransferred);
+            // parse next chunk (or note body bytes read into the request)
+            RequestParser::status status = readingBody_ ?
+               requestParser_.bodyReceived(request_, bytesTransferred) :
+               requestParser_.parse(request_,
+                                    buffer_.data(),
+                                    buffer_.data() + bytesTransferred);
             
             // error - return bad request
             if (status == RequestParser::error)
@@ -181,6 +184,21 @@ private:
    {
       try
       {
+         // headers written -- now stream the body if necessary
+         if (!e && !pStreamBody_)
+         {
+            if (!response_.streamFile().empty())
+               pStreamBody_.reset(new StreamFileReader(response_.streamFile()));
+            else
+               pStreamBody_ = response_.streamBody();
+
+            if (pStreamBody_)
+            {
+               writeStreamBodyChunk();
+               return;
+            }
+         }
+
          if (e)
          {
             // log the error if it wasn't connection terminated
@@ -202,10 +220,55 @@ private:
       CATCH_UNEXPECTED_EXCEPTION
    }
    
+   void writeStreamBodyChunk()
+   {
+      // read the next chunk (a read error ends the response early)
+      Error error = pStreamBody_->next(&streamBodyChunk_);
+      if (error)
+      {
+         LOG_ERROR(error);
+         streamBodyChunk_.clear();
+      }
+
+      // all done
+      if (streamBodyChunk_.empty())
+      {
+         handleWrite(boost::system::error_code());
+         return;
+      }
+
+      boost::asio::async_write(
+          socket_,
+          boost::asio::buffer(streamBodyChunk_),
+          boost::bind(
+               &AsyncConnectionImpl<ProtocolType>::handleWriteStreamBodyChunk,
+               AsyncConnectionImpl<ProtocolType>::shared_from_this(),
+               boost::asio::placeholders::error)
+      );
+   }
+
+   void handleWriteStreamBodyChunk(const boost::system::error_code& e)
+   {
+      try
+      {
+         if (e)
+            handleWrite(e);
+         else
+            writeStreamBodyChunk();
+      }
+      CATCH_UNEXPECTED_EXCEPTION
+   }
+
    void readSome()
    {
+      // once we are receiving the body read directly into the request
+      std::size_t bodySize = 0;
+      char* pBody = requestParser_.bodyBuffer(request_, &bodySize);
+      readingBody_ = (pBody != NULL);
+
       socket_.async_read_some(
-         boost::asio::buffer(buffer_),
+         readingBody_ ? boost::asio::buffer(pBody, bodySize) :
+                        boost::asio::buffer(buffer_),
          boost::bind(
                &AsyncConnectionImpl<ProtocolType>::handleRead,
                AsyncConnectionImpl<ProtocolType>::shared_from_this(),
@@ -220,9 +283,12 @@ private:
    Handler handler_;
    ResponseFilter responseFilter_;
    boost::array<char, 8192> buffer_ ;
+   bool readingBody_;
    RequestParser requestParser_ ;
    http::Request request_;
    http::Response response_;
+   boost::shared_ptr<StreamBody> pStreamBody_;
+   std::string streamBodyChunk_;
 };
    
 
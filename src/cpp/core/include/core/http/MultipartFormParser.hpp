@@ -0,0 +1,93 @@
+/*
+ * MultipartFormParser.hpp
+ *
+ * Copyright (C) 2009-12 by RStudio, Inc.
+ *
+ * Unless you have received this program directly from RStudio pursuant
+ * to the terms of a commercial license agreement with RStudio, then
+ * this program is licensed to you under the terms of version 3 of the
+ * GNU Affero General Public License. This program is distributed WITHOUT
+ * ANY EXPRESS OR IMPLIED WARRANTY, INCLUDING THOSE OF NON-INFRINGEMENT,
+ * MERCHANTABILITY OR FITNESS FOR A PARTICULAR PURPOSE. Please refer to the
+ * AGPL (http://www.gnu.org/licenses/agpl-3.0.txt) for more details.
+ *
+ */
+
+#ifndef CORE_HTTP_MULTIPART_FORM_PARSER_HPP
+#define CORE_HTTP_MULTIPART_FORM_PARSER_HPP
+
+#include <string>
+#include <iosfwd>
+
+#include <boost/utility.hpp>
+#include <boost/shared_ptr.hpp>
+
+#include <core/FilePath.hpp>
+#include <core/http/Util.hpp>
+
+namespace core {
+
+class Error;
+
+namespace http {
+
+// Incremental parser for multipart/form-data bodies. The body can be
+// supplied in chunks of any size as it is received. If a spool directory
+// is provided then uploaded files are written to (uniquely named) files
+// within it as they are parsed rather than being accumulated in memory.
+// Parsing fails if an uploaded file exceeds maxFileSize (if specified) or
+// if the values of the form's other fields exceed a fixed limit.
+class MultipartFormParser : boost::noncopyable
+{
+public:
+   explicit MultipartFormParser(const std::string& contentType,
+                                const FilePath& spoolDir = FilePath(),
+                                std::size_t maxFileSize = 0);
+   virtual ~MultipartFormParser();
+
+   // COPYING: boost::noncopyable
+
+public:
+   // parse the next chunk of the body
+   Error parse(const char* begin, const char* end);
+
+   // complete parsing, appending the fields and files which were parsed
+   // (returns an error if the body was incomplete)
+   Error finish(Fields* pFields, Files* pFiles);
+
+private:
+   enum State { Preamble, Delimiter, PartHeaders, PartData, Epilogue };
+
+   Error parseBuffer();
+   Error beginPart(const std::string& headers);
+   Error writePartData(const char* data, std::size_t size);
+   Error endPart();
+   void discardPart();
+
+private:
+   std::string delimiter_;
+   FilePath spoolDir_;
+   std::size_t maxFileSize_;
+   State state_;
+   std::string buffer_;
+
+   // part currently being parsed
+   bool partIgnored_;
+   bool partIsFile_;
+   std::size_t partSize_;
+   std::string partName_;
+   std::string partValue_;
+   File partFile_;
+   boost::shared_ptr<std::ostream> pPartStream_;
+
+   // total size of the field values (which are held in memory)
+   std::size_t fieldsSize_;
+
+   Fields fields_;
+   Files files_;
+};
+
+} // namespace http
+} // namespace core
+
+#endif // CORE_HTTP_MULTIPART_FORM_PARSER_HPP
@@ -17,12 +17,20 @@
 #ifndef CORE_HTTP_REQUEST_PARSER_HPP
 #define CORE_HTTP_REQUEST_PARSER_HPP
 
+#include <boost/shared_ptr.hpp>
+
+#include <core/FilePath.hpp>
 #include <core/http/Request.hpp>
 
 namespace core {
 namespace http {
 
-/// Parser for incoming requests.
+class MultipartFormParser;
+
+/// Parser for incoming requests. The request line and headers are
+/// accumulated until the end of the header block is seen and are then
+/// parsed in a single pass (headers are constructed directly into storage
+/// reserved for them). The body is received directly into the request.
 class RequestParser
 {
 public:
@@ -32,6 +40,17 @@ public:
   /// Reset to initial parser state.
   void reset();
 
+  /// Spool the files within multipart/form-data bodies of requests whose
+  /// uri begins with uriPrefix to the specified directory as they are
+  /// received (rather than accumulating the body in memory). The request's
+  /// form fields and uploaded files are populated directly and its body is
+  /// left empty. If maxFileSize is specified then such requests whose
+  /// Content-Length or uploaded files exceed it are rejected. Other
+  /// requests are received as usual.
+  void setFormSpoolDir(const std::string& uriPrefix,
+                       const FilePath& spoolDir,
+                       std::size_t maxFileSize = 0);
+
   // enum for parse results
   enum status
   {
@@ -40,47 +59,23 @@ public:
      error
   };
 
-  template <typename InputIterator>
-  status parse(Request& req, InputIterator begin, InputIterator end)
-  {
-    while (begin != end)
-    {
-       // header parsing
-      if (!parsing_body_)
-      {
-         status st = consume(req, *begin++);
-         if ( st == error )
-         {
-            return st ;
-         }
-         else if ( st == complete  )
-         {
-            // if we have a body then continue parsing it
-            if (content_length_ > 0)
-            {
-               parsing_body_ = true ;
-               continue ;
-            }
-            else
-            {
-               return st ;
-            }
-         }
-      }
-      // body parsing
-      else
-      {
-         req.body_.push_back(*begin++) ;
-         if (req.body_.size() == content_length_)
-            return complete ;
-      }
-    }
-    return incomplete ;
-  }
+  /// Parse the next chunk of input (any input beyond the end of the
+  /// request is ignored).
+  status parse(Request& req, const char* begin, const char* end);
+
+  /// While the body is being received, the region of the request body
+  /// which should be filled next (returns NULL if the body isn't being
+  /// received or is being spooled). This allows callers to read the body
+  /// directly into the request rather than via an intermediate buffer.
+  char* bodyBuffer(Request& req, std::size_t* pSize);
+
+  /// Note that bytes were written into the region returned by bodyBuffer.
+  status bodyReceived(Request& req, std::size_t bytes);
 
 private:
-  /// Handle the next character of input.
-  status consume(Request& req, char input);
+  status parseHeaders(Request& req, const char* begin, const char* end);
+  status receiveBody(Request& req, const char* begin, const char* end);
+  status receiveFormData(Request& req, const char* begin, const char* end);
 
   /// Check if a byte is an HTTP character.
   static bool is_char(int c);
@@ -94,35 +89,21 @@ private:
   /// Check if a byte is a digit.
   static bool is_digit(int c);
 
-  /// The current state of the parser.
-  enum state
+  /// Check if a byte is valid within a token (method or header name).
+  static bool is_token(int c)
   {
-    method_start,
-    method,
-    uri_start,
-    uri,
-    http_version_h,
-    http_version_t_1,
-    http_version_t_2,
-    http_version_p,
-    http_version_slash,
-    http_version_major_start,
-    http_version_major,
-    http_version_minor_start,
-    http_version_minor,
-    expecting_newline_1,
-    header_line_start,
-    header_lws,
-    header_name,
-    space_before_header_value,
-    header_value,
-    expecting_newline_2,
-    expecting_newline_3
-  } state_;
-  
+     return is_char(c) && !is_ctl(c) && !is_tspecial(c);
+  }
+
+private:
+  std::string header_buffer_ ;
   std::size_t content_length_ ;
-  bool parsing_content_length_ ;
+  std::size_t body_received_ ;
   bool parsing_body_ ;
+  std::string form_uri_prefix_ ;
+  FilePath form_spool_dir_ ;
+  std::size_t form_max_file_size_ ;
+  boost::shared_ptr<MultipartFormParser> form_parser_ ;
 };
 
 } // namespace http
@@ -32,6 +32,7 @@
 
 #include "Message.hpp"
 #include "Request.hpp"
+#include "StreamFile.hpp"
 #include "Util.hpp"
 
 namespace core {
@@ -93,6 +94,8 @@ public:
       statusCode_ = response.statusCode_;
       statusCodeStr_ = response.statusCodeStr_;
       statusMessage_ = response.statusMessage_;
+      streamFile_ = response.streamFile_;
+      pStreamBody_ = response.pStreamBody_;
    }
 
 public:   
@@ -113,6 +116,16 @@ public:
    void setChromeFrameCompatible(const Request& request);
 
    void addCookie(const Cookie& cookie) ;
+
+   // file which is streamed from disk as the body (empty if the body is
+   // held in memory)
+   const StreamFile& streamFile() const { return streamFile_; }
+
+   // body which is produced as the response is written (NULL if the body
+   // is held in memory). since the length isn't known up front the body
+   // is delimited by the connection closing
+   boost::shared_ptr<StreamBody> streamBody() const { return pStreamBody_; }
+   void setStreamBody(boost::shared_ptr<StreamBody> pStreamBody);
    
    Error setBody(const std::string& content);
    
@@ -166,6 +179,10 @@ public:
    {
       try
       {
+         // body is now held in memory
+         streamFile_ = StreamFile();
+         pStreamBody_.reset();
+
          // set exception mask (required for proper reporting of errors)
          is.exceptions(std::istream::failbit | std::istream::badbit);
          
@@ -209,10 +226,22 @@ public:
       }
    }   
 
+   // when no filter is required the file is streamed from disk as the
+   // response is written rather than read into memory (on posix)
    Error setBody(const FilePath& filePath, std::streamsize buffSize = 512)
    {
+#ifndef _WIN32
+      StreamFile streamFile;
+      Error error = openStreamFile(filePath, &streamFile);
+      if (error)
+         return error;
+
+      setStreamFile(streamFile);
+      return Success();
+#else
       NullOutputFilter nullFilter;
       return setBody(filePath, nullFilter, buffSize);
+#endif
    }
    
    template <typename Filter>
@@ -268,8 +297,10 @@ public:
       if (request.acceptsEncoding(kGzipEncoding))
          setContentEncoding(kGzipEncoding);
       
-      // set body from file
-      Error error = setBody(filePath, filter);
+      // set body from file (streamed from disk if there is no filter)
+      Error error = boost::is_same<Filter, NullOutputFilter>::value ?
+                                          setBody(filePath) :
+                                          setBody(filePath, filter);
       if (error)
          setError(status::InternalServerError, error.code().message());
    }
@@ -332,6 +363,7 @@ private:
       
 private:
    void ensureStatusMessage() const ;
+   void setStreamFile(const StreamFile& streamFile);
    void removeCachingHeaders();
    void setCacheForeverHeaders(bool publicAccessiblity);
    std::string eTagForContent(const std::string& content);
@@ -347,6 +379,11 @@ private:
 
    // string storage for integer members (need for toBuffers)
    mutable std::string statusCodeStr_ ;
+
+   // body streamed from disk or produced as the response is written (these
+   // are written after the buffers returned by toBuffers)
+   StreamFile streamFile_;
+   boost::shared_ptr<StreamBody> pStreamBody_;
 };
 
 std::ostream& operator << (std::ostream& stream, const Response& r) ;
@@ -0,0 +1,99 @@
+/*
+ * StreamFile.hpp
+ *
+ * Copyright (C) 2009-12 by RStudio, Inc.
+ *
+ * Unless you have received this program directly from RStudio pursuant
+ * to the terms of a commercial license agreement with RStudio, then
+ * this program is licensed to you under the terms of version 3 of the
+ * GNU Affero General Public License. This program is distributed WITHOUT
+ * ANY EXPRESS OR IMPLIED WARRANTY, INCLUDING THOSE OF NON-INFRINGEMENT,
+ * MERCHANTABILITY OR FITNESS FOR A PARTICULAR PURPOSE. Please refer to the
+ * AGPL (http://www.gnu.org/licenses/agpl-3.0.txt) for more details.
+ *
+ */
+
+#ifndef CORE_HTTP_STREAM_FILE_HPP
+#define CORE_HTTP_STREAM_FILE_HPP
+
+#include <string>
+#include <vector>
+
+#include <boost/cstdint.hpp>
+#include <boost/utility.hpp>
+#include <boost/shared_ptr.hpp>
+#include <boost/scoped_ptr.hpp>
+#include <boost/iostreams/filtering_stream.hpp>
+
+namespace core {
+
+class Error;
+class FilePath;
+
+namespace http {
+
+// File (or range of a file) which is written directly from disk as the body
+// of a response rather than being read into memory. The file is opened when
+// the response is populated, so it may be removed as soon as that is done.
+struct StreamFile
+{
+   StreamFile()
+      : fd(-1), offset(0), length(0), gzip(false)
+   {
+   }
+
+   bool empty() const { return fd == -1; }
+
+   int fd;
+   boost::shared_ptr<void> fdOwner;
+   boost::uintmax_t offset;
+   boost::uintmax_t length;
+   bool gzip;
+};
+
+// open a file for streaming (the length is initialized to the file size)
+Error openStreamFile(const FilePath& filePath, StreamFile* pStreamFile);
+
+// Body which is produced in chunks as a response is written rather than
+// being held in memory
+class StreamBody : boost::noncopyable
+{
+public:
+   virtual ~StreamBody() {}
+
+   // COPYING: boost::noncopyable
+
+   // read the next chunk of the body (an empty chunk marks the end)
+   virtual Error next(std::string* pChunk) = 0;
+};
+
+// Reads the body of a stream file in chunks (compressing it if requested)
+class StreamFileReader : public StreamBody
+{
+public:
+   explicit StreamFileReader(const StreamFile& streamFile);
+   virtual ~StreamFileReader();
+
+public:
+   virtual Error next(std::string* pChunk);
+
+private:
+   StreamFile streamFile_;
+   boost::uintmax_t position_;
+   boost::uintmax_t remaining_;
+   std::vector<char> buffer_;
+   std::string compressed_;
+   boost::scoped_ptr<boost::iostreams::filtering_ostream> pGzipStream_;
+};
+
+// write the body of a stream file to a connected socket (uses sendfile
+// where it is available)
+Error sendStreamFile(int socketFd, const StreamFile& streamFile);
+
+// write a stream body to a connected socket
+Error sendStreamBody(int socketFd, StreamBody* pStreamBody);
+
+} // namespace http
+} // namespace core
+
+#endif // CORE_HTTP_STREAM_FILE_HPP
@@ -20,9 +20,12 @@
 #include <vector>
 #include <map>
 
+#include <boost/shared_ptr.hpp>
 #include <boost/lexical_cast.hpp>
 #include <boost/date_time/posix_time/posix_time.hpp>
 
+#include <core/FilePath.hpp>
+
 namespace core {
    
 class Error;
@@ -52,9 +55,18 @@ private:
 struct File
 {
    bool empty() const { return name.empty(); }
+   bool spooled() const { return !path.empty(); }
+   uintmax_t size() const { return spooled() ? path.size() : contents.size(); }
    std::string name;
    std::string contentType;
    std::string contents;   
+
+   // files spooled to disk as they were received have empty contents and
+   // are instead located at path. the spooled file is removed when the
+   // last copy of the File is destroyed (so should be moved elsewhere by
+   // handlers which want to retain it)
+   FilePath path;
+   boost::shared_ptr<void> pathOwner;
 };
 
 typedef std::map<std::string,File> Files;
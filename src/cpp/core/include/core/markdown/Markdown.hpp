@@ -17,6 +17,10 @@
 #define CORE_MARKDOWN_MARKDOWN_HPP
 
 #include <string>
+#include <map>
+
+#include <boost/utility.hpp>
+#include <boost/cstdint.hpp>
 
 namespace core {
 
@@ -80,6 +84,69 @@ struct HTMLOptions
    bool escape;
 };
 
+// cumulative timing and reuse counters for a BlockCache
+struct BlockCacheStats
+{
+   BlockCacheStats()
+      : renders(0),
+        blocksRendered(0),
+        blocksReused(0),
+        totalMicroseconds(0),
+        lastRenderMicroseconds(0)
+   {
+   }
+
+   boost::uint64_t renders;
+   boost::uint64_t blocksRendered;
+   boost::uint64_t blocksReused;
+   boost::uint64_t totalMicroseconds;
+   boost::uint64_t lastRenderMicroseconds;
+};
+
+// Cache of rendered top-level markdown blocks (paragraphs, fenced code,
+// display math, etc.). When a cache is passed to markdownToHTML only the
+// blocks which changed since they were last rendered are passed through
+// sundown and the resulting HTML is spliced together. Entries which
+// haven't been used within the last maxIdleRenders renders are evicted.
+class BlockCache : boost::noncopyable
+{
+public:
+   explicit BlockCache(std::size_t maxIdleRenders = 8)
+      : maxIdleRenders_(maxIdleRenders), generation_(0)
+   {
+   }
+
+   const BlockCacheStats& stats() const { return stats_; }
+
+   void clear() { entries_.clear(); }
+
+private:
+   friend Error markdownToHTML(const std::string&,
+                               const Extensions&,
+                               const HTMLOptions&,
+                               BlockCache*,
+                               std::string*);
+
+   struct Entry
+   {
+      Entry() : generation(0) {}
+      std::string html;
+      std::size_t generation;
+   };
+
+   bool lookup(const std::string& key, std::string* pHTML);
+   void insert(const std::string& key, const std::string& html);
+   void endRender(std::size_t blocksRendered,
+                  std::size_t blocksReused,
+                  boost::uint64_t microseconds);
+
+private:
+   const std::size_t maxIdleRenders_;
+   std::size_t generation_;
+   std::map<std::string,Entry> entries_;
+   BlockCacheStats stats_;
+};
+
 // render markdown to HTML -- assumes UTF-8 encoding
 Error markdownToHTML(const FilePath& markdownFile,
                      const Extensions& extensions,
@@ -98,6 +165,14 @@ Error markdownToHTML(const std::string& markdownInput,
                      const HTMLOptions& htmlOptions,
                      std::string* pHTMLOutput);
 
+// render markdown to HTML re-using previously rendered blocks from the
+// passed cache where possible -- assumes UTF-8 encoding
+Error markdownToHTML(const std::string& markdownInput,
+                     const Extensions& extensions,
+                     const HTMLOptions& htmlOptions,
+                     BlockCache* pCache,
+                     std::string* pHTMLOutput);
+
 
 bool isMathJaxRequired(const std::string& htmlOutput);
 
@@ -40,6 +40,7 @@ namespace r_util {
 class RToken_lock
 {
    friend class RToken ;
+   friend class RUtf8Token ;
 private:
    RToken_lock() {}
    RToken_lock(const RToken_lock&) {}
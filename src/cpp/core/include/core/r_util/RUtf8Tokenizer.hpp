@@ -0,0 +1,179 @@
+/*
+ * RUtf8Tokenizer.hpp
+ *
+ * Copyright (C) 2009-12 by RStudio, Inc.
+ *
+ * Unless you have received this program directly from RStudio pursuant
+ * to the terms of a commercial license agreement with RStudio, then
+ * this program is licensed to you under the terms of version 3 of the
+ * GNU Affero General Public License. This program is distributed WITHOUT
+ * ANY EXPRESS OR IMPLIED WARRANTY, INCLUDING THOSE OF NON-INFRINGEMENT,
+ * MERCHANTABILITY OR FITNESS FOR A PARTICULAR PURPOSE. Please refer to the
+ * AGPL (http://www.gnu.org/licenses/agpl-3.0.txt) for more details.
+ *
+ */
+
+#ifndef CORE_R_UTIL_R_UTF8_TOKENIZER_HPP
+#define CORE_R_UTIL_R_UTF8_TOKENIZER_HPP
+
+#include <string>
+#include <vector>
+#include <algorithm>
+
+#include <boost/utility.hpp>
+
+#include <core/r_util/RTokenizer.hpp>
+
+namespace core {
+namespace r_util {
+
+// RUtf8Token. Same semantics as RToken (including the token type constants,
+// which are shared with RToken) however the token refers to a range of bytes
+// within UTF-8 encoded source data. Offsets and lengths are in bytes.
+class RUtf8Token : public virtual RToken_lock
+{
+public:
+   RUtf8Token()
+      : type_(0), offset_(-1)
+   {
+   }
+
+   RUtf8Token(wchar_t type,
+              std::string::const_iterator begin,
+              std::string::const_iterator end,
+              std::size_t offset)
+      : type_(type), begin_(begin), end_(end), offset_(offset)
+   {
+   }
+
+   // COPYING: via compiler (copyable members)
+
+   // accessors
+   wchar_t type() const { return type_; }
+   std::string content() const { return std::string(begin_, end_); }
+   std::size_t offset() const { return offset_; }
+   std::size_t length() const { return end_ - begin_; }
+   std::string::const_iterator begin() const { return begin_; }
+   std::string::const_iterator end() const { return end_; }
+
+   // efficient comparison operations
+   bool contentEquals(const std::string& text) const
+   {
+      return length() == text.length() &&
+             std::equal(begin_, end_, text.begin());
+   }
+
+   bool contentStartsWith(const std::string& text) const
+   {
+      return length() >= text.length() &&
+             std::equal(text.begin(), text.end(), begin_);
+   }
+
+   bool isOperator(const std::string& op) const
+   {
+      return (type_ == RToken::OPER) && contentEquals(op);
+   }
+
+   bool isType(wchar_t type) const
+   {
+      return type_ == type;
+   }
+
+   // allow direct use in conditional statements (nullability)
+   typedef void (*unspecified_bool_type)();
+   static void unspecified_bool_true() {}
+   operator unspecified_bool_type() const
+   {
+      return offset_ == static_cast<std::size_t>(-1) ?
+                                             0 :
+                                             unspecified_bool_true;
+   }
+   bool operator!() const
+   {
+      return offset_ == static_cast<std::size_t>(-1);
+   }
+
+private:
+   wchar_t type_;
+   std::string::const_iterator begin_;
+   std::string::const_iterator end_;
+   std::size_t offset_;
+};
+
+// Tokenize UTF-8 encoded R code. This produces the same tokens as
+// RTokenizer but operates directly on the UTF-8 bytes (using hand-written
+// scanners rather than regular expressions) so doesn't require the code
+// to be converted to a wide string. As with RTokenizer the RUtf8Token
+// instances which are returned are valid only during the lifetime of the
+// RUtf8Tokenizer which yielded them.
+class RUtf8Tokenizer : boost::noncopyable
+{
+public:
+   explicit RUtf8Tokenizer(const std::string& data)
+      : data_(data), pos_(data_.begin())
+   {
+   }
+
+   virtual ~RUtf8Tokenizer() {}
+
+   // COPYING: boost::noncopyable
+
+   RUtf8Token nextToken();
+
+private:
+   RUtf8Token matchWhitespace();
+   RUtf8Token matchStringLiteral();
+   RUtf8Token matchNumber();
+   RUtf8Token matchIdentifier();
+   RUtf8Token matchQuotedIdentifier();
+   RUtf8Token matchComment();
+   RUtf8Token matchUserOperator();
+   RUtf8Token matchOperator();
+   bool eol() const;
+   char peek(std::size_t lookahead = 0) const;
+   wchar_t peekChar(std::size_t* pLength) const;
+   std::size_t whitespaceLength(std::string::const_iterator it) const;
+   RUtf8Token consumeToken(wchar_t tokenType, std::size_t length);
+
+private:
+   std::string data_;
+   std::string::const_iterator pos_;
+};
+
+// Set of RUtf8Tokens stored contiguously. Note that the RUtf8Tokens
+// returned from the set are conceptually iterators so are only valid for
+// the lifetime of the RUtf8Tokens object which yielded them.
+class RUtf8Tokens : public std::vector<RUtf8Token>, boost::noncopyable
+{
+public:
+   explicit RUtf8Tokens(const std::string& code, int flags = RTokens::None)
+      : tokenizer_(code)
+   {
+      // a conservative estimate of the number of tokens (reserving much
+      // more would cost several times the size of the code up front)
+      reserve(code.length() / 16);
+
+      RUtf8Token token;
+      while ((token = tokenizer_.nextToken()))
+      {
+         if ((flags & RTokens::StripWhitespace) &&
+             token.type() == RToken::WHITESPACE)
+            continue;
+
+         if ((flags & RTokens::StripComments) &&
+             token.type() == RToken::COMMENT)
+            continue;
+
+         push_back(token);
+      }
+   }
+
+private:
+    RUtf8Tokenizer tokenizer_;
+};
+
+} // namespace r_util
+} // namespace core
+
+
+#endif // CORE_R_UTIL_R_UTF8_TOKENIZER_HPP
@@ -35,6 +35,8 @@ typedef boost::function<core::Error(const std::string&,
                                     bool,
                                     std::string*)> IconvstrFunction;
 
+// NOTE: calls into the engine are serialized internally so it is safe
+// to check spelling from a background thread
 class HunspellSpellingEngine : public SpellingEngine
 {
 public:
@@ -49,6 +51,9 @@ public:
    Error checkSpelling(const std::string& word,
                        bool *pCorrect);
 
+   Error checkSpelling(const std::vector<std::string>& words,
+                       std::vector<bool>* pCorrect);
+
    Error suggestionList(const std::string& word,
                         std::vector<std::string>* pSugs);
 
@@ -37,6 +37,10 @@ public:
    virtual Error checkSpelling(const std::string& word,
                                bool *pCorrect) = 0;
 
+   // check a batch of words at once (pCorrect receives one entry per word)
+   virtual Error checkSpelling(const std::vector<std::string>& words,
+                               std::vector<bool>* pCorrect) = 0;
+
    virtual Error suggestionList(const std::string& word,
                                 std::vector<std::string>* pSugs) = 0;
 
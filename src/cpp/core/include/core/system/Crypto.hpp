@@ -34,6 +34,17 @@ core::Error HMAC_SHA1(const std::string& data,
 core::Error HMAC_SHA1(const std::string& data, 
                       const std::vector<unsigned char>& key,
                       std::vector<unsigned char>* pHMAC);   
+
+core::Error HMAC_SHA256(const std::string& data,
+                        const std::string& key,
+                        std::vector<unsigned char>* pHMAC);
+
+core::Error sha256Digest(const std::string& data,
+                         std::vector<unsigned char>* pDigest);
+
+// compare two strings (e.g. MACs) in time which doesn't depend on where
+// they first differ
+bool constantTimeEquals(const std::string& a, const std::string& b);
    
 core::Error base64Encode(const std::vector<unsigned char>& data, 
                          std::string* pEncoded);   
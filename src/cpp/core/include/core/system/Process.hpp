@@ -247,6 +247,31 @@ ProcessCallbacks createProcessCallbacks(
                const boost::function<void(const Error&)>& onError=
                                   boost::function<void(const core::Error&)>());
 
+// Output throughput counters for a supervised child process
+struct ProcessIOStats
+{
+   ProcessIOStats()
+      : stdoutBytes(0), stderrBytes(0), outputEvents(0)
+   {
+   }
+
+   // Bytes per second of output (stdout + stderr) since the child started
+   double bytesPerSecond() const;
+
+   // Executable or command which was run
+   std::string command;
+
+   // Time at which the child was started
+   boost::posix_time::ptime started;
+
+   // Bytes received on standard output and standard error
+   std::size_t stdoutBytes;
+   std::size_t stderrBytes;
+
+   // Number of output callbacks delivered
+   std::size_t outputEvents;
+};
+
 // Process supervisor
 class ProcessSupervisor : boost::noncopyable
 {
@@ -256,11 +281,12 @@ public:
 
    // Run a child asynchronously, invoking callbacks as the process starts,
    // produces output, and exits. Output callbacks are streamed/interleaved,
-   // but note that output is collected at a polling interval so it is
+   // but note that output is delivered at a polling interval so it is
    // possible that e.g. two writes to standard output which had an
-   // intervening write to standard input might still be concatenated. See
-   // comment on runProgram above for the semantics of the "executable"
-   // argument.
+   // intervening write to standard input might still be concatenated (on
+   // linux output is read by a background thread as soon as it is available
+   // and then handed to callbacks within poll). See comment on runProgram
+   // above for the semantics of the "executable" argument.
    Error runProgram(const std::string& executable,
                     const std::vector<std::string>& args,
                     const ProcessOptions& options,
@@ -310,6 +336,9 @@ public:
    // Terminate all running children
    void terminateAll();
 
+   // Get output throughput counters for all running children
+   std::vector<ProcessIOStats> ioStats();
+
    // Wait for all children to exit. Returns false if the operaiton timed out
    bool wait(
       const boost::posix_time::time_duration& pollingInterval =
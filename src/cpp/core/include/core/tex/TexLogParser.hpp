@@ -19,6 +19,10 @@
 #include <string>
 #include <vector>
 
+#include <boost/function.hpp>
+#include <boost/scoped_ptr.hpp>
+#include <boost/utility.hpp>
+
 #include <core/FilePath.hpp>
 
 namespace core {
@@ -74,6 +78,30 @@ private:
 
 typedef std::vector<LogEntry> LogEntries;
 
+// Incremental parser for LaTeX log output. Output can be passed to parse in
+// arbitrarily sized chunks (e.g. as it is written by the tex compiler) and
+// entries are reported via onLogEntry as soon as they are complete. Only the
+// lines required to complete the current entry are retained, so memory use
+// does not grow with the size of the log.
+class LatexLogParser : boost::noncopyable
+{
+public:
+   LatexLogParser(const FilePath& logFilePath,
+                  const boost::function<void(const LogEntry&)>& onLogEntry);
+   virtual ~LatexLogParser();
+
+   // parse the next chunk of log output
+   void parse(const std::string& output);
+
+   // indicate that the end of the log has been reached (reports any
+   // entries which were still waiting on subsequent lines)
+   void finish();
+
+private:
+   struct Impl;
+   boost::scoped_ptr<Impl> pImpl_;
+};
+
 Error parseLatexLog(const FilePath& logFilePath, LogEntries* pLogEntries);
 
 Error parseBibtexLog(const FilePath& logFilePath, LogEntries* pLogEntries);
@@ -23,6 +23,7 @@
 #include <boost/algorithm/string/join.hpp>
 #include <boost/algorithm/string/split.hpp>
 #include <boost/algorithm/string/predicate.hpp>
+#include <boost/date_time/posix_time/posix_time.hpp>
 
 #include <core/Error.hpp>
 #include <core/FilePath.hpp>
@@ -305,8 +306,256 @@ void stripMetadata(std::string* pInput)
    }
 }
 
+bool isBlankLine(const std::string& line)
+{
+   return line.find_first_not_of(" \t\r\n") == std::string::npos;
+}
+
+// can a line which follows a blank line start a new top-level block?
+// (indented lines, list items and block quotes may continue the
+// preceding block so we keep those together)
+bool canStartBlock(const std::string& line)
+{
+   static const boost::regex listItemRegex("^(?:[-*+]|\\d+\\.)\\s");
+   if (line.empty())
+      return false;
+
+   char ch = line[0];
+   if (ch == ' ' || ch == '\t' || ch == '>')
+      return false;
+
+   return !boost::regex_search(line, listItemRegex);
+}
+
+// does this line open fenced code? (as in sundown, a run of at least three
+// backticks or tildes optionally followed by a language)
+bool opensCodeFence(const std::string& line)
+{
+   static const boost::regex openRegex(
+            "^ {0,3}(?:`{3,}|~{3,}) *(?:\\{[^}\\n]*\\}|[^\\s{]\\S*)?\\s*$");
+   return boost::regex_match(line, openRegex);
+}
+
+// does this line close fenced code? sundown ends fenced code at the first
+// bare fence regardless of the character or length of the opening fence so
+// we must do the same to split where it does
+bool closesCodeFence(const std::string& line)
+{
+   static const boost::regex closeRegex("^ {0,3}(?:`{3,}|~{3,})\\s*$");
+   return boost::regex_match(line, closeRegex);
+}
+
+// change in the nesting depth of the given html tag on this line (opening
+// tags less closing tags, not counting self-closing tags)
+int htmlTagDepthChange(const std::string& line, const std::string& tag)
+{
+   boost::regex openRegex("<" + tag + "(?![A-Za-z0-9])[^>]*?(/?)(?:>|$)");
+   boost::regex closeRegex("</" + tag + "\\s*>");
+
+   int depth = 0;
+   boost::sregex_iterator end;
+   for (boost::sregex_iterator it(line.begin(), line.end(), openRegex);
+        it != end;
+        ++it)
+   {
+      if ((*it)[1].length() == 0)
+         depth++;
+   }
+   for (boost::sregex_iterator it(line.begin(), line.end(), closeRegex);
+        it != end;
+        ++it)
+   {
+      depth--;
+   }
+   return depth;
+}
+
+// name of the html tag opened (and not closed) at the start of a line
+// (if any). pDepth receives the nesting depth of the tag after the line
+std::string openedHtmlTag(const std::string& line, int* pDepth)
+{
+   static const boost::regex htmlTagRegex("^<([A-Za-z][A-Za-z0-9]*)");
+   boost::smatch match;
+   if (boost::regex_search(line, match, htmlTagRegex))
+   {
+      std::string tag = match[1];
+      *pDepth = htmlTagDepthChange(line, tag);
+      if (*pDepth > 0)
+         return tag;
+   }
+   *pDepth = 0;
+   return std::string();
+}
+
+std::size_t countOccurrences(const std::string& line, const std::string& str)
+{
+   std::size_t count = 0;
+   std::size_t pos = 0;
+   while ((pos = line.find(str, pos)) != std::string::npos)
+   {
+      count++;
+      pos += str.length();
+   }
+   return count;
+}
+
+// split a document into top-level blocks which can be rendered
+// independently of each other. blocks are separated by blank lines
+// however we never split within fenced code, display math, html
+// blocks, or html comments
+void splitBlocks(const std::string& input, std::vector<std::string>* pBlocks)
+{
+   std::string block;
+   bool pendingBlank = false;
+   bool inFence = false;
+   bool inDisplayMath = false;
+   bool inComment = false;
+   std::string htmlTag;
+   int htmlDepth = 0;
+
+   std::size_t pos = 0;
+   while (pos < input.length())
+   {
+      // extract the next line (including the newline)
+      std::size_t nextPos = input.find('\n', pos);
+      nextPos = (nextPos == std::string::npos) ? input.length() : nextPos + 1;
+      std::string line = input.substr(pos, nextPos - pos);
+      pos = nextPos;
+
+      bool inRegion = inFence || inDisplayMath || inComment ||
+                      !htmlTag.empty();
+
+      if (!inRegion && isBlankLine(line))
+      {
+         block.append(line);
+         pendingBlank = true;
+         continue;
+      }
+
+      if (pendingBlank && !inRegion && canStartBlock(line))
+      {
+         pBlocks->push_back(block);
+         block.clear();
+      }
+      pendingBlank = false;
+      block.append(line);
+
+      // update region state
+      if (inFence)
+      {
+         if (closesCodeFence(line))
+            inFence = false;
+      }
+      else if (opensCodeFence(line))
+      {
+         inFence = true;
+      }
+      else
+      {
+         if (countOccurrences(line, "$$") % 2 == 1)
+            inDisplayMath = !inDisplayMath;
+         else if (line.find("\\[") != std::string::npos &&
+                  line.find("\\]") == std::string::npos)
+            inDisplayMath = true;
+         else if (line.find("\\]") != std::string::npos &&
+                  line.find("\\[") == std::string::npos)
+            inDisplayMath = false;
+
+         if (inComment)
+         {
+            if (line.find("-->") != std::string::npos)
+               inComment = false;
+         }
+         else if (boost::algorithm::starts_with(line, "<!--"))
+         {
+            inComment = line.find("-->") == std::string::npos;
+         }
+         else if (!htmlTag.empty())
+         {
+            htmlDepth += htmlTagDepthChange(line, htmlTag);
+            if (htmlDepth <= 0)
+               htmlTag.clear();
+         }
+         else
+         {
+            htmlTag = openedHtmlTag(line, &htmlDepth);
+         }
+      }
+   }
+
+   if (!block.empty())
+      pBlocks->push_back(block);
+}
+
+// reference style link definitions can be used from any block so
+// documents which contain them need to be rendered as a whole
+bool hasLinkReferenceDefinitions(const std::string& input)
+{
+   static const boost::regex refRegex("^ {0,3}\\[[^\\]\\n]+\\]:");
+   return boost::regex_search(input, refRegex);
+}
+
+// key which identifies the rendering options used for a block
+std::string optionsKey(const Extensions& ext, const HTMLOptions& opt)
+{
+   bool flags[] = { ext.noIntraEmphasis, ext.tables, ext.fencedCode,
+                    ext.autolink, ext.laxSpacing, ext.spaceHeaders,
+                    ext.strikethrough, ext.superscript, ext.ignoreMath,
+                    opt.useXHTML, opt.hardWrap, opt.smartypants, opt.safelink,
+                    opt.toc, opt.skipHTML, opt.skipStyle, opt.skipImages,
+                    opt.skipLinks, opt.escape };
+
+   std::string key;
+   for (std::size_t i = 0; i < sizeof(flags) / sizeof(bool); i++)
+      key.push_back(flags[i] ? '1' : '0');
+   key.push_back('\n');
+   return key;
+}
+
 } // anonymous namespace
 
+bool BlockCache::lookup(const std::string& key, std::string* pHTML)
+{
+   std::map<std::string,Entry>::iterator it = entries_.find(key);
+   if (it == entries_.end())
+      return false;
+
+   it->second.generation = generation_;
+   *pHTML = it->second.html;
+   return true;
+}
+
+void BlockCache::insert(const std::string& key, const std::string& html)
+{
+   Entry& entry = entries_[key];
+   entry.html = html;
+   entry.generation = generation_;
+}
+
+void BlockCache::endRender(std::size_t blocksRendered,
+                           std::size_t blocksReused,
+                           boost::uint64_t microseconds)
+{
+   // update stats
+   stats_.renders++;
+   stats_.blocksRendered += blocksRendered;
+   stats_.blocksReused += blocksReused;
+   stats_.totalMicroseconds += microseconds;
+   stats_.lastRenderMicroseconds = microseconds;
+
+   // evict entries which haven't been used recently
+   std::map<std::string,Entry>::iterator it = entries_.begin();
+   while (it != entries_.end())
+   {
+      if ((generation_ - it->second.generation) >= maxIdleRenders_)
+         entries_.erase(it++);
+      else
+         ++it;
+   }
+
+   generation_++;
+}
+
 // render markdown to HTML -- assumes UTF-8 encoding
 Error markdownToHTML(const FilePath& markdownFile,
                      const Extensions& extensions,
@@ -448,6 +697,74 @@ Error markdownToHTML(const std::string& markdownInput,
    return Success();
 }
 
+// render markdown to HTML using a block cache -- assumes UTF-8 encoding
+Error markdownToHTML(const std::string& markdownInput,
+                     const Extensions& extensions,
+                     const HTMLOptions& options,
+                     BlockCache* pCache,
+                     std::string* pHTMLOutput)
+{
+   // the table of contents spans the whole document so can't be
+   // assembled from independently rendered blocks
+   if (pCache == NULL || options.toc)
+      return markdownToHTML(markdownInput, extensions, options, pHTMLOutput);
+
+   using namespace boost::posix_time;
+   ptime startTime = microsec_clock::universal_time();
+
+   // strip metadata up front (blocks are rendered without it)
+   std::string input = markdownInput;
+   if (extensions.stripMetadata)
+      stripMetadata(&input);
+   Extensions blockExtensions = extensions;
+   blockExtensions.stripMetadata = false;
+
+   // split into blocks (or a single block if the blocks are interdependent)
+   std::vector<std::string> blocks;
+   if (hasLinkReferenceDefinitions(input))
+      blocks.push_back(input);
+   else
+      splitBlocks(input, &blocks);
+
+   // render each block (re-using previously rendered blocks)
+   std::string optsKey = optionsKey(extensions, options);
+   std::size_t rendered = 0, reused = 0;
+   std::string output;
+   BOOST_FOREACH(const std::string& block, blocks)
+   {
+      std::string key = optsKey + block;
+      std::string blockHTML;
+      if (pCache->lookup(key, &blockHTML))
+      {
+         reused++;
+      }
+      else
+      {
+         Error error = markdownToHTML(block,
+                                      blockExtensions,
+                                      options,
+                                      &blockHTML);
+         if (error)
+            return error;
+
+         pCache->insert(key, blockHTML);
+         rendered++;
+      }
+
+      // sundown separates top-level blocks with an empty line
+      if (!output.empty() && !blockHTML.empty())
+         output.push_back('\n');
+      output.append(blockHTML);
+   }
+
+   pHTMLOutput->append(output);
+
+   time_duration elapsed = microsec_clock::universal_time() - startTime;
+   pCache->endRender(rendered, reused, elapsed.total_microseconds());
+
+   return Success();
+}
+
 bool isMathJaxRequired(const std::string& htmlOutput)
 {
    return requiresMathjax(htmlOutput);
@@ -14,11 +14,16 @@
  */
 
 #include <core/r_util/RTokenizer.hpp>
+#include <core/r_util/RUtf8Tokenizer.hpp>
 
 #include <iostream>
+#include <algorithm>
 
 #include <boost/assert.hpp>
 #include <boost/foreach.hpp>
+#include <boost/date_time/posix_time/posix_time.hpp>
+
+#include <core/StringUtils.hpp>
 
 namespace core {
 namespace r_util {
@@ -45,6 +50,8 @@ public:
    void verify(wchar_t tokenType, const std::wstring& value)
    {
 
+      verifyUtf8(tokenType, value);
+
       RTokenizer rt(prefix_ + value + suffix_) ;
       RToken t ;
       while ((t = rt.nextToken()))
@@ -72,6 +79,28 @@ public:
          verify(tokenType, value);
    }
 
+private:
+   // the utf8 tokenizer should yield exactly the same tokens
+   void verifyUtf8(wchar_t tokenType, const std::wstring& value)
+   {
+      std::string prefix = string_utils::wideToUtf8(prefix_);
+      std::string utf8Value = string_utils::wideToUtf8(value);
+      RUtf8Tokenizer rt(prefix + utf8Value +
+                        string_utils::wideToUtf8(suffix_));
+      RUtf8Token t ;
+      while ((t = rt.nextToken()))
+      {
+         if (t.offset() == prefix.length())
+         {
+            BOOST_ASSERT(tokenType == t.type());
+            BOOST_ASSERT(utf8Value.length() == t.length());
+            BOOST_ASSERT(utf8Value == t.content());
+            return ;
+         }
+      }
+      BOOST_ASSERT(false);
+   }
+
 private:
    const wchar_t defaultTokenType_ ;
    const std::wstring prefix_ ;
@@ -84,6 +113,9 @@ void testVoid()
 {
    RTokenizer rt(L"") ;
    BOOST_ASSERT(!rt.nextToken());
+
+   RUtf8Tokenizer urt("") ;
+   BOOST_ASSERT(!urt.nextToken());
 }
 
 void testSimple()
@@ -237,6 +269,44 @@ void runTokenizerTests()
    testWhitespace();
 }
 
+// tokenize the passed code repeatedly with both the wide and utf8
+// tokenizers and report throughput (in tokens per second) for each
+void runTokenizerBenchmark(const std::string& code, int iterations)
+{
+   using namespace boost::posix_time;
+
+   std::size_t wideTokens = 0;
+   ptime start = microsec_clock::universal_time();
+   for (int i = 0; i < iterations; i++)
+   {
+      RTokens tokens(string_utils::utf8ToWide(code));
+      wideTokens += tokens.size();
+   }
+   time_duration wideElapsed = microsec_clock::universal_time() - start;
+
+   std::size_t utf8Tokens = 0;
+   start = microsec_clock::universal_time();
+   for (int i = 0; i < iterations; i++)
+   {
+      RUtf8Tokens tokens(code);
+      utf8Tokens += tokens.size();
+   }
+   time_duration utf8Elapsed = microsec_clock::universal_time() - start;
+
+   BOOST_ASSERT(wideTokens == utf8Tokens);
+
+   double wideSecs = std::max(
+         static_cast<double>(wideElapsed.total_microseconds()), 1.0) / 1e6;
+   double utf8Secs = std::max(
+         static_cast<double>(utf8Elapsed.total_microseconds()), 1.0) / 1e6;
+   std::wcout << L"RTokenizer:     "
+              << static_cast<long>(wideTokens / wideSecs) << L" tokens/sec"
+              << std::endl;
+   std::wcout << L"RUtf8Tokenizer: "
+              << static_cast<long>(utf8Tokens / utf8Secs) << L" tokens/sec"
+              << std::endl;
+}
+
 
 } // namespace r_util
 } // namespace core 
@@ -0,0 +1,413 @@
+/*
+ * RUtf8Tokenizer.cpp
+ *
+ * Copyright (C) 2009-12 by RStudio, Inc.
+ *
+ * Unless you have received this program directly from RStudio pursuant
+ * to the terms of a commercial license agreement with RStudio, then
+ * this program is licensed to you under the terms of version 3 of the
+ * GNU Affero General Public License. This program is distributed WITHOUT
+ * ANY EXPRESS OR IMPLIED WARRANTY, INCLUDING THOSE OF NON-INFRINGEMENT,
+ * MERCHANTABILITY OR FITNESS FOR A PARTICULAR PURPOSE. Please refer to the
+ * AGPL (http://www.gnu.org/licenses/agpl-3.0.txt) for more details.
+ *
+ */
+
+#include <core/r_util/RUtf8Tokenizer.hpp>
+
+#include <core/Error.hpp>
+#include <core/Log.hpp>
+#include <core/StringUtils.hpp>
+
+namespace core {
+namespace r_util {
+
+namespace {
+
+const wchar_t kReplacementChar = 0xFFFD;
+
+// decode the UTF-8 character at the specified position. invalid sequences
+// are treated as a single (non-alphanumeric) replacement character so that
+// they are consumed one byte at a time
+wchar_t decodeUtf8(std::string::const_iterator it,
+                   std::string::const_iterator end,
+                   std::size_t* pLength)
+{
+   unsigned char lead = static_cast<unsigned char>(*it);
+
+   *pLength = 1;
+   if (lead < 0x80)
+      return lead;
+
+   std::size_t length;
+   wchar_t ch;
+   if ((lead & 0xE0) == 0xC0)
+   {
+      length = 2;
+      ch = lead & 0x1F;
+   }
+   else if ((lead & 0xF0) == 0xE0)
+   {
+      length = 3;
+      ch = lead & 0x0F;
+   }
+   else if ((lead & 0xF8) == 0xF0)
+   {
+      length = 4;
+      ch = lead & 0x07;
+   }
+   else
+   {
+      return kReplacementChar;
+   }
+
+   if (static_cast<std::size_t>(end - it) < length)
+      return kReplacementChar;
+
+   for (std::size_t i = 1; i < length; i++)
+   {
+      unsigned char cont = static_cast<unsigned char>(*(it + i));
+      if ((cont & 0xC0) != 0x80)
+         return kReplacementChar;
+      ch = (ch << 6) | (cont & 0x3F);
+   }
+
+   *pLength = length;
+   return ch;
+}
+
+inline bool isDigit(char c)
+{
+   return c >= '0' && c <= '9';
+}
+
+inline bool isHexDigit(char c)
+{
+   return isDigit(c) || (c >= 'a' && c <= 'f') || (c >= 'A' && c <= 'F');
+}
+
+// corresponds to the line separators recognized by '$' in the regex
+// used by RTokenizer to match comments
+bool isLineSeparator(wchar_t ch)
+{
+   switch (ch)
+   {
+   case L'\n': case L'\r': case L'\f':
+   case 0x0085: case 0x2028: case 0x2029:
+      return true;
+   default:
+      return false;
+   }
+}
+
+bool isWhitespace(wchar_t ch)
+{
+   switch (ch)
+   {
+   case L' ': case L'\t': case L'\r': case L'\n': case L'\f': case L'\v':
+   case 0x00A0: case 0x1680: case 0x2028: case 0x2029:
+   case 0x202F: case 0x205F: case 0x3000:
+      return true;
+   default:
+      return ch >= 0x2000 && ch <= 0x200A;
+   }
+}
+
+} // anonymous namespace
+
+
+RUtf8Token RUtf8Tokenizer::nextToken()
+{
+  if (eol())
+     return RUtf8Token() ;
+
+  char c = peek() ;
+
+  switch (c)
+  {
+  case '(': case ')':
+  case '{': case '}':
+  case ';': case ',':
+     return consumeToken(c, 1) ;
+  case '[':
+     if (peek(1) == '[')
+        return consumeToken(RToken::LDBRACKET, 2) ;
+     else
+        return consumeToken(c, 1) ;
+  case ']':
+     if (peek(1) == ']')
+        return consumeToken(RToken::RDBRACKET, 2) ;
+     else
+        return consumeToken(c, 1) ;
+  case '"':
+  case '\'':
+     return matchStringLiteral() ;
+  case '`':
+     return matchQuotedIdentifier();
+  case '#':
+     return matchComment();
+  case '%':
+     return matchUserOperator();
+  case ' ': case '\t': case '\r': case '\n':
+     return matchWhitespace() ;
+  }
+
+  std::size_t charLength;
+  wchar_t ch = peekChar(&charLength);
+  if (ch == 0x00A0 || ch == 0x3000)
+     return matchWhitespace();
+
+  if (isDigit(c) || (c == '.' && isDigit(peek(1))))
+  {
+     RUtf8Token numberToken = matchNumber() ;
+     if (numberToken.length() > 0)
+        return numberToken ;
+  }
+
+  if (string_utils::isalnum(ch) || c == '.')
+  {
+     // From Section 10.3.2, identifiers must not start with
+     // a digit, nor may they start with a period followed by
+     // a digit.
+     //
+     // Since we're not checking for either condition, we must
+     // match on identifiers AFTER we have already tried to
+     // match on number.
+     return matchIdentifier() ;
+  }
+
+  RUtf8Token oper = matchOperator() ;
+  if (oper)
+     return oper ;
+
+  // Error!!
+  return consumeToken(RToken::ERR, charLength) ;
+}
+
+RUtf8Token RUtf8Tokenizer::matchWhitespace()
+{
+   std::string::const_iterator it = pos_;
+   std::size_t length;
+   while ((length = whitespaceLength(it)) > 0)
+      it += length;
+
+   return consumeToken(RToken::WHITESPACE, it - pos_);
+}
+
+RUtf8Token RUtf8Tokenizer::matchStringLiteral()
+{
+   std::string::const_iterator start = pos_ ;
+   std::string::const_iterator end = data_.end();
+   char quot = *pos_++ ;
+
+   while (pos_ != end)
+   {
+      // scan to the next quote or escape (all of these are ascii so
+      // we can never land in the middle of a multibyte character)
+      while (pos_ != end && *pos_ != '\\' && *pos_ != '\'' && *pos_ != '"')
+         ++pos_;
+
+      if (pos_ == end)
+         break ;
+
+      char c = *pos_++ ;
+      if (c == quot)
+         break ;
+
+      if (c == '\\')
+      {
+         if (pos_ != end)
+            ++pos_ ;
+      }
+   }
+
+   return RUtf8Token(RToken::STRING,
+                     start,
+                     pos_,
+                     start - data_.begin());
+}
+
+RUtf8Token RUtf8Tokenizer::matchNumber()
+{
+   std::string::const_iterator it = pos_;
+   std::string::const_iterator end = data_.end();
+
+   // hex number: 0x[0-9a-fA-F]*L?
+   if (peek() == '0' && peek(1) == 'x')
+   {
+      it += 2;
+      while (it != end && isHexDigit(*it))
+         ++it;
+      if (it != end && *it == 'L')
+         ++it;
+      return consumeToken(RToken::NUMBER, it - pos_);
+   }
+
+   // decimal number: [0-9]*(\.[0-9]*)?([eE][+-]?[0-9]*)?[Li]?
+   while (it != end && isDigit(*it))
+      ++it;
+
+   if (it != end && *it == '.')
+   {
+      ++it;
+      while (it != end && isDigit(*it))
+         ++it;
+   }
+
+   if (it != end && (*it == 'e' || *it == 'E'))
+   {
+      ++it;
+      if (it != end && (*it == '+' || *it == '-'))
+         ++it;
+      while (it != end && isDigit(*it))
+         ++it;
+   }
+
+   if (it != end && (*it == 'L' || *it == 'i'))
+      ++it;
+
+   return consumeToken(RToken::NUMBER, it - pos_);
+}
+
+RUtf8Token RUtf8Tokenizer::matchIdentifier()
+{
+   std::string::const_iterator start = pos_ ;
+
+   std::size_t length;
+   peekChar(&length);
+   pos_ += length;
+
+   while (!eol())
+   {
+      wchar_t ch = peekChar(&length);
+      if (!string_utils::isalnum(ch) && ch != L'.' && ch != L'_')
+         break;
+      pos_ += length;
+   }
+
+   return RUtf8Token(RToken::ID,
+                     start,
+                     pos_,
+                     start - data_.begin()) ;
+}
+
+RUtf8Token RUtf8Tokenizer::matchQuotedIdentifier()
+{
+   std::size_t endPos = data_.find('`', (pos_ - data_.begin()) + 1);
+   if (endPos == std::string::npos)
+      return consumeToken(RToken::ERR, 1);
+   else
+      return consumeToken(RToken::ID, endPos + 1 - (pos_ - data_.begin()));
+}
+
+RUtf8Token RUtf8Tokenizer::matchComment()
+{
+   std::string::const_iterator it = pos_;
+   std::string::const_iterator end = data_.end();
+   while (it != end)
+   {
+      std::size_t length;
+      wchar_t ch = decodeUtf8(it, end, &length);
+      if (isLineSeparator(ch))
+         break;
+      it += length;
+   }
+
+   return consumeToken(RToken::COMMENT, it - pos_);
+}
+
+RUtf8Token RUtf8Tokenizer::matchUserOperator()
+{
+   std::size_t endPos = data_.find('%', (pos_ - data_.begin()) + 1);
+   if (endPos == std::string::npos)
+      return consumeToken(RToken::ERR, 1) ;
+   else
+      return consumeToken(RToken::UOPER, endPos + 1 - (pos_ - data_.begin()));
+}
+
+RUtf8Token RUtf8Tokenizer::matchOperator()
+{
+   char cNext = peek(1) ;
+
+   switch (peek())
+   {
+   case '+': case '*': case '/':
+   case '^': case '&': case '|':
+   case '~': case '$': case ':':
+      // single-character operators
+      return consumeToken(RToken::OPER, 1) ;
+   case '-': // also ->
+      return consumeToken(RToken::OPER, cNext == '>' ? 2 : 1) ;
+   case '>': // also >=
+      return consumeToken(RToken::OPER, cNext == '=' ? 2 : 1) ;
+   case '<': // also <- and <=
+      return consumeToken(RToken::OPER, cNext == '=' ? 2 :
+                                        cNext == '-' ? 2 :
+                                        1) ;
+   case '=': // also ==
+      return consumeToken(RToken::OPER, cNext == '=' ? 2 : 1) ;
+   case '!': // also !=
+      return consumeToken(RToken::OPER, cNext == '=' ? 2 : 1) ;
+   default:
+      return RUtf8Token() ;
+   }
+}
+
+bool RUtf8Tokenizer::eol() const
+{
+   return pos_ >= data_.end();
+}
+
+char RUtf8Tokenizer::peek(std::size_t lookahead) const
+{
+   if (static_cast<std::size_t>(data_.end() - pos_) <= lookahead)
+      return 0 ;
+   else
+      return *(pos_ + lookahead) ;
+}
+
+wchar_t RUtf8Tokenizer::peekChar(std::size_t* pLength) const
+{
+   if (eol())
+   {
+      *pLength = 0;
+      return 0;
+   }
+
+   return decodeUtf8(pos_, data_.end(), pLength);
+}
+
+std::size_t RUtf8Tokenizer::whitespaceLength(
+                                    std::string::const_iterator it) const
+{
+   if (it == data_.end())
+      return 0;
+
+   std::size_t length;
+   wchar_t ch = decodeUtf8(it, data_.end(), &length);
+   return isWhitespace(ch) ? length : 0;
+}
+
+RUtf8Token RUtf8Tokenizer::consumeToken(wchar_t tokenType, std::size_t length)
+{
+   if (length == 0)
+   {
+      LOG_WARNING_MESSAGE("Can't create zero-length token");
+      return RUtf8Token();
+   }
+   else if (static_cast<std::size_t>(data_.end() - pos_) < length)
+   {
+      LOG_WARNING_MESSAGE("Premature EOF");
+      return RUtf8Token();
+   }
+
+   std::string::const_iterator start = pos_ ;
+   pos_ += length ;
+   return RUtf8Token(tokenType,
+                     start,
+                     pos_,
+                     start - data_.begin()) ;
+}
+
+} // namespace r_util
+} // namespace core
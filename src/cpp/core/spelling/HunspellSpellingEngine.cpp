@@ -15,10 +15,14 @@
 
 #include <core/spelling/HunspellSpellingEngine.hpp>
 
+#include <list>
+#include <map>
+
 #include <boost/foreach.hpp>
 #include <boost/algorithm/string.hpp>
 
 #include <core/Error.hpp>
+#include <core/Thread.hpp>
 #include <core/FilePath.hpp>
 #include <core/StringUtils.hpp>
 #include <core/FileSerializer.hpp>
@@ -106,11 +110,74 @@ std::string exampleWordForEnglishAffix(const std::string& affix)
       return std::string();
 }
 
+// least recently used cache of spelling results. words are checked
+// over and over again as the user edits a document so caching these
+// avoids redundant encoding conversions and hunspell lookups
+class SpellingCache : boost::noncopyable
+{
+public:
+   explicit SpellingCache(std::size_t capacity)
+      : capacity_(capacity)
+   {
+   }
+
+   bool lookup(const std::string& word, bool* pCorrect)
+   {
+      Index::iterator it = index_.find(word);
+      if (it == index_.end())
+         return false;
+
+      // move to the front of the recently used list
+      entries_.splice(entries_.begin(), entries_, it->second);
+      *pCorrect = it->second->second;
+      return true;
+   }
+
+   void insert(const std::string& word, bool correct)
+   {
+      Index::iterator it = index_.find(word);
+      if (it != index_.end())
+      {
+         it->second->second = correct;
+         entries_.splice(entries_.begin(), entries_, it->second);
+         return;
+      }
+
+      entries_.push_front(std::make_pair(word, correct));
+      index_[word] = entries_.begin();
+
+      // evict the least recently used entry if we are over capacity
+      if (index_.size() > capacity_)
+      {
+         index_.erase(entries_.back().first);
+         entries_.pop_back();
+      }
+   }
+
+   void clear()
+   {
+      index_.clear();
+      entries_.clear();
+   }
+
+private:
+   typedef std::list<std::pair<std::string,bool> > Entries;
+   typedef std::map<std::string,Entries::iterator> Index;
+   const std::size_t capacity_;
+   Entries entries_;
+   Index index_;
+};
+
+// maximum number of words to keep in the spelling cache
+const std::size_t kSpellingCacheCapacity = 20000;
+
 class SpellChecker : boost::noncopyable
 {
 public:
    virtual ~SpellChecker() {}
    virtual Error checkSpelling(const std::string& word, bool *pCorrect) = 0;
+   virtual Error checkSpelling(const std::vector<std::string>& words,
+                               std::vector<bool>* pCorrect) = 0;
    virtual Error suggestionList(const std::string& word,
                                 std::vector<std::string>* pSugs) = 0;
    virtual Error wordChars(std::wstring* pWordChars) = 0;
@@ -125,6 +192,13 @@ public:
       return Success();
    }
 
+   Error checkSpelling(const std::vector<std::string>& words,
+                       std::vector<bool>* pCorrect)
+   {
+      pCorrect->assign(words.size(), true);
+      return Success();
+   }
+
    Error suggestionList(const std::string& word,
                         std::vector<std::string>* pSugs)
    {
@@ -141,6 +215,7 @@ class HunspellSpellChecker : public SpellChecker
 {
 public:
    HunspellSpellChecker()
+      : encodingIsUtf8_(false), cache_(kSpellingCacheCapacity)
    {
    }
 
@@ -175,6 +250,7 @@ public:
                                     systemDicPath.c_str()));
       iconvstrFunc_ = iconvstrFunc;
       encoding_ = pHunspell_->get_dic_encoding();
+      encodingIsUtf8_ = boost::algorithm::iequals(encoding_, "UTF-8");
 
       // add words from dic_delta if available
       FilePath dicPath = dictionary.dicPath();
@@ -269,12 +345,89 @@ private:
 public:
    Error checkSpelling(const std::string& word, bool *pCorrect)
    {
+      if (cache_.lookup(word, pCorrect))
+         return Success();
+
       std::string encoded;
-      Error error = iconvstrFunc_(word,"UTF-8",encoding_,false,&encoded);
+      Error error = encode(word, &encoded);
       if (error)
          return error;
 
       *pCorrect = pHunspell_->spell(encoded.c_str());
+      cache_.insert(word, *pCorrect);
+      return Success();
+   }
+
+   Error checkSpelling(const std::vector<std::string>& words,
+                       std::vector<bool>* pCorrect)
+   {
+      pCorrect->assign(words.size(), true);
+
+      // resolve what we can from the cache and collect the rest. the
+      // remaining words are joined with newlines so that they can be
+      // converted to the dictionary encoding with a single iconv call
+      // (all of the hunspell dictionary encodings are ascii compatible)
+      std::vector<std::size_t> pending;
+      std::string joined;
+      bool canJoin = true;
+      for (std::size_t i = 0; i < words.size(); i++)
+      {
+         bool correct;
+         if (cache_.lookup(words[i], &correct))
+         {
+            (*pCorrect)[i] = correct;
+         }
+         else
+         {
+            if (!pending.empty())
+               joined.push_back('\n');
+            joined.append(words[i]);
+            if (words[i].find('\n') != std::string::npos)
+               canJoin = false;
+            pending.push_back(i);
+         }
+      }
+
+      if (pending.empty())
+         return Success();
+
+      // convert the batch (fall back to converting word by word if the
+      // batch can't be converted as a whole)
+      std::vector<std::string> encoded;
+      if (canJoin)
+      {
+         std::string encodedJoined;
+         Error error = encode(joined, &encodedJoined);
+         if (!error)
+         {
+            boost::algorithm::split(encoded,
+                                    encodedJoined,
+                                    boost::algorithm::is_any_of("\n"));
+         }
+      }
+
+      if (encoded.size() != pending.size())
+      {
+         encoded.clear();
+         BOOST_FOREACH(std::size_t i, pending)
+         {
+            std::string encodedWord;
+            Error error = encode(words[i], &encodedWord);
+            if (error)
+               return error;
+            encoded.push_back(encodedWord);
+         }
+      }
+
+      // check spelling and remember the results
+      for (std::size_t i = 0; i < pending.size(); i++)
+      {
+         const std::string& word = words[pending[i]];
+         bool correct = pHunspell_->spell(encoded[i].c_str());
+         (*pCorrect)[pending[i]] = correct;
+         cache_.insert(word, correct);
+      }
+
       return Success();
    }
 
@@ -310,6 +463,7 @@ public:
       // it seems the return value is always 0, meaning there's really no
       // error ever thrown if the method fails.
       *pAdded = (pHunspell_->add(encoded.c_str()) == 0);
+      cache_.clear();
       return Success();
    }
 
@@ -337,6 +491,7 @@ public:
 
       *pAdded = (pHunspell_->add_with_affix(wordEncoded.c_str(),
                                             exampleEncoded.c_str()) == 0);
+      cache_.clear();
       return Success();
    }
 
@@ -360,13 +515,29 @@ public:
       // Convert path to system encoding before sending to external api
       std::string systemDicPath = string_utils::utf8ToSystem(dicPath.absolutePath());
       *pAdded = (pHunspell_->add_dic(systemDicPath.c_str(),key.c_str()) == 0);
+      cache_.clear();
       return Success();
    }
 
+private:
+   Error encode(const std::string& word, std::string* pEncoded)
+   {
+      // no conversion required for utf-8 dictionaries
+      if (encodingIsUtf8_)
+      {
+         *pEncoded = word;
+         return Success();
+      }
+
+      return iconvstrFunc_(word,"UTF-8",encoding_,false,pEncoded);
+   }
+
 private:
    boost::scoped_ptr<Hunspell> pHunspell_;
    IconvstrFunction iconvstrFunc_;
    std::string encoding_;
+   bool encodingIsUtf8_;
+   SpellingCache cache_;
 };
 
 } // anonymous namespace
@@ -382,6 +553,8 @@ struct HunspellSpellingEngine::Impl
    {
    }
 
+   boost::mutex& mutex() { return mutex_; }
+
    void useDictionary(const std::string& langId)
    {
       if (dictionaryContextChanged(langId))
@@ -448,6 +621,7 @@ private:
    HunspellDictionaryManager dictManager_;
    IconvstrFunction iconvstrFunction_;
    boost::shared_ptr<SpellChecker> pSpellChecker_;
+   boost::mutex mutex_;
 };
 
 
@@ -462,24 +636,60 @@ HunspellSpellingEngine::HunspellSpellingEngine(
 
 void HunspellSpellingEngine::useDictionary(const std::string& langId)
 {
-   pImpl_->useDictionary(langId);
+   LOCK_MUTEX(pImpl_->mutex())
+   {
+      pImpl_->useDictionary(langId);
+   }
+   END_LOCK_MUTEX
 }
 
 Error HunspellSpellingEngine::checkSpelling(const std::string& word,
                                             bool *pCorrect)
 {
-   return pImpl_->spellChecker().checkSpelling(word, pCorrect);
+   LOCK_MUTEX(pImpl_->mutex())
+   {
+      return pImpl_->spellChecker().checkSpelling(word, pCorrect);
+   }
+   END_LOCK_MUTEX
+
+   *pCorrect = true;
+   return Success();
+}
+
+Error HunspellSpellingEngine::checkSpelling(const std::vector<std::string>& words,
+                                            std::vector<bool>* pCorrect)
+{
+   LOCK_MUTEX(pImpl_->mutex())
+   {
+      return pImpl_->spellChecker().checkSpelling(words, pCorrect);
+   }
+   END_LOCK_MUTEX
+
+   pCorrect->assign(words.size(), true);
+   return Success();
 }
 
 Error HunspellSpellingEngine::suggestionList(const std::string& word,
                                              std::vector<std::string>* pSugs)
 {
-   return pImpl_->spellChecker().suggestionList(word, pSugs);
+   LOCK_MUTEX(pImpl_->mutex())
+   {
+      return pImpl_->spellChecker().suggestionList(word, pSugs);
+   }
+   END_LOCK_MUTEX
+
+   return Success();
 }
 
 Error HunspellSpellingEngine::wordChars(std::wstring *pChars)
 {
-   return pImpl_->spellChecker().wordChars(pChars);
+   LOCK_MUTEX(pImpl_->mutex())
+   {
+      return pImpl_->spellChecker().wordChars(pChars);
+   }
+   END_LOCK_MUTEX
+
+   return Success();
 }
 
 } // namespace spelling
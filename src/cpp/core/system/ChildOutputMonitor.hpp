@@ -0,0 +1,125 @@
+/*
+ * ChildOutputMonitor.hpp
+ *
+ * Copyright (C) 2009-12 by RStudio, Inc.
+ *
+ * Unless you have received this program directly from RStudio pursuant
+ * to the terms of a commercial license agreement with RStudio, then
+ * this program is licensed to you under the terms of version 3 of the
+ * GNU Affero General Public License. This program is distributed WITHOUT
+ * ANY EXPRESS OR IMPLIED WARRANTY, INCLUDING THOSE OF NON-INFRINGEMENT,
+ * MERCHANTABILITY OR FITNESS FOR A PARTICULAR PURPOSE. Please refer to the
+ * AGPL (http://www.gnu.org/licenses/agpl-3.0.txt) for more details.
+ *
+ */
+
+#ifndef CORE_SYSTEM_CHILD_OUTPUT_MONITOR_HPP
+#define CORE_SYSTEM_CHILD_OUTPUT_MONITOR_HPP
+
+#include <sys/types.h>
+
+#include <string>
+#include <vector>
+
+#include <boost/utility.hpp>
+#include <boost/shared_ptr.hpp>
+#include <boost/date_time/posix_time/posix_time_duration.hpp>
+
+#include <core/Error.hpp>
+#include <core/BoostThread.hpp>
+
+// The child output monitor reads the output of async child processes on a
+// dedicated thread (using epoll) as soon as it becomes available, and also
+// watches for process exit (using pidfds where the kernel supports them).
+// Output is buffered in a ChildOutputChannel and handed back to the thread
+// which owns the child whenever it calls AsyncChildProcess::poll, so polling
+// no longer requires any system calls for children which are idle.
+
+namespace core {
+namespace system {
+namespace child_output_monitor {
+
+// Output and exit state accumulated for a child since the last call to take
+struct ChildOutput
+{
+   ChildOutput()
+      : stdoutEOF(false), stderrEOF(false), exited(false)
+   {
+   }
+
+   std::string stdOut;
+   std::string stdErr;
+   bool stdoutEOF;
+   bool stderrEOF;
+   bool exited;
+   Error error;
+};
+
+// Channel between the monitor thread (which writes to it) and the thread
+// which owns the child (which takes buffered output from it)
+class ChildOutputChannel : boost::noncopyable
+{
+public:
+   ChildOutputChannel()
+      : throttled_(false), watchingExit_(false), activity_(false)
+   {
+   }
+
+   // COPYING: boost::noncopyable
+
+public:
+   // take all output accumulated since the last call (returns true if
+   // the monitor stopped reading because the buffer was full, in which
+   // case the caller should call resume once the output is consumed)
+   bool take(ChildOutput* pOutput);
+
+   // is exit being reported by the monitor (if not then the owner
+   // needs to check for exit on its own)
+   bool watchingExit();
+
+private:
+   friend class ChildOutputMonitor;
+
+   std::size_t bufferedBytes() const
+   {
+      return output_.stdOut.size() + output_.stdErr.size();
+   }
+
+   boost::mutex mutex_;
+   ChildOutput output_;
+   bool throttled_;
+   bool watchingExit_;
+
+   // set when output or exit is reported (cleared by take)
+   bool activity_;
+};
+
+// is the monitor available on this system
+bool isAvailable();
+
+// start monitoring the output streams (and exit) of the specified child.
+// the stdout/stderr descriptors must already be in non-blocking mode
+// (either may be -1 if the stream isn't available)
+Error registerChild(pid_t pid,
+                    int fdStdout,
+                    int fdStderr,
+                    boost::shared_ptr<ChildOutputChannel> pChannel);
+
+// resume reading output for a channel which was throttled
+void resume(boost::shared_ptr<ChildOutputChannel> pChannel);
+
+// stop monitoring a child. once this returns the monitor thread no longer
+// reads from the child's file descriptors (so they can be closed)
+void unregisterChild(boost::shared_ptr<ChildOutputChannel> pChannel);
+
+// wait (up to maxWait) for output or exit to be reported for any of the
+// specified channels
+void waitForActivity(
+         const std::vector<boost::shared_ptr<ChildOutputChannel> >& channels,
+         const boost::posix_time::time_duration& maxWait);
+
+} // namespace child_output_monitor
+} // namespace system
+} // namespace core
+
+#endif // CORE_SYSTEM_CHILD_OUTPUT_MONITOR_HPP
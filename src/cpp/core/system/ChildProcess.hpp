@@ -65,6 +65,10 @@ protected:
 
    const ProcessOptions& options() const { return options_; }
 
+private:
+   // launch using posix_spawn (not available on all platforms)
+   Error spawn();
+
 protected:
    // platform specific impl
    struct Impl;
@@ -221,6 +225,17 @@ private:
       reportError(error);
    }
 
+private:
+   friend void waitForChildActivity(
+         const std::vector<boost::shared_ptr<AsyncChildProcess> >& children,
+         const boost::posix_time::time_duration& maxWait);
+
+   // read output directly from our pipes
+   void readOutput();
+
+   // take output which was read by the child output monitor
+   void takeMonitoredOutput();
+
 private:
    // callbacks
    ProcessCallbacks callbacks_;
@@ -230,6 +245,12 @@ private:
    boost::scoped_ptr<AsyncImpl> pAsyncImpl_;
 };
 
+// Wait (up to maxWait) for output or exit to be available from any of the
+// specified children (sleeps for maxWait if this can't be detected)
+void waitForChildActivity(
+         const std::vector<boost::shared_ptr<AsyncChildProcess> >& children,
+         const boost::posix_time::time_duration& maxWait);
+
 } // namespace system
 } // namespace core
 
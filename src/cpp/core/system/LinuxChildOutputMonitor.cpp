@@ -0,0 +1,604 @@
+/*
+ * LinuxChildOutputMonitor.cpp
+ *
+ * Copyright (C) 2009-12 by RStudio, Inc.
+ *
+ * Unless you have received this program directly from RStudio pursuant
+ * to the terms of a commercial license agreement with RStudio, then
+ * this program is licensed to you under the terms of version 3 of the
+ * GNU Affero General Public License. This program is distributed WITHOUT
+ * ANY EXPRESS OR IMPLIED WARRANTY, INCLUDING THOSE OF NON-INFRINGEMENT,
+ * MERCHANTABILITY OR FITNESS FOR A PARTICULAR PURPOSE. Please refer to the
+ * AGPL (http://www.gnu.org/licenses/agpl-3.0.txt) for more details.
+ *
+ */
+
+#include "ChildOutputMonitor.hpp"
+
+#include <errno.h>
+#include <unistd.h>
+#include <sys/epoll.h>
+#include <sys/syscall.h>
+
+#include <map>
+#include <vector>
+
+#include <boost/bind.hpp>
+
+#include <core/Log.hpp>
+#include <core/Thread.hpp>
+#include <core/system/System.hpp>
+
+// pidfd_open was added in linux 5.3 and may not be in our headers
+#ifndef SYS_pidfd_open
+#define SYS_pidfd_open 434
+#endif
+
+namespace core {
+namespace system {
+namespace child_output_monitor {
+
+namespace {
+
+// stop reading from a child once this much of its output is buffered
+// (reading resumes once the owner has taken the output)
+const std::size_t kMaxBufferedBytes = 4 * 1024 * 1024;
+
+// size of the buffer used for each read
+const std::size_t kReadBufferSize = 64 * 1024;
+
+enum StreamType
+{
+   StreamStdout,
+   StreamStderr,
+   StreamExit
+};
+
+struct Watch
+{
+   Watch()
+      : type(StreamStdout), paused(false)
+   {
+   }
+
+   Watch(const boost::shared_ptr<ChildOutputChannel>& pChannel,
+         StreamType type)
+      : pChannel(pChannel), type(type), paused(false)
+   {
+   }
+
+   boost::shared_ptr<ChildOutputChannel> pChannel;
+   StreamType type;
+
+   // paused watches are removed from the epoll set (rather than having
+   // their events cleared) since epoll always reports hangups and errors
+   bool paused;
+};
+
+struct Registration
+{
+   Registration()
+      : fdStdout(-1), fdStderr(-1), fdExit(-1)
+   {
+   }
+
+   int fdStdout;
+   int fdStderr;
+   int fdExit;
+};
+
+} // anonymous namespace
+
+class ChildOutputMonitor : boost::noncopyable
+{
+public:
+   static ChildOutputMonitor& instance()
+   {
+      static ChildOutputMonitor* pInstance = new ChildOutputMonitor();
+      return *pInstance;
+   }
+
+private:
+   ChildOutputMonitor()
+      : epollFd_(-1), started_(false), readBuffer_(kReadBufferSize)
+   {
+   }
+
+public:
+   bool start()
+   {
+      LOCK_MUTEX(mutex_)
+      {
+         if (started_)
+            return epollFd_ != -1;
+         started_ = true;
+
+         epollFd_ = ::epoll_create1(EPOLL_CLOEXEC);
+         if (epollFd_ == -1)
+         {
+            LOG_ERROR(systemError(errno, ERROR_LOCATION));
+            return false;
+         }
+      }
+      END_LOCK_MUTEX
+
+      core::thread::safeLaunchThread(
+               boost::bind(&ChildOutputMonitor::monitorThreadMain, this));
+      return true;
+   }
+
+   Error registerChild(pid_t pid,
+                       int fdStdout,
+                       int fdStderr,
+                       boost::shared_ptr<ChildOutputChannel> pChannel)
+   {
+      if (!start())
+         return systemError(boost::system::errc::not_supported,
+                            ERROR_LOCATION);
+
+      // watch for exit using a pidfd if the kernel supports them (if it
+      // doesn't then the owner continues to check for exit using waitpid)
+      int fdExit = ::syscall(SYS_pidfd_open, pid, 0);
+
+      LOCK_MUTEX(mutex_)
+      {
+         Registration registration;
+         Error error = addWatch(fdStdout, pChannel, StreamStdout);
+         if (!error)
+         {
+            registration.fdStdout = fdStdout;
+            error = addWatch(fdStderr, pChannel, StreamStderr);
+         }
+         if (!error)
+            registration.fdStderr = fdStderr;
+
+         if (error)
+         {
+            removeWatches(registration);
+            if (fdExit != -1)
+               ::close(fdExit);
+            return error;
+         }
+
+         if (fdExit != -1)
+         {
+            Error exitError = addWatch(fdExit, pChannel, StreamExit);
+            if (!exitError)
+            {
+               registration.fdExit = fdExit;
+
+               LOCK_MUTEX(pChannel->mutex_)
+               {
+                  pChannel->watchingExit_ = true;
+               }
+               END_LOCK_MUTEX
+            }
+            else
+            {
+               LOG_ERROR(exitError);
+               ::close(fdExit);
+            }
+         }
+
+         registrations_[pChannel.get()] = registration;
+      }
+      END_LOCK_MUTEX
+
+      return Success();
+   }
+
+   void resume(boost::shared_ptr<ChildOutputChannel> pChannel)
+   {
+      LOCK_MUTEX(mutex_)
+      {
+         std::map<ChildOutputChannel*,Registration>::const_iterator it =
+                                       registrations_.find(pChannel.get());
+         if (it == registrations_.end())
+            return;
+
+         resumeWatch(it->second.fdStdout);
+         resumeWatch(it->second.fdStderr);
+      }
+      END_LOCK_MUTEX
+   }
+
+   void unregisterChild(boost::shared_ptr<ChildOutputChannel> pChannel)
+   {
+      LOCK_MUTEX(mutex_)
+      {
+         std::map<ChildOutputChannel*,Registration>::iterator it =
+                                       registrations_.find(pChannel.get());
+         if (it == registrations_.end())
+            return;
+
+         removeWatches(it->second);
+         registrations_.erase(it);
+      }
+      END_LOCK_MUTEX
+   }
+
+   void waitForActivity(
+         const std::vector<boost::shared_ptr<ChildOutputChannel> >& channels,
+         const boost::posix_time::time_duration& maxWait)
+   {
+      try
+      {
+         // activity is tracked per channel so that threads waiting on
+         // different children don't consume each other's notifications
+         boost::system_time timeoutTime = boost::get_system_time() + maxWait;
+         boost::unique_lock<boost::mutex> lock(activityMutex_);
+         while (!hasActivity(channels))
+         {
+            if (!activityCondition_.timed_wait(lock, timeoutTime))
+               break;
+         }
+      }
+      catch(const boost::thread_resource_error& e)
+      {
+         Error waitError(boost::thread_error::ec_from_exception(e),
+                         ERROR_LOCATION);
+         LOG_ERROR(waitError);
+      }
+   }
+
+private:
+
+   static bool hasActivity(
+         const std::vector<boost::shared_ptr<ChildOutputChannel> >& channels)
+   {
+      std::vector<boost::shared_ptr<ChildOutputChannel> >::const_iterator it;
+      for (it = channels.begin(); it != channels.end(); ++it)
+      {
+         LOCK_MUTEX((*it)->mutex_)
+         {
+            if ((*it)->activity_)
+               return true;
+         }
+         END_LOCK_MUTEX
+      }
+
+      return false;
+   }
+
+   void monitorThreadMain()
+   {
+      std::vector<struct epoll_event> events(64);
+      while (true)
+      {
+         int count = ::epoll_wait(epollFd_, &events[0], events.size(), -1);
+         if (count == -1)
+         {
+            if (errno == EINTR)
+               continue;
+
+            LOG_ERROR(systemError(errno, ERROR_LOCATION));
+            return;
+         }
+
+         bool activity = false;
+         LOCK_MUTEX(mutex_)
+         {
+            for (int i = 0; i < count; i++)
+            {
+               // the fd may have been unregistered since epoll_wait returned
+               int fd = events[i].data.fd;
+               std::map<int,Watch>::iterator it = watches_.find(fd);
+               if (it == watches_.end())
+                  continue;
+
+               // copy the watch since processing may remove it
+               Watch watch = it->second;
+               if (watch.type == StreamExit)
+                  activity |= processExit(fd, watch);
+               else
+                  activity |= processOutput(fd, watch);
+            }
+         }
+         END_LOCK_MUTEX
+
+         if (activity)
+            notifyActivity();
+      }
+   }
+
+   bool processExit(int fd, const Watch& watch)
+   {
+      LOCK_MUTEX(watch.pChannel->mutex_)
+      {
+         watch.pChannel->output_.exited = true;
+         watch.pChannel->activity_ = true;
+      }
+      END_LOCK_MUTEX
+
+      // exit is only reported once, so we're done with the pidfd
+      removeWatch(fd);
+      ::close(fd);
+      std::map<ChildOutputChannel*,Registration>::iterator it =
+                                    registrations_.find(watch.pChannel.get());
+      if (it != registrations_.end())
+         it->second.fdExit = -1;
+
+      return true;
+   }
+
+   bool processOutput(int fd, const Watch& watch)
+   {
+      ChildOutputChannel& channel = *watch.pChannel;
+
+      std::string output;
+      bool eof = false;
+      Error error;
+
+      // stop reading if the owner isn't keeping up
+      std::size_t buffered = 0;
+      LOCK_MUTEX(channel.mutex_)
+      {
+         buffered = channel.bufferedBytes();
+         if (buffered >= kMaxBufferedBytes)
+         {
+            channel.throttled_ = true;
+            channel.activity_ = true;
+         }
+      }
+      END_LOCK_MUTEX
+
+      if (buffered >= kMaxBufferedBytes)
+      {
+         pauseWatch(fd);
+         return true;
+      }
+
+      while (buffered + output.size() < kMaxBufferedBytes)
+      {
+         ssize_t bytesRead = posixCall<ssize_t>(
+                  boost::bind(::read, fd, &readBuffer_[0], readBuffer_.size()));
+         if (bytesRead > 0)
+         {
+            output.append(&readBuffer_[0], bytesRead);
+         }
+         else if (bytesRead == 0)
+         {
+            eof = true;
+            break;
+         }
+         else if (errno == EAGAIN)
+         {
+            break;
+         }
+         // on linux slave terminals return EIO rather than bytesRead == 0
+         // to indicate end of file
+         else if ((errno == EIO) && ::isatty(fd))
+         {
+            eof = true;
+            break;
+         }
+         else
+         {
+            error = systemError(errno, ERROR_LOCATION);
+            break;
+         }
+      }
+
+      // stop watching streams which are finished (the owner closes them)
+      if (eof || error)
+      {
+         removeWatch(fd);
+         std::map<ChildOutputChannel*,Registration>::iterator it =
+                                    registrations_.find(watch.pChannel.get());
+         if (it != registrations_.end())
+         {
+            if (it->second.fdStdout == fd)
+               it->second.fdStdout = -1;
+            if (it->second.fdStderr == fd)
+               it->second.fdStderr = -1;
+         }
+      }
+
+      if (output.empty() && !eof && !error)
+         return false;
+
+      LOCK_MUTEX(channel.mutex_)
+      {
+         if (watch.type == StreamStdout)
+         {
+            channel.output_.stdOut.append(output);
+            if (eof)
+               channel.output_.stdoutEOF = true;
+         }
+         else
+         {
+            channel.output_.stdErr.append(output);
+            if (eof)
+               channel.output_.stderrEOF = true;
+         }
+
+         if (error)
+            channel.output_.error = error;
+
+         channel.activity_ = true;
+      }
+      END_LOCK_MUTEX
+
+      return true;
+   }
+
+   void notifyActivity()
+   {
+      // taking the mutex ensures that a waiter which found no activity is
+      // already waiting (and so receives the notification)
+      LOCK_MUTEX(activityMutex_)
+      {
+      }
+      END_LOCK_MUTEX
+
+      activityCondition_.notify_all();
+   }
+
+   Error addWatch(int fd,
+                  const boost::shared_ptr<ChildOutputChannel>& pChannel,
+                  StreamType type)
+   {
+      if (fd == -1)
+         return Success();
+
+      struct epoll_event event;
+      event.events = EPOLLIN;
+      event.data.u64 = 0;
+      event.data.fd = fd;
+      if (::epoll_ctl(epollFd_, EPOLL_CTL_ADD, fd, &event) == -1)
+         return systemError(errno, ERROR_LOCATION);
+
+      watches_[fd] = Watch(pChannel, type);
+      return Success();
+   }
+
+   void pauseWatch(int fd)
+   {
+      std::map<int,Watch>::iterator it = watches_.find(fd);
+      if (it == watches_.end() || it->second.paused)
+         return;
+
+      if (::epoll_ctl(epollFd_, EPOLL_CTL_DEL, fd, NULL) == -1)
+         LOG_ERROR(systemError(errno, ERROR_LOCATION));
+      else
+         it->second.paused = true;
+   }
+
+   void resumeWatch(int fd)
+   {
+      if (fd == -1)
+         return;
+
+      std::map<int,Watch>::iterator it = watches_.find(fd);
+      if (it == watches_.end() || !it->second.paused)
+         return;
+
+      // if the child hung up while we were paused then epoll reports it as
+      // soon as the fd is added back, and we read the remaining output and
+      // end of file as usual
+      struct epoll_event event;
+      event.events = EPOLLIN;
+      event.data.u64 = 0;
+      event.data.fd = fd;
+      if (::epoll_ctl(epollFd_, EPOLL_CTL_ADD, fd, &event) == -1)
+         LOG_ERROR(systemError(errno, ERROR_LOCATION));
+      else
+         it->second.paused = false;
+   }
+
+   void removeWatch(int fd)
+   {
+      if (fd == -1)
+         return;
+
+      std::map<int,Watch>::iterator it = watches_.find(fd);
+      if (it == watches_.end())
+         return;
+
+      bool paused = it->second.paused;
+      watches_.erase(it);
+      if (!paused && ::epoll_ctl(epollFd_, EPOLL_CTL_DEL, fd, NULL) == -1)
+         LOG_ERROR(systemError(errno, ERROR_LOCATION));
+   }
+
+   void removeWatches(const Registration& registration)
+   {
+      removeWatch(registration.fdStdout);
+      removeWatch(registration.fdStderr);
+      if (registration.fdExit != -1)
+      {
+         removeWatch(registration.fdExit);
+         ::close(registration.fdExit);
+      }
+   }
+
+private:
+   // protects everything below (held by the monitor thread while it
+   // processes events so that unregistration is synchronous)
+   boost::mutex mutex_;
+   int epollFd_;
+   bool started_;
+   std::map<int,Watch> watches_;
+   std::map<ChildOutputChannel*,Registration> registrations_;
+
+   // signals activity to threads waiting for it
+   boost::mutex activityMutex_;
+   boost::condition activityCondition_;
+
+   // only used on the monitor thread
+   std::vector<char> readBuffer_;
+};
+
+bool ChildOutputChannel::take(ChildOutput* pOutput)
+{
+   LOCK_MUTEX(mutex_)
+   {
+      pOutput->stdOut.swap(output_.stdOut);
+      pOutput->stdErr.swap(output_.stdErr);
+      output_.stdOut.clear();
+      output_.stdErr.clear();
+      pOutput->stdoutEOF = output_.stdoutEOF;
+      pOutput->stderrEOF = output_.stderrEOF;
+      pOutput->exited = output_.exited;
+      pOutput->error = output_.error;
+      output_.error = Success();
+      activity_ = false;
+
+      bool throttled = throttled_;
+      throttled_ = false;
+      return throttled;
+   }
+   END_LOCK_MUTEX
+
+   // keep compiler happy
+   return false;
+}
+
+bool ChildOutputChannel::watchingExit()
+{
+   LOCK_MUTEX(mutex_)
+   {
+      return watchingExit_;
+   }
+   END_LOCK_MUTEX
+
+   // keep compiler happy
+   return false;
+}
+
+bool isAvailable()
+{
+   return ChildOutputMonitor::instance().start();
+}
+
+Error registerChild(pid_t pid,
+                    int fdStdout,
+                    int fdStderr,
+                    boost::shared_ptr<ChildOutputChannel> pChannel)
+{
+   return ChildOutputMonitor::instance().registerChild(pid,
+                                                       fdStdout,
+                                                       fdStderr,
+                                                       pChannel);
+}
+
+void resume(boost::shared_ptr<ChildOutputChannel> pChannel)
+{
+   ChildOutputMonitor::instance().resume(pChannel);
+}
+
+void unregisterChild(boost::shared_ptr<ChildOutputChannel> pChannel)
+{
+   ChildOutputMonitor::instance().unregisterChild(pChannel);
+}
+
+void waitForActivity(
+         const std::vector<boost::shared_ptr<ChildOutputChannel> >& channels,
+         const boost::posix_time::time_duration& maxWait)
+{
+   ChildOutputMonitor::instance().waitForActivity(channels, maxWait);
+}
+
+} // namespace child_output_monitor
+} // namespace system
+} // namespace core
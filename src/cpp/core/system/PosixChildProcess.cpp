@@ -31,10 +31,21 @@
 #include <sys/wait.h>
 #include <sys/types.h>
 
+// posix_spawn can be used in place of fork + exec when the C library can
+// close inherited descriptors, change directories, and create a new session
+// via spawn file actions and attributes (glibc 2.34 and later)
+#if defined(__GLIBC__) && \
+    (__GLIBC__ > 2 || (__GLIBC__ == 2 && __GLIBC_MINOR__ >= 34))
+#define HAVE_POSIX_SPAWN_CLOSEFROM
+#include <spawn.h>
+extern char** environ;
+#endif
+
 #include <boost/bind.hpp>
 
 #include <core/Error.hpp>
 #include <core/Log.hpp>
+#include <core/BoostThread.hpp>
 #include <core/system/System.hpp>
 #include <core/system/ProcessArgs.hpp>
 #include <core/system/ShellUtils.hpp>
@@ -43,6 +54,10 @@
 
 #include "ChildProcess.hpp"
 
+#ifdef __linux__
+#include "ChildOutputMonitor.hpp"
+#endif
+
 namespace core {
 namespace system {
 
@@ -65,6 +80,19 @@ void setPipeNonBlocking(int pipeFd)
      ::fcntl(pipeFd, F_SETFL, flags | O_NONBLOCK);
 }
 
+// create a pipe whose handles aren't inherited by other children which
+// are launched while it is open (the child's ends are dup'd onto its
+// standard streams, which clears the flag)
+Error createPipe(int* pipeDescriptors)
+{
+#ifdef __linux__
+   return posixCall<int>(boost::bind(::pipe2, pipeDescriptors, O_CLOEXEC),
+                         ERROR_LOCATION);
+#else
+   return posixCall<int>(boost::bind(::pipe, pipeDescriptors), ERROR_LOCATION);
+#endif
+}
+
 void closePipe(int pipeFd, const ErrorLocation& location)
 {
    safePosixCall<int>(boost::bind(::close, pipeFd), location);
@@ -354,8 +382,131 @@ Error ChildProcess::terminate()
 }
 
 
+#ifdef HAVE_POSIX_SPAWN_CLOSEFROM
+
+Error ChildProcess::spawn()
+{
+   // create pipes
+   int fdInput[2] = {0,0};
+   int fdOutput[2] = {0,0};
+   int fdError[2] = {0,0};
+   Error error = createPipe(fdInput);
+   if (error)
+      return error;
+   error = createPipe(fdOutput);
+   if (error)
+   {
+      closePipe(fdInput, ERROR_LOCATION);
+      return error;
+   }
+   error = createPipe(fdError);
+   if (error)
+   {
+      closePipe(fdInput, ERROR_LOCATION);
+      closePipe(fdOutput, ERROR_LOCATION);
+      return error;
+   }
+
+   // wire standard streams then close everything else
+   posix_spawn_file_actions_t actions;
+   ::posix_spawn_file_actions_init(&actions);
+   ::posix_spawn_file_actions_adddup2(&actions, fdInput[READ], STDIN_FILENO);
+   ::posix_spawn_file_actions_adddup2(&actions, fdOutput[WRITE], STDOUT_FILENO);
+   ::posix_spawn_file_actions_adddup2(
+                        &actions,
+                        options_.redirectStdErrToStdOut ? fdOutput[WRITE]
+                                                        : fdError[WRITE],
+                        STDERR_FILENO);
+   ::posix_spawn_file_actions_addclosefrom_np(&actions, STDERR_FILENO+1);
+   if (!options_.workingDir.empty())
+   {
+      ::posix_spawn_file_actions_addchdir_np(
+                  &actions, options_.workingDir.absolutePath().c_str());
+   }
+
+   // clear the child signal mask and setup its session / process group
+   // (see the comments in run for the rationale for these)
+   posix_spawnattr_t attr;
+   ::posix_spawnattr_init(&attr);
+   short flags = POSIX_SPAWN_SETSIGMASK;
+   sigset_t emptyMask;
+   ::sigemptyset(&emptyMask);
+   ::posix_spawnattr_setsigmask(&attr, &emptyMask);
+   if (options_.detachSession)
+   {
+      flags |= POSIX_SPAWN_SETSID;
+   }
+   else if (options_.terminateChildren)
+   {
+      flags |= POSIX_SPAWN_SETPGROUP;
+      ::posix_spawnattr_setpgroup(&attr, 0);
+   }
+   ::posix_spawnattr_setflags(&attr, flags);
+
+   // build args and environment
+   std::vector<std::string> args;
+   args.push_back(exe_);
+   args.insert(args.end(), args_.begin(), args_.end());
+   ProcessArgs processArgs(args);
+
+   std::vector<std::string> env;
+   if (options_.environment)
+   {
+      const Options& options = options_.environment.get();
+      for (Options::const_iterator
+               it = options.begin(); it != options.end(); ++it)
+      {
+         env.push_back(it->first + "=" + it->second);
+      }
+   }
+   ProcessArgs environment(env);
+
+   // spawn
+   pid_t pid = -1;
+   int result = ::posix_spawn(&pid,
+                              exe_.c_str(),
+                              &actions,
+                              &attr,
+                              processArgs.args(),
+                              options_.environment ? environment.args()
+                                                   : environ);
+   ::posix_spawn_file_actions_destroy(&actions);
+   ::posix_spawnattr_destroy(&attr);
+
+   if (result != 0)
+   {
+      closePipe(fdInput, ERROR_LOCATION);
+      closePipe(fdOutput, ERROR_LOCATION);
+      closePipe(fdError, ERROR_LOCATION);
+      return systemError(result, ERROR_LOCATION);
+   }
+
+   // close unused pipes & record the handles we'll use
+   closePipe(fdInput[READ], ERROR_LOCATION);
+   closePipe(fdOutput[WRITE], ERROR_LOCATION);
+   closePipe(fdError[WRITE], ERROR_LOCATION);
+   pImpl_->init(pid, fdInput[WRITE], fdOutput[READ], fdError[READ]);
+
+   return Success();
+}
+
+#endif
+
 Error ChildProcess::run()
-{  
+{
+#ifdef HAVE_POSIX_SPAWN_CLOSEFROM
+   // posix_spawn avoids copying our (potentially very large) address
+   // space, so we use it unless we need to do work within the child which
+   // spawn can't express (setting up a pseudoterminal or onAfterFork). if
+   // the spawn fails we fall back to fork so that failures (e.g. a missing
+   // executable) are handled and reported exactly as they are with fork
+   if (!options_.pseudoterminal && !options_.onAfterFork)
+   {
+      if (!spawn())
+         return Success();
+   }
+#endif
+
    // declarations
    pid_t pid = 0;
    int fdInput[2] = {0,0};
@@ -385,12 +536,12 @@ Error ChildProcess::run()
    else
    {
       // standard input
-      Error error = posixCall<int>(boost::bind(::pipe, fdInput), ERROR_LOCATION);
+      Error error = createPipe(fdInput);
       if (error)
          return error;
 
       // standard output
-      error = posixCall<int>(boost::bind(::pipe, fdOutput), ERROR_LOCATION);
+      error = createPipe(fdOutput);
       if (error)
       {
          closePipe(fdInput, ERROR_LOCATION);
@@ -398,7 +549,7 @@ Error ChildProcess::run()
       }
 
       // standard error
-      error = posixCall<int>(boost::bind(::pipe, fdError), ERROR_LOCATION);
+      error = createPipe(fdError);
       if (error)
       {
          closePipe(fdInput, ERROR_LOCATION);
@@ -648,7 +799,8 @@ struct AsyncChildProcess::AsyncImpl
       : calledOnStarted_(false),
         finishedStdout_(false),
         finishedStderr_(false),
-        exited_(false)
+        exited_(false),
+        exitSignaled_(false)
    {
    }
 
@@ -656,6 +808,24 @@ struct AsyncChildProcess::AsyncImpl
    bool finishedStdout_;
    bool finishedStderr_;
    bool exited_;
+
+   // set when the output monitor reports that the child exited
+   bool exitSignaled_;
+
+#ifdef __linux__
+   // channel which receives our output from the monitor thread (NULL if
+   // we read output directly from our pipes within poll)
+   boost::shared_ptr<child_output_monitor::ChildOutputChannel> pOutputChannel_;
+#endif
+
+   bool monitoringOutput() const
+   {
+#ifdef __linux__
+      return pOutputChannel_.get() != NULL;
+#else
+      return false;
+#endif
+   }
 };
 
 AsyncChildProcess::AsyncChildProcess(const std::string& exe,
@@ -680,6 +850,16 @@ AsyncChildProcess::AsyncChildProcess(const std::string& command,
 
 AsyncChildProcess::~AsyncChildProcess()
 {
+#ifdef __linux__
+   // a child destroyed before it exits is still being monitored. stop
+   // monitoring it (which also closes its pidfd) before closing the
+   // pipes the monitor is reading from
+   if (pAsyncImpl_->monitoringOutput())
+      child_output_monitor::unregisterChild(pAsyncImpl_->pOutputChannel_);
+#endif
+
+   // close any pipes which weren't closed when the child exited
+   pImpl_->closeAll(false, ERROR_LOCATION);
 }
 
 Error AsyncChildProcess::terminate()
@@ -711,6 +891,24 @@ void AsyncChildProcess::poll()
       else
          setPipeNonBlocking(pImpl_->fdStderr);         
 
+#ifdef __linux__
+      // hand our output streams to the monitor thread if it's available
+      if (child_output_monitor::isAvailable())
+      {
+         boost::shared_ptr<child_output_monitor::ChildOutputChannel> pChannel(
+                           new child_output_monitor::ChildOutputChannel());
+         Error error = child_output_monitor::registerChild(
+               pImpl_->pid,
+               pImpl_->fdStdout,
+               pAsyncImpl_->finishedStderr_ ? -1 : pImpl_->fdStderr,
+               pChannel);
+         if (!error)
+            pAsyncImpl_->pOutputChannel_ = pChannel;
+         else
+            LOG_ERROR(error);
+      }
+#endif
+
       if (callbacks_.onStarted)
          callbacks_.onStarted(*this);
       pAsyncImpl_->calledOnStarted_ = true;
@@ -728,6 +926,78 @@ void AsyncChildProcess::poll()
       }
    }
 
+   // check for output (read on the monitor thread if we are using it,
+   // otherwise read directly from the pipes)
+   if (pAsyncImpl_->monitoringOutput())
+      takeMonitoredOutput();
+   else
+      readOutput();
+
+   // if the monitor is watching for our exit then there is no need to
+   // call waitpid until it tells us that we have exited
+#ifdef __linux__
+   if (pAsyncImpl_->monitoringOutput() &&
+       !pAsyncImpl_->exitSignaled_ &&
+       pAsyncImpl_->pOutputChannel_->watchingExit())
+   {
+      return;
+   }
+#endif
+
+   // Check for exited. Note that this method specifies WNOHANG
+   // so we don't block forever waiting for a process the exit. We may
+   // not be able to reap the child due to an error (typically ECHILD,
+   // which occurs if the child was reaped by a global handler) in which
+   // case we'll allow the exit sequence to proceed and simply pass -1 as
+   // the exit status.
+   int status;
+   pid_t result = posixCall<pid_t>(
+            boost::bind(::waitpid, pImpl_->pid, &status, WNOHANG));
+
+   // either a normal exit or an error while waiting
+   if (result != 0)
+   {
+#ifdef __linux__
+      // stop monitoring then collect any output which remains
+      if (pAsyncImpl_->monitoringOutput())
+      {
+         child_output_monitor::unregisterChild(pAsyncImpl_->pOutputChannel_);
+         takeMonitoredOutput();
+         pAsyncImpl_->pOutputChannel_.reset();
+         readOutput();
+      }
+#endif
+
+      // close all of our pipes
+      pImpl_->closeAll(ERROR_LOCATION);
+
+      // fire exit event
+      if (callbacks_.onExit)
+      {
+         // resolve exit status
+         if (result > 0)
+            status = resolveExitStatus(status);
+         else
+            status = -1;
+
+         // call onExit
+         callbacks_.onExit(status);
+      }
+
+      // set exited_ flag so that our exited function always
+      // returns the right value
+      pAsyncImpl_->exited_ = true;
+
+      // if this is an error that isn't ECHILD then log it (we never
+      // expect this to occur as the only documented error codes are
+      // EINTR and ECHILD, and EINTR is handled internally by posixCall)
+      if (result == -1 && errno != ECHILD)
+         LOG_ERROR(systemError(errno, ERROR_LOCATION));
+   }
+}
+
+void AsyncChildProcess::readOutput()
+{
    // check stdout and fire event if we got output
    if (!pAsyncImpl_->finishedStdout_)
    {
@@ -768,47 +1038,38 @@ void AsyncChildProcess::poll()
            pAsyncImpl_->finishedStderr_ = true;
       }
    }
+}
 
+void AsyncChildProcess::takeMonitoredOutput()
+{
+#ifdef __linux__
+   boost::shared_ptr<child_output_monitor::ChildOutputChannel> pChannel =
+                                                pAsyncImpl_->pOutputChannel_;
 
-   // Check for exited. Note that this method specifies WNOHANG
-   // so we don't block forever waiting for a process the exit. We may
-   // not be able to reap the child due to an error (typically ECHILD,
-   // which occurs if the child was reaped by a global handler) in which
-   // case we'll allow the exit sequence to proceed and simply pass -1 as
-   // the exit status.
-   int status;
-   pid_t result = posixCall<pid_t>(
-            boost::bind(::waitpid, pImpl_->pid, &status, WNOHANG));
+   child_output_monitor::ChildOutput output;
+   bool throttled = pChannel->take(&output);
 
-   // either a normal exit or an error while waiting
-   if (result != 0)
-   {
-      // close all of our pipes
-      pImpl_->closeAll(ERROR_LOCATION);
+   if (output.error)
+      reportError(output.error);
 
-      // fire exit event
-      if (callbacks_.onExit)
-      {
-         // resolve exit status
-         if (result > 0)
-            status = resolveExitStatus(status);
-         else
-            status = -1;
+   if (!output.stdOut.empty() && callbacks_.onStdout)
+      callbacks_.onStdout(*this, output.stdOut);
 
-         // call onExit
-         callbacks_.onExit(status);
-      }
+   if (!output.stdErr.empty() && callbacks_.onStderr)
+      callbacks_.onStderr(*this, output.stdErr);
 
-      // set exited_ flag so that our exited function always
-      // returns the right value
-      pAsyncImpl_->exited_ = true;
+   if (output.stdoutEOF)
+      pAsyncImpl_->finishedStdout_ = true;
+   if (output.stderrEOF)
+      pAsyncImpl_->finishedStderr_ = true;
+   if (output.exited)
+      pAsyncImpl_->exitSignaled_ = true;
 
-      // if this is an error that isn't ECHILD then log it (we never
-      // expect this to occur as the only documented error codes are
-      // EINTR and ECHILD, and EINTR is handled internally by posixCall)
-      if (result == -1 && errno != ECHILD)
-         LOG_ERROR(systemError(errno, ERROR_LOCATION));
-   }
+   // the monitor stops reading when our buffer is full, so let it
+   // know that we've consumed the output
+   if (throttled)
+      child_output_monitor::resume(pChannel);
+#endif
 }
 
 bool AsyncChildProcess::exited()
@@ -816,6 +1077,32 @@ bool AsyncChildProcess::exited()
    return pAsyncImpl_->exited_;
 }
 
+void waitForChildActivity(
+         const std::vector<boost::shared_ptr<AsyncChildProcess> >& children,
+         const boost::posix_time::time_duration& maxWait)
+{
+#ifdef __linux__
+   // wait on the channels of the children whose output is being monitored
+   // (any others are checked when we return after maxWait)
+   std::vector<boost::shared_ptr<child_output_monitor::ChildOutputChannel> >
+                                                                  channels;
+   std::vector<boost::shared_ptr<AsyncChildProcess> >::const_iterator it;
+   for (it = children.begin(); it != children.end(); ++it)
+   {
+      if ((*it)->pAsyncImpl_->monitoringOutput())
+         channels.push_back((*it)->pAsyncImpl_->pOutputChannel_);
+   }
+
+   if (!channels.empty())
+   {
+      child_output_monitor::waitForActivity(channels, maxWait);
+      return;
+   }
+#endif
+
+   boost::this_thread::sleep(maxWait);
+}
+
 } // namespace system
 } // namespace core
 
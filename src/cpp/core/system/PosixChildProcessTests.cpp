@@ -0,0 +1,132 @@
+/*
+ * PosixChildProcessTests.cpp
+ *
+ * Copyright (C) 2009-12 by RStudio, Inc.
+ *
+ * Unless you have received this program directly from RStudio pursuant
+ * to the terms of a commercial license agreement with RStudio, then
+ * this program is licensed to you under the terms of version 3 of the
+ * GNU Affero General Public License. This program is distributed WITHOUT
+ * ANY EXPRESS OR IMPLIED WARRANTY, INCLUDING THOSE OF NON-INFRINGEMENT,
+ * MERCHANTABILITY OR FITNESS FOR A PARTICULAR PURPOSE. Please refer to the
+ * AGPL (http://www.gnu.org/licenses/agpl-3.0.txt) for more details.
+ *
+ */
+
+#include <core/system/Process.hpp>
+
+#include <fcntl.h>
+#include <unistd.h>
+
+#include <iostream>
+
+#include <boost/assert.hpp>
+#include <boost/date_time/posix_time/posix_time.hpp>
+
+#include <core/Error.hpp>
+#include <core/FilePath.hpp>
+#include <core/system/Environment.hpp>
+
+namespace core {
+namespace system {
+
+namespace {
+
+void noopAfterFork()
+{
+}
+
+// specifying onAfterFork forces the fork + exec launch path
+ProcessOptions withFork(ProcessOptions options)
+{
+   options.onAfterFork = noopAfterFork;
+   return options;
+}
+
+void verifySameResult(const std::string& command,
+                      const ProcessOptions& options)
+{
+   ProcessResult spawnResult;
+   Error error = runCommand(command, options, &spawnResult);
+   BOOST_ASSERT(!error);
+
+   ProcessResult forkResult;
+   error = runCommand(command, withFork(options), &forkResult);
+   BOOST_ASSERT(!error);
+
+   BOOST_ASSERT(spawnResult.exitStatus == forkResult.exitStatus);
+   BOOST_ASSERT(spawnResult.stdOut == forkResult.stdOut);
+   BOOST_ASSERT(spawnResult.stdErr == forkResult.stdErr);
+}
+
+double launchMicroseconds(const ProcessOptions& options, int iterations)
+{
+   using namespace boost::posix_time;
+
+   std::vector<std::string> args;
+   ptime start = microsec_clock::universal_time();
+   for (int i = 0; i < iterations; i++)
+   {
+      ProcessResult result;
+      Error error = runProgram("/bin/true", args, "", options, &result);
+      BOOST_ASSERT(!error && result.exitStatus == EXIT_SUCCESS);
+   }
+   time_duration elapsed = microsec_clock::universal_time() - start;
+
+   return static_cast<double>(elapsed.total_microseconds()) / iterations;
+}
+
+} // anonymous namespace
+
+
+void runChildProcessTests()
+{
+   ProcessOptions options;
+   verifySameResult("echo out; echo err 1>&2; exit 3", options);
+
+   options.redirectStdErrToStdOut = true;
+   verifySameResult("echo out; echo err 1>&2", options);
+
+   ProcessOptions dirOptions;
+   dirOptions.workingDir = FilePath("/");
+   Options env;
+   core::system::setenv(&env, "CHILD_PROCESS_TEST", "value");
+   dirOptions.environment = env;
+   dirOptions.terminateChildren = true;
+   verifySameResult("pwd; echo $CHILD_PROCESS_TEST", dirOptions);
+
+   // a missing executable is reported via the exit status for both paths
+   std::vector<std::string> args;
+   ProcessResult result;
+   Error error = runProgram("/nonexistent/program", args, "",
+                            ProcessOptions(), &result);
+   BOOST_ASSERT(!error && result.exitStatus == EXIT_FAILURE);
+
+#ifdef __linux__
+   // descriptors which aren't close-on-exec are not inherited
+   int fd = ::open("/dev/null", O_RDONLY);
+   BOOST_ASSERT(fd != -1);
+   verifySameResult("ls /proc/self/fd | wc -l", ProcessOptions());
+   ProcessResult lsResult;
+   error = runCommand("ls /proc/self/fd", ProcessOptions(), &lsResult);
+   BOOST_ASSERT(!error && lsResult.stdOut == "0\n1\n2\n3\n");
+   ::close(fd);
+#endif
+}
+
+// launch /bin/true repeatedly using both posix_spawn and fork and report
+// the average time taken for each launch
+void runProcessLaunchBenchmark(int iterations)
+{
+   double spawnMicros = launchMicroseconds(ProcessOptions(), iterations);
+   double forkMicros = launchMicroseconds(withFork(ProcessOptions()),
+                                          iterations);
+
+   std::cout << "posix_spawn: " << static_cast<long>(spawnMicros)
+             << " us/launch" << std::endl;
+   std::cout << "fork + exec: " << static_cast<long>(forkMicros)
+             << " us/launch" << std::endl;
+}
+
+} // namespace system
+} // namespace core
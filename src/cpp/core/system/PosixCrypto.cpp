@@ -19,6 +19,7 @@
 #include <fcntl.h>
 
 #include <openssl/err.h>
+#include <openssl/evp.h>
 #include <openssl/hmac.h>
 #include <openssl/bio.h>
 #include <openssl/buffer.h>
@@ -98,6 +99,34 @@ private:
    BIO* pMem_;
 };
    
+// compute an HMAC directly from the data and key (without copying them)
+Error computeHMAC(const EVP_MD* pDigest,
+                  const std::string& data,
+                  const void* pKey,
+                  std::size_t keySize,
+                  std::vector<unsigned char>* pHMAC)
+{
+   unsigned int md_len = 0;
+   pHMAC->resize(EVP_MAX_MD_SIZE);
+   unsigned char* pResult = ::HMAC(
+                  pDigest,
+                  pKey,
+                  static_cast<int>(keySize),
+                  reinterpret_cast<const unsigned char*>(data.data()),
+                  data.size(),
+                  &(pHMAC->operator[](0)),
+                  &md_len);
+   if (pResult != NULL)
+   {
+      pHMAC->resize(md_len);
+      return Success();
+   }
+   else
+   {
+      return lastCryptoError(ERROR_LOCATION);
+   }
+}
+
 } // anonymous namespace
    
 void initialize()
@@ -110,35 +139,37 @@ Error HMAC_SHA1(const std::string& data,
                 const std::string& key,
                 std::vector<unsigned char>* pHMAC)
 {
-   // copy data into vector
-   std::vector<unsigned char> keyVector;
-   std::copy(key.begin(), key.end(), std::back_inserter(keyVector));  
-   
-   // call core
-   return HMAC_SHA1(data, keyVector, pHMAC);
+   return computeHMAC(EVP_sha1(), data, key.data(), key.size(), pHMAC);
 }
    
 Error HMAC_SHA1(const std::string& data, 
                 const std::vector<unsigned char>& key,
                 std::vector<unsigned char>* pHMAC)
 {
-   // copy data into data vector
-   std::vector<unsigned char> dataVector;
-   std::copy(data.begin(), data.end(), std::back_inserter(dataVector));
-   
-   // perform the hash
+   return computeHMAC(EVP_sha1(), data, &(key[0]), key.size(), pHMAC);
+}
+
+Error HMAC_SHA256(const std::string& data,
+                  const std::string& key,
+                  std::vector<unsigned char>* pHMAC)
+{
+   return computeHMAC(EVP_sha256(), data, key.data(), key.size(), pHMAC);
+}
+
+Error sha256Digest(const std::string& data,
+                   std::vector<unsigned char>* pDigest)
+{
    unsigned int md_len = 0;
-   pHMAC->resize(EVP_MAX_MD_SIZE);
-   unsigned char* pResult = ::HMAC(EVP_sha1(),
-                                   &(key[0]),
-                                   key.size(),
-                                   &(dataVector[0]),
-                                   dataVector.size(),
-                                   &(pHMAC->operator[](0)),
-                                   &md_len);
-   if (pResult != NULL)
+   pDigest->resize(EVP_MAX_MD_SIZE);
+   int result = ::EVP_Digest(data.data(),
+                             data.size(),
+                             &(pDigest->operator[](0)),
+                             &md_len,
+                             EVP_sha256(),
+                             NULL);
+   if (result == 1)
    {
-      pHMAC->resize(md_len);
+      pDigest->resize(md_len);
       return Success();
    }
    else
@@ -147,6 +178,19 @@ Error HMAC_SHA1(const std::string& data,
    }
 }
 
+bool constantTimeEquals(const std::string& a, const std::string& b)
+{
+   // the length of a MAC isn't secret so can be compared directly
+   if (a.size() != b.size())
+      return false;
+
+   // examine every byte regardless of where the first difference is
+   unsigned char result = 0;
+   for (std::string::size_type i = 0; i < a.size(); i++)
+      result |= static_cast<unsigned char>(a[i] ^ b[i]);
+   return result == 0;
+}
+
 Error base64Encode(const std::vector<unsigned char>& data, 
                    std::string* pEncoded)
 {
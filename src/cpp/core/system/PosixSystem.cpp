@@ -32,6 +32,11 @@
 #include <pwd.h>
 #include <grp.h>
 
+#ifdef __linux__
+#include <stdint.h>
+#include <sys/syscall.h>
+#endif
+
 #include <uuid/uuid.h>
 
 #ifdef __APPLE__
@@ -62,6 +67,11 @@
 
 #include "config.h"
 
+// close_range was added in linux 5.9 and may not be in our headers
+#if defined(__linux__) && !defined(SYS_close_range)
+#define SYS_close_range 436
+#endif
+
 namespace core {
 namespace system {
 
@@ -446,6 +456,67 @@ bool currentUserIsPrivilleged(unsigned int minimumUserId)
 
 namespace {
 
+#ifdef __linux__
+
+// layout of the records returned by getdents64
+struct LinuxDirent64
+{
+   uint64_t d_ino;
+   int64_t d_off;
+   unsigned short d_reclen;
+   unsigned char d_type;
+   char d_name[1];
+};
+
+// close the open file descriptors listed in /proc/self/fd. this uses
+// getdents64 directly rather than opendir/readdir since it is called after
+// fork (where we want to avoid allocating memory). returns false if
+// /proc/self/fd could not be read.
+bool closeOpenFileDescriptorsFrom(int fdStart)
+{
+   int dirFd = ::open("/proc/self/fd", O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+   if (dirFd == -1)
+      return false;
+
+   char buffer[4096];
+   while (true)
+   {
+      long bytes = ::syscall(SYS_getdents64, dirFd, buffer, sizeof(buffer));
+      if (bytes < 0)
+      {
+         ::close(dirFd);
+         return false;
+      }
+      else if (bytes == 0)
+      {
+         break;
+      }
+
+      for (long offset = 0; offset < bytes; )
+      {
+         LinuxDirent64* pEntry =
+                     reinterpret_cast<LinuxDirent64*>(buffer + offset);
+         offset += pEntry->d_reclen;
+
+         // parse the descriptor number (skipping . and ..)
+         int fd = 0;
+         const char* pName = pEntry->d_name;
+         if (*pName < '0' || *pName > '9')
+            continue;
+         for ( ; *pName >= '0' && *pName <= '9'; ++pName)
+            fd = (fd * 10) + (*pName - '0');
+
+         if (fd >= fdStart && fd != dirFd)
+            ::close(fd);
+      }
+   }
+
+   ::close(dirFd);
+   return true;
+}
+
+#endif
+
 // NOTE: this function is duplicated between here and core::system
 // Did this to prevent the "system" interface from allowing Posix
 // constructs with Win32 no-ops to creep in (since this is used on
@@ -468,6 +539,17 @@ Error closeFileDescriptorsFrom(int fdStart)
    // which case substituting/truncating to an appropriate number (1024?)
    // is still required
 
+#ifdef __linux__
+   // close_range (linux 5.9) closes the whole range with a single call
+   if (::syscall(SYS_close_range, fdStart, ~0U, 0) == 0)
+      return Success();
+
+   // otherwise close only the descriptors which are actually open (the
+   // hard limit on RLIMIT_NOFILE can be very large on some systems)
+   if (closeOpenFileDescriptorsFrom(fdStart))
+      return Success();
+#endif
+
    // get limit
    struct rlimit rl;
    if (::getrlimit(RLIMIT_NOFILE, &rl) < 0)
@@ -60,11 +60,63 @@ Error runCommand(const std::string& command,
 }
 
 
+double ProcessIOStats::bytesPerSecond() const
+{
+   using namespace boost::posix_time;
+   if (started.is_not_a_date_time())
+      return 0;
+
+   double seconds = static_cast<double>(
+      (microsec_clock::universal_time() - started).total_microseconds()) /
+      1000000.0;
+   if (seconds <= 0)
+      return 0;
+
+   return static_cast<double>(stdoutBytes + stderrBytes) / seconds;
+}
+
+namespace {
+
+struct SupervisedChild
+{
+   boost::shared_ptr<AsyncChildProcess> pChild;
+   boost::shared_ptr<ProcessIOStats> pStats;
+
+   void poll() const { pChild->poll(); }
+   bool exited() const { return pChild->exited(); }
+};
+
+void countStdout(boost::shared_ptr<ProcessIOStats> pStats,
+                 const boost::function<void(ProcessOperations&,
+                                            const std::string&)>& onStdout,
+                 ProcessOperations& operations,
+                 const std::string& output)
+{
+   pStats->stdoutBytes += output.size();
+   pStats->outputEvents++;
+   if (onStdout)
+      onStdout(operations, output);
+}
+
+void countStderr(boost::shared_ptr<ProcessIOStats> pStats,
+                 const boost::function<void(ProcessOperations&,
+                                            const std::string&)>& onStderr,
+                 ProcessOperations& operations,
+                 const std::string& output)
+{
+   pStats->stderrBytes += output.size();
+   pStats->outputEvents++;
+   if (onStderr)
+      onStderr(operations, output);
+}
+
+} // anonymous namespace
+
 struct ProcessSupervisor::Impl
 {
    Impl() : isPolling(false) {}
    bool isPolling;
-   std::vector<boost::shared_ptr<AsyncChildProcess> > children;
+   std::vector<SupervisedChild> children;
 };
 
 ProcessSupervisor::ProcessSupervisor()
@@ -79,16 +131,30 @@ ProcessSupervisor::~ProcessSupervisor()
 namespace {
 
 Error runChild(boost::shared_ptr<AsyncChildProcess> pChild,
-               std::vector<boost::shared_ptr<AsyncChildProcess> >* pChildren,
+               const std::string& command,
+               std::vector<SupervisedChild>* pChildren,
                const ProcessCallbacks& callbacks)
 {
+   // count output as it is delivered
+   boost::shared_ptr<ProcessIOStats> pStats(new ProcessIOStats());
+   pStats->command = command;
+   pStats->started = boost::posix_time::microsec_clock::universal_time();
+   ProcessCallbacks countingCallbacks = callbacks;
+   countingCallbacks.onStdout = boost::bind(countStdout,
+                                            pStats, callbacks.onStdout, _1, _2);
+   countingCallbacks.onStderr = boost::bind(countStderr,
+                                            pStats, callbacks.onStderr, _1, _2);
+
    // run the child
-   Error error = pChild->run(callbacks);
+   Error error = pChild->run(countingCallbacks);
    if (error)
       return error;
 
    // add to the list of children
-   pChildren->push_back(pChild);
+   SupervisedChild child;
+   child.pChild = pChild;
+   child.pStats = pStats;
+   pChildren->push_back(child);
 
    // success
    return Success();
@@ -108,7 +174,7 @@ Error ProcessSupervisor::runProgram(const std::string& executable,
                                                        options));
 
    // run the child
-   return runChild(pChild, &(pImpl_->children), callbacks);
+   return runChild(pChild, executable, &(pImpl_->children), callbacks);
 }
 
 Error ProcessSupervisor::runCommand(const std::string& command,
@@ -120,7 +186,7 @@ Error ProcessSupervisor::runCommand(const std::string& command,
                                  new AsyncChildProcess(command, options));
 
    // run the child
-   return runChild(pChild, &(pImpl_->children), callbacks);
+   return runChild(pChild, command, &(pImpl_->children), callbacks);
 }
 
 namespace {
@@ -281,13 +347,13 @@ bool ProcessSupervisor::poll()
    // call poll on all of our children
    std::for_each(pImpl_->children.begin(),
                  pImpl_->children.end(),
-                 boost::bind(&AsyncChildProcess::poll, _1));
+                 boost::bind(&SupervisedChild::poll, _1));
 
    // remove any children who have exited from our list
    pImpl_->children.erase(std::remove_if(
                              pImpl_->children.begin(),
                              pImpl_->children.end(),
-                             boost::bind(&AsyncChildProcess::exited, _1)),
+                             boost::bind(&SupervisedChild::exited, _1)),
                           pImpl_->children.end());
 
    // return status
@@ -297,15 +363,24 @@ bool ProcessSupervisor::poll()
 void ProcessSupervisor::terminateAll()
 {
    // call terminate on all of our children
-   BOOST_FOREACH(boost::shared_ptr<AsyncChildProcess> pChild,
-                 pImpl_->children)
+   BOOST_FOREACH(const SupervisedChild& child, pImpl_->children)
    {
-      Error error = pChild->terminate();
+      Error error = child.pChild->terminate();
       if (error)
          LOG_ERROR(error);
    }
 }
 
+std::vector<ProcessIOStats> ProcessSupervisor::ioStats()
+{
+   std::vector<ProcessIOStats> stats;
+   BOOST_FOREACH(const SupervisedChild& child, pImpl_->children)
+   {
+      stats.push_back(*child.pStats);
+   }
+   return stats;
+}
+
 bool ProcessSupervisor::wait(
       const boost::posix_time::time_duration& pollingInterval,
       const boost::posix_time::time_duration& maxWait)
@@ -316,8 +391,14 @@ bool ProcessSupervisor::wait(
 
    while (poll())
    {
-      // wait the specified polling interval
-      boost::this_thread::sleep(pollingInterval);
+      // wait the specified polling interval (returns early if
+      // output or exit is reported for a child)
+      std::vector<boost::shared_ptr<AsyncChildProcess> > children;
+      BOOST_FOREACH(const SupervisedChild& child, pImpl_->children)
+      {
+         children.push_back(child.pChild);
+      }
+      waitForChildActivity(children, pollingInterval);
 
       // check for timeout if appropriate
       if (!timeoutTime.is_not_a_date_time())
@@ -24,6 +24,7 @@
 #include <boost/foreach.hpp>
 #include <boost/algorithm/string/predicate.hpp>
 
+#include <core/BoostThread.hpp>
 #include <core/system/System.hpp>
 #include <core/system/ShellUtils.hpp>
 #include <core/FilePath.hpp>
@@ -641,6 +642,13 @@ bool AsyncChildProcess::exited()
    return pImpl_->hProcess == NULL;
 }
 
+void waitForChildActivity(
+         const std::vector<boost::shared_ptr<AsyncChildProcess> >& children,
+         const boost::posix_time::time_duration& maxWait)
+{
+   boost::this_thread::sleep(maxWait);
+}
+
 } // namespace system
 } // namespace core
 
@@ -15,6 +15,7 @@
 
 #include <core/tex/TexLogParser.hpp>
 
+#include <boost/bind.hpp>
 #include <boost/foreach.hpp>
 #include <boost/regex.hpp>
 #include <boost/lexical_cast.hpp>
@@ -139,70 +140,41 @@ FilePath resolveFilename(const FilePath& rootDir,
 
 // TeX wraps lines hard at 79 characters. We use heuristics as described in
 // Sublime Text's TeX plugin to determine where these breaks are.
-void unwrapLines(std::vector<std::string>* pLines,
-                 std::vector<size_t>* pLinesUnwrapped=NULL)
+const std::size_t kTexLineWidth = 79;
+
+// Upper bound on the size of a single unwrapped line or log entry message
+// (protects against runaway memory use when parsing malformed logs)
+const std::size_t kMaxLineLength = 16384;
+
+// Returns true if `nextLine` must not be appended to a preceding line
+// which was wrapped at the tex line width
+bool isUnwrapBreak(const std::string& nextLine)
 {
    static boost::regex regexLine("^l\\.(\\d+)\\s");
    static boost::regex regexAssignment("^\\\\.*?=");
 
-   std::vector<std::string>::iterator pos = pLines->begin();
-
-   for ( ; pos != pLines->end(); pos++)
-   {
-      // The first line is always long, and not artificially wrapped
-      if (pos == pLines->begin())
-         continue;
-
-      if (pos->length() != 79)
-         continue;
-
-      // The **<filename> line may be long, but we don't care about it
-      if (beginsWith(*pos, "**"))
-         continue;
-
-      while (true)
-      {
-         std::vector<std::string>::iterator nextPos = pos + 1;
-         // No more lines to add
-         if (nextPos == pLines->end())
-            break;
-
-         if (nextPos->empty())
-            break;
-
-         // Underfull/Overfull terminator
-         if (*nextPos == " []")
-            break;
-
-         // Common prefixes
-         if (beginsWith(*nextPos, "File:", "Package:", "Document Class:"))
-            break;
+   if (nextLine.empty())
+      return true;
 
-         // More prefixes
-         if (beginsWith(*nextPos, "LaTeX Warning:", "LaTeX Info:", "LaTeX2e <"))
-            break;
+   // Underfull/Overfull terminator
+   if (nextLine == " []")
+      return true;
 
-         if (boost::regex_search(*nextPos, regexAssignment))
-            break;
+   // Common prefixes
+   if (beginsWith(nextLine, "File:", "Package:", "Document Class:"))
+      return true;
 
-         if (boost::regex_search(*nextPos, regexLine))
-            break;
+   // More prefixes
+   if (beginsWith(nextLine, "LaTeX Warning:", "LaTeX Info:", "LaTeX2e <"))
+      return true;
 
-         bool breakAfterAppend = nextPos->length() != 79;
+   if (boost::regex_search(nextLine, regexAssignment))
+      return true;
 
-         pos->append(*nextPos);
-         // NOTE: Erase is a simple but inefficient way of handling this. Would
-         //    be way faster to maintain an output iterator that points to the
-         //    correct point in pLines, and when finished, truncate whatever
-         //    elements come after the final position of the output iterator.
-         pLines->erase(nextPos, nextPos+1);
-         if (pLinesUnwrapped)
-            pLinesUnwrapped->push_back(1 + (pos - pLines->begin()));
+   if (boost::regex_search(nextLine, regexLine))
+      return true;
 
-         if (breakAfterAppend)
-            break;
-      }
-   }
+   return false;
 }
 
 class FileStack : public boost::noncopyable
@@ -309,49 +281,153 @@ FilePath texFilePath(const std::string& logPath, const FilePath& compileDir)
    }
 }
 
-size_t calculateWrappedLine(const std::vector<size_t>& unwrappedLines,
-                               size_t unwrappedLineNum)
+void addLogEntry(LogEntries* pLogEntries, const LogEntry& logEntry)
 {
-   for (std::vector<size_t>::const_iterator it = unwrappedLines.begin();
-        it != unwrappedLines.end();
-        it++)
+   pLogEntries->push_back(logEntry);
+}
+
+} // anonymous namespace
+
+struct LatexLogParser::Impl
+{
+   enum State { Normal, InBox, InError, InWarning };
+
+   Impl(const FilePath& logFilePath,
+        const boost::function<void(const LogEntry&)>& onLogEntry)
+      : logFilePath(logFilePath),
+        rootDir(logFilePath.parent()),
+        onLogEntry(onLogEntry),
+        fileStack(rootDir),
+        physicalLineNum(0),
+        hasPendingLine(false),
+        pendingLineNum(0),
+        pendingLineOpen(false),
+        state(Normal),
+        entryType(LogEntry::Error),
+        entryLogLine(0)
    {
-      if (*it >= unwrappedLineNum)
+   }
+
+   // split output into physical lines (retaining any partial line)
+   void parse(const std::string& output)
+   {
+      std::string::size_type pos = 0;
+      while (true)
       {
-         return unwrappedLineNum + (it - unwrappedLines.begin());
+         std::string::size_type nlPos = output.find('\n', pos);
+         if (nlPos == std::string::npos)
+            break;
+
+         partialLine.append(output, pos, nlPos - pos);
+         onPhysicalLine();
+         pos = nlPos + 1;
       }
+
+      partialLine.append(output, pos, std::string::npos);
+      if (partialLine.size() > kMaxLineLength)
+         onPhysicalLine();
    }
 
-   return unwrappedLineNum + unwrappedLines.size();
-}
+   void finish()
+   {
+      if (!partialLine.empty())
+         onPhysicalLine();
+      flushPendingLine();
+
+      // entries still waiting on a terminating line are reported as-is
+      if (state == InError || state == InWarning)
+         addEntry(-1);
+      state = Normal;
+   }
 
-} // anonymous namespace
+private:
 
-Error parseLatexLog(const FilePath& logFilePath, LogEntries* pLogEntries)
-{
-   static boost::regex regexOverUnderfullLines(" at lines (\\d+)--(\\d+)\\s*(?:\\[])?$");
-   static boost::regex regexWarning("^(?:.*?) Warning: (.+)");
-   static boost::regex regexWarningEnd(" input line (\\d+)\\.$");
-   static boost::regex regexLnn("^l\\.(\\d+)\\s");
-   static boost::regex regexCStyleError("^(.+):(\\d+):\\s(.+)$");
+   void onPhysicalLine()
+   {
+      std::string line;
+      line.swap(partialLine);
+      if (!line.empty() && line[line.size()-1] == '\r')
+         line.erase(line.size()-1);
 
-   std::vector<std::string> lines;
-   Error error = readStringVectorFromFile(logFilePath, &lines, false);
-   if (error)
-      return error;
+      physicalLineNum++;
+
+      // append to the pending line if it was wrapped at the tex line width
+      if (hasPendingLine && pendingLineOpen && !isUnwrapBreak(line))
+      {
+         pendingLine.append(line);
+         pendingLineOpen = line.length() == kTexLineWidth &&
+                           pendingLine.length() < kMaxLineLength;
+         if (!pendingLineOpen)
+            flushPendingLine();
+         return;
+      }
 
-   std::vector<size_t> linesUnwrapped;
-   unwrapLines(&lines, &linesUnwrapped);
+      flushPendingLine();
 
-   FilePath rootDir = logFilePath.parent();
-   FileStack fileStack(rootDir);
+      pendingLine = line;
+      pendingLineNum = physicalLineNum;
+      hasPendingLine = true;
 
-   for (std::vector<std::string>::const_iterator it = lines.begin();
-        it != lines.end();
-        it++)
+      // The first line is always long, and not artificially wrapped. The
+      // **<filename> line may be long, but we don't care about it.
+      pendingLineOpen = physicalLineNum > 1 &&
+                        line.length() == kTexLineWidth &&
+                        !beginsWith(line, "**");
+      if (!pendingLineOpen)
+         flushPendingLine();
+   }
+
+   void flushPendingLine()
+   {
+      if (!hasPendingLine)
+         return;
+
+      std::string line;
+      line.swap(pendingLine);
+      hasPendingLine = false;
+      pendingLineOpen = false;
+
+      processLine(line, pendingLineNum);
+   }
+
+   void processLine(const std::string& line, int logLineNum)
    {
-      const std::string& line = *it;
-      int logLineNum = (it - lines.begin()) + 1;
+      static boost::regex regexOverUnderfullLines(" at lines (\\d+)--(\\d+)\\s*(?:\\[])?$");
+      static boost::regex regexWarning("^(?:.*?) Warning: (.+)");
+      static boost::regex regexLnn("^l\\.(\\d+)\\s");
+      static boost::regex regexCStyleError("^(.+):(\\d+):\\s(.+)$");
+
+      switch (state)
+      {
+         case InBox:
+         {
+            // For multi-line case, we're looking for " []" on a line by itself
+            if (line == " []")
+               state = Normal;
+            return;
+         }
+
+         case InError:
+         {
+            boost::smatch match;
+            if (boost::regex_search(line, match, regexLnn))
+               addEntry(safe_convert::stringTo<int>(match[1], -1));
+            return;
+         }
+
+         case InWarning:
+         {
+            entryMessage.append(line);
+            if (boost::algorithm::ends_with(entryMessage, "."))
+               addEntry(warningEndLine(line));
+            else if (entryMessage.length() >= kMaxLineLength)
+               addEntry(-1);
+            return;
+         }
+
+         case Normal:
+            break;
+      }
 
       // We slurp overfull/underfull messages with no further processing
       // (i.e. not manipulating the file stack)
@@ -380,32 +456,16 @@ Error parseLatexLog(const FilePath& logFilePath, LogEntries* pLogEntries)
             boost::algorithm::trim_right(msg);
          }
 
-         pLogEntries->push_back(LogEntry(logFilePath,
-                                         calculateWrappedLine(linesUnwrapped,
-                                                              logLineNum),
-                                         LogEntry::Box,
-                                         fileStack.currentFile(),
-                                         lineNum,
-                                         msg));
-
-         if (singleLine)
-            continue;
+         onLogEntry(LogEntry(logFilePath,
+                             logLineNum,
+                             LogEntry::Box,
+                             fileStack.currentFile(),
+                             lineNum,
+                             msg));
 
-         for (; it != lines.end(); it++)
-         {
-            // For multi-line case, we're looking for " []" on a line by itself
-            if (*it == " []")
-               break;
-         }
-
-         // The iterator would be incremented by the outer for loop, must not
-         // let it go past the end! (If we did get to the end, it would
-         // mean the log file was malformed, but we still can't crash in this
-         // situation.)
-         if (it == lines.end())
-            break;
-         else
-            continue;
+         if (!singleLine)
+            state = InBox;
+         return;
       }
 
       fileStack.processLine(line);
@@ -414,75 +474,22 @@ Error parseLatexLog(const FilePath& logFilePath, LogEntries* pLogEntries)
 
       if (beginsWith(line, "! "))
       {
-         std::string errorMsg = line.substr(2);
-         int lineNum = -1;
-
-         boost::smatch match;
-         for (it++; it != lines.end(); it++)
-         {
-            if (boost::regex_search(*it, match, regexLnn))
-            {
-               lineNum = safe_convert::stringTo<int>(match[1], -1);
-               break;
-            }
-         }
-
-         pLogEntries->push_back(LogEntry(logFilePath,
-                                         calculateWrappedLine(linesUnwrapped,
-                                                              logLineNum),
-                                         LogEntry::Error,
-                                         fileStack.currentFile(),
-                                         lineNum,
-                                         errorMsg));
-
-         // The iterator would be incremented by the outer for loop, must not
-         // let it go past the end! (If we did get to the end, it would
-         // mean the log file was malformed, but we still can't crash in this
-         // situation.)
-         if (it == lines.end())
-            break;
-         else
-            continue;
+         // the source line number is reported on a subsequent l.NN line
+         beginEntry(LogEntry::Error, logLineNum, line.substr(2));
+         state = InError;
+         return;
       }
 
       boost::smatch warningMatch;
       if (boost::regex_search(line, warningMatch, regexWarning))
       {
-         std::string warningMsg = warningMatch[1];
-         int lineNum = -1;
-         while (true)
-         {
-            if (boost::algorithm::ends_with(warningMsg, "."))
-            {
-               boost::smatch warningEndMatch;
-               if (boost::regex_search(*it, warningEndMatch, regexWarningEnd))
-               {
-                  lineNum = safe_convert::stringTo<int>(warningEndMatch[1], -1);
-               }
-               break;
-            }
-
-            if (++it == lines.end())
-               break;
-            warningMsg.append(*it);
-         }
-
-         pLogEntries->push_back(LogEntry(logFilePath,
-                                         calculateWrappedLine(linesUnwrapped,
-                                                              logLineNum),
-                                         LogEntry::Warning,
-                                         fileStack.currentFile(),
-                                         lineNum,
-                                         warningMsg));
-
-         // The iterator would be incremented by the outer for loop, must not
-         // let it go past the end! (If we did get to the end, it would
-         // mean the log file was malformed, but we still can't crash in this
-         // situation.)
-         if (it == lines.end())
-            break;
+         // warnings continue on subsequent lines until terminated by a '.'
+         beginEntry(LogEntry::Warning, logLineNum, warningMatch[1]);
+         if (boost::algorithm::ends_with(entryMessage, "."))
+            addEntry(warningEndLine(line));
          else
-            continue;
+            state = InWarning;
+         return;
       }
 
       boost::smatch cStyleErrorMatch;
@@ -492,17 +499,120 @@ Error parseLatexLog(const FilePath& logFilePath, LogEntries* pLogEntries)
          if (cstyleFile.exists())
          {
             int lineNum = safe_convert::stringTo<int>(cStyleErrorMatch[2], -1);
-            pLogEntries->push_back(LogEntry(logFilePath,
-                                            calculateWrappedLine(linesUnwrapped,
-                                                                 logLineNum),
-                                            LogEntry::Error,
-                                            cstyleFile,
-                                            lineNum,
-                                            cStyleErrorMatch[3]));
+            onLogEntry(LogEntry(logFilePath,
+                                logLineNum,
+                                LogEntry::Error,
+                                cstyleFile,
+                                lineNum,
+                                cStyleErrorMatch[3]));
          }
       }
    }
 
+   int warningEndLine(const std::string& line)
+   {
+      static boost::regex regexWarningEnd(" input line (\\d+)\\.$");
+
+      boost::smatch warningEndMatch;
+      if (boost::regex_search(line, warningEndMatch, regexWarningEnd))
+         return safe_convert::stringTo<int>(warningEndMatch[1], -1);
+      else
+         return -1;
+   }
+
+   void beginEntry(LogEntry::Type type,
+                   int logLineNum,
+                   const std::string& message)
+   {
+      entryType = type;
+      entryLogLine = logLineNum;
+      entryFile = fileStack.currentFile();
+      entryMessage = message;
+   }
+
+   void addEntry(int lineNum)
+   {
+      state = Normal;
+
+      std::string message;
+      message.swap(entryMessage);
+      onLogEntry(LogEntry(logFilePath,
+                          entryLogLine,
+                          entryType,
+                          entryFile,
+                          lineNum,
+                          message));
+   }
+
+private:
+   FilePath logFilePath;
+   FilePath rootDir;
+   boost::function<void(const LogEntry&)> onLogEntry;
+   FileStack fileStack;
+
+   // physical line currently being received
+   std::string partialLine;
+   int physicalLineNum;
+
+   // logical (unwrapped) line currently being assembled
+   bool hasPendingLine;
+   std::string pendingLine;
+   int pendingLineNum;
+   bool pendingLineOpen;
+
+   // entry currently waiting on subsequent lines
+   State state;
+   LogEntry::Type entryType;
+   int entryLogLine;
+   FilePath entryFile;
+   std::string entryMessage;
+};
+
+LatexLogParser::LatexLogParser(
+               const FilePath& logFilePath,
+               const boost::function<void(const LogEntry&)>& onLogEntry)
+   : pImpl_(new Impl(logFilePath, onLogEntry))
+{
+}
+
+LatexLogParser::~LatexLogParser()
+{
+}
+
+void LatexLogParser::parse(const std::string& output)
+{
+   pImpl_->parse(output);
+}
+
+void LatexLogParser::finish()
+{
+   pImpl_->finish();
+}
+
+Error parseLatexLog(const FilePath& logFilePath, LogEntries* pLogEntries)
+{
+   boost::shared_ptr<std::istream> pIfs;
+   Error error = logFilePath.open_r(&pIfs);
+   if (error)
+      return error;
+
+   LatexLogParser parser(logFilePath,
+                         boost::bind(addLogEntry, pLogEntries, _1));
+
+   // feed the log to the parser a block at a time
+   std::vector<char> buffer(8192);
+   while (pIfs->read(&buffer[0], buffer.size()) || pIfs->gcount() > 0)
+   {
+      parser.parse(std::string(&buffer[0], pIfs->gcount()));
+      if (pIfs->eof())
+         break;
+   }
+
+   if (pIfs->bad())
+      return systemError(boost::system::errc::io_error, ERROR_LOCATION);
+
+   parser.finish();
+
    return Success();
 }
 
@@ -16,6 +16,7 @@
 #include <core/tex/TexSynctex.hpp>
 
 #include <iostream>
+#include <map>
 
 #include <boost/algorithm/string/trim.hpp>
 #include <boost/algorithm/string/predicate.hpp>
@@ -72,6 +73,10 @@ struct Synctex::Impl
 
    FilePath pdfPath;
    synctex_scanner_t scanner;
+
+   // synctex names for input files (resolving these requires comparing
+   // against every input file so we cache them for subsequent searches)
+   std::map<std::string,std::string> inputFileNames;
 };
 
 
@@ -195,6 +200,19 @@ PdfLocation Synctex::topOfPageContent(int page)
 }
 
 std::string Synctex::synctexNameForInputFile(const FilePath& inputFile)
+{
+   // check the cache
+   std::map<std::string,std::string>::const_iterator it =
+                     pImpl_->inputFileNames.find(inputFile.absolutePath());
+   if (it != pImpl_->inputFileNames.end())
+      return it->second;
+
+   std::string name = findSynctexNameForInputFile(inputFile);
+   pImpl_->inputFileNames[inputFile.absolutePath()] = name;
+   return name;
+}
+
+std::string Synctex::findSynctexNameForInputFile(const FilePath& inputFile)
 {
    // get the base directory for the input file
    FilePath parentPath = inputFile.parent();
@@ -53,7 +53,10 @@ struct ROptions
          autoReloadSource(false),
          restoreWorkspace(true),
          saveWorkspace(SA_SAVEASK),
-         rProfileOnResume(false)
+         rProfileOnResume(false),
+         lazyRestore(false),
+         suspendCompressionThreads(1),
+         backgroundSuspend(false)
    {
    }
    core::FilePath userHomePath;
@@ -76,6 +79,9 @@ struct ROptions
    bool restoreWorkspace;
    SA_TYPE saveWorkspace;
    bool rProfileOnResume;
+   bool lazyRestore;
+   int suspendCompressionThreads;
+   bool backgroundSuspend;
 };
       
 struct RInitInfo
@@ -163,6 +169,14 @@ struct RSuspendOptions
    bool excludePackages;
 };
 void suspendForRestart(const RSuspendOptions& options);
+
+// complete a suspend whose state is being saved in the background (does
+// not return if the save has completed)
+void checkBackgroundSuspend();
+
+// abandon a suspend whose state is being saved in the background (e.g.
+// because the user is active again)
+void cancelBackgroundSuspend();
    
 // set save action
 extern const int kSaveActionNoSave;
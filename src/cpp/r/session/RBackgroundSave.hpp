@@ -0,0 +1,60 @@
+/*
+ * RBackgroundSave.hpp
+ *
+ * Copyright (C) 2009-12 by RStudio, Inc.
+ *
+ * Unless you have received this program directly from RStudio pursuant
+ * to the terms of a commercial license agreement with RStudio, then
+ * this program is licensed to you under the terms of version 3 of the
+ * GNU Affero General Public License. This program is distributed WITHOUT
+ * ANY EXPRESS OR IMPLIED WARRANTY, INCLUDING THOSE OF NON-INFRINGEMENT,
+ * MERCHANTABILITY OR FITNESS FOR A PARTICULAR PURPOSE. Please refer to the
+ * AGPL (http://www.gnu.org/licenses/agpl-3.0.txt) for more details.
+ *
+ */
+
+#ifndef R_SESSION_BACKGROUND_SAVE_HPP
+#define R_SESSION_BACKGROUND_SAVE_HPP
+
+#include <boost/function.hpp>
+
+// The session state can be saved by a forked child process. The child saves
+// the state as it was at the time of the fork (so the session can continue
+// to run or exit immediately) and holds a lock on the state until the save
+// is complete. Sessions which restore the state wait for this lock.
+
+namespace core {
+   class Error;
+   class FilePath;
+}
+
+namespace r {
+namespace session {
+namespace background_save {
+
+// start saving the state. saveState is called in the child with the path
+// to save to (which is moved to statePath once it is complete) and returns
+// whether the state was saved. returns once the child holds the lock.
+core::Error start(
+            const core::FilePath& statePath,
+            const boost::function<bool(const core::FilePath&)>& saveState);
+
+// is a save in progress (and if so to which path)
+bool isRunning();
+core::FilePath statePath();
+
+// has the save in progress completed (pSaved indicates whether it succeeded)
+bool isCompleted(bool* pSaved);
+
+// abandon the save in progress
+void cancel();
+
+// wait for a save of the state by another process to complete
+void waitForSave(const core::FilePath& statePath);
+
+} // namespace background_save
+} // namespace session
+} // namespace r
+
+#endif // R_SESSION_BACKGROUND_SAVE_HPP
+
@@ -0,0 +1,310 @@
+/*
+ * RBackgroundSavePosix.cpp
+ *
+ * Copyright (C) 2009-12 by RStudio, Inc.
+ *
+ * Unless you have received this program directly from RStudio pursuant
+ * to the terms of a commercial license agreement with RStudio, then
+ * this program is licensed to you under the terms of version 3 of the
+ * GNU Affero General Public License. This program is distributed WITHOUT
+ * ANY EXPRESS OR IMPLIED WARRANTY, INCLUDING THOSE OF NON-INFRINGEMENT,
+ * MERCHANTABILITY OR FITNESS FOR A PARTICULAR PURPOSE. Please refer to the
+ * AGPL (http://www.gnu.org/licenses/agpl-3.0.txt) for more details.
+ *
+ */
+
+#include "RBackgroundSave.hpp"
+
+#include <signal.h>
+#include <unistd.h>
+#include <sys/wait.h>
+
+#include <cstdlib>
+
+#include <boost/bind.hpp>
+#include <boost/thread/thread.hpp>
+
+#include <core/Log.hpp>
+#include <core/Error.hpp>
+#include <core/FilePath.hpp>
+#include <core/FileLock.hpp>
+#include <core/system/System.hpp>
+#include <core/system/PosixSystem.hpp>
+
+using namespace core;
+
+namespace r {
+namespace session {
+namespace background_save {
+
+namespace {
+
+const int kPollIntervalMs = 50;
+
+// how long we wait for the child to acquire the lock
+const int kLockTimeoutMs = 30 * 1000;
+
+// how long we wait for another process to complete its save
+const int kSaveTimeoutMs = 5 * 60 * 1000;
+
+// the save in progress
+pid_t s_childPid = -1;
+FilePath s_statePath;
+
+FilePath lockFilePath(const FilePath& statePath)
+{
+   return statePath.parent().complete(statePath.filename() + ".lock");
+}
+
+// the child saves the state here and then moves it into place so that an
+// interrupted save never leaves a partial state at the state path
+FilePath tempStatePath(const FilePath& statePath)
+{
+   return statePath.parent().complete(statePath.filename() + ".saving");
+}
+
+void sleepMs(int milliseconds)
+{
+   boost::this_thread::sleep(boost::posix_time::milliseconds(milliseconds));
+}
+
+void reset()
+{
+   s_childPid = -1;
+   s_statePath = FilePath();
+}
+
+// NOTE: only the forking thread exists in the child so we must not use
+// anything owned by the session's other threads (e.g. the http server or
+// the file monitor) as their locks may have been held at the time of the
+// fork. the session's fork handlers disable its event processing and
+// client notifications in the child.
+bool saveStateInTemp(const FilePath& statePath,
+                     const boost::function<bool(const FilePath&)>& saveState)
+{
+   // start from an empty directory (a previous save may have been killed)
+   FilePath tempPath = tempStatePath(statePath);
+   Error error = tempPath.removeIfExists();
+   if (error)
+   {
+      LOG_ERROR(error);
+      return false;
+   }
+
+   bool saved = saveState(tempPath);
+
+   // replace the state with the one we saved
+   if (saved)
+   {
+      error = statePath.removeIfExists();
+      if (!error)
+         error = tempPath.move(statePath);
+      if (error)
+      {
+         LOG_ERROR(error);
+         saved = false;
+      }
+   }
+
+   if (!saved)
+   {
+      error = tempPath.removeIfExists();
+      if (error)
+         LOG_ERROR(error);
+   }
+
+   return saved;
+}
+
+void saveInChild(const FilePath& statePath,
+                 const FilePath& lockPath,
+                 const boost::function<bool(const FilePath&)>& saveState)
+{
+   int status = EXIT_FAILURE;
+   try
+   {
+      // detach from the session's process group (so we aren't terminated
+      // along with the session) and close inherited descriptors (an open
+      // listening socket would prevent a new session from using its port)
+      if (::setsid() == -1)
+         LOG_ERROR(systemError(errno, ERROR_LOCATION));
+      Error error = core::system::closeNonStdFileDescriptors();
+      if (error)
+         LOG_ERROR(error);
+
+      // acquire the lock (retry since the parent takes the lock briefly
+      // when checking whether we hold it)
+      FileLock lock;
+      for (int waited = 0; waited < kLockTimeoutMs; waited += kPollIntervalMs)
+      {
+         error = lock.acquire(lockPath);
+         if (!error)
+            break;
+         sleepMs(kPollIntervalMs);
+      }
+
+      if (!error)
+      {
+         if (saveStateInTemp(statePath, saveState))
+            status = EXIT_SUCCESS;
+
+         error = lock.release();
+         if (error)
+            LOG_ERROR(error);
+      }
+      else
+      {
+         LOG_ERROR(error);
+      }
+   }
+   CATCH_UNEXPECTED_EXCEPTION
+
+   // exit without running exit handlers or static destructors (they
+   // belong to the session)
+   ::_exit(status);
+}
+
+pid_t checkExited(pid_t pid, int* pStatus)
+{
+   return core::system::posixCall<pid_t>(
+                              boost::bind(::waitpid, pid, pStatus, WNOHANG));
+}
+
+void killChild(pid_t pid)
+{
+   if (::kill(pid, SIGKILL) == -1)
+      LOG_ERROR(systemError(errno, ERROR_LOCATION));
+
+   Error error = core::system::waitForProcessExit(pid);
+   if (error)
+      LOG_ERROR(error);
+}
+
+} // anonymous namespace
+
+Error start(const FilePath& statePath,
+            const boost::function<bool(const FilePath&)>& saveState)
+{
+   if (isRunning())
+   {
+      return systemError(boost::system::errc::operation_in_progress,
+                         ERROR_LOCATION);
+   }
+
+   // sessions check whether the state exists before they wait on the
+   // lock so make sure it does
+   Error error = statePath.ensureDirectory();
+   if (error)
+      return error;
+
+   FilePath lockPath = lockFilePath(statePath);
+
+   pid_t pid;
+   error = core::system::posixCall<pid_t>(::fork, ERROR_LOCATION, &pid);
+   if (error)
+      return error;
+
+   // child (doesn't return)
+   if (pid == 0)
+      saveInChild(statePath, lockPath, saveState);
+
+   // wait for the child to acquire the lock. the child has a snapshot
+   // of the session as of the fork but until it holds the lock another
+   // session could attempt to restore the state.
+   for (int waited = 0;
+        !FileLock::isLocked(lockPath);
+        waited += kPollIntervalMs)
+   {
+      int status;
+      bool exited = checkExited(pid, &status) != 0;
+      if (exited || waited >= kLockTimeoutMs)
+      {
+         if (!exited)
+            killChild(pid);
+
+         error = systemError(boost::system::errc::no_lock_available,
+                             ERROR_LOCATION);
+         error.addProperty("lock-file", lockPath);
+         return error;
+      }
+
+      sleepMs(kPollIntervalMs);
+   }
+
+   s_childPid = pid;
+   s_statePath = statePath;
+   return Success();
+}
+
+bool isRunning()
+{
+   return s_childPid != -1;
+}
+
+FilePath statePath()
+{
+   return s_statePath;
+}
+
+bool isCompleted(bool* pSaved)
+{
+   if (!isRunning())
+      return false;
+
+   int status = 0;
+   pid_t result = checkExited(s_childPid, &status);
+   if (result == 0)
+      return false;
+
+   // if we couldn't get the exit status (e.g. the child was reaped by a
+   // global handler) then assume that the save failed
+   if (result == -1)
+   {
+      LOG_ERROR(systemError(errno, ERROR_LOCATION));
+      *pSaved = false;
+   }
+   else
+   {
+      *pSaved = WIFEXITED(status) && WEXITSTATUS(status) == EXIT_SUCCESS;
+   }
+
+   reset();
+   return true;
+}
+
+void cancel()
+{
+   if (!isRunning())
+      return;
+
+   // the lock is released when the child exits. the state is only moved
+   // into place once it is complete so we just remove the partial one.
+   killChild(s_childPid);
+   Error error = tempStatePath(s_statePath).removeIfExists();
+   if (error)
+      LOG_ERROR(error);
+   reset();
+}
+
+void waitForSave(const FilePath& statePath)
+{
+   FilePath lockPath = lockFilePath(statePath);
+   for (int waited = 0;
+        FileLock::isLocked(lockPath);
+        waited += kPollIntervalMs)
+   {
+      if (waited >= kSaveTimeoutMs)
+      {
+         LOG_WARNING_MESSAGE("Timed out waiting for session state to be "
+                             "saved: " + statePath.absolutePath());
+         break;
+      }
+
+      sleepMs(kPollIntervalMs);
+   }
+}
+
+} // namespace background_save
+} // namespace session
+} // namespace r
+
@@ -0,0 +1,61 @@
+/*
+ * RBackgroundSaveWin32.cpp
+ *
+ * Copyright (C) 2009-12 by RStudio, Inc.
+ *
+ * Unless you have received this program directly from RStudio pursuant
+ * to the terms of a commercial license agreement with RStudio, then
+ * this program is licensed to you under the terms of version 3 of the
+ * GNU Affero General Public License. This program is distributed WITHOUT
+ * ANY EXPRESS OR IMPLIED WARRANTY, INCLUDING THOSE OF NON-INFRINGEMENT,
+ * MERCHANTABILITY OR FITNESS FOR A PARTICULAR PURPOSE. Please refer to the
+ * AGPL (http://www.gnu.org/licenses/agpl-3.0.txt) for more details.
+ *
+ */
+
+#include "RBackgroundSave.hpp"
+
+#include <core/Error.hpp>
+#include <core/FilePath.hpp>
+
+using namespace core;
+
+namespace r {
+namespace session {
+namespace background_save {
+
+// saving in the background requires fork
+
+Error start(const FilePath& statePath,
+            const boost::function<bool(const FilePath&)>& saveState)
+{
+   return systemError(boost::system::errc::not_supported, ERROR_LOCATION);
+}
+
+bool isRunning()
+{
+   return false;
+}
+
+FilePath statePath()
+{
+   return FilePath();
+}
+
+bool isCompleted(bool* pSaved)
+{
+   return false;
+}
+
+void cancel()
+{
+}
+
+void waitForSave(const FilePath& statePath)
+{
+}
+
+} // namespace background_save
+} // namespace session
+} // namespace r
+
@@ -0,0 +1,912 @@
+/*
+ * RGlobalEnvironment.cpp
+ *
+ * Copyright (C) 2009-12 by RStudio, Inc.
+ *
+ * Unless you have received this program directly from RStudio pursuant
+ * to the terms of a commercial license agreement with RStudio, then
+ * this program is licensed to you under the terms of version 3 of the
+ * GNU Affero General Public License. This program is distributed WITHOUT
+ * ANY EXPRESS OR IMPLIED WARRANTY, INCLUDING THOSE OF NON-INFRINGEMENT,
+ * MERCHANTABILITY OR FITNESS FOR A PARTICULAR PURPOSE. Please refer to the
+ * AGPL (http://www.gnu.org/licenses/agpl-3.0.txt) for more details.
+ *
+ */
+
+#include "RGlobalEnvironment.hpp"
+
+#include <algorithm>
+#include <map>
+#include <set>
+#include <string>
+#include <vector>
+#include <fstream>
+#include <sstream>
+
+#include <boost/bind.hpp>
+#include <boost/format.hpp>
+#include <boost/algorithm/string/join.hpp>
+#include <boost/algorithm/string/split.hpp>
+#include <boost/algorithm/string/predicate.hpp>
+#include <boost/algorithm/string/classification.hpp>
+#include <boost/cstdint.hpp>
+#include <boost/shared_ptr.hpp>
+#include <boost/iostreams/filtering_stream.hpp>
+#include <boost/iostreams/filter/gzip.hpp>
+
+#include <core/Log.hpp>
+#include <core/Error.hpp>
+#include <core/FilePath.hpp>
+#include <core/SafeConvert.hpp>
+#include <core/FileSerializer.hpp>
+#include <core/ParallelGzip.hpp>
+#include <core/http/Util.hpp>
+
+#define R_INTERNAL_FUNCTIONS
+#include <r/RInternal.hpp>
+#include <r/RExec.hpp>
+#include <r/RSexp.hpp>
+#include <r/RRoutines.hpp>
+
+using namespace core ;
+
+namespace r {
+namespace session {
+namespace global_environment {
+
+namespace {
+
+const char * const kIndexFile = "index";
+const char * const kTempExtension = ".tmp";
+
+// objects which share environments (other than the global environment and
+// package environments, which are serialized by name) are saved together
+// in a group blob containing a named list of the objects, so that they
+// still share them once restored. group blobs are named with this suffix.
+const char * const kGroupSuffix = "-g";
+
+// map of object name to the name of the blob it is saved in
+typedef std::map<std::string,std::string> Objects;
+
+// map of blob name to the names of the objects saved in it
+typedef std::map<std::string,std::vector<std::string> > Blobs;
+
+// SEXPs of the objects most recently saved to (or restored from) the
+// tracked path. a different SEXP indicates that an object was reassigned
+// (as with the workspace's environment monitor we only compare the
+// pointer values so the objects don't need to be protected). for objects
+// which were restored lazily and haven't been loaded yet this is the SEXP
+// of the promise they are bound to.
+FilePath s_trackedPath;
+std::map<std::string,SEXP> s_savedObjects;
+
+std::size_t s_compressionThreads = 1;
+
+// 64-bit FNV-1a checksum
+class Checksum
+{
+public:
+   Checksum()
+      : value_(UINT64_C(14695981039346656037))
+   {
+   }
+
+   void update(const char* data, std::size_t length)
+   {
+      for (std::size_t i = 0; i < length; i++)
+      {
+         value_ ^= static_cast<unsigned char>(data[i]);
+         value_ *= UINT64_C(1099511628211);
+      }
+   }
+
+   boost::uint64_t value() const { return value_; }
+
+private:
+   boost::uint64_t value_;
+};
+
+// blobs are named <checksum>-<sequence> (the checksum is of the serialized
+// object and the sequence makes names unique within the directory)
+std::string blobName(boost::uint64_t checksum, int sequence, bool group)
+{
+   return boost::str(boost::format("%016x-%d%s") % checksum % sequence %
+                     (group ? kGroupSuffix : ""));
+}
+
+bool isGroupBlob(const std::string& blobName)
+{
+   return boost::algorithm::ends_with(blobName, kGroupSuffix);
+}
+
+boost::uint64_t blobChecksum(const std::string& blobName)
+{
+   boost::uint64_t checksum = 0;
+   std::istringstream istr(blobName.substr(0, blobName.find('-')));
+   istr >> std::hex >> checksum;
+   return checksum;
+}
+
+int blobSequence(const std::string& blobName)
+{
+   std::string::size_type pos = blobName.find('-');
+   if (pos == std::string::npos)
+      return 0;
+   std::string::size_type end = blobName.find('-', pos + 1);
+   return safe_convert::stringTo<int>(
+                  blobName.substr(pos + 1, end - pos - 1), 0);
+}
+
+Blobs objectsByBlob(const Objects& objects)
+{
+   Blobs blobs;
+   for (Objects::const_iterator it = objects.begin(); it != objects.end(); ++it)
+      blobs[it->second].push_back(it->first);
+   return blobs;
+}
+
+Error readObjects(const FilePath& environmentPath, Objects* pObjects)
+{
+   FilePath indexPath = environmentPath.complete(kIndexFile);
+   if (!indexPath.exists())
+      return Success();
+
+   // the index file maps blob names to object names (the object names
+   // are url encoded so they can contain any character, and are separated
+   // by commas for group blobs)
+   std::map<std::string,std::string> index;
+   Error error = readStringMapFromFile(indexPath, &index);
+   if (error)
+      return error;
+
+   for (std::map<std::string,std::string>::const_iterator it = index.begin();
+        it != index.end();
+        ++it)
+   {
+      std::vector<std::string> names;
+      boost::algorithm::split(names,
+                              it->second,
+                              boost::algorithm::is_any_of(","));
+      for (std::vector<std::string>::const_iterator name = names.begin();
+           name != names.end();
+           ++name)
+      {
+         (*pObjects)[http::util::urlDecode(*name)] = it->first;
+      }
+   }
+
+   return Success();
+}
+
+Error writeObjects(const FilePath& environmentPath, const Objects& objects)
+{
+   std::map<std::string,std::string> index;
+   for (Objects::const_iterator it = objects.begin(); it != objects.end(); ++it)
+   {
+      std::string& names = index[it->second];
+      if (!names.empty())
+         names.append(",");
+      names.append(http::util::urlEncode(it->first));
+   }
+
+   // write to a temporary file first so that the index is always complete
+   FilePath indexPath = environmentPath.complete(kIndexFile);
+   FilePath tempPath = environmentPath.complete(kIndexFile +
+                                                std::string(kTempExtension));
+   Error error = writeStringMapToFile(tempPath, index);
+   if (error)
+      return error;
+
+   return tempPath.move(indexPath);
+}
+
+void removeUnreferencedBlobs(const FilePath& environmentPath,
+                             const Objects& objects)
+{
+   std::set<std::string> referenced;
+   for (Objects::const_iterator it = objects.begin(); it != objects.end(); ++it)
+      referenced.insert(it->second);
+
+   std::vector<FilePath> children;
+   Error error = environmentPath.children(&children);
+   if (error)
+   {
+      LOG_ERROR(error);
+      return;
+   }
+
+   for (std::vector<FilePath>::const_iterator it = children.begin();
+        it != children.end();
+        ++it)
+   {
+      std::string filename = it->filename();
+      if (filename == kIndexFile || referenced.count(filename))
+         continue;
+
+      error = it->remove();
+      if (error)
+         LOG_ERROR(error);
+   }
+}
+
+// serialization streams (note that these functions are called back from
+// within R so they must not throw or allocate objects with destructors)
+struct OutputStream
+{
+   OutputStream() : pStream(NULL), pEnvironments(NULL) {}
+
+   // NULL when only computing the checksum of an object
+   std::ostream* pStream;
+   Checksum checksum;
+
+   // receives the environments referenced by the object (if not NULL)
+   std::set<SEXP>* pEnvironments;
+};
+
+// environments referenced by the object currently being serialized
+std::set<SEXP>* s_pEnvironments = NULL;
+
+// R calls the persistence hook for each environment it serializes other
+// than the global, base, empty, namespace and package environments (as
+// well as for external pointers and weak references). we use it to find
+// the environments an object references and return R_NilValue so that
+// everything is serialized as usual.
+SEXP collectEnvironment(SEXP objectSEXP, SEXP dataSEXP)
+{
+   if (s_pEnvironments != NULL && TYPEOF(objectSEXP) == ENVSXP)
+      s_pEnvironments->insert(objectSEXP);
+   return R_NilValue;
+}
+
+void outputBytes(R_outpstream_t stream, void* buffer, int length)
+{
+   OutputStream* pOutput = static_cast<OutputStream*>(stream->data);
+   const char* data = static_cast<const char*>(buffer);
+   pOutput->checksum.update(data, length);
+   if (pOutput->pStream != NULL)
+      pOutput->pStream->write(data, length);
+}
+
+void outputChar(R_outpstream_t stream, int c)
+{
+   char ch = static_cast<char>(c);
+   outputBytes(stream, &ch, 1);
+}
+
+void serializeObject(SEXP objectSEXP, OutputStream* pOutput)
+{
+   struct R_outpstream_st stream;
+   R_InitOutPStream(&stream,
+                    pOutput,
+                    R_pstream_xdr_format,
+                    2,
+                    outputChar,
+                    outputBytes,
+                    pOutput->pEnvironments != NULL ? collectEnvironment : NULL,
+                    R_NilValue);
+   s_pEnvironments = pOutput->pEnvironments;
+   R_Serialize(objectSEXP, &stream);
+   s_pEnvironments = NULL;
+}
+
+void inputBytes(R_inpstream_t stream, void* buffer, int length)
+{
+   std::istream* pStream = static_cast<std::istream*>(stream->data);
+   if (!pStream->read(static_cast<char*>(buffer), length))
+      Rf_error("unexpected end of saved object");
+}
+
+int inputChar(R_inpstream_t stream)
+{
+   char ch;
+   inputBytes(stream, &ch, 1);
+   return static_cast<unsigned char>(ch);
+}
+
+// is this a lazily restored object which hasn't been loaded yet
+bool isDelayed(const std::string& name, SEXP objectSEXP)
+{
+   if (TYPEOF(objectSEXP) != PROMSXP || PRVALUE(objectSEXP) != R_UnboundValue)
+      return false;
+
+   std::map<std::string,SEXP>::const_iterator it = s_savedObjects.find(name);
+   return it != s_savedObjects.end() && it->second == objectSEXP;
+}
+
+void bindObject(const char* name,
+                SEXP objectSEXP,
+                std::map<std::string,SEXP>* pObjects)
+{
+   Rf_defineVar(Rf_install(name), objectSEXP, R_GlobalEnv);
+   pObjects->insert(std::make_pair(name, objectSEXP));
+}
+
+// unserialize a blob and bind the objects in it. a group blob contains a
+// named list of objects; when one of them is being loaded lazily we only
+// bind those which are still bound to the promise they were restored with
+// (the others have either been loaded already or reassigned)
+void unserializeBlob(std::istream* pStream,
+                     bool group,
+                     bool delayed,
+                     const char* name,
+                     std::map<std::string,SEXP>* pObjects)
+{
+   struct R_inpstream_st stream;
+   R_InitInPStream(&stream,
+                   pStream,
+                   R_pstream_any_format,
+                   inputChar,
+                   inputBytes,
+                   NULL,
+                   R_NilValue);
+   SEXP blobSEXP = R_Unserialize(&stream);
+   PROTECT(blobSEXP);
+   if (!group)
+   {
+      bindObject(name, blobSEXP, pObjects);
+   }
+   else if (TYPEOF(blobSEXP) == VECSXP)
+   {
+      SEXP namesSEXP = Rf_getAttrib(blobSEXP, R_NamesSymbol);
+      for (int i = 0; i < Rf_length(namesSEXP); i++)
+      {
+         const char* objectName = CHAR(STRING_ELT(namesSEXP, i));
+         SEXP currentSEXP = Rf_findVarInFrame(R_GlobalEnv,
+                                              Rf_install(objectName));
+         if (!delayed || isDelayed(objectName, currentSEXP))
+            bindObject(objectName, VECTOR_ELT(blobSEXP, i), pObjects);
+      }
+   }
+   UNPROTECT(1);
+}
+
+// compute the checksum of an object's serialized form (along with the
+// environments it references if requested)
+Error scanObject(SEXP objectSEXP,
+                 boost::uint64_t* pChecksum,
+                 std::set<SEXP>* pEnvironments = NULL)
+{
+   OutputStream output;
+   output.pEnvironments = pEnvironments;
+   Error error = r::exec::executeSafely(
+                        boost::bind(serializeObject, objectSEXP, &output));
+   if (error)
+      return error;
+
+   *pChecksum = output.checksum.value();
+   return Success();
+}
+
+// the named list saved in a group blob
+SEXP groupList(const std::vector<std::string>& names,
+                 const std::vector<SEXP>& objects,
+                 r::sexp::Protect* pProtect)
+{
+   SEXP listSEXP = Rf_allocVector(VECSXP, objects.size());
+   pProtect->add(listSEXP);
+   for (std::size_t i = 0; i < objects.size(); i++)
+      SET_VECTOR_ELT(listSEXP, i, objects[i]);
+   Rf_setAttrib(listSEXP, R_NamesSymbol, r::sexp::create(names, pProtect));
+   return listSEXP;
+}
+
+Error writeObject(const FilePath& environmentPath,
+                  SEXP objectSEXP,
+                  bool compress,
+                  int sequence,
+                  bool group,
+                  std::string* pBlobName)
+{
+   // write to a temporary file (we don't know the checksum until the
+   // object has been serialized)
+   FilePath tempPath = environmentPath.complete(
+            safe_convert::numberToString(sequence) + kTempExtension);
+   boost::shared_ptr<std::ostream> pFile;
+   Error error = tempPath.open_w(&pFile);
+   if (error)
+      return error;
+
+   OutputStream output;
+   bool failed = false;
+   try
+   {
+      boost::iostreams::filtering_ostream stream;
+      if (compress && s_compressionThreads != 1)
+         stream.push(core::gzip::ParallelCompressor(6, s_compressionThreads));
+      else if (compress)
+         stream.push(boost::iostreams::gzip_compressor());
+      stream.push(*pFile);
+
+      output.pStream = &stream;
+      error = r::exec::executeSafely(
+                        boost::bind(serializeObject, objectSEXP, &output));
+
+      stream.flush();
+      failed = !stream.good();
+      stream.reset();
+   }
+   catch(const std::exception&)
+   {
+      failed = true;
+   }
+
+   std::ofstream* pFileStream = dynamic_cast<std::ofstream*>(pFile.get());
+   if (pFileStream != NULL)
+      pFileStream->close();
+   failed = failed || pFile->fail();
+   pFile.reset();
+
+   if (!error && failed)
+   {
+      error = systemError(boost::system::errc::io_error, ERROR_LOCATION);
+      error.addProperty("path", tempPath.absolutePath());
+   }
+   if (error)
+   {
+      Error removeError = tempPath.removeIfExists();
+      if (removeError)
+         LOG_ERROR(removeError);
+      return error;
+   }
+
+   *pBlobName = blobName(output.checksum.value(), sequence, group);
+   return tempPath.move(environmentPath.complete(*pBlobName));
+}
+
+// read a blob (binding the objects in it as described for unserializeBlob).
+// name is the name of the object being read from the blob
+Error readObject(const FilePath& blobPath,
+                 const std::string& name,
+                 bool delayed,
+                 std::map<std::string,SEXP>* pObjects)
+{
+   boost::shared_ptr<std::istream> pFile;
+   Error error = blobPath.open_r(&pFile);
+   if (error)
+      return error;
+
+   try
+   {
+      // serialized objects begin with their format (e.g. 'X') so a gzip
+      // magic number indicates that the blob is compressed. blobs written
+      // in parallel can also be decompressed in parallel.
+      std::string header(core::gzip::kParallelHeaderSize, '\0');
+      pFile->read(&header[0], header.size());
+      std::streamsize count = pFile->gcount();
+      pFile->clear();
+      pFile->seekg(0);
+
+      boost::iostreams::filtering_istream stream;
+      if (core::gzip::isParallelCompressed(header.data(), count))
+      {
+         stream.push(core::gzip::ParallelDecompressor(s_compressionThreads));
+      }
+      else if (count > 0 && header[0] == '\x1f')
+      {
+         stream.push(boost::iostreams::gzip_decompressor());
+      }
+      stream.push(*pFile);
+
+      bool group = isGroupBlob(blobPath.filename());
+      error = r::exec::executeSafely(boost::bind(unserializeBlob,
+                                                 &stream,
+                                                 group,
+                                                 delayed,
+                                                 name.c_str(),
+                                                 pObjects));
+   }
+   catch(const std::exception& e)
+   {
+      error = systemError(boost::system::errc::io_error, ERROR_LOCATION);
+      error.addProperty("what", e.what());
+   }
+
+   if (!error && pObjects->find(name) == pObjects->end())
+   {
+      error = systemError(boost::system::errc::invalid_argument,
+                          ERROR_LOCATION);
+   }
+
+   if (error)
+      error.addProperty("path", blobPath.absolutePath());
+   return error;
+}
+
+void evaluateObject(const char* name, SEXP* pObjectSEXP)
+{
+   *pObjectSEXP = Rf_eval(Rf_install(name), R_GlobalEnv);
+}
+
+// load an object (replacing the promise it is bound to) by evaluating it
+Error loadDelayed(const std::string& name, SEXP* pObjectSEXP)
+{
+   return r::exec::executeSafely(boost::bind(evaluateObject,
+                                             name.c_str(),
+                                             pObjectSEXP));
+}
+
+Error delayObject(const FilePath& blobPath,
+                  const std::string& name,
+                  SEXP* pPromiseSEXP)
+{
+   Error error = r::exec::RFunction(".rs.delayLoadGlobalObject",
+                                    name,
+                                    blobPath.absolutePath()).call();
+   if (error)
+      return error;
+
+   *pPromiseSEXP = Rf_findVarInFrame(R_GlobalEnv, Rf_install(name.c_str()));
+   return Success();
+}
+
+SEXP rs_loadGlobalObject(SEXP nameSEXP, SEXP blobPathSEXP)
+{
+   try
+   {
+      std::string name = r::sexp::asString(nameSEXP);
+      FilePath blobPath(r::sexp::asString(blobPathSEXP));
+
+      // loading an object from a group blob also loads the other objects
+      // in the group which are still waiting to be loaded
+      std::map<std::string,SEXP> objects;
+      Error error = readObject(blobPath, name, true, &objects);
+      if (error)
+      {
+         LOG_ERROR(error);
+         throw r::exec::RErrorException("Unable to load " + name + " (" +
+                                        error.code().message() + ")");
+      }
+
+      // the loaded objects replace their promises as the saved objects
+      if (blobPath.parent() == s_trackedPath)
+      {
+         for (std::map<std::string,SEXP>::const_iterator it = objects.begin();
+              it != objects.end();
+              ++it)
+         {
+            s_savedObjects[it->first] = it->second;
+         }
+      }
+
+      return objects[name];
+   }
+   catch(r::exec::RErrorException e)
+   {
+      r::exec::error(e.message());
+   }
+   CATCH_UNEXPECTED_EXCEPTION
+
+   return R_NilValue;
+}
+
+SEXP rs_isDelayedGlobalObject(SEXP nameSEXP)
+{
+   std::string name = r::sexp::asString(nameSEXP);
+   SEXP objectSEXP = Rf_findVarInFrame(R_GlobalEnv, Rf_install(name.c_str()));
+   r::sexp::Protect rProtect;
+   return r::sexp::create(isDelayed(name, objectSEXP), &rProtect);
+}
+
+std::size_t findGroup(std::vector<std::size_t>* pGroups, std::size_t i)
+{
+   std::vector<std::size_t>& groups = *pGroups;
+   while (groups[i] != i)
+   {
+      groups[i] = groups[groups[i]];
+      i = groups[i];
+   }
+   return i;
+}
+
+// partition objects (by index) into groups of objects which share
+// environments with each other, either directly or through other objects
+std::vector<std::vector<std::size_t> > groupObjects(
+                           const std::vector<std::set<SEXP> >& environments)
+{
+   std::vector<std::size_t> groups(environments.size());
+   for (std::size_t i = 0; i < groups.size(); i++)
+      groups[i] = i;
+
+   // join each object's group with that of the first object which
+   // referenced each of its environments
+   std::map<SEXP,std::size_t> owners;
+   for (std::size_t i = 0; i < environments.size(); i++)
+   {
+      for (std::set<SEXP>::const_iterator it = environments[i].begin();
+           it != environments[i].end();
+           ++it)
+      {
+         std::map<SEXP,std::size_t>::iterator owner =
+                                    owners.insert(std::make_pair(*it, i)).first;
+         std::size_t group = findGroup(&groups, i);
+         groups[group] = findGroup(&groups, owner->second);
+      }
+   }
+
+   // list the members of each group in order
+   std::vector<std::vector<std::size_t> > members;
+   std::map<std::size_t,std::size_t> memberIndexes;
+   for (std::size_t i = 0; i < groups.size(); i++)
+   {
+      std::size_t group = findGroup(&groups, i);
+      std::map<std::size_t,std::size_t>::iterator it =
+                                                   memberIndexes.find(group);
+      if (it == memberIndexes.end())
+      {
+         it = memberIndexes.insert(
+                        std::make_pair(group, members.size())).first;
+         members.push_back(std::vector<std::size_t>());
+      }
+      members[it->second].push_back(i);
+   }
+   return members;
+}
+
+void addRestoreError(Error error, const std::string& name, Error* pRestoreError)
+{
+   error.addProperty("object", name);
+   if (!*pRestoreError)
+      *pRestoreError = error;
+   else
+      LOG_ERROR(error);
+}
+
+} // anonymous namespace
+
+bool hasObjects(const FilePath& environmentPath)
+{
+   return environmentPath.complete(kIndexFile).exists();
+}
+
+Error save(const FilePath& environmentPath, bool compress)
+{
+   Error error = environmentPath.ensureDirectory();
+   if (error)
+      return error;
+
+   // read the objects saved previously
+   Objects previousObjects;
+   error = readObjects(environmentPath, &previousObjects);
+   if (error)
+      LOG_ERROR(error);
+
+   int sequence = 0;
+   for (Objects::const_iterator it = previousObjects.begin();
+        it != previousObjects.end();
+        ++it)
+   {
+      sequence = std::max(sequence, blobSequence(it->second));
+   }
+
+   // identities are only meaningful if we saved or restored this path
+   bool tracked = (environmentPath == s_trackedPath);
+
+   // list in the same order as the index (so groups list their objects in
+   // the same order as the blobs they were previously saved in)
+   r::sexp::Protect rProtect;
+   std::vector<r::sexp::Variable> variables;
+   r::sexp::listEnvironment(R_GlobalEnv, true, &rProtect, &variables);
+   std::sort(variables.begin(), variables.end());
+
+   // objects which haven't been loaded since they were lazily restored
+   // keep their blobs (or are loaded if we are saving elsewhere). a group
+   // blob is only kept if none of its objects have been loaded or reassigned
+   // (otherwise its objects are loaded and grouped again)
+   std::set<std::string> delayed;
+   for (std::vector<r::sexp::Variable>::const_iterator it = variables.begin();
+        it != variables.end();
+        ++it)
+   {
+      if (tracked && isDelayed(it->first, it->second))
+         delayed.insert(it->first);
+   }
+
+   Blobs previousBlobs = objectsByBlob(previousObjects);
+   std::set<std::string> keptBlobs;
+   for (Blobs::const_iterator it = previousBlobs.begin();
+        it != previousBlobs.end();
+        ++it)
+   {
+      bool keep = true;
+      for (std::vector<std::string>::const_iterator name = it->second.begin();
+           name != it->second.end();
+           ++name)
+      {
+         keep = keep && delayed.count(*name) > 0;
+      }
+      if (keep)
+         keptBlobs.insert(it->first);
+   }
+
+   Objects objects;
+   std::map<std::string,SEXP> savedObjects;
+   std::vector<std::string> names;
+   std::vector<SEXP> liveObjects;
+   for (std::vector<r::sexp::Variable>::const_iterator it = variables.begin();
+        it != variables.end();
+        ++it)
+   {
+      const std::string& name = it->first;
+      Objects::const_iterator previous = previousObjects.find(name);
+      if (previous != previousObjects.end() &&
+          keptBlobs.count(previous->second) > 0)
+      {
+         objects[name] = previous->second;
+         savedObjects[name] = it->second;
+         continue;
+      }
+
+      // loading an object from a group blob also binds the other objects in
+      // the group so we use the current binding rather than the listing
+      SEXP objectSEXP = Rf_findVarInFrame(R_GlobalEnv,
+                                          Rf_install(name.c_str()));
+      if (isDelayed(name, objectSEXP))
+      {
+         error = loadDelayed(name, &objectSEXP);
+         if (error)
+            return error;
+      }
+      rProtect.add(objectSEXP);
+
+      names.push_back(name);
+      liveObjects.push_back(objectSEXP);
+      savedObjects[name] = objectSEXP;
+   }
+
+   // find the environments each object references (along with the checksum
+   // of its serialized form) then group objects which share environments
+   std::vector<boost::uint64_t> checksums(liveObjects.size());
+   std::vector<std::set<SEXP> > environments(liveObjects.size());
+   for (std::size_t i = 0; i < liveObjects.size(); i++)
+   {
+      error = scanObject(liveObjects[i], &checksums[i], &environments[i]);
+      if (error)
+      {
+         error.addProperty("object", names[i]);
+         return error;
+      }
+   }
+   std::vector<std::vector<std::size_t> > groups = groupObjects(environments);
+
+   // objects may have been modified in place (or been removed and then
+   // replaced by an object at the same address) so we compare the checksum
+   // of each object (or group) with that of its saved blob
+   for (std::vector<std::vector<std::size_t> >::const_iterator group =
+                                                            groups.begin();
+        group != groups.end();
+        ++group)
+   {
+      std::vector<std::string> groupNames;
+      std::vector<SEXP> groupObjects;
+      for (std::vector<std::size_t>::const_iterator i = group->begin();
+           i != group->end();
+           ++i)
+      {
+         groupNames.push_back(names[*i]);
+         groupObjects.push_back(liveObjects[*i]);
+      }
+
+      bool isGroup = groupNames.size() > 1;
+      SEXP objectSEXP = liveObjects[group->front()];
+      boost::uint64_t checksum = checksums[group->front()];
+      if (isGroup)
+      {
+         objectSEXP = groupList(groupNames, groupObjects, &rProtect);
+         error = scanObject(objectSEXP, &checksum);
+         if (error)
+            return error;
+      }
+
+      std::string blob;
+      Objects::const_iterator previous = previousObjects.find(
+                                                      groupNames.front());
+      if (previous != previousObjects.end() &&
+          isGroupBlob(previous->second) == isGroup &&
+          previousBlobs[previous->second] == groupNames &&
+          checksum == blobChecksum(previous->second))
+      {
+         blob = previous->second;
+      }
+      else
+      {
+         error = writeObject(environmentPath, objectSEXP, compress,
+                             ++sequence, isGroup, &blob);
+         if (error)
+         {
+            error.addProperty("object", boost::algorithm::join(groupNames,
+                                                               ", "));
+            return error;
+         }
+      }
+
+      for (std::vector<std::string>::const_iterator name = groupNames.begin();
+           name != groupNames.end();
+           ++name)
+      {
+         objects[*name] = blob;
+      }
+   }
+
+   // write the index then remove the blobs of changed and removed objects
+   error = writeObjects(environmentPath, objects);
+   if (error)
+      return error;
+   removeUnreferencedBlobs(environmentPath, objects);
+
+   s_trackedPath = environmentPath;
+   s_savedObjects.swap(savedObjects);
+
+   return Success();
+}
+
+Error restore(const FilePath& environmentPath, bool lazy)
+{
+   Objects objects;
+   Error error = readObjects(environmentPath, &objects);
+   if (error)
+      return error;
+
+   // restore as many objects as we can (returning the first error)
+   Error restoreError;
+   std::map<std::string,SEXP> restoredObjects;
+   Blobs blobs = objectsByBlob(objects);
+   for (Blobs::const_iterator it = blobs.begin(); it != blobs.end(); ++it)
+   {
+      FilePath blobPath = environmentPath.complete(it->first);
+      const std::vector<std::string>& names = it->second;
+      if (lazy)
+      {
+         for (std::vector<std::string>::const_iterator name = names.begin();
+              name != names.end();
+              ++name)
+         {
+            SEXP promiseSEXP = R_NilValue;
+            error = delayObject(blobPath, *name, &promiseSEXP);
+            if (error)
+               addRestoreError(error, *name, &restoreError);
+            else
+               restoredObjects[*name] = promiseSEXP;
+         }
+      }
+      else
+      {
+         error = readObject(blobPath, names.front(), false, &restoredObjects);
+         if (error)
+         {
+            addRestoreError(error,
+                            boost::algorithm::join(names, ", "),
+                            &restoreError);
+         }
+      }
+   }
+
+   s_trackedPath = environmentPath;
+   s_savedObjects.swap(restoredObjects);
+
+   return restoreError;
+}
+
+void setCompressionThreads(std::size_t threads)
+{
+   s_compressionThreads = threads;
+}
+
+void registerRoutines()
+{
+   R_CallMethodDef loadGlobalObjectMethodDef ;
+   loadGlobalObjectMethodDef.name = "rs_loadGlobalObject" ;
+   loadGlobalObjectMethodDef.fun = (DL_FUNC) rs_loadGlobalObject ;
+   loadGlobalObjectMethodDef.numArgs = 2;
+   r::routines::addCallMethod(loadGlobalObjectMethodDef);
+
+   R_CallMethodDef isDelayedGlobalObjectMethodDef ;
+   isDelayedGlobalObjectMethodDef.name = "rs_isDelayedGlobalObject" ;
+   isDelayedGlobalObjectMethodDef.fun = (DL_FUNC) rs_isDelayedGlobalObject ;
+   isDelayedGlobalObjectMethodDef.numArgs = 1;
+   r::routines::addCallMethod(isDelayedGlobalObjectMethodDef);
+}
+
+} // namespace global_environment
+} // namespace session
+} // namespace r
+
@@ -0,0 +1,58 @@
+/*
+ * RGlobalEnvironment.hpp
+ *
+ * Copyright (C) 2009-12 by RStudio, Inc.
+ *
+ * Unless you have received this program directly from RStudio pursuant
+ * to the terms of a commercial license agreement with RStudio, then
+ * this program is licensed to you under the terms of version 3 of the
+ * GNU Affero General Public License. This program is distributed WITHOUT
+ * ANY EXPRESS OR IMPLIED WARRANTY, INCLUDING THOSE OF NON-INFRINGEMENT,
+ * MERCHANTABILITY OR FITNESS FOR A PARTICULAR PURPOSE. Please refer to the
+ * AGPL (http://www.gnu.org/licenses/agpl-3.0.txt) for more details.
+ *
+ */
+
+#ifndef R_SESSION_GLOBAL_ENVIRONMENT_HPP
+#define R_SESSION_GLOBAL_ENVIRONMENT_HPP
+
+// The global environment is saved as one blob per object (along with an
+// index which maps object names to blobs). When the environment is saved
+// again into the same directory only the objects which have changed since
+// they were last saved (or restored) are rewritten. Objects which share
+// environments are saved together in a single blob so that they still
+// share them when restored. Objects can also be restored lazily, in which
+// case each object is bound to a promise which loads it (along with the
+// rest of its blob) when it is first accessed.
+
+#include <cstddef>
+
+namespace core {
+   class Error;
+   class FilePath;
+}
+
+namespace r {
+namespace session {
+namespace global_environment {
+
+bool hasObjects(const core::FilePath& environmentPath);
+
+core::Error save(const core::FilePath& environmentPath, bool compress);
+
+core::Error restore(const core::FilePath& environmentPath, bool lazy);
+
+// register the routines used to load lazily restored objects
+void registerRoutines();
+
+// set the number of threads used to compress (and decompress) objects. the
+// default of 1 uses a standard gzip stream, otherwise objects are written
+// as blocks which are compressed in parallel (0 for one thread per core)
+void setCompressionThreads(std::size_t threads);
+
+} // namespace global_environment
+} // namespace session
+} // namespace r
+
+#endif // R_SESSION_GLOBAL_ENVIRONMENT_HPP
+
@@ -20,6 +20,7 @@
 //
 
 #include "RSearchPath.hpp"
+#include "RGlobalEnvironment.hpp"
 
 #include <string>
 #include <vector>
@@ -54,6 +55,7 @@ namespace search_path {
 namespace {   
 
 const char * const kEnvironmentFile = "environment";
+const char * const kGlobalEnvironmentDir = "global_environment";
 const char * const kSearchPathDir = "search_path";
    
 const char * const kSearchPathElementsDir = "search_path_elements";
@@ -79,16 +81,15 @@ void reportRestoreError(const std::string& context,
    REprintf(report.c_str());
 }   
    
-Error saveGlobalEnvironmentToFile(const FilePath& environmentFile)
+Error restoreGlobalEnvironment(const core::FilePath& statePath, bool lazy)
 {
-   std::string envPath =
-            string_utils::utf8ToSystem(environmentFile.absolutePath());
-   return executeSafely(boost::bind(R_SaveGlobalEnvToFile, envPath.c_str()));
-}
-   
-Error restoreGlobalEnvironment(const core::FilePath& environmentFile)
-{
-   // tolerate no environment saved
+   FilePath environmentPath = statePath.complete(kGlobalEnvironmentDir);
+   if (global_environment::hasObjects(environmentPath))
+      return global_environment::restore(environmentPath, lazy);
+
+   // fall back to an environment file written by previous versions
+   // (tolerating no environment saved)
+   FilePath environmentFile = statePath.complete(kEnvironmentFile);
    if (!environmentFile.exists())
       return Success();
    
@@ -225,11 +226,10 @@ void attachEnvironmentData(const FilePath& dataFilePath,
 } // anonymous namespace
    
 
-Error save(const FilePath& statePath)
+Error save(const FilePath& statePath, bool compress)
 {
    // save the global environment
-   FilePath environmentFile = statePath.complete(kEnvironmentFile);
-   Error error = saveGlobalEnvironmentToFile(environmentFile);
+   Error error = saveGlobalEnvironment(statePath, compress);
    if (error)
       return error;
    
@@ -319,17 +319,21 @@ Error save(const FilePath& statePath)
 }
 
 
-Error saveGlobalEnvironment(const FilePath& statePath)
+Error saveGlobalEnvironment(const FilePath& statePath, bool compress)
 {
-   FilePath environmentFile = statePath.complete(kEnvironmentFile);
-   return saveGlobalEnvironmentToFile(environmentFile);
+   Error error = global_environment::save(
+                           statePath.complete(kGlobalEnvironmentDir), compress);
+   if (error)
+      return error;
+
+   // remove the environment file written by previous versions
+   return statePath.complete(kEnvironmentFile).removeIfExists();
 }
 
-Error restore(const FilePath& statePath)
+Error restore(const FilePath& statePath, bool lazy)
 {
    // restore global environment
-   FilePath environmentFile = statePath.complete(kEnvironmentFile);
-   Error error = restoreGlobalEnvironment(environmentFile);
+   Error error = restoreGlobalEnvironment(statePath, lazy);
    if (error)
       return error;
    
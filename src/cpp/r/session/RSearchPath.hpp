@@ -25,9 +25,10 @@ namespace r {
 namespace session {
 namespace search_path {
 
-core::Error save(const core::FilePath& statePath);
-core::Error saveGlobalEnvironment(const core::FilePath& statePath);
-core::Error restore(const core::FilePath& statePath);
+core::Error save(const core::FilePath& statePath, bool compress);
+core::Error saveGlobalEnvironment(const core::FilePath& statePath,
+                                  bool compress);
+core::Error restore(const core::FilePath& statePath, bool lazy);
    
 } // namespace search_path
 } // namespace session
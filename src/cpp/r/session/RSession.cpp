@@ -48,6 +48,8 @@
 
 #include "RClientMetrics.hpp"
 #include "RSessionState.hpp"
+#include "RGlobalEnvironment.hpp"
+#include "RBackgroundSave.hpp"
 #include "RRestartContext.hpp"
 #include "REmbedded.hpp"
 
@@ -211,6 +213,26 @@ bool saveSessionState(const RSuspendOptions& options,
    }
 }
    
+bool saveSessionStateInBackground(const RSuspendOptions& options,
+                                  const FilePath& suspendedSessionPath,
+                                  bool disableSaveCompression)
+{
+   // the state is saved by a forked child (which has a snapshot of the
+   // session as of the fork)
+   Error error = background_save::start(suspendedSessionPath,
+                                        boost::bind(saveSessionState,
+                                                    options,
+                                                    _1,
+                                                    disableSaveCompression));
+   if (error)
+   {
+      LOG_ERROR(error);
+      return false;
+   }
+
+   return true;
+}
+
 void deferredRestoreSuspendedSession(
                      const boost::function<Error()>& deferredRestoreAction)
 {
@@ -340,6 +362,7 @@ const int kSerializationActionResumeSession = 4;
 const int kSerializationActionCompleted = 5;
 
 void restoreSession(const FilePath& suspendedSessionPath,
+                    bool lazyRestore,
                     std::string* pErrorMessages)
 {
    // don't show output during deserialization (packages loaded
@@ -354,6 +377,7 @@ void restoreSession(const FilePath& suspendedSessionPath,
    boost::function<Error()> deferredRestoreAction;
    r::session::state::restore(suspendedSessionPath,
                               s_options.serverMode,
+                              lazyRestore,
                               &deferredRestoreAction,
                               pErrorMessages);
 
@@ -421,9 +445,12 @@ Error initialize()
    // first check for a pending restart
    if (restartContext().hasSessionState())
    {
-      // restore session
+      // restore session (objects can't be loaded on demand because the
+      // restart context is removed once the restore is complete)
       std::string errorMessages ;
-      restoreSession(restartContext().sessionStatePath(), &errorMessages);
+      restoreSession(restartContext().sessionStatePath(),
+                     false,
+                     &errorMessages);
 
       // show any error messages
       if (!errorMessages.empty())
@@ -436,7 +463,9 @@ Error initialize()
    {  
       // restore session
       std::string errorMessages ;
-      restoreSession(s_suspendedSessionPath, &errorMessages);
+      restoreSession(s_suspendedSessionPath,
+                     s_options.lazyRestore,
+                     &errorMessages);
       
       // show any error messages
       if (!errorMessages.empty())
@@ -1307,6 +1336,12 @@ Error run(const ROptions& options, const RCallbacks& callbacks)
    restartContext().initialize(s_options.scopedScratchPath,
                                s_options.sessionPort);
 
+   // wait for the previous session if it is still saving its state
+   // in the background
+   background_save::waitForSave(s_suspendedSessionPath);
+   if (restartContext().hasSessionState())
+      background_save::waitForSave(restartContext().sessionStatePath());
+
    // register browseURL method
    R_CallMethodDef browseURLMethod ;
    browseURLMethod.name = "rs_browseURL";
@@ -1349,6 +1384,13 @@ Error run(const ROptions& options, const RCallbacks& callbacks)
    saveHistoryMethodDef.numArgs = 1;
    r::routines::addCallMethod(saveHistoryMethodDef);
 
+   // register methods used to load lazily restored objects
+   global_environment::registerRoutines();
+
+   // threads used to compress the global environment when suspending
+   int threads = s_options.suspendCompressionThreads;
+   global_environment::setCompressionThreads(threads > 0 ? threads : 0);
+
 
    // run R
 
@@ -1456,6 +1498,19 @@ bool isSuspendable(const std::string& currentPrompt)
 }
    
 
+void completeSuspend()
+{
+   // set suspended flag so cleanup code can act accordingly
+   s_suspended = true;
+
+   // call suspend hook
+   s_callbacks.suspended();
+
+   // clean up but don't save workspace or runLast because we have
+   // been suspended
+   RCleanUp(SA_NOSAVE, 0, FALSE);
+}
+
 bool suspend(const RSuspendOptions& options,
              const FilePath& suspendedSessionPath,
              bool disableSaveCompression,
@@ -1468,6 +1523,23 @@ bool suspend(const RSuspendOptions& options,
    if (disableSaveCompression)
       BOOST_ASSERT(force == true);
 
+   // a save in the background is cancelled by any activity so it has a
+   // snapshot of the current state. if we are forced we can complete the
+   // suspend immediately, otherwise the save is left to finish.
+   if (background_save::isRunning())
+   {
+      if (background_save::statePath() == suspendedSessionPath)
+      {
+         if (!force)
+            return false;
+
+         completeSuspend();
+         return true;
+      }
+
+      background_save::cancel();
+   }
+
    // commit all client state
    saveClientState(ClientStateCommitAll);
 
@@ -1477,6 +1549,21 @@ bool suspend(const RSuspendOptions& options,
       r::session::graphics::display().clear();
    }
 
+   // save the session state in the background if requested. forced
+   // suspends exit as soon as the child has its snapshot, otherwise we
+   // return to idle and complete the suspend once the save succeeds.
+   if (s_options.backgroundSuspend &&
+       saveSessionStateInBackground(options,
+                                    suspendedSessionPath,
+                                    disableSaveCompression))
+   {
+      if (!force)
+         return false;
+
+      completeSuspend();
+      return true;
+   }
+
    // save the session state. errors are handled internally and reported
    // directly to the end user and written to the server log.
    bool suspend = saveSessionState(options,
@@ -1494,15 +1581,7 @@ bool suspend(const RSuspendOptions& options,
    // only continue with exiting the process if we actually succeed in saving
    if(suspend)
    {      
-      // set suspended flag so cleanup code can act accordingly
-      s_suspended = true;
-      
-      // call suspend hook
-      s_callbacks.suspended();
-   
-      // clean up but don't save workspace or runLast because we have
-      // been suspended
-      RCleanUp(SA_NOSAVE, 0, FALSE);
+      completeSuspend();
       
       // keep compiler happy (this line will never execute)
       return true;
@@ -1527,6 +1606,24 @@ void suspendForRestart(const RSuspendOptions& options)
            true); // force suspend
 }
 
+void checkBackgroundSuspend()
+{
+   bool saved = false;
+   if (!background_save::isCompleted(&saved))
+      return;
+
+   if (saved)
+      completeSuspend();
+   else
+      LOG_ERROR_MESSAGE("Suspend abandoned (session state could not be "
+                        "saved in the background)");
+}
+
+void cancelBackgroundSuspend()
+{
+   background_save::cancel();
+}
+
 // set save action
 const int kSaveActionNoSave = 0;
 const int kSaveActionSave = 1;
@@ -343,7 +343,7 @@ bool save(const FilePath& statePath,
 
    if (!excludePackages)
    {
-      error = search_path::save(statePath);
+      error = search_path::save(statePath, !disableSaveCompression);
       if (error)
       {
          reportError(kSaving, kSearchPath, error, ERROR_LOCATION);
@@ -352,7 +352,8 @@ bool save(const FilePath& statePath,
    }
    else
    {
-      error = search_path::saveGlobalEnvironment(statePath);
+      error = search_path::saveGlobalEnvironment(statePath,
+                                                 !disableSaveCompression);
       if (error)
       {
          reportError(kSaving, kGlobalEnvironment, error, ERROR_LOCATION);
@@ -385,12 +386,8 @@ bool saveMinimal(const core::FilePath& statePath,
    // save global environment if requested
    if (saveGlobalEnvironment)
    {
-      // disable save compression
-      Error error = r::exec::RFunction(".rs.disableSaveCompression").call();
-      if (error)
-         LOG_ERROR(error);
-
-      error = search_path::saveGlobalEnvironment(statePath);
+      // save without compression
+      Error error = search_path::saveGlobalEnvironment(statePath, false);
       if (error)
       {
          reportError(kSaving, kGlobalEnvironment, error, ERROR_LOCATION);
@@ -417,10 +414,12 @@ bool rProfileOnRestore(const core::FilePath& statePath)
    return settings.getBool(kRProfileOnRestore, true);
 }
 
-Error deferredRestore(const FilePath& statePath, bool serverMode)
+Error deferredRestore(const FilePath& statePath,
+                      bool serverMode,
+                      bool lazyRestore)
 {
    // search path
-   Error error = search_path::restore(statePath);
+   Error error = search_path::restore(statePath, lazyRestore);
    if (error)
       return error;
 
@@ -442,6 +441,7 @@ Error deferredRestore(const FilePath& statePath, bool serverMode)
    
 bool restore(const FilePath& statePath,
              bool serverMode,
+             bool lazyRestore,
              boost::function<Error()>* pDeferredRestoreAction,
              std::string* pErrorMessages)
 {
@@ -508,7 +508,9 @@ bool restore(const FilePath& statePath,
    // to bring their UI up and then receive an event indicating that the
    // latent deserialization actions are taking place
    *pDeferredRestoreAction = boost::bind(deferredRestore,
-                                             statePath, serverMode);
+                                         statePath,
+                                         serverMode,
+                                         lazyRestore);
    
    // return true if there were no error messages
    return pErrorMessages->empty();
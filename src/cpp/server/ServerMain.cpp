@@ -17,9 +17,14 @@
 #include <pthread.h>
 #include <signal.h>
 
+#include <sstream>
+
 #include <core/Error.hpp>
 #include <core/ProgramStatus.hpp>
 #include <core/ProgramOptions.hpp>
+#include <core/PeriodicCommand.hpp>
+
+#include <core/json/Json.hpp>
 
 #include <core/text/TemplateFilter.hpp>
 
@@ -62,8 +67,73 @@ namespace {
 bool mainPageFilter(const core::http::Request& request,
                     core::http::Response* pResponse)
 {
-   return server::browser::supportedBrowserFilter(request, pResponse) &&
-          auth::handler::mainPageFilter(request, pResponse);
+   if (!server::browser::supportedBrowserFilter(request, pResponse) ||
+       !auth::handler::mainPageFilter(request, pResponse))
+   {
+      return false;
+   }
+
+   // note activity (and possibly prewarm the session) for the user
+   if (server::options().rsessionPrewarmEnabled())
+   {
+      std::string username = auth::handler::userIdentifierToLocalUsername(
+                              auth::handler::getUserIdentifier(request));
+      if (!username.empty())
+         sessionManager().notifyUserActive(username);
+   }
+
+   return true;
+}
+
+void handleAuthMetricsRequest(const std::string& username,
+                              const http::Request& request,
+                              http::Response* pResponse)
+{
+   // metrics are only available to members of the admin group
+   std::string adminGroup = server::options().authAdminGroup();
+   bool isAdmin = false;
+   if (!adminGroup.empty())
+   {
+      Error error = core::system::userBelongsToGroup(username,
+                                                     adminGroup,
+                                                     &isAdmin);
+      if (error)
+         LOG_ERROR(error);
+   }
+   if (!isAdmin)
+   {
+      pResponse->setError(http::status::Forbidden, "Forbidden");
+      return;
+   }
+
+   auth::ValidateUserCacheStats userStats = auth::validateUserCacheStats();
+   json::Object userCacheJson;
+   userCacheJson["hits"] = userStats.hits;
+   userCacheJson["misses"] = userStats.misses;
+   userCacheJson["size"] = userStats.size;
+
+   auth::secure_cookie::CacheStats cookieStats =
+                                       auth::secure_cookie::cacheStats();
+   json::Object cookieCacheJson;
+   cookieCacheJson["hits"] = cookieStats.hits;
+   cookieCacheJson["misses"] = cookieStats.misses;
+   cookieCacheJson["size"] = cookieStats.size;
+
+   json::Object metricsJson;
+   metricsJson["validate_user_cache"] = userCacheJson;
+   metricsJson["secure_cookie_cache"] = cookieCacheJson;
+
+   std::ostringstream ostr;
+   json::write(metricsJson, ostr);
+   pResponse->setNoCacheHeaders();
+   pResponse->setContentType("application/json");
+   pResponse->setBody(ostr.str());
+}
+
+bool prewarmRecentSessions()
+{
+   sessionManager().prewarmRecentSessions();
+   return true;
 }
 
 
@@ -169,12 +239,33 @@ void httpServerAddHandlers()
    // restrct access to templates directory
    uri_handlers::addBlocking("/templates", http::notFoundHandler);
 
+   // auth cache metrics
+   uri_handlers::addBlocking("/auth_metrics",
+                             secureHttpHandler(handleAuthMetricsRequest));
+
+   // session prewarming
+   if (server::options().rsessionPrewarmEnabled())
+   {
+      uri_handlers::addBlocking("/session_prewarm_metrics",
+         secureHttpHandler(boost::bind(
+                  &SessionManager::handlePrewarmMetricsRequest,
+                  &sessionManager(), _1, _2, _3)));
+
+      if (server::options().rsessionPrewarmHour() >= 0)
+      {
+         scheduler::addCommand(boost::shared_ptr<ScheduledCommand>(
+                  new PeriodicCommand(boost::posix_time::minutes(1),
+                                      prewarmRecentSessions,
+                                      false)));
+      }
+   }
+
    // add default handler for gwt app
    uri_handlers::setBlockingDefault(blockingFileHandler());
 }
 
 
-// bogus SIGCHLD handler (never called)
+// bogus SIGCHLD and SIGHUP handler (never called)
 void handleSIGCHLD(int)
 {
 }
@@ -194,10 +285,18 @@ Error waitForSignals()
    if (result != 0)
       return systemError(errno, ERROR_LOCATION);
 
+   // SIGHUP is ignored when we daemonize so install the same bogus
+   // handler for it (we sigwait on it to reload cached user validations)
+   sa.sa_flags = 0;
+   result = ::sigaction(SIGHUP, &sa, NULL);
+   if (result != 0)
+      return systemError(errno, ERROR_LOCATION);
+
    // block signals that we want to sigwait on
    sigset_t wait_mask;
    sigemptyset(&wait_mask);
    sigaddset(&wait_mask, SIGCHLD);
+   sigaddset(&wait_mask, SIGHUP);
    sigaddset(&wait_mask, SIGINT);
    sigaddset(&wait_mask, SIGQUIT);
    sigaddset(&wait_mask, SIGTERM);
@@ -220,6 +319,14 @@ Error waitForSignals()
          sessionManager().notifySIGCHLD();
       }
 
+      // SIGHUP (discard cached user validations so that changes to
+      // system accounts and group membership take effect immediately)
+      else if (sig == SIGHUP)
+      {
+         auth::invalidateUsers();
+         LOG_INFO_MESSAGE("Received SIGHUP: cleared user validation cache");
+      }
+
       // SIGINT, SIGQUIT, SIGTERM
       else if (sig == SIGINT || sig == SIGQUIT || sig == SIGTERM)
       {
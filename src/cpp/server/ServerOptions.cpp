@@ -129,7 +129,19 @@ ProgramStatus Options::read(int argc, char * const argv[])
          "rsession stack limit (mb)")
       ("rsession-process-limit",
          value<int>(&rsessionUserProcessLimit_)->default_value(0),
-         "rsession user process limit");
+         "rsession user process limit")
+      ("rsession-prewarm-on-sign-in",
+         value<bool>(&rsessionPrewarmOnSignIn_)->default_value(false),
+         "launch sessions as soon as users load the main page")
+      ("rsession-prewarm-hour",
+         value<int>(&rsessionPrewarmHour_)->default_value(-1),
+         "hour of the day (0-23) to launch sessions for recent users")
+      ("rsession-prewarm-days",
+         value<int>(&rsessionPrewarmDays_)->default_value(7),
+         "days since last use for which users are considered recent")
+      ("rsession-prewarm-max",
+         value<int>(&rsessionPrewarmMax_)->default_value(20),
+         "maximum number of sessions launched for recent users");
    
    // still read depracated options (so we don't break config files)
    bool deprecatedAuthPamRequiresPriv;
@@ -141,6 +153,15 @@ ProgramStatus Options::read(int argc, char * const argv[])
       ("auth-required-user-group",
         value<std::string>(&authRequiredUserGroup_)->default_value(""),
         "limit to users belonging to the specified group")
+      ("auth-validate-users-cache-seconds",
+        value<int>(&authValidateUsersCacheSeconds_)->default_value(300),
+        "seconds to cache the results of validating users (0 to disable)")
+      ("auth-admin-group",
+        value<std::string>(&authAdminGroup_)->default_value(""),
+        "group whose members may view server auth metrics")
+      ("auth-secure-cookie-sha256",
+        value<bool>(&authSecureCookieSHA256_)->default_value(false),
+        "sign secure cookies using HMAC-SHA256 (rather than HMAC-SHA1)")
       ("auth-pam-helper-path",
         value<std::string>(&authPamHelperPath_)->default_value("bin/rserver-pam"),
        "path to PAM helper binary")
@@ -262,6 +262,9 @@ void doSignIn(const http::Request& request,
    std::string username = plainText.substr(0, splitAt);
    std::string password = plainText.substr(splitAt + 1, plainText.size());
 
+   // always validate from scratch when signing in
+   server::auth::invalidateUser(username);
+
    if ( pamLogin(username, password) &&
         server::auth::validateUser(username))
    {
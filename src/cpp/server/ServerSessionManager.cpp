@@ -18,6 +18,8 @@
 #include <sys/wait.h>
 
 #include <vector>
+#include <sstream>
+#include <algorithm>
 
 #include <boost/foreach.hpp>
 #include <boost/format.hpp>
@@ -25,11 +27,15 @@
 #include <core/Error.hpp>
 #include <core/Log.hpp>
 #include <core/SafeConvert.hpp>
+#include <core/json/Json.hpp>
+#include <core/http/Request.hpp>
+#include <core/http/Response.hpp>
 #include <core/system/PosixSystem.hpp>
 #include <core/system/PosixUser.hpp>
 #include <core/system/Environment.hpp>
 
 #include <session/SessionConstants.hpp>
+#include <session/SessionLocalStreams.hpp>
 
 #include <server/ServerOptions.hpp>
 
@@ -50,6 +56,11 @@ SessionManager& sessionManager()
 }
 
 Error SessionManager::launchSession(const std::string& username)
+{
+   return launchSession(username, false);
+}
+
+Error SessionManager::launchSession(const std::string& username, bool prewarm)
 {
    using namespace boost::posix_time;
 
@@ -65,6 +76,12 @@ Error SessionManager::launchSession(const std::string& username)
          {
             return Success();
          }
+         // if this is a prewarm then the session is launching (or
+         // running) so there is nothing more to do
+         else if (prewarm)
+         {
+            return Success();
+         }
          // otherwise erase it from pending launches and then
          // re-launch (immediately below)
          else
@@ -87,7 +104,12 @@ Error SessionManager::launchSession(const std::string& username)
    Error error = server::launchSession(username, &pid);
    if (error)
    {
-      removePendingLaunch(username);
+      LOCK_MUTEX(launchesMutex_)
+      {
+         pendingLaunches_.erase(username);
+      }
+      END_LOCK_MUTEX
+
       return error;
    }
    else
@@ -95,6 +117,22 @@ Error SessionManager::launchSession(const std::string& username)
       // add it to our active pids
       addActivePid(pid);
 
+      // track prewarmed sessions until they serve their first request
+      // and note activity for sessions launched on demand
+      LOCK_MUTEX(prewarmMutex_)
+      {
+         if (prewarm)
+         {
+            prewarmedSessions_[username] = pid;
+            prewarmLaunches_++;
+         }
+         else
+         {
+            recentUsers_[username] = microsec_clock::universal_time();
+         }
+      }
+      END_LOCK_MUTEX
+
       // return success
       return Success();
    }
@@ -102,11 +140,187 @@ Error SessionManager::launchSession(const std::string& username)
 
 void SessionManager::removePendingLaunch(const std::string& username)
 {
+   boost::posix_time::ptime launchTime;
    LOCK_MUTEX(launchesMutex_)
    {
-      pendingLaunches_.erase(username);
+      LaunchMap::iterator it = pendingLaunches_.find(username);
+      if (it == pendingLaunches_.end())
+         return;
+
+      launchTime = it->second;
+      pendingLaunches_.erase(it);
    }
    END_LOCK_MUTEX
+
+   if (!launchTime.is_not_a_date_time())
+      notifyFirstResponse(username, launchTime);
+}
+
+void SessionManager::notifyFirstResponse(
+                           const std::string& username,
+                           const boost::posix_time::ptime& launchTime)
+{
+   using namespace boost::posix_time;
+
+   LOCK_MUTEX(prewarmMutex_)
+   {
+      PrewarmedMap::iterator it = prewarmedSessions_.find(username);
+      if (it != prewarmedSessions_.end())
+      {
+         prewarmedSessions_.erase(it);
+         prewarmHits_++;
+      }
+      else
+      {
+         time_duration launchDuration =
+                              microsec_clock::universal_time() - launchTime;
+         onDemandLaunches_++;
+         onDemandLaunchTime_ += launchDuration;
+         if (launchDuration > maxOnDemandLaunchTime_)
+            maxOnDemandLaunchTime_ = launchDuration;
+      }
+   }
+   END_LOCK_MUTEX
+}
+
+void SessionManager::notifySessionExited(PidType pid)
+{
+   // prewarmed sessions which exit (e.g. due to timing out) before serving
+   // a request are no longer pending
+   std::string username;
+   LOCK_MUTEX(prewarmMutex_)
+   {
+      for (PrewarmedMap::iterator it = prewarmedSessions_.begin();
+           it != prewarmedSessions_.end();
+           ++it)
+      {
+         if (it->second == pid)
+         {
+            username = it->first;
+            prewarmedSessions_.erase(it);
+            prewarmExpired_++;
+            break;
+         }
+      }
+   }
+   END_LOCK_MUTEX
+
+   if (!username.empty())
+   {
+      LOCK_MUTEX(launchesMutex_)
+      {
+         pendingLaunches_.erase(username);
+      }
+      END_LOCK_MUTEX
+   }
+}
+
+void SessionManager::notifyUserActive(const std::string& username)
+{
+   LOCK_MUTEX(prewarmMutex_)
+   {
+      recentUsers_[username] =
+                     boost::posix_time::microsec_clock::universal_time();
+   }
+   END_LOCK_MUTEX
+
+   if (server::options().rsessionPrewarmOnSignIn())
+   {
+      Error error = prewarmSession(username);
+      if (error)
+         LOG_ERROR(error);
+   }
+}
+
+Error SessionManager::prewarmSession(const std::string& username)
+{
+   // a session which is listening already has its stream (we don't
+   // attempt a connection since that would be seen by the session)
+   if (session::local_streams::streamPath(username).exists())
+      return Success();
+
+   return launchSession(username, true);
+}
+
+void SessionManager::prewarmRecentSessions()
+{
+   using namespace boost::posix_time;
+
+   // prewarm once per day at the specified (local) hour
+   Options& options = server::options();
+   ptime now = second_clock::local_time();
+   if (now.time_of_day().hours() != options.rsessionPrewarmHour())
+      return;
+
+   // determine the users to prewarm (most recently active first)
+   std::vector<std::pair<ptime,std::string> > users;
+   LOCK_MUTEX(prewarmMutex_)
+   {
+      if (lastPrewarmDate_ == now.date())
+         return;
+      lastPrewarmDate_ = now.date();
+
+      ptime cutoff = microsec_clock::universal_time() -
+                     hours(24 * options.rsessionPrewarmDays());
+      for (LaunchMap::iterator it = recentUsers_.begin();
+           it != recentUsers_.end(); )
+      {
+         if (it->second < cutoff)
+         {
+            recentUsers_.erase(it++);
+         }
+         else
+         {
+            users.push_back(std::make_pair(it->second, it->first));
+            ++it;
+         }
+      }
+   }
+   END_LOCK_MUTEX
+
+   std::sort(users.rbegin(), users.rend());
+   if (users.size() > static_cast<std::size_t>(options.rsessionPrewarmMax()))
+      users.resize(std::max(options.rsessionPrewarmMax(), 0));
+
+   typedef std::pair<ptime,std::string> RecentUser;
+   BOOST_FOREACH(const RecentUser& user, users)
+   {
+      Error error = prewarmSession(user.second);
+      if (error)
+         LOG_ERROR(error);
+   }
+}
+
+void SessionManager::handlePrewarmMetricsRequest(
+                                    const std::string& username,
+                                    const core::http::Request& request,
+                                    core::http::Response* pResponse)
+{
+   json::Object metricsJson;
+   LOCK_MUTEX(prewarmMutex_)
+   {
+      int firstRequests = prewarmHits_ + onDemandLaunches_;
+      metricsJson["pool_size"] = static_cast<int>(prewarmedSessions_.size());
+      metricsJson["recent_users"] = static_cast<int>(recentUsers_.size());
+      metricsJson["prewarm_launches"] = prewarmLaunches_;
+      metricsJson["prewarm_hits"] = prewarmHits_;
+      metricsJson["prewarm_expired"] = prewarmExpired_;
+      metricsJson["on_demand_launches"] = onDemandLaunches_;
+      metricsJson["hit_rate"] = firstRequests > 0 ?
+               static_cast<double>(prewarmHits_) / firstRequests : 0.0;
+      metricsJson["on_demand_launch_ms_avg"] = onDemandLaunches_ > 0 ?
+               static_cast<double>(onDemandLaunchTime_.total_milliseconds()) /
+                                                      onDemandLaunches_ : 0.0;
+      metricsJson["on_demand_launch_ms_max"] = static_cast<double>(
+                                 maxOnDemandLaunchTime_.total_milliseconds());
+   }
+   END_LOCK_MUTEX
+
+   std::ostringstream ostr;
+   json::write(metricsJson, ostr);
+   pResponse->setNoCacheHeaders();
+   pResponse->setContentType("application/json");
+   pResponse->setBody(ostr.str());
 }
 
 namespace {
@@ -160,6 +374,7 @@ void SessionManager::notifySIGCHLD()
          {
             // all done with this pid
             removeActivePid(pid);
+            notifySessionExited(pid);
          }
          else
          {
@@ -21,12 +21,17 @@
 #include <map>
 
 #include <boost/signals.hpp>
+#include <boost/date_time/posix_time/posix_time.hpp>
 
 #include <core/Thread.hpp>
 #include <core/system/PosixSystem.hpp>
 
 namespace core {
    class Error;
+   namespace http {
+      class Request;
+      class Response;
+   }
 }
 
 namespace server {
@@ -38,12 +43,19 @@ SessionManager& sessionManager();
 // Session manager for launching managed sessions. This includes
 // automatically waiting for other pending launches (rather than
 // attempting to launch the same session twice) as well as reaping
-// of session child processes
+// of session child processes.
+//
+// Sessions can also be prewarmed (launched ahead of the user's first
+// request) so that their initialization overlaps with the browser loading
+// the application. Since sessions run as their user this is done per-user
+// rather than from a shared pool: either when a user loads the main page
+// or once a day for users who were active recently.
 class SessionManager
 {
 private:
    // singleton
-   SessionManager() {}
+   SessionManager() : prewarmLaunches_(0), prewarmHits_(0),
+                      prewarmExpired_(0), onDemandLaunches_(0) {}
    friend SessionManager& sessionManager();
 
 public:
@@ -51,10 +63,22 @@ public:
    core::Error launchSession(const std::string& username);
    void removePendingLaunch(const std::string& username);
 
+   // prewarming
+   void notifyUserActive(const std::string& username);
+   void prewarmRecentSessions();
+   void handlePrewarmMetricsRequest(const std::string& username,
+                                    const core::http::Request& request,
+                                    core::http::Response* pResponse);
+
    // notificatio that a SIGCHLD was received
    void notifySIGCHLD();
 
 private:
+   core::Error launchSession(const std::string& username, bool prewarm);
+   core::Error prewarmSession(const std::string& username);
+   void notifyFirstResponse(const std::string& username,
+                            const boost::posix_time::ptime& launchTime);
+   void notifySessionExited(PidType pid);
    void addActivePid(PidType pid);
    void removeActivePid(PidType pid);
    std::vector<PidType> activePids();
@@ -68,6 +92,20 @@ private:
    // pids we have launched
    boost::mutex pidsMutex_;
    std::vector<PidType> activePids_;
+
+   // prewarming (recently active users, prewarmed sessions which haven't
+   // yet served a request, and metrics)
+   boost::mutex prewarmMutex_;
+   LaunchMap recentUsers_;
+   typedef std::map<std::string,PidType> PrewarmedMap;
+   PrewarmedMap prewarmedSessions_;
+   boost::gregorian::date lastPrewarmDate_;
+   int prewarmLaunches_;
+   int prewarmHits_;
+   int prewarmExpired_;
+   int onDemandLaunches_;
+   boost::posix_time::time_duration onDemandLaunchTime_;
+   boost::posix_time::time_duration maxOnDemandLaunchTime_;
 };
 
 // Lower-level global functions for launching sessions. These are used
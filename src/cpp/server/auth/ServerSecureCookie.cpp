@@ -17,13 +17,21 @@
 
 #include <sys/stat.h>
 
+#include <map>
+#include <vector>
+
+#include <boost/foreach.hpp>
 #include <boost/optional.hpp>
 #include <boost/tokenizer.hpp>
 #include <boost/algorithm/string/predicate.hpp>
+#include <boost/algorithm/string/split.hpp>
+#include <boost/algorithm/string/trim.hpp>
+#include <boost/algorithm/string/classification.hpp>
 #include <boost/date_time/posix_time/posix_time.hpp>
 #include <boost/date_time/gregorian/gregorian.hpp>
 
 #include <core/Log.hpp>
+#include <core/Thread.hpp>
 #include <core/FileSerializer.hpp>
 
 #include <core/http/URL.hpp>
@@ -36,6 +44,8 @@
 #include <core/system/PosixSystem.hpp>
 #include <core/system/FileMode.hpp>
 
+#include <server/ServerOptions.hpp>
+
 
 namespace server {
 namespace auth {
@@ -46,30 +56,153 @@ namespace {
 // cookie field delimiter
 const char * const kDelim = "|";
 
-// secure cookie key
-std::string s_secureCookieKey ;
+// prefix for hmacs computed using sha256 (hmacs without a prefix use sha1)
+const char * const kSHA256Prefix = "sha256:";
+
+// secure cookie keys (the first is used for signing and all are accepted
+// when verifying, which allows keys to be rotated)
+std::vector<std::string> s_secureCookieKeys;
+
+// cache of verified cookies (keyed by a SHA-256 digest of the signed cookie
+// value so that lookups don't compare against attacker supplied strings).
+// the cache is bounded and expired entries are pruned when it becomes full
+const std::size_t kMaxVerifiedCookies = 1024;
+
+struct VerifiedCookie
+{
+   std::string value;
+   boost::posix_time::ptime expires;
+};
+
+typedef std::map<std::string,VerifiedCookie> VerifiedCookies;
+
+bool cookieDigest(const std::string& signedCookieValue, std::string* pDigest)
+{
+   std::vector<unsigned char> digest;
+   Error error = core::system::crypto::sha256Digest(signedCookieValue, &digest);
+   if (error)
+   {
+      LOG_ERROR(error);
+      return false;
+   }
+
+   pDigest->assign(digest.begin(), digest.end());
+   return true;
+}
+
+boost::mutex s_verifiedCookiesMutex;
+VerifiedCookies s_verifiedCookies;
+int s_cacheHits = 0;
+int s_cacheMisses = 0;
 
+bool lookupVerifiedCookie(const std::string& cookieDigest,
+                          std::string* pValue)
+{
+   using namespace boost::posix_time;
+
+   LOCK_MUTEX(s_verifiedCookiesMutex)
+   {
+      VerifiedCookies::iterator it = s_verifiedCookies.find(cookieDigest);
+      if (it != s_verifiedCookies.end())
+      {
+         if (it->second.expires > second_clock::universal_time())
+         {
+            s_cacheHits++;
+            *pValue = it->second.value;
+            return true;
+         }
+         s_verifiedCookies.erase(it);
+      }
+      s_cacheMisses++;
+   }
+   END_LOCK_MUTEX
+
+   return false;
+}
+
+void cacheVerifiedCookie(const std::string& cookieDigest,
+                         const std::string& value,
+                         const boost::posix_time::ptime& expires)
+{
+   using namespace boost::posix_time;
+
+   VerifiedCookie verifiedCookie;
+   verifiedCookie.value = value;
+   verifiedCookie.expires = expires;
+
+   LOCK_MUTEX(s_verifiedCookiesMutex)
+   {
+      if (s_verifiedCookies.size() >= kMaxVerifiedCookies)
+      {
+         ptime now = second_clock::universal_time();
+         for (VerifiedCookies::iterator it = s_verifiedCookies.begin();
+              it != s_verifiedCookies.end(); )
+         {
+            if (it->second.expires <= now)
+               s_verifiedCookies.erase(it++);
+            else
+               ++it;
+         }
+
+         // still full (all unexpired) so start over
+         if (s_verifiedCookies.size() >= kMaxVerifiedCookies)
+            s_verifiedCookies.clear();
+      }
+
+      s_verifiedCookies[cookieDigest] = verifiedCookie;
+   }
+   END_LOCK_MUTEX
+}
 
 Error base64HMAC(const std::string& value,
                  const std::string& expires,
+                 const std::string& key,
+                 bool sha256,
                  std::string* pHMAC)
 {
    // compute message to apply hmac to
    std::string message = value + expires;
 
-   // get cookie key
-   // NOTE: threadsafe because we never modify s_secureCookieKey and
-   // the c_str accessor just returns a pointer to the internal data
-   const char * cookieKey = s_secureCookieKey.c_str();
-
    // compute hmac for the message
    std::vector<unsigned char> hmac;
-   Error error = core::system::crypto::HMAC_SHA1(message, cookieKey, &hmac);
+   Error error = sha256 ?
+         core::system::crypto::HMAC_SHA256(message, key, &hmac) :
+         core::system::crypto::HMAC_SHA1(message, key, &hmac);
    if (error)
       return error;
 
    // base 64 encode it
-   return core::system::crypto::base64Encode(hmac, pHMAC);
+   error = core::system::crypto::base64Encode(hmac, pHMAC);
+   if (error)
+      return error;
+
+   if (sha256)
+      pHMAC->insert(0, kSHA256Prefix);
+   return Success();
+}
+
+bool verifyHMAC(const std::string& value,
+                const std::string& expires,
+                const std::string& hmac)
+{
+   // NOTE: threadsafe because we never modify s_secureCookieKeys after
+   // initialization
+   bool sha256 = boost::algorithm::starts_with(hmac, kSHA256Prefix);
+   BOOST_FOREACH(const std::string& key, s_secureCookieKeys)
+   {
+      std::string computedHmac;
+      Error error = base64HMAC(value, expires, key, sha256, &computedHmac);
+      if (error)
+      {
+         LOG_ERROR(error);
+         return false;
+      }
+
+      if (core::system::crypto::constantTimeEquals(hmac, computedHmac))
+         return true;
+   }
+
+   return false;
 }
 
 http::Cookie createSecureCookie(
@@ -89,7 +222,11 @@ http::Cookie createSecureCookie(
    // secure the cookie)
    std::string signedCookieValue ;
    std::string hmac;
-   Error error = base64HMAC(value, expires, &hmac);
+   Error error = base64HMAC(value,
+                            expires,
+                            s_secureCookieKeys.front(),
+                            server::options().authSecureCookieSHA256(),
+                            &hmac);
    if (error)
    {
       LOG_ERROR(error);
@@ -122,6 +259,14 @@ std::string readSecureCookie(const core::http::Request& request,
    if (signedCookieValue.empty())
       return std::string();
 
+   // check whether we've already verified this cookie (if we can't compute
+   // the digest we just skip the cache)
+   std::string digest;
+   bool useCache = cookieDigest(signedCookieValue, &digest);
+   std::string verifiedValue;
+   if (useCache && lookupVerifiedCookie(digest, &verifiedValue))
+      return verifiedValue;
+
    // split it into its parts (url decode them as well)
    std::string value, expires, hmac;
    using namespace boost;
@@ -146,17 +291,8 @@ std::string readSecureCookie(const core::http::Request& request,
       return std::string();
    }
 
-   // compute the hmac of the value + expires
-   std::string computedHmac;
-   Error error = base64HMAC(value, expires, &computedHmac);
-   if (error)
-   {
-      LOG_ERROR(error);
-      return std::string();
-   }
-
-   // compare hmac to the one in the cookie
-   if (hmac != computedHmac)
+   // compare the hmac of the value + expires to the one in the cookie
+   if (!verifyHMAC(value, expires, hmac))
    {
       // will occur in normal course of operations if the user upgrades
       // their browser (and the User-Agent changes). could also occur
@@ -172,10 +308,27 @@ std::string readSecureCookie(const core::http::Request& request,
    else if (expiresTime <= second_clock::universal_time())
       return std::string();
 
+   // remember that we verified the cookie (until it expires)
+   if (useCache)
+      cacheVerifiedCookie(digest, value, expiresTime);
+
    // ok to return the value
    return value;
 }
 
+CacheStats cacheStats()
+{
+   CacheStats stats;
+   LOCK_MUTEX(s_verifiedCookiesMutex)
+   {
+      stats.hits = s_cacheHits;
+      stats.misses = s_cacheMisses;
+      stats.size = static_cast<int>(s_verifiedCookies.size());
+   }
+   END_LOCK_MUTEX
+   return stats;
+}
+
 void set(const std::string& name,
          const std::string& value,
          const http::Request& request,
@@ -249,8 +402,29 @@ Error initialize()
                             ERROR_LOCATION);
       }
 
-      // save the key and return success
-      s_secureCookieKey = secureCookieKey;
+      // the file may contain one key per line: the first is the current key
+      // and any others are previous keys which are still accepted
+      std::vector<std::string> keys;
+      boost::algorithm::split(keys,
+                              secureCookieKey,
+                              boost::algorithm::is_any_of("\r\n"));
+      BOOST_FOREACH(std::string key, keys)
+      {
+         boost::algorithm::trim(key);
+         if (!key.empty())
+            s_secureCookieKeys.push_back(key);
+      }
+
+      // a file with a single key is used verbatim (including any trailing
+      // whitespace) so that existing keys, and the cookies signed with
+      // them, remain valid
+      if (s_secureCookieKeys.size() <= 1)
+      {
+         s_secureCookieKeys.clear();
+         s_secureCookieKeys.push_back(secureCookieKey);
+      }
+
+      // return success
       return Success();
    }
 
@@ -278,7 +452,7 @@ Error initialize()
       }
 
       // successfully generated the cookie key, set it
-      s_secureCookieKey = secureCookieKey;
+      s_secureCookieKeys.push_back(secureCookieKey);
 
       // reutrn success
       return Success();
@@ -15,7 +15,13 @@
 
 #include <server/auth/ServerValidateUser.hpp>
 
+#include <map>
+#include <algorithm>
+
+#include <boost/date_time/posix_time/posix_time.hpp>
+
 #include <core/Error.hpp>
+#include <core/Thread.hpp>
 #include <core/Log.hpp>
 #include <core/StringUtils.hpp>
 
@@ -29,20 +35,43 @@ using namespace core;
 namespace server {
 namespace auth {
 
-bool validateUser(const std::string& username)
+namespace {
+
+// failed validations are cached for a shorter time so that newly created
+// users (or users newly added to the required group) can sign in promptly
+const int kMaxNegativeCacheSeconds = 30;
+
+// expired entries are pruned once the cache reaches this size
+const std::size_t kMaxCacheSize = 10000;
+
+struct CachedValidation
 {
-   // short circuit if we aren't validating users
-   if (!server::options().authValidateUsers())
-      return true;
-   
+   bool valid;
+   boost::posix_time::ptime expires;
+};
+
+typedef std::map<std::string,CachedValidation> ValidationCache;
+
+boost::mutex s_cacheMutex;
+ValidationCache s_cache;
+int s_hits = 0;
+int s_misses = 0;
+
+bool lookupUser(const std::string& username, bool* pCacheable)
+{
+   *pCacheable = true;
+
    // get the user
    core::system::user::User user;
    Error error = userFromUsername(username, &user);
    if (error)
    {
-      // log the error only if it is unexpected
+      // log the error only if it is unexpected (and don't cache it)
       if (!core::system::isUserNotFoundError(error))
+      {
          LOG_ERROR(error);
+         *pCacheable = false;
+      }
 
       // not found either due to non-existence or an unexpected error
       return false;
@@ -61,6 +90,7 @@ bool validateUser(const std::string& username)
       {
          // log and return false
          LOG_ERROR(error);
+         *pCacheable = false;
          return false;
       }
       else
@@ -77,6 +107,101 @@ bool validateUser(const std::string& username)
    }
 }
 
+void pruneExpired(const boost::posix_time::ptime& now)
+{
+   for (ValidationCache::iterator it = s_cache.begin(); it != s_cache.end(); )
+   {
+      if (it->second.expires <= now)
+         s_cache.erase(it++);
+      else
+         ++it;
+   }
+}
+
+} // anonymous namespace
+
+bool validateUser(const std::string& username)
+{
+   using namespace boost::posix_time;
+
+   // short circuit if we aren't validating users
+   if (!server::options().authValidateUsers())
+      return true;
+
+   // check the cache
+   int cacheSeconds = server::options().authValidateUsersCacheSeconds();
+   ptime now = microsec_clock::universal_time();
+   if (cacheSeconds > 0)
+   {
+      LOCK_MUTEX(s_cacheMutex)
+      {
+         ValidationCache::const_iterator it = s_cache.find(username);
+         if (it != s_cache.end() && it->second.expires > now)
+         {
+            s_hits++;
+            return it->second.valid;
+         }
+         s_misses++;
+      }
+      END_LOCK_MUTEX
+   }
+
+   // perform the lookup (outside the lock since it may be slow)
+   bool cacheable = false;
+   bool valid = lookupUser(username, &cacheable);
+
+   // cache the result
+   if (cacheSeconds > 0 && cacheable)
+   {
+      CachedValidation validation;
+      validation.valid = valid;
+      validation.expires = now + seconds(valid ?
+                  cacheSeconds : std::min(cacheSeconds, kMaxNegativeCacheSeconds));
+
+      LOCK_MUTEX(s_cacheMutex)
+      {
+         if (s_cache.size() >= kMaxCacheSize)
+            pruneExpired(now);
+         if (s_cache.size() < kMaxCacheSize)
+            s_cache[username] = validation;
+      }
+      END_LOCK_MUTEX
+   }
+
+   return valid;
+}
+
+void invalidateUser(const std::string& username)
+{
+   LOCK_MUTEX(s_cacheMutex)
+   {
+      s_cache.erase(username);
+   }
+   END_LOCK_MUTEX
+}
+
+void invalidateUsers()
+{
+   LOCK_MUTEX(s_cacheMutex)
+   {
+      s_cache.clear();
+   }
+   END_LOCK_MUTEX
+}
+
+ValidateUserCacheStats validateUserCacheStats()
+{
+   ValidateUserCacheStats stats;
+   LOCK_MUTEX(s_cacheMutex)
+   {
+      stats.hits = s_hits;
+      stats.misses = s_misses;
+      stats.size = static_cast<int>(s_cache.size());
+   }
+   END_LOCK_MUTEX
+   return stats;
+}
+
 } // namespace auth
 } // namespace server
 
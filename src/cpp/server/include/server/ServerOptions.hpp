@@ -99,6 +99,21 @@ public:
       return std::string(authRequiredUserGroup_.c_str());
    }
 
+   int authValidateUsersCacheSeconds() const
+   {
+      return authValidateUsersCacheSeconds_;
+   }
+
+   std::string authAdminGroup() const
+   {
+      return std::string(authAdminGroup_.c_str());
+   }
+
+   bool authSecureCookieSHA256() const
+   {
+      return authSecureCookieSHA256_;
+   }
+
    std::string authPamHelperPath() const
    {
       return std::string(authPamHelperPath_.c_str());
@@ -145,6 +160,32 @@ public:
       return rsessionUserProcessLimit_;
    }
 
+   bool rsessionPrewarmOnSignIn() const
+   {
+      return rsessionPrewarmOnSignIn_;
+   }
+
+   int rsessionPrewarmHour() const
+   {
+      return rsessionPrewarmHour_;
+   }
+
+   int rsessionPrewarmDays() const
+   {
+      return rsessionPrewarmDays_;
+   }
+
+   int rsessionPrewarmMax() const
+   {
+      return rsessionPrewarmMax_;
+   }
+
+   bool rsessionPrewarmEnabled() const
+   {
+      return rsessionPrewarmOnSignIn_ ||
+             (rsessionPrewarmHour_ >= 0 && rsessionPrewarmHour_ < 24);
+   }
+
 private:
    bool verifyInstallation_;
    std::string serverWorkingDir_;
@@ -158,6 +199,9 @@ private:
    int wwwThreadPoolSize_;
    bool authValidateUsers_;
    std::string authRequiredUserGroup_;
+   int authValidateUsersCacheSeconds_;
+   std::string authAdminGroup_;
+   bool authSecureCookieSHA256_;
    std::string authPamHelperPath_;
    std::string rsessionWhichR_;
    std::string rsessionPath_;
@@ -167,6 +211,10 @@ private:
    int rsessionMemoryLimitMb_;
    int rsessionStackLimitMb_;
    int rsessionUserProcessLimit_;
+   bool rsessionPrewarmOnSignIn_;
+   int rsessionPrewarmHour_;
+   int rsessionPrewarmDays_;
+   int rsessionPrewarmMax_;
 };
       
 } // namespace server
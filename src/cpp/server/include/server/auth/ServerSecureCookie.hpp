@@ -37,6 +37,17 @@ namespace secure_cookie {
 std::string readSecureCookie(const core::http::Request& request,
                              const std::string& name);
 
+// statistics for the cache of verified cookies
+struct CacheStats
+{
+   CacheStats() : hits(0), misses(0), size(0) {}
+   int hits;
+   int misses;
+   int size;
+};
+
+CacheStats cacheStats();
+
 void set(const std::string& name,
          const std::string& value,
          const http::Request& request,
@@ -21,8 +21,27 @@
 namespace server {
 namespace auth {
    
+// validate that the user exists (and belongs to the required group if one
+// is specified). results are cached for auth-validate-users-cache-seconds
+// (failures for a shorter time) since the underlying lookups may require
+// calls to directory services
 bool validateUser(const std::string& username);
 
+// discard cached validation results for a user (or all users, which the
+// server does when it receives SIGHUP)
+void invalidateUser(const std::string& username);
+void invalidateUsers();
+
+struct ValidateUserCacheStats
+{
+   ValidateUserCacheStats() : hits(0), misses(0), size(0) {}
+   int hits;
+   int misses;
+   int size;
+};
+
+ValidateUserCacheStats validateUserCacheStats();
+
 } // namespace auth
 } // namespace server
 
@@ -85,6 +85,8 @@ extern "C" const char *locale2charset(const char *);
 #include "SessionClientEventQueue.hpp"
 #include "SessionClientEventService.hpp"
 
+#include "http/SessionHttpConnectionUtils.hpp"
+
 #include "modules/SessionAgreement.hpp"
 #include "modules/SessionAskPass.hpp"
 #include "modules/SessionAuthoring.hpp"
@@ -1055,6 +1057,10 @@ bool waitForMethod(const std::string& method,
       // suspend if necessary (does not return if a suspend occurs)
       suspendIfRequested(allowSuspend);
 
+      // complete a suspend which is saving in the background (does not
+      // return if the save has completed)
+      r::session::checkBackgroundSuspend();
+
       // check for timeout
       if ( isTimedOut(timeoutTime) )
       {
@@ -1089,6 +1095,9 @@ bool waitForMethod(const std::string& method,
 
       if (ptrConnection)
       {
+         // activity cancels a suspend which is saving in the background
+         r::session::cancelBackgroundSuspend();
+
          // check for client_init
          if ( isMethod(ptrConnection, kClientInit) )
          {
@@ -1256,6 +1265,19 @@ Error ping(const core::json::JsonRpcRequest& request,
 Error startHttpConnectionListener()
 {
    initializeHttpConnectionListener();
+
+   // spool uploaded files within the scratch path (removing any which
+   // were left behind by a previous session)
+   FilePath uploadSpoolDir = module_context::scopedScratchPath().complete(
+                                                            "upload_spool");
+   Error error = uploadSpoolDir.removeIfExists();
+   if (!error)
+      error = uploadSpoolDir.ensureDirectory();
+   if (!error)
+      httpConnectionListener().setUploadSpoolDir(uploadSpoolDir);
+   else
+      LOG_ERROR(error);
+
    return httpConnectionListener().start();
 }
 
@@ -1997,6 +2019,10 @@ void rCleanup(bool terminatedNormally)
    
 void rSerialization(int action, const FilePath& targetPath)
 {
+   // the session state may be saved by a forked child
+   if (s_wasForked)
+      return;
+
    json::Object serializationActionObject ;
    serializationActionObject["type"] = action;
    if (!targetPath.empty())
@@ -2277,6 +2303,13 @@ Error registerUriHandler(const std::string& name,
 }
 
 
+Error registerBackgroundUriHandler(const std::string& name,
+                                   const BackgroundUriHandler& handler)
+{
+   connection::registerBackgroundUriHandler(name, handler);
+   return Success();
+}
+
 Error registerAsyncLocalUriHandler(
                          const std::string& name,
                          const http::UriAsyncHandlerFunction& handlerFunction)
@@ -2718,6 +2751,10 @@ int main (int argc, char * const argv[])
       rOptions.saveWorkspace = saveWorkspaceOption();
       rOptions.rProfileOnResume = serverMode &&
                                   userSettings().rProfileOnResume();
+      rOptions.lazyRestore = options.lazyRestore();
+      rOptions.suspendCompressionThreads =
+                              options.suspendCompressionThreads();
+      rOptions.backgroundSuspend = options.backgroundSuspend();
       
       // r callbacks
       r::session::RCallbacks rCallbacks;
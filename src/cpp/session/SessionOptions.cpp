@@ -155,7 +155,16 @@ core::ProgramStatus Options::read(int argc, char * const argv[])
          "automatically create public folder")
       ("session-rprofile-on-resume-default",
           value<bool>(&rProfileOnResumeDefault_)->default_value(false),
-          "default user setting for running Rprofile on resume");
+          "default user setting for running Rprofile on resume")
+      ("session-lazy-restore",
+          value<bool>(&lazyRestore_)->default_value(false),
+          "load objects of resumed sessions when they are first accessed")
+      ("session-suspend-compression-threads",
+          value<int>(&suspendCompressionThreads_)->default_value(1),
+          "threads used to compress suspended sessions (0 for one per core)")
+      ("session-background-suspend",
+          value<bool>(&backgroundSuspend_)->default_value(false),
+          "save the state of suspended sessions in a forked process");
 
    // r options
    bool rShellEscape; // no longer works but don't want to break any
@@ -22,6 +22,7 @@
 #include <boost/bind.hpp>
 #include <boost/foreach.hpp>
 #include <boost/regex.hpp>
+#include <boost/algorithm/string/predicate.hpp>
 #include <boost/date_time/posix_time/posix_time.hpp>
 
 #include <core/Log.hpp>
@@ -54,6 +55,16 @@
 // One way to overcome this might be to use filesystem metadata to store
 // properties rather than a side-database
 
+// Documents are stored as an append-only log of binary records: a header
+// identifying the log, then records holding either the full contents, a
+// single replaced range of the contents (written on edit), or the rest of
+// the document's fields as JSON. Every write ends with a metadata record,
+// so the last metadata record and the contents as of that record describe
+// the document (and an interrupted write is ignored). When a log holds too
+// much superseded data it is rewritten. Documents written by
+// earlier versions (a single JSON object) are still read, and are rewritten
+// as a log the next time they are written.
+
 using namespace core;
 
 namespace session {
@@ -63,24 +74,76 @@ namespace {
 
 struct PropertiesDatabase
 {
+   PropertiesDatabase() : indexSize(0), indexWriteTime(0) {}
+
    FilePath path;
    FilePath indexFile;
    std::map<std::string,std::string> index;
+
+   // state of the index file when it was read (the database is shared
+   // with other sessions so we re-read the index if it changes)
+   uintmax_t indexSize;
+   std::time_t indexWriteTime;
+
+   // the properties we last wrote
+   std::map<std::string,std::string> written;
 };
 
-Error getPropertiesDatabase(PropertiesDatabase* pDatabase)
+PropertiesDatabase s_propertiesDB;
+
+Error getPropertiesDatabase(PropertiesDatabase** ppDatabase)
 {
-   pDatabase->path = module_context::scopedScratchPath().complete("sdb/prop");
-   Error error = pDatabase->path.ensureDirectory();
+   PropertiesDatabase& db = s_propertiesDB;
+   *ppDatabase = &db;
+
+   if (db.path.empty())
+   {
+      db.path = module_context::scopedScratchPath().complete("sdb/prop");
+      db.indexFile = db.path.complete("INDEX");
+   }
+
+   Error error = db.path.ensureDirectory();
    if (error)
       return error;
 
-   pDatabase->indexFile = pDatabase->path.complete("INDEX");
+   if (!db.indexFile.exists())
+   {
+      db.index.clear();
+      db.indexSize = 0;
+      db.indexWriteTime = 0;
+      return Success();
+   }
 
-   if (pDatabase->indexFile.exists())
-      return readStringMapFromFile(pDatabase->indexFile, &(pDatabase->index));
-   else
+   // re-read the index if it changed since we last read it
+   uintmax_t size = db.indexFile.size();
+   std::time_t writeTime = db.indexFile.lastWriteTime();
+   if (size == db.indexSize && writeTime == db.indexWriteTime)
       return Success();
+
+   db.index.clear();
+   error = readStringMapFromFile(db.indexFile, &db.index);
+   if (error)
+      return error;
+   db.indexSize = size;
+   db.indexWriteTime = writeTime;
+   return Success();
+}
+
+Error addToPropertiesIndex(PropertiesDatabase* pDatabase,
+                           const std::string& escapedPath,
+                           const std::string& propertiesFile)
+{
+   // append rather than rewrite the index (this is cheaper and doesn't
+   // drop entries added by other sessions since we read it)
+   pDatabase->index[escapedPath] = propertiesFile;
+   Error error = appendToFile(pDatabase->indexFile,
+                              escapedPath + "=" + propertiesFile + "\n");
+   if (error)
+      return error;
+
+   pDatabase->indexSize = pDatabase->indexFile.size();
+   pDatabase->indexWriteTime = pDatabase->indexFile.lastWriteTime();
+   return Success();
 }
 
 Error putProperties(const std::string& path, const json::Object& properties)
@@ -89,33 +152,53 @@ Error putProperties(const std::string& path, const json::Object& properties)
    std::string escapedPath = http::util::urlEncode(path);
 
    // get properties database
-   PropertiesDatabase propertiesDB;
-   Error error = getPropertiesDatabase(&propertiesDB);
+   PropertiesDatabase* pPropertiesDB;
+   Error error = getPropertiesDatabase(&pPropertiesDB);
    if (error)
       return error;
+   PropertiesDatabase& propertiesDB = *pPropertiesDB;
 
    // use existing properties file if it exists, otherwise create new
    bool updateIndex = false;
-   std::string propertiesFile = propertiesDB.index[escapedPath];
+   std::map<std::string,std::string>::const_iterator it =
+                                          propertiesDB.index.find(escapedPath);
+   std::string propertiesFile;
+   if (it != propertiesDB.index.end())
+      propertiesFile = it->second;
    if (propertiesFile.empty())
    {
       FilePath propFile = file_utils::uniqueFilePath(propertiesDB.path);
       propertiesFile = propFile.filename();
-      propertiesDB.index[escapedPath] = propertiesFile;
       updateIndex = true;
    }
 
-   // write the file
+   // skip the write if these are the properties we last wrote and the
+   // file still contains them (another session may have written it since,
+   // and write times are too coarse to detect that reliably)
    std::ostringstream ostr ;
    json::writeFormatted(properties, ostr);
    FilePath propertiesFilePath = propertiesDB.path.complete(propertiesFile);
+   std::string& written = propertiesDB.written[escapedPath];
+   if (!updateIndex &&
+       written == ostr.str() &&
+       propertiesFilePath.exists() &&
+       propertiesFilePath.size() == written.size())
+   {
+      std::string contents;
+      error = readStringFromFile(propertiesFilePath, &contents);
+      if (!error && contents == written)
+         return Success();
+   }
+
+   // write the file
    error = writeStringToFile(propertiesFilePath, ostr.str());
    if (error)
       return error;
+   written = ostr.str();
 
    // update the index if necessary
    if (updateIndex)
-      return writeStringMapToFile(propertiesDB.indexFile, propertiesDB.index);
+      return addToPropertiesIndex(&propertiesDB, escapedPath, propertiesFile);
    else
       return Success();
 }
@@ -126,13 +209,18 @@ Error getProperties(const std::string& path, json::Object* pProperties)
    std::string escapedPath = http::util::urlEncode(path);
 
    // get properties database
-   PropertiesDatabase propertiesDB;
-   Error error = getPropertiesDatabase(&propertiesDB);
+   PropertiesDatabase* pPropertiesDB;
+   Error error = getPropertiesDatabase(&pPropertiesDB);
    if (error)
       return error;
+   PropertiesDatabase& propertiesDB = *pPropertiesDB;
 
    // check for properties file
-   std::string propertiesFile = propertiesDB.index[escapedPath];
+   std::map<std::string,std::string>::const_iterator it =
+                                          propertiesDB.index.find(escapedPath);
+   std::string propertiesFile;
+   if (it != propertiesDB.index.end())
+      propertiesFile = it->second;
    if (propertiesFile.empty())
    {
       // return empty object if there is none
@@ -159,9 +247,212 @@ Error getProperties(const std::string& path, json::Object* pProperties)
    return Success();
 }
 
+bool hasNullByteSequence(const std::string& contents)
+{
+   std::string nullBytes;
+   nullBytes.push_back('\0');
+   nullBytes.push_back('\0');
+   return boost::algorithm::contains(contents, nullBytes);
+}
+
+// source database log format (see the note at the top of the file). each
+// record is a type, a 32-bit little endian payload size, and the payload
+const char * const kLogMagic = "RSSDB01\n";
+const std::size_t kLogMagicSize = 8;
+const std::size_t kRecordHeaderSize = 5;
+
+const char kGenerationRecord = 'G';    // unique id of the log (always first)
+const char kContentsRecord = 'C';      // full contents
+const char kDeltaRecord = 'D';         // offset, length, replacement text
+const char kMetadataRecord = 'M';      // fields other than contents (json)
+
+// logs are rewritten when they are larger than twice their contents and
+// metadata plus this amount
+const boost::uintmax_t kLogSlack = 64 * 1024;
+
+void appendUInt32(std::size_t value, std::string* pOutput)
+{
+   for (int i = 0; i < 4; i++)
+      pOutput->push_back(static_cast<char>((value >> (8 * i)) & 0xFF));
+}
+
+boost::uint32_t readUInt32(const char* data)
+{
+   boost::uint32_t value = 0;
+   for (int i = 3; i >= 0; i--)
+      value = (value << 8) | static_cast<unsigned char>(data[i]);
+   return value;
+}
+
+void appendRecord(char type, const std::string& payload, std::string* pOutput)
+{
+   pOutput->push_back(type);
+   appendUInt32(payload.size(), pOutput);
+   pOutput->append(payload);
+}
+
+// payload of a delta record which turns one version of the contents into
+// another (by replacing the range between their common prefix and suffix)
+std::string deltaPayload(const std::string& from, const std::string& to)
+{
+   std::size_t common = std::min(from.size(), to.size());
+   std::size_t prefix = 0;
+   while (prefix < common && from[prefix] == to[prefix])
+      prefix++;
+   std::size_t suffix = 0;
+   while (suffix < (common - prefix) &&
+          from[from.size() - suffix - 1] == to[to.size() - suffix - 1])
+   {
+      suffix++;
+   }
+
+   std::string payload;
+   appendUInt32(prefix, &payload);
+   appendUInt32(from.size() - prefix - suffix, &payload);
+   payload.append(to, prefix, to.size() - prefix - suffix);
+   return payload;
+}
+
+Error applyDelta(const std::string& payload, std::string* pContents)
+{
+   if (payload.size() < 8)
+      return systemError(boost::system::errc::bad_message, ERROR_LOCATION);
+
+   std::size_t offset = readUInt32(payload.data());
+   std::size_t length = readUInt32(payload.data() + 4);
+   if (offset > pContents->size() || length > (pContents->size() - offset))
+      return systemError(boost::system::errc::bad_message, ERROR_LOCATION);
+
+   pContents->replace(offset, length, payload, 8, std::string::npos);
+   return Success();
+}
+
+Error logReadError(const std::exception& e, const FilePath& filePath)
+{
+   Error error = systemError(boost::system::errc::io_error, ERROR_LOCATION);
+   error.addProperty("what", e.what());
+   error.addProperty("path", filePath.absolutePath());
+   return error;
+}
+
+// read the header of a log (pIsLog is set to false for documents written
+// by earlier versions)
+Error readLogHeader(const FilePath& filePath,
+                    bool* pIsLog,
+                    std::string* pGeneration)
+{
+   boost::shared_ptr<std::istream> pIfs;
+   Error error = filePath.open_r(&pIfs);
+   if (error)
+      return error;
+
+   try
+   {
+      char magic[kLogMagicSize];
+      pIfs->read(magic, kLogMagicSize);
+      *pIsLog = pIfs->good() &&
+                std::string(magic, kLogMagicSize) == kLogMagic;
+      if (!*pIsLog)
+         return Success();
+
+      char header[kRecordHeaderSize];
+      pIfs->read(header, kRecordHeaderSize);
+      boost::uint32_t size = readUInt32(header + 1);
+      if (!pIfs->good() || header[0] != kGenerationRecord || size > 256)
+         return systemError(boost::system::errc::bad_message, ERROR_LOCATION);
+
+      pGeneration->resize(size);
+      if (size > 0)
+         pIfs->read(&(*pGeneration)[0], size);
+      if (!pIfs->good())
+         return systemError(boost::system::errc::bad_message, ERROR_LOCATION);
+
+      return Success();
+   }
+   catch(const std::exception& e)
+   {
+      return logReadError(e, filePath);
+   }
+}
+
+struct LogRecord
+{
+   char type;
+   boost::uintmax_t offset;
+   std::string payload;
+};
+
+// read the records of a log between offset and end (or the end of the
+// file if end is zero). the payloads of contents and delta records are
+// only read if requested. an incomplete record at the end of the log
+// (e.g. from an interrupted write) is ignored and pEnd receives the end
+// of the last complete record
+Error readLogRecords(const FilePath& filePath,
+                     boost::uintmax_t offset,
+                     boost::uintmax_t end,
+                     bool readContents,
+                     std::vector<LogRecord>* pRecords,
+                     boost::uintmax_t* pEnd)
+{
+   boost::shared_ptr<std::istream> pIfs;
+   Error error = filePath.open_r(&pIfs);
+   if (error)
+      return error;
+
+   if (end == 0)
+      end = filePath.size();
+
+   try
+   {
+      pIfs->exceptions(std::istream::failbit | std::istream::badbit);
+      pIfs->seekg(offset);
+
+      while ((offset + kRecordHeaderSize) <= end)
+      {
+         char header[kRecordHeaderSize];
+         pIfs->read(header, kRecordHeaderSize);
+         boost::uint32_t size = readUInt32(header + 1);
+         if ((offset + kRecordHeaderSize + size) > end)
+            break;
+
+         LogRecord record;
+         record.type = header[0];
+         record.offset = offset;
+         if (readContents || (record.type != kContentsRecord &&
+                              record.type != kDeltaRecord))
+         {
+            record.payload.resize(size);
+            if (size > 0)
+               pIfs->read(&record.payload[0], size);
+         }
+         else
+         {
+            pIfs->seekg(size, std::ios_base::cur);
+         }
+
+         pRecords->push_back(record);
+         offset += kRecordHeaderSize + size;
+      }
+
+      *pEnd = offset;
+      return Success();
+   }
+   catch(const std::exception& e)
+   {
+      return logReadError(e, filePath);
+   }
+}
+
 }  // anonymous namespace
 
 SourceDocument::SourceDocument(const std::string& type)
+   : contentsSize_(0),
+     nullBytes_(false),
+     lastKnownWriteTime_(0),
+     logSize_(0),
+     contentsOffset_(0),
+     contentsPending_(false),
+     contentsChanged_(false)
 {
    FilePath srcDBPath = source_database::path();
    FilePath docPath = file_utils::uniqueFilePath(srcDBPath);
@@ -174,6 +465,15 @@ SourceDocument::SourceDocument(const std::string& type)
 }
    
 
+const std::string& SourceDocument::contents() const
+{
+   Error error = loadContents();
+   if (error)
+      LOG_ERROR(error);
+
+   return contents_;
+}
+
 std::string SourceDocument::getProperty(const std::string& name) const
 {
    json::Object::const_iterator it = properties_.find(name);
@@ -199,7 +499,56 @@ bool SourceDocument::isUntitled() const
 // set contents from string
 void SourceDocument::setContents(const std::string& contents)
 {
+   // hold on to the contents as they are in the database (if we read
+   // them) so that only the range which changed needs to be written
+   if (!contentsChanged_)
+   {
+      if (contentsPending_)
+         contentsOffset_ = 0;
+      else if (contentsOffset_ != 0)
+         persistedContents_.swap(contents_);
+   }
+   else if (!contentsDelta_.empty())
+   {
+      // edited in place (see below) so we don't have them
+      contentsDelta_.clear();
+      contentsOffset_ = 0;
+   }
+
    contents_ = contents;
+   contentsPending_ = false;
+   onContentsChanged();
+}
+
+void SourceDocument::replaceContents(std::size_t offset,
+                                     std::size_t length,
+                                     const std::string& replacement)
+{
+   // if the contents are as they are in the database then the edit is
+   // exactly what needs to be written (otherwise we diff against the
+   // contents in the database if we have them, see setContents)
+   contents();
+   if (!contentsChanged_ && !contentsPending_ && contentsOffset_ != 0)
+   {
+      appendUInt32(offset, &contentsDelta_);
+      appendUInt32(length, &contentsDelta_);
+      contentsDelta_.append(replacement);
+   }
+   else if (!contentsDelta_.empty())
+   {
+      contentsDelta_.clear();
+      contentsOffset_ = 0;
+   }
+
+   contents_.replace(offset, length, replacement);
+   onContentsChanged();
+}
+
+void SourceDocument::onContentsChanged()
+{
+   contentsChanged_ = true;
+   contentsSize_ = contents_.size();
+   nullBytes_ = hasNullByteSequence(contents_);
    hash_ = hash::crc32Hash(contents_);
 }
 
@@ -312,6 +661,26 @@ Error SourceDocument::readFromJson(json::Object* pDocJson)
    // persistence format we need to make sure this code is robust
    // in the presence of the old format
 
+   Error error = readMetadataFromJson(pDocJson);
+   if (error)
+      return error;
+
+   try
+   {
+      json::Object& docJson = *pDocJson;
+      setContents(docJson["contents"].get_str());
+      return Success();
+   }
+   catch(const std::exception& e)
+   {
+      return systemError(boost::system::errc::protocol_error,
+                         e.what(),
+                         ERROR_LOCATION);
+   }
+}
+
+Error SourceDocument::readMetadataFromJson(json::Object* pDocJson)
+{
    try
    {
       json::Object& docJson = *pDocJson;
@@ -323,7 +692,6 @@ Error SourceDocument::readFromJson(json::Object* pDocJson)
       json::Value type = docJson["type"];
       type_ = !type.is_null() ? type.get_str() : std::string();
 
-      setContents(docJson["contents"].get_str());
       dirty_ = docJson["dirty"].get_bool();
       created_ = docJson["created"].get_real();
       sourceOnSave_ = docJson["source_on_save"].get_bool();
@@ -354,13 +722,20 @@ Error SourceDocument::readFromJson(json::Object* pDocJson)
 }
    
 void SourceDocument::writeToJson(json::Object* pDocJson) const
+{
+   writeMetadataToJson(pDocJson);
+
+   json::Object& jsonDoc = *pDocJson;
+   jsonDoc["contents"] = contents();
+}
+
+void SourceDocument::writeMetadataToJson(json::Object* pDocJson) const
 {
    json::Object& jsonDoc = *pDocJson;
    jsonDoc["id"] = id();
    jsonDoc["path"] = !path().empty() ? path_ : json::Value();
    jsonDoc["type"] = !type().empty() ? type_ : json::Value();
    jsonDoc["hash"] = hash();
-   jsonDoc["contents"] = contents();
    jsonDoc["dirty"] = dirty();
    jsonDoc["created"] = created();
    jsonDoc["source_on_save"] = sourceOnSave();
@@ -371,16 +746,299 @@ void SourceDocument::writeToJson(json::Object* pDocJson) const
    jsonDoc["encoding"] = encoding_;
 }
 
+std::string SourceDocument::metadataRecord() const
+{
+   // include what we know about the contents so they needn't be read
+   // until they are used
+   json::Object metadata;
+   writeMetadataToJson(&metadata);
+   metadata["contents_size"] = json::Value(
+         static_cast<boost::int64_t>(contentsSize_));
+   metadata["null_bytes"] = nullBytes_;
+
+   std::ostringstream ostr;
+   json::write(metadata, ostr);
+   return ostr.str();
+}
+
+Error SourceDocument::readFromFile(const FilePath& filePath)
+{
+   // check whether this is a log or a document written by an earlier
+   // version (a json object)
+   bool isLog;
+   std::string generation;
+   Error error = readLogHeader(filePath, &isLog, &generation);
+   if (error)
+      return error;
+
+   if (!isLog)
+   {
+      // read the contents of the file
+      std::string contents ;
+      error = readStringFromFile(filePath, &contents,
+                                 options().sourceLineEnding());
+      if (error)
+         return error;
+
+      // parse the json
+      json::Value value;
+      if ( !json::parse(contents, &value) ||
+           !json::isType<json::Object>(value) )
+      {
+         return systemError(boost::system::errc::invalid_argument,
+                            ERROR_LOCATION);
+      }
+
+      // initialize doc from json (it will be rewritten as a log when
+      // it is next written)
+      json::Object jsonDoc = value.get_obj();
+      logFile_ = FilePath();
+      return readFromJson(&jsonDoc);
+   }
+
+   // read the records (other than the contents)
+   std::vector<LogRecord> records;
+   boost::uintmax_t end;
+   error = readLogRecords(filePath, kLogMagicSize, 0, false, &records, &end);
+   if (error)
+      return error;
+
+   // find the latest metadata and the contents as of then (a write always
+   // ends with a metadata record so anything after it is incomplete)
+   const LogRecord* pMetadata = NULL;
+   boost::uintmax_t contentsOffset = 0, lastContentsOffset = 0;
+   BOOST_FOREACH(const LogRecord& record, records)
+   {
+      if (record.type == kMetadataRecord)
+      {
+         pMetadata = &record;
+         contentsOffset = lastContentsOffset;
+      }
+      else if (record.type == kContentsRecord)
+      {
+         lastContentsOffset = record.offset;
+      }
+   }
+
+   json::Value value;
+   if (pMetadata == NULL ||
+       contentsOffset == 0 ||
+       !json::parse(pMetadata->payload, &value) ||
+       !json::isType<json::Object>(value))
+   {
+      Error error = systemError(boost::system::errc::bad_message,
+                                ERROR_LOCATION);
+      error.addProperty("path", filePath.absolutePath());
+      return error;
+   }
+
+   json::Object metadata = value.get_obj();
+   error = readMetadataFromJson(&metadata);
+   if (error)
+      return error;
+
+   try
+   {
+      hash_ = metadata["hash"].get_str();
+      contentsSize_ = metadata["contents_size"].get_int64();
+      nullBytes_ = metadata["null_bytes"].get_bool();
+   }
+   catch(const std::exception& e)
+   {
+      return systemError(boost::system::errc::protocol_error,
+                         e.what(),
+                         ERROR_LOCATION);
+   }
+
+   // the contents are read when they are first used
+   contents_.clear();
+   persistedContents_.clear();
+   contentsDelta_.clear();
+   contentsPending_ = true;
+   contentsChanged_ = false;
+   contentsOffset_ = contentsOffset;
+
+   logFile_ = filePath;
+   logGeneration_ = generation;
+   logMetadata_ = pMetadata->payload;
+   logSize_ = pMetadata->offset + kRecordHeaderSize + pMetadata->payload.size();
+
+   return Success();
+}
+
+Error SourceDocument::loadContents() const
+{
+   if (!contentsPending_)
+      return Success();
+
+   // read from the latest contents record as of when we read the log (or
+   // the latest in the file if the log has since been rewritten)
+   bool isLog;
+   std::string generation;
+   Error error = readLogHeader(logFile_, &isLog, &generation);
+   if (error)
+      return error;
+   if (!isLog)
+      return systemError(boost::system::errc::bad_message, ERROR_LOCATION);
+
+   boost::uintmax_t offset = contentsOffset_;
+   boost::uintmax_t end = logSize_;
+   if (generation != logGeneration_)
+   {
+      offset = kLogMagicSize;
+      end = 0;
+   }
+
+   std::vector<LogRecord> records;
+   boost::uintmax_t recordsEnd;
+   error = readLogRecords(logFile_, offset, end, true, &records, &recordsEnd);
+   if (error)
+      return error;
+
+   // ignore anything after the last metadata record
+   while (!records.empty() && records.back().type != kMetadataRecord)
+      records.pop_back();
+
+   std::string contents;
+   bool haveContents = false;
+   BOOST_FOREACH(const LogRecord& record, records)
+   {
+      if (record.type == kContentsRecord)
+      {
+         contents = record.payload;
+         haveContents = true;
+      }
+      else if (record.type == kDeltaRecord)
+      {
+         if (!haveContents)
+            return systemError(boost::system::errc::bad_message,
+                               ERROR_LOCATION);
+
+         error = applyDelta(record.payload, &contents);
+         if (error)
+            return error;
+      }
+   }
+
+   if (!haveContents)
+      return systemError(boost::system::errc::bad_message, ERROR_LOCATION);
+
+   contents_.swap(contents);
+   contentsPending_ = false;
+   return Success();
+}
+
+Error SourceDocument::writeLog(const FilePath& filePath,
+                               std::string* pGeneration,
+                               std::string* pMetadata,
+                               boost::uintmax_t* pSize) const
+{
+   Error error = loadContents();
+   if (error)
+      return error;
+
+   *pGeneration = core::system::generateShortenedUuid();
+   *pMetadata = metadataRecord();
+
+   std::string log(kLogMagic, kLogMagicSize);
+   appendRecord(kGenerationRecord, *pGeneration, &log);
+   appendRecord(kContentsRecord, contents_, &log);
+   appendRecord(kMetadataRecord, *pMetadata, &log);
+   *pSize = log.size();
+
+   return writeStringToFile(filePath, log);
+}
+
 Error SourceDocument::writeToFile(const FilePath& filePath) const
 {
-   // get json representation
-   json::Object jsonDoc ;
-   writeToJson(&jsonDoc);
-   std::ostringstream ostr ;
-   json::writeFormatted(jsonDoc, ostr);
+   std::string generation, metadata;
+   boost::uintmax_t size;
+   return writeLog(filePath, &generation, &metadata, &size);
+}
 
-   // write to file
-   return writeStringToFile(filePath, ostr.str());
+Error SourceDocument::updateFile(const FilePath& filePath)
+{
+   // we can append to the log if it's the one we read (or last wrote) and
+   // it hasn't been written since
+   bool append = false;
+   if (filePath == logFile_ &&
+       filePath.exists() &&
+       filePath.size() == logSize_)
+   {
+      bool isLog;
+      std::string generation;
+      Error error = readLogHeader(filePath, &isLog, &generation);
+      if (error)
+         LOG_ERROR(error);
+      append = !error && isLog && (generation == logGeneration_);
+   }
+
+   std::string records, metadata;
+   boost::uintmax_t contentsOffset = contentsOffset_;
+   if (append)
+   {
+      // write just the range which changed if we have the contents as
+      // they are in the log
+      if (contentsChanged_)
+      {
+         std::string delta = contentsDelta_;
+         if (delta.empty() && contentsOffset_ != 0)
+            delta = deltaPayload(persistedContents_, contents_);
+
+         if (contentsOffset_ != 0 && delta.size() < contents_.size())
+         {
+            appendRecord(kDeltaRecord, delta, &records);
+         }
+         else
+         {
+            contentsOffset = logSize_ + records.size();
+            appendRecord(kContentsRecord, contents_, &records);
+         }
+      }
+
+      // each write ends with a metadata record (which marks it complete)
+      metadata = metadataRecord();
+      if (!records.empty() || metadata != logMetadata_)
+         appendRecord(kMetadataRecord, metadata, &records);
+
+      // rewrite the log instead if it would hold too much superseded data
+      boost::uintmax_t liveSize = contentsSize_ + metadata.size();
+      if ((logSize_ + records.size()) > ((2 * liveSize) + kLogSlack))
+         append = false;
+   }
+
+   if (append)
+   {
+      if (!records.empty())
+      {
+         Error error = appendToFile(filePath, records);
+         if (error)
+            return error;
+
+         logSize_ += records.size();
+         logMetadata_ = metadata;
+         contentsOffset_ = contentsOffset;
+      }
+   }
+   else
+   {
+      Error error = writeLog(filePath, &logGeneration_, &logMetadata_, &logSize_);
+      if (error)
+      {
+         logFile_ = FilePath();
+         return error;
+      }
+
+      logFile_ = filePath;
+      contentsOffset_ = kLogMagicSize + kRecordHeaderSize +
+                        logGeneration_.size();
+   }
+
+   // the log now has our contents
+   contentsChanged_ = false;
+   persistedContents_.clear();
+   contentsDelta_.clear();
+   return Success();
 }
 
 void SourceDocument::editProperty(const json::Object::value_type& property)
@@ -417,24 +1075,7 @@ Error get(const std::string& id, boost::shared_ptr<SourceDocument> pDoc)
    FilePath filePath = source_database::path().complete(id);
    if (filePath.exists())
    {
-      // read the contents of the file
-      std::string contents ;
-      Error error = readStringFromFile(filePath, &contents,
-                                       options().sourceLineEnding());
-      if (error)
-         return error;
-   
-      // parse the json
-      json::Value value;
-      if ( !json::parse(contents, &value) )
-      {
-         return systemError(boost::system::errc::invalid_argument,
-                            ERROR_LOCATION);
-      }
-      
-      // initialize doc from json
-      json::Object jsonDoc = value.get_obj();
-      return pDoc->readFromJson(&jsonDoc);
+      return pDoc->readFromFile(filePath);
    }
    else
    {
@@ -470,16 +1111,7 @@ void logUnsafeSourceDocument(const FilePath& filePath,
    LOG_WARNING_MESSAGE(msg);
 }
 
-bool hasNullByteSequence(const std::string& contents)
-{
-   std::string nullBytes;
-   nullBytes.push_back('\0');
-   nullBytes.push_back('\0');
-   return boost::algorithm::contains(contents, nullBytes);
-}
-
-bool isSafeSourceDocument(const FilePath& docDbPath,
-                          boost::shared_ptr<SourceDocument> pDoc)
+bool isSafeSourceDocument(boost::shared_ptr<SourceDocument> pDoc)
 {
    // get a filepath and use it for filtering if we can
    FilePath filePath;
@@ -493,8 +1125,9 @@ bool isSafeSourceDocument(const FilePath& docDbPath,
       }
    }
 
-   // get the size of the file in KB
-   uintmax_t docSizeKb = docDbPath.size() / 1024;
+   // get the size of the contents in KB (this and the null byte check
+   // below don't require the contents to be read)
+   uintmax_t docSizeKb = pDoc->contentsSize() / 1024;
    std::string kbStr = safe_convert::numberToString(docSizeKb);
 
    // if it's larger than 2MB then always drop it (that's the limit
@@ -514,7 +1147,7 @@ bool isSafeSourceDocument(const FilePath& docDbPath,
    }
 
    // if it has a sequence of 2 null bytes then drop it
-   else if (hasNullByteSequence(pDoc->contents()))
+   else if (pDoc->hasNullBytes())
    {
       logUnsafeSourceDocument(filePath,
                               "File is binary (has null byte sequence)");
@@ -545,7 +1178,7 @@ Error list(std::vector<boost::shared_ptr<SourceDocument> >* pDocs)
          if (!error)
          {
             // safety filter
-            if (isSafeSourceDocument(filePath, pDoc))
+            if (isSafeSourceDocument(pDoc))
                pDocs->push_back(pDoc);
          }
          else
@@ -560,7 +1193,7 @@ Error put(boost::shared_ptr<SourceDocument> pDoc)
 {   
    // write to file
    FilePath filePath = source_database::path().complete(pDoc->id());
-   Error error = pDoc->writeToFile(filePath);
+   Error error = pDoc->updateFile(filePath);
    if (error)
       return error ;
 
@@ -18,6 +18,8 @@
 
 
 #include <boost/array.hpp>
+#include <boost/bind.hpp>
+#include <boost/function.hpp>
 
 #include <boost/utility.hpp>
 #include <boost/asio/io_service.hpp>
@@ -26,16 +28,20 @@
 #include <boost/enable_shared_from_this.hpp>
 
 #include <core/Error.hpp>
+#include <core/FilePath.hpp>
 #include <core/Log.hpp>
 #include <core/SafeConvert.hpp>
+#include <core/Thread.hpp>
 
 #include <core/http/Request.hpp>
 #include <core/http/Response.hpp>
 #include <core/http/RequestParser.hpp>
 #include <core/http/SocketUtils.hpp>
+#include <core/http/StreamFile.hpp>
 
 #include <core/json/JsonRpc.hpp>
 
+#include <session/SessionConstants.hpp>
 #include <session/SessionHttpConnection.hpp>
 
 #include "SessionHttpConnectionUtils.hpp"
@@ -55,9 +61,18 @@ public:
 
 public:
    HttpConnectionImpl(boost::asio::io_service& ioService,
+                      const core::FilePath& uploadSpoolDir,
+                      std::size_t uploadMaxFileSize,
                       const Handler& handler)
-      : socket_(ioService), handler_(handler)
+      : socket_(ioService), readingBody_(false), handler_(handler)
    {
+      // spool uploaded files to disk rather than reading them into memory
+      if (!uploadSpoolDir.empty())
+      {
+         requestParser_.setFormSpoolDir(kFileUploadUri,
+                                        uploadSpoolDir,
+                                        uploadMaxFileSize);
+      }
    }
 
    virtual ~HttpConnectionImpl()
@@ -85,6 +100,32 @@ public:
          boost::asio::write(socket_,
                             response.toBuffers(
                                   core::http::Header::connectionClose()));
+
+#ifndef _WIN32
+         // write the body directly from disk (or as it is produced) if it
+         // is being streamed. this is done on a background thread so that
+         // the caller (typically the main thread) isn't blocked while a
+         // large body is written
+         if (!response.streamFile().empty() || response.streamBody())
+         {
+            boost::function<void()> sendStream = boost::bind(
+                        &HttpConnectionImpl<ProtocolType>::sendStream,
+                        HttpConnectionImpl<ProtocolType>::shared_from_this(),
+                        response.streamFile(),
+                        response.streamBody());
+
+            // if we can't launch a thread then write the body here
+            boost::thread sendThread;
+            core::thread::safeLaunchThread(sendStream, &sendThread);
+            if (sendThread.joinable())
+               sendThread.detach();
+            else
+               sendStream();
+
+            // the connection is closed once the body is written
+            return;
+         }
+#endif
       }
       catch(const boost::system::system_error& e)
       {
@@ -132,6 +173,40 @@ public:
 
 private:
 
+#ifndef _WIN32
+   // write a streamed body to the socket and then close it (holds a
+   // reference to the connection so it outlives the caller of sendResponse)
+   void sendStream(const core::http::StreamFile& streamFile,
+                   boost::shared_ptr<core::http::StreamBody> pStreamBody)
+   {
+      try
+      {
+         core::Error error;
+         if (!streamFile.empty())
+            error = core::http::sendStreamFile(socket_.native_handle(),
+                                               streamFile);
+         else if (pStreamBody)
+            error = core::http::sendStreamBody(socket_.native_handle(),
+                                               pStreamBody.get());
+
+         if (error)
+         {
+            error.addProperty("request-uri", request_.uri());
+            if (!core::http::isConnectionTerminatedError(error))
+               LOG_ERROR(error);
+         }
+      }
+      CATCH_UNEXPECTED_EXCEPTION
+
+      // always close connection
+      try
+      {
+         close();
+      }
+      CATCH_UNEXPECTED_EXCEPTION
+   }
+#endif
+
    // async request reading interface
    void readSome()
    {
@@ -141,8 +216,14 @@ private:
       // (unless the handler chooses to retain a copy of it e.g. to perform
       // processing in a background thread)
 
+      // once we are receiving the body read directly into the request
+      std::size_t bodySize = 0;
+      char* pBody = requestParser_.bodyBuffer(request_, &bodySize);
+      readingBody_ = (pBody != NULL);
+
       socket_.async_read_some(
-         boost::asio::buffer(buffer_),
+         readingBody_ ? boost::asio::buffer(pBody, bodySize) :
+                        boost::asio::buffer(buffer_),
          boost::bind(
                &HttpConnectionImpl<ProtocolType>::handleRead,
                HttpConnectionImpl<ProtocolType>::shared_from_this(),
@@ -157,11 +238,12 @@ private:
       {
          if (!e)
          {
-            // parse next chunk
-            core::http::RequestParser::status status = requestParser_.parse(
-                                        request_,
-                                        buffer_.data(),
-                                        buffer_.data() + bytesTransferred);
+            // parse next chunk (or note body bytes read into the request)
+            core::http::RequestParser::status status = readingBody_ ?
+               requestParser_.bodyReceived(request_, bytesTransferred) :
+               requestParser_.parse(request_,
+                                    buffer_.data(),
+                                    buffer_.data() + bytesTransferred);
 
             // error - return bad request
             if (status == core::http::RequestParser::error)
@@ -215,6 +297,7 @@ private:
 private:
    typename ProtocolType::socket socket_;
    boost::array<char, 8192> buffer_ ;
+   bool readingBody_;
    core::http::RequestParser requestParser_ ;
    core::http::Request request_;
    std::string requestId_;
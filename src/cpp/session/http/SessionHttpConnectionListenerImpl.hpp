@@ -122,6 +122,11 @@ public:
       }
    }
 
+   virtual void setUploadSpoolDir(const core::FilePath& spoolDir)
+   {
+      uploadSpoolDir_ = spoolDir;
+   }
+
    virtual void stop()
    {
       // don't stop if we never started
@@ -195,6 +200,8 @@ private:
       // create the connection
       ptrNextConnection_.reset( new HttpConnectionImpl<ProtocolType>(
             ioService(),
+            uploadSpoolDir_,
+            uploadMaxFileSize(),
             boost::bind(
                  &HttpConnectionListenerImpl<ProtocolType>::enqueConnection,
                  this,
@@ -211,6 +218,14 @@ private:
    }
 
 
+   // limit on the size of uploaded files (0 for no limit)
+   std::size_t uploadMaxFileSize() const
+   {
+      int mbLimit = session::options().limitFileUploadSizeMb();
+      return mbLimit > 0 ? static_cast<std::size_t>(mbLimit) * 1024 * 1024
+                         : 0;
+   }
+
    void handleAccept(const boost::system::error_code& ec)
    {
       try
@@ -281,6 +296,11 @@ private:
          return;
       }
 
+      // some requests can be served without involving the main thread
+      // (e.g. those whose content is cached)
+      if (connection::handleInBackground(ptrHttpConnection))
+         return;
+
       // place the connection on the correct queue
       if (connection::isGetEvents(ptrHttpConnection))
          eventsConnectionQueue_.enqueConnection(ptrHttpConnection);
@@ -296,6 +316,9 @@ private:
    // next connection
    boost::shared_ptr<HttpConnectionImpl<ProtocolType> > ptrNextConnection_;
 
+   // directory uploaded files are spooled to
+   core::FilePath uploadSpoolDir_;
+
    // connection queues
    HttpConnectionQueue mainConnectionQueue_;
    HttpConnectionQueue eventsConnectionQueue_;
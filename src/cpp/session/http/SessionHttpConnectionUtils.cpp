@@ -17,12 +17,15 @@
 #include "SessionHttpConnectionUtils.hpp"
 
 
+#include <vector>
+
 #include <boost/algorithm/string/predicate.hpp>
 
 #include <core/FilePath.hpp>
 #include <core/Log.hpp>
 #include <core/Error.hpp>
 #include <core/FileSerializer.hpp>
+#include <core/BoostThread.hpp>
 
 
 #include <core/http/Response.hpp>
@@ -184,6 +187,61 @@ bool authenticate(boost::shared_ptr<HttpConnection> ptrConnection,
    return secret == ptrConnection->request().headerValue("X-Shared-Secret");
 }
 
+namespace {
+
+// handlers are registered on the main thread and called on the listener
+// thread (so access to them is synchronized)
+boost::mutex s_backgroundHandlersMutex;
+std::vector<std::pair<std::string,BackgroundUriHandler> >
+                                                   s_backgroundHandlers;
+
+} // anonymous namespace
+
+void registerBackgroundUriHandler(const std::string& prefix,
+                                  const BackgroundUriHandler& handler)
+{
+   boost::lock_guard<boost::mutex> lock(s_backgroundHandlersMutex);
+   s_backgroundHandlers.push_back(std::make_pair(prefix, handler));
+}
+
+bool handleInBackground(boost::shared_ptr<HttpConnection> ptrConnection)
+{
+   const core::http::Request& request = ptrConnection->request();
+
+   BackgroundUriHandler handler;
+   {
+      boost::lock_guard<boost::mutex> lock(s_backgroundHandlersMutex);
+      std::vector<std::pair<std::string,BackgroundUriHandler> >
+                                                   ::const_iterator it;
+      for (it = s_backgroundHandlers.begin();
+           it != s_backgroundHandlers.end();
+           ++it)
+      {
+         if (boost::algorithm::starts_with(request.uri(), it->first))
+         {
+            handler = it->second;
+            break;
+         }
+      }
+   }
+
+   if (!handler)
+      return false;
+
+   try
+   {
+      core::http::Response response;
+      if (!handler(request, &response))
+         return false;
+
+      ptrConnection->sendResponse(response);
+      return true;
+   }
+   CATCH_UNEXPECTED_EXCEPTION
+
+   return false;
+}
+
 } // namespace connection
 } // namespace session
 
@@ -25,6 +25,7 @@
 namespace core {
 namespace http {
    class Request;
+   class Response;
 }
 }
 
@@ -49,6 +50,19 @@ bool checkForAbort(boost::shared_ptr<HttpConnection> ptrConnection,
 bool authenticate(boost::shared_ptr<HttpConnection> ptrConnection,
                   const std::string& secret);
 
+// handlers which are called on the listener thread (before connections
+// are queued for the main thread). they return false to decline a request
+// (it is then queued as usual). they must never call R
+typedef boost::function<bool(const core::http::Request&,
+                             core::http::Response*)> BackgroundUriHandler;
+
+void registerBackgroundUriHandler(const std::string& prefix,
+                                  const BackgroundUriHandler& handler);
+
+// respond to the connection using a background handler (returns false if
+// no handler accepted the request)
+bool handleInBackground(boost::shared_ptr<HttpConnection> ptrConnection);
+
 
 } // namespace connection
 } // namespace session
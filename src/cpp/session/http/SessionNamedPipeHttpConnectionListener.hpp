@@ -364,6 +364,11 @@ private:
          return;
       }
 
+      // some requests can be served without involving the main thread
+      // (e.g. those whose content is cached)
+      if (connection::handleInBackground(ptrHttpConnection))
+         return;
+
       // place the connection on the correct queue
       if (connection::isGetEvents(ptrHttpConnection))
          eventsConnectionQueue_.enqueConnection(ptrHttpConnection);
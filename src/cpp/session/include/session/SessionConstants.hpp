@@ -39,6 +39,10 @@
 #define kPostbackUriScope                 "postback/"
 #define kPostbackExitCodeHeader           "X-Postback-ExitCode"
 
+// Files uploaded to this uri are spooled to disk as they are received
+// (other requests are read into memory)
+#define kFileUploadUri                    "/upload"
+
 // These constants are here so that the HttpConnectionListener::checkForAbort
 // method can write the next session project (so that aborts don't require
 // a full IDE reload)
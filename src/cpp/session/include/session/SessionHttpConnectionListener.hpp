@@ -72,6 +72,7 @@
 
 namespace core {
 	class Error;
+	class FilePath;
 }
 
 namespace session {
@@ -93,6 +94,11 @@ public:
 	virtual core::Error start() = 0;
    virtual void stop() = 0;
 
+   // directory which files uploaded to kFileUploadUri are spooled to as
+   // they are received (must be set before starting; listeners which don't
+   // spool uploads read them into memory)
+   virtual void setUploadSpoolDir(const core::FilePath& spoolDir) {}
+
    // connection queues
 	virtual HttpConnectionQueue& mainConnectionQueue() = 0;
 	virtual HttpConnectionQueue& eventsConnectionQueue() = 0;
@@ -102,6 +102,15 @@ core::Error registerUriHandler(
                         const std::string& name,
                         const core::http::UriHandlerFunction& handlerFunction);
 
+// register a handler which is called on the http listener thread (so
+// that it can respond while the main thread is busy). the handler returns
+// false to decline a request, which is then dispatched to the uri handlers
+// above. it must never call R or use state owned by the main thread
+typedef boost::function<bool(const core::http::Request&,
+                             core::http::Response*)> BackgroundUriHandler;
+core::Error registerBackgroundUriHandler(const std::string& name,
+                                         const BackgroundUriHandler& handler);
+
 // register a local uri handler (scoped by a special prefix which indicates
 // a local scope)
 core::Error registerAsyncLocalUriHandler(
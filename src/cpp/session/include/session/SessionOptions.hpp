@@ -122,6 +122,15 @@ public:
 
    bool rProfileOnResumeDefault() const { return rProfileOnResumeDefault_; }
 
+   bool lazyRestore() const { return lazyRestore_; }
+
+   int suspendCompressionThreads() const
+   {
+      return suspendCompressionThreads_;
+   }
+
+   bool backgroundSuspend() const { return backgroundSuspend_; }
+
    unsigned int minimumUserId() const { return 100; }
    
    core::FilePath coreRSourcePath() const 
@@ -317,6 +326,9 @@ private:
    int timeoutMinutes_;
    bool createPublicFolder_;
    bool rProfileOnResumeDefault_;
+   bool lazyRestore_;
+   int suspendCompressionThreads_;
+   bool backgroundSuspend_;
 
    // r
    std::string coreRSourcePath_;
@@ -20,6 +20,7 @@
 #include <vector>
 
 #include <boost/utility.hpp>
+#include <boost/cstdint.hpp>
 #include <boost/shared_ptr.hpp>
 
 #include <core/FilePath.hpp>
@@ -44,7 +45,7 @@ public:
    const std::string& id() const { return id_; }
    const std::string& path() const { return path_; }
    const std::string& type() const { return type_; }
-   const std::string& contents() const { return contents_; }
+   const std::string& contents() const;
    const std::string& hash() const { return hash_; }
    const std::string& encoding() const { return encoding_; }
    bool dirty() const { return dirty_; }
@@ -54,12 +55,22 @@ public:
    const std::string& folds() const { return folds_; }
    std::string getProperty(const std::string& name) const;
 
+   // size of the contents and whether they contain a sequence of null
+   // bytes (neither requires the contents to be read from the database)
+   std::size_t contentsSize() const { return contentsSize_; }
+   bool hasNullBytes() const { return nullBytes_; }
+
    // is this an untitled document?
    bool isUntitled() const;
 
    // set contents from string
    void setContents(const std::string& contents);
 
+   // replace a range of the contents (offset and length are in bytes)
+   void replaceContents(std::size_t offset,
+                        std::size_t length,
+                        const std::string& replacement);
+
    // set contents from file
    core::Error setPathAndContents(const std::string& path,
                                   bool allowSubstChars = true);
@@ -107,16 +118,37 @@ public:
    core::Error readFromJson(core::json::Object* pDocJson);
    void writeToJson(core::json::Object* pDocJson) const;
 
+   // read from a source database file (contents are read on first access)
+   core::Error readFromFile(const core::FilePath& filePath);
+
+   // write the whole document to a source database file
    core::Error writeToFile(const core::FilePath& filePath) const;
 
+   // write the changes made since the document was last read from or
+   // written to the file (rewrites the file if it has changed since then)
+   core::Error updateFile(const core::FilePath& filePath);
+
 private:
    void editProperty(const core::json::Object::value_type& property);
+   void onContentsChanged();
+
+   core::Error readMetadataFromJson(core::json::Object* pDocJson);
+   void writeMetadataToJson(core::json::Object* pDocJson) const;
+   std::string metadataRecord() const;
+
+   core::Error loadContents() const;
+   core::Error writeLog(const core::FilePath& filePath,
+                        std::string* pGeneration,
+                        std::string* pMetadata,
+                        boost::uintmax_t* pSize) const;
 
 private:
    std::string id_;
    std::string path_;
    std::string type_;
-   std::string contents_;
+   mutable std::string contents_;
+   std::size_t contentsSize_;
+   bool nullBytes_;
    std::string hash_;
    std::string encoding_;
    std::string folds_;
@@ -125,6 +157,18 @@ private:
    double created_;
    bool sourceOnSave_;
    core::json::Object properties_;
+
+   // state of the database file the document was read from or last
+   // written to (used to append changes rather than rewrite the file)
+   core::FilePath logFile_;
+   std::string logGeneration_;
+   std::string logMetadata_;
+   boost::uintmax_t logSize_;
+   mutable boost::uintmax_t contentsOffset_;
+   mutable bool contentsPending_;
+   bool contentsChanged_;
+   std::string persistedContents_;
+   std::string contentsDelta_;
 };
 
 bool sortByCreated(const boost::shared_ptr<SourceDocument>& pDoc1,
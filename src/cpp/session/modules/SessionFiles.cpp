@@ -35,6 +35,7 @@
 #include <core/Settings.hpp>
 #include <core/Exec.hpp>
 #include <core/DateTime.hpp>
+#include <core/ZipWriter.hpp>
 
 #include <core/http/Util.hpp>
 #include <core/http/Request.hpp>
@@ -51,6 +52,7 @@
 #include <r/RRoutines.hpp>
 #include <r/RErrorCategory.hpp>
 
+#include <session/SessionConstants.hpp>
 #include <session/SessionClientEvent.hpp>
 #include <session/SessionModuleContext.hpp>
 #include <session/SessionOptions.hpp>
@@ -543,14 +545,19 @@ Error completeUpload(const core::json::JsonRpcRequest& request,
          if (removeError)
             return removeError;
          
-         // copy the source to the destination
-         Error copyError = uploadedTempFilePath.copy(targetPath);
-         if (copyError)
-            return copyError;
+         // move the source to the destination (copying if it is on
+         // another device)
+         Error moveError = uploadedTempFilePath.move(targetPath);
+         if (moveError)
+         {
+            Error copyError = uploadedTempFilePath.copy(targetPath);
+            if (copyError)
+               return copyError;
+         }
       }
 
       // remove the uploaded temp file
-      error = uploadedTempFilePath.remove();
+      error = uploadedTempFilePath.removeIfExists();
       if (error)
          LOG_ERROR(error);
       
@@ -610,7 +617,7 @@ bool validateUploadedFile(const http::File& file, http::Response* pResponse)
    size_t byteLimit = mbLimit * 1024 * 1024;
    
    // compare to file size
-   if (file.contents.size() > byteLimit)
+   if (file.size() > byteLimit)
    {
       Error fileTooLargeError = systemError(boost::system::errc::file_too_large,
                                             ERROR_LOCATION);
@@ -653,11 +660,23 @@ void handleFileUploadRequest(const http::Request& request,
    
    // establish whether this is a zip file and create appropriate temp file path
    bool isZip = destPath.extensionLowerCase() == ".zip";
-   FilePath tempFilePath = module_context::tempFile("upload", 
-                                                    isZip ? "zip" : "bin");
-   
-   // attempt to write the temp file
-   Error saveError = core::writeStringToFile(tempFilePath, file.contents);
+   FilePath tempFilePath;
+   Error saveError;
+   if (file.spooled())
+   {
+      // the file was spooled to disk as it was received so just move it
+      // (within the spool directory so no copying is required)
+      tempFilePath = file.path.parent().complete(
+                           file.path.filename() + (isZip ? ".zip" : ".bin"));
+      saveError = file.path.move(tempFilePath);
+   }
+   else
+   {
+      tempFilePath = module_context::tempFile("upload", isZip ? "zip" : "bin");
+      saveError = core::writeStringToFile(tempFilePath, file.contents);
+   }
+
+   // check for errors saving the temp file
    if (saveError)
    {
       LOG_ERROR(saveError);
@@ -676,6 +695,11 @@ void handleFileUploadRequest(const http::Request& request,
       {
          LOG_ERROR(error);
          json::setJsonRpcError(error, pResponse);
+
+         // the upload won't be completed so remove the temp file now
+         Error removeError = tempFilePath.removeIfExists();
+         if (removeError)
+            LOG_ERROR(removeError);
          return;
       }
    }
@@ -696,10 +720,9 @@ void handleFileUploadRequest(const http::Request& request,
    json::setJsonRpcResult(uploadJson, pResponse);   
 }
    
-void setAttachmentResponse(const http::Request& request,
-                           const std::string& filename,
-                           const FilePath& attachmentPath,
-                           http::Response* pResponse)
+void setAttachmentHeaders(const http::Request& request,
+                          const std::string& filename,
+                          http::Response* pResponse)
 {
    if (request.headerValue("User-Agent").find("MSIE") == std::string::npos)
    {
@@ -719,7 +742,20 @@ void setAttachmentResponse(const http::Request& request,
                         "attachment; filename*=UTF-8''"
                         + http::util::urlEncode(filename, false));
    pResponse->setHeader("Content-Type", "application/octet-stream");
-   pResponse->setBody(attachmentPath);
+}
+
+void setAttachmentResponse(const http::Request& request,
+                           const std::string& filename,
+                           const FilePath& attachmentPath,
+                           http::Response* pResponse)
+{
+   setAttachmentHeaders(request, filename, pResponse);
+   Error error = pResponse->setBody(attachmentPath);
+   if (error)
+   {
+      LOG_ERROR(error);
+      pResponse->setError(error);
+   }
 }
    
 void handleMultipleFileExportRequest(const http::Request& request, 
@@ -748,7 +784,7 @@ void handleMultipleFileExportRequest(const http::Request& request,
    }
    
    // files parameters (paths relative to parent)
-   std::vector<std::string> files;
+   boost::shared_ptr<zip::ZipWriter> pZipWriter(new zip::ZipWriter());
    for (int i=0; ;i++)
    {
       // get next file (terminate when we stop finding files)
@@ -766,25 +802,35 @@ void handleMultipleFileExportRequest(const http::Request& request,
          return;
       }
       
-      // add it
-      files.push_back(file);
+      // add it (directories are added recursively)
+      Error error = pZipWriter->add(filePath, file);
+      if (error)
+      {
+         LOG_ERROR(error);
+         pResponse->setError(error);
+         return;
+      }
    }
    
-   // create the zip file
+#ifndef _WIN32
+   // stream the zip into the response as it is written (files are
+   // compressed on background threads so R isn't involved)
+   setAttachmentHeaders(request, name, pResponse);
+   pResponse->setStreamBody(pZipWriter);
+#else
+   // the desktop requires a content length so write the zip to a temp file
    FilePath tempZipFilePath = module_context::tempFile("export", "zip");
-   Error error = r::exec::RFunction(".rs.createZipFile",
-                                    tempZipFilePath.absolutePath(),
-                                    parentPath.absolutePath(),
-                                    files).call();
+   Error error = pZipWriter->writeToFile(tempZipFilePath);
    if (error)
    {
       LOG_ERROR(error);
       pResponse->setError(error);
       return;
    }
-   
+
    // return attachment
    setAttachmentResponse(request, name, tempZipFilePath, pResponse);
+#endif
 }
    
 void handleFileExportRequest(const http::Request& request, 
@@ -904,7 +950,7 @@ Error initialize()
       (bind(registerRpcMethod, "move_files", moveFiles))
       (bind(registerRpcMethod, "rename_file", renameFile))
       (bind(registerUriHandler, "/files", handleFilesRequest))
-      (bind(registerUriHandler, "/upload", handleFileUploadRequest))
+      (bind(registerUriHandler, kFileUploadUri, handleFileUploadRequest))
       (bind(registerUriHandler, "/export", handleFileExportRequest))
       (bind(registerRpcMethod, "complete_upload", completeUpload))
       (bind(sourceModuleRFile, "SessionFiles.R"))
@@ -24,6 +24,7 @@
 #include <boost/iostreams/concepts.hpp>
 #include <boost/iostreams/filter/regex.hpp>
 #include <boost/iostreams/filtering_stream.hpp>
+#include <boost/iostreams/device/back_inserter.hpp>
 
 #include <boost/algorithm/string/join.hpp>
 #include <boost/algorithm/string/predicate.hpp>
@@ -62,6 +63,10 @@ namespace html_preview {
 
 namespace {
 
+// cache of rendered markdown blocks (re-used across previews so that
+// a refresh only needs to render the blocks which changed)
+markdown::BlockCache s_markdownBlockCache;
+
 class HTMLPreview : boost::noncopyable,
                     public boost::enable_shared_from_this<HTMLPreview>
 {
@@ -406,6 +411,7 @@ private:
                                             content,
                                             markdown::Extensions(),
                                             markdown::HTMLOptions(),
+                                            &s_markdownBlockCache,
                                             &htmlContent);
             if (error)
             {
@@ -908,21 +914,19 @@ void handleInternalMarkdownPreviewRequest(
       html_utils::Base64ImageFilter imageFilter(
                                     s_pCurrentPreview_->targetDirectory());
 
-      // write into in-memory string
+      // write directly into in-memory string
+      std::string previewHtml;
       std::istringstream previewInputStream(previewTemplate);
-      std::stringstream previewStrStream;
-      previewStrStream.exceptions(std::istream::failbit | std::istream::badbit);
       boost::iostreams::filtering_ostream previewOutputStream ;
       previewOutputStream.push(templateFilter);
       previewOutputStream.push(imageFilter);
-      previewOutputStream.push(previewStrStream);
+      previewOutputStream.push(boost::iostreams::back_inserter(previewHtml));
       boost::iostreams::copy(previewInputStream,
                              previewOutputStream,
                              128);
 
 
       // write to output file
-      std::string previewHtml = previewStrStream.str();
       error = core::writeStringToFile(s_pCurrentPreview_->htmlPreviewFile(),
                                       previewHtml);
       if (error)
@@ -48,6 +48,7 @@
 #include <session/SessionModuleContext.hpp>
 
 #include "presentation/SlideRequestHandler.hpp"
+#include "SessionHelpCache.hpp"
 
 // protect R against windows TRUE/FALSE defines
 #undef TRUE
@@ -277,10 +278,14 @@ void setDynamicContentResponse(const std::string& content,
 }
    
 
+// called with html which was dynamically rendered by httpd
+typedef boost::function<void(const std::string&)> HtmlRenderedHandler;
+
 template <typename Filter>
 void handleHttpdResult(SEXP httpdSEXP, 
                        const http::Request& request, 
                        const Filter& htmlFilter,
+                       const HtmlRenderedHandler& onHtmlRendered,
                        http::Response* pResponse)
 {
    // NOTE: this function is a port of process_request in Rhttpd.c
@@ -388,6 +393,9 @@ void handleHttpdResult(SEXP httpdSEXP,
             // set body (apply filter to html)
             if (pResponse->contentType() == kTextHtml)
             {
+               if (onHtmlRendered)
+                  onHtmlRendered(content);
+
                setDynamicContentResponse(content, 
                                          request, 
                                          htmlFilter, 
@@ -626,6 +634,7 @@ void handleHttpdRequest(const std::string& location,
                         const HandlerSource& handlerSource,
                         const http::Request& request, 
                         const Filter& filter,
+                        const HtmlRenderedHandler& onHtmlRendered,
                         http::Response* pResponse)
 {
    // get the requested path
@@ -696,7 +705,7 @@ void handleHttpdRequest(const std::string& location,
    // content returned from httpd
    else if (TYPEOF(httpdSEXP) == VECSXP && LENGTH(httpdSEXP) > 0)
    {
-      handleHttpdResult(httpdSEXP, request, filter, pResponse);
+      handleHttpdResult(httpdSEXP, request, filter, onHtmlRendered, pResponse);
    }
    
    // unexpected SEXP type returned from httpd
@@ -750,6 +759,7 @@ void handleCustomRequest(const http::Request& request,
                       lookupCustomHandler,
                       request,
                       http::NullOutputFilter(),
+                      HtmlRenderedHandler(),
                       pResponse);
 }
 
@@ -776,15 +786,41 @@ void handleSessionRequest(const http::Request& request, http::Response* pRespons
    pResponse->setCacheableFile(tempFilePath, request);
 }
 
+// package help topics which were previously rendered are served from the
+// help cache (so they don't need to be converted again and don't require
+// R). this is called on the http listener thread so that cached topics are
+// served even while R is busy (returns false if the topic isn't cached)
+bool handleCachedHelpRequest(const http::Request& request,
+                             http::Response* pResponse)
+{
+   std::string path = http::util::pathAfterPrefix(request, kHelpLocation);
+   std::string html;
+   if (!cache::read(path, &html))
+      return false;
+
+   pResponse->setContentType("text/html");
+   setDynamicContentResponse(html,
+                             request,
+                             HelpContentsFilter(request),
+                             pResponse);
+   return true;
+}
+
 // the ShowHelp event will result in the Help pane requesting the specified
 // help url. we handle this request directly by calling the R httpd function
 // to dynamically form the correct http response
 void handleHelpRequest(const http::Request& request, http::Response* pResponse)
 {
+   // the topic may have been cached since the listener thread checked
+   if (handleCachedHelpRequest(request, pResponse))
+      return;
+
+   std::string path = http::util::pathAfterPrefix(request, kHelpLocation);
    handleHttpdRequest(kHelpLocation,
                       boost::bind(r::sexp::findFunction, "httpd", "tools"),
                       request,
                       HelpContentsFilter(request),
+                      boost::bind(cache::write, path, _1),
                       pResponse);
 }
 
@@ -803,6 +839,9 @@ Error initialize()
    initBlock.addFunctions()
       (bind(registerRBrowseUrlHandler, handleLocalHttpUrl))
       (bind(registerRBrowseFileHandler, handleRShowDocFile))
+      (bind(registerBackgroundUriHandler,
+            kHelpLocation,
+            handleCachedHelpRequest))
       (bind(registerUriHandler, kHelpLocation, handleHelpRequest))
       (bind(sourceModuleRFile, "SessionHelp.R"));
    Error error = initBlock.execute();
@@ -817,6 +856,11 @@ Error initialize()
    if (error)
       LOG_ERROR(error);
 
+   // help cache
+   error = cache::initialize();
+   if (error)
+      return error;
+
    // handle /custom and /session urls internally if necessary (always in
    // server mode, in desktop mode if the internal http server can't
    // bind to a port)
@@ -0,0 +1,376 @@
+/*
+ * SessionHelpCache.cpp
+ *
+ * Copyright (C) 2009-12 by RStudio, Inc.
+ *
+ * Unless you have received this program directly from RStudio pursuant
+ * to the terms of a commercial license agreement with RStudio, then
+ * this program is licensed to you under the terms of version 3 of the
+ * GNU Affero General Public License. This program is distributed WITHOUT
+ * ANY EXPRESS OR IMPLIED WARRANTY, INCLUDING THOSE OF NON-INFRINGEMENT,
+ * MERCHANTABILITY OR FITNESS FOR A PARTICULAR PURPOSE. Please refer to the
+ * AGPL (http://www.gnu.org/licenses/agpl-3.0.txt) for more details.
+ *
+ */
+
+#include "SessionHelpCache.hpp"
+
+#include <map>
+#include <set>
+
+#include <boost/regex.hpp>
+#include <boost/format.hpp>
+#include <boost/foreach.hpp>
+#include <boost/algorithm/string/join.hpp>
+
+#include <core/Error.hpp>
+#include <core/Log.hpp>
+#include <core/FilePath.hpp>
+#include <core/FileSerializer.hpp>
+#include <core/StringUtils.hpp>
+#include <core/Thread.hpp>
+#include <core/http/Util.hpp>
+#include <core/system/System.hpp>
+#include <core/system/Environment.hpp>
+#include <core/system/Process.hpp>
+#include <core/r_util/RPackageInfo.hpp>
+
+#include <r/RExec.hpp>
+
+#include <session/SessionOptions.hpp>
+#include <session/SessionModuleContext.hpp>
+
+using namespace core;
+
+namespace session {
+namespace modules { 
+namespace help {
+namespace cache {
+
+namespace {
+
+// installed location and version of a package
+struct InstalledPackage
+{
+   InstalledPackage()
+      : descriptionModified(0)
+   {
+   }
+
+   FilePath path;
+   std::string version;
+   std::time_t descriptionModified;
+};
+
+// packages whose location we know (lets us check the installed version
+// of a package without calling into R). cached topics are read on the
+// http listener thread so access to these is synchronized
+boost::mutex s_packagesMutex;
+std::map<std::string,InstalledPackage> s_packages;
+
+// package directories which have been prefilled this session
+std::set<std::string> s_prefilledPackages;
+bool s_prefillRunning = false;
+
+FilePath helpCachePath()
+{
+   return module_context::userScratchPath().childPath("help_cache");
+}
+
+bool parseTopicPath(const std::string& path,
+                    std::string* pPackage,
+                    std::string* pTopic)
+{
+   static boost::regex reTopic("^/library/([^/\\\\]+)/html/([^/\\\\]+)\\.html$");
+
+   boost::smatch match;
+   std::string decodedPath = http::util::urlDecode(path, false);
+   if (!boost::regex_match(decodedPath, match, reTopic))
+      return false;
+
+   *pPackage = match[1];
+   *pTopic = match[2];
+
+   // never allow the package to refer outside of the cache
+   return *pPackage != "." && *pPackage != "..";
+}
+
+void registerPackage(const std::string& name, const FilePath& path)
+{
+   LOCK_MUTEX(s_packagesMutex)
+   {
+      InstalledPackage& package = s_packages[name];
+      if (package.path != path)
+      {
+         package = InstalledPackage();
+         package.path = path;
+      }
+   }
+   END_LOCK_MUTEX
+}
+
+bool isKnownPackage(const std::string& name)
+{
+   LOCK_MUTEX(s_packagesMutex)
+   {
+      return s_packages.find(name) != s_packages.end();
+   }
+   END_LOCK_MUTEX
+
+   // keep compiler happy
+   return false;
+}
+
+// find a package (calls into R for packages we haven't yet seen)
+bool findPackage(const std::string& name,
+                 bool allowR,
+                 InstalledPackage* pPackage)
+{
+   if (!isKnownPackage(name))
+   {
+      if (!allowR)
+         return false;
+
+      std::string path;
+      Error error = r::exec::RFunction(".rs.helpCachePackagePath",
+                                       name).call(&path);
+      if (error)
+      {
+         LOG_ERROR(error);
+         return false;
+      }
+      if (path.empty())
+         return false;
+
+      registerPackage(name, FilePath(string_utils::systemToUtf8(path)));
+   }
+
+   LOCK_MUTEX(s_packagesMutex)
+   {
+      std::map<std::string,InstalledPackage>::iterator it =
+                                                      s_packages.find(name);
+      if (it == s_packages.end())
+         return false;
+
+      // re-read the version whenever the DESCRIPTION file changes
+      InstalledPackage& package = it->second;
+      FilePath descPath = package.path.childPath("DESCRIPTION");
+      if (!descPath.exists())
+         return false;
+      std::time_t modified = descPath.lastWriteTime();
+      if (modified != package.descriptionModified)
+      {
+         r_util::RPackageInfo pkgInfo;
+         Error error = pkgInfo.read(package.path);
+         if (error)
+         {
+            LOG_ERROR(error);
+            return false;
+         }
+
+         package.version = pkgInfo.version();
+         package.descriptionModified = modified;
+      }
+
+      *pPackage = package;
+      return true;
+   }
+   END_LOCK_MUTEX
+
+   // keep compiler happy
+   return false;
+}
+
+FilePath topicCachePath(const std::string& name,
+                        const InstalledPackage& package,
+                        const std::string& topic)
+{
+   return helpCachePath().childPath(name)
+                         .childPath(package.version)
+                         .childPath(topic + ".html");
+}
+
+// reinstalling a package without changing its version rewrites its help
+// database, so entries older than the database are treated as stale
+bool isCurrent(const FilePath& cachedPath,
+               const std::string& name,
+               const InstalledPackage& package)
+{
+   if (!cachedPath.exists())
+      return false;
+
+   FilePath rdbPath = package.path.childPath("help/" + name + ".rdb");
+   return !rdbPath.exists() ||
+          cachedPath.lastWriteTime() >= rdbPath.lastWriteTime();
+}
+
+void onPrefillCompleted(const core::system::ProcessResult& result)
+{
+   s_prefillRunning = false;
+
+   if (result.exitStatus != EXIT_SUCCESS)
+      LOG_ERROR_MESSAGE("Error prefilling help cache: " + result.stdErr);
+}
+
+// render the help topics for newly attached packages in a background R
+// process (one at a time; packages attached while it runs are picked up
+// the next time we check)
+void prefillAttachedPackages()
+{
+   if (s_prefillRunning)
+      return;
+
+   std::vector<std::string> packagePaths;
+   Error error = r::exec::RFunction(".rs.attachedPackagePaths").call(
+                                                            &packagePaths);
+   if (error)
+   {
+      LOG_ERROR(error);
+      return;
+   }
+
+   std::vector<std::string> newPackagePaths;
+   BOOST_FOREACH(const std::string& packagePath, packagePaths)
+   {
+      FilePath path(string_utils::systemToUtf8(packagePath));
+      registerPackage(path.filename(), path);
+      if (s_prefilledPackages.insert(packagePath).second)
+         newPackagePaths.push_back(packagePath);
+   }
+   if (newPackagePaths.empty())
+      return;
+
+   // R binary
+   FilePath rProgramPath;
+   error = module_context::rScriptPath(&rProgramPath);
+   if (error)
+   {
+      LOG_ERROR(error);
+      return;
+   }
+   std::string rBin = string_utils::utf8ToSystem(rProgramPath.absolutePath());
+
+   // vanilla execution of the prefill script
+   std::vector<std::string> args;
+   args.push_back("--slave");
+   args.push_back("--vanilla");
+   args.push_back("-e");
+   FilePath scriptPath = session::options().modulesRSourcePath().complete(
+                                                         "SessionHelpCache.R");
+   std::string escapedScriptPath = string_utils::jsLiteralEscape(
+               string_utils::utf8ToSystem(scriptPath.absolutePath()));
+   args.push_back(boost::str(boost::format("source('%1%')") %
+                             escapedScriptPath));
+
+   // pass the cache location and packages via the environment (along
+   // with our R_LIBS so the child sees the same libraries)
+   core::system::Options childEnv;
+   core::system::environment(&childEnv);
+   std::string libPaths = module_context::libPathsString();
+   if (!libPaths.empty())
+      core::system::setenv(&childEnv, "R_LIBS", libPaths);
+   core::system::setenv(&childEnv,
+                        "RS_HELP_CACHE_DIR",
+                        string_utils::utf8ToSystem(
+                                       helpCachePath().absolutePath()));
+   core::system::setenv(&childEnv,
+                        "RS_HELP_CACHE_PACKAGES",
+                        boost::algorithm::join(newPackagePaths, "\n"));
+
+   core::system::ProcessOptions options;
+   options.terminateChildren = true;
+   options.environment = childEnv;
+
+   error = module_context::processSupervisor().runProgram(rBin,
+                                                          args,
+                                                          "",
+                                                          options,
+                                                          onPrefillCompleted);
+   if (error)
+      LOG_ERROR(error);
+   else
+      s_prefillRunning = true;
+}
+
+void onDeferredInit(bool)
+{
+   prefillAttachedPackages();
+}
+
+void onDetectChanges(module_context::ChangeSource source)
+{
+   if (source == module_context::ChangeSourceREPL)
+      prefillAttachedPackages();
+}
+
+} // anonymous namespace
+
+bool read(const std::string& path, std::string* pHtml)
+{
+   std::string name, topic;
+   if (!parseTopicPath(path, &name, &topic))
+      return false;
+
+   InstalledPackage package;
+   if (!findPackage(name, false, &package))
+      return false;
+
+   FilePath cachedPath = topicCachePath(name, package, topic);
+   if (!isCurrent(cachedPath, name, package))
+      return false;
+
+   Error error = readStringFromFile(cachedPath, pHtml);
+   if (error)
+   {
+      LOG_ERROR(error);
+      return false;
+   }
+
+   return true;
+}
+
+void write(const std::string& path, const std::string& html)
+{
+   std::string name, topic;
+   if (!parseTopicPath(path, &name, &topic))
+      return;
+
+   InstalledPackage package;
+   if (!findPackage(name, true, &package))
+      return;
+
+   FilePath cachedPath = topicCachePath(name, package, topic);
+   Error error = cachedPath.parent().ensureDirectory();
+   if (error)
+   {
+      LOG_ERROR(error);
+      return;
+   }
+
+   // write to a temporary file then move it into place so that readers
+   // (including other sessions) never see a partially written page
+   FilePath tempPath = cachedPath.parent().childPath(
+                                 core::system::generateShortenedUuid());
+   error = writeStringToFile(tempPath, html);
+   if (!error)
+      error = tempPath.move(cachedPath);
+   if (error)
+   {
+      LOG_ERROR(error);
+      tempPath.removeIfExists();
+   }
+}
+
+Error initialize()
+{
+   using namespace module_context;
+   events().onDeferredInit.connect(onDeferredInit);
+   events().onDetectChanges.connect(onDetectChanges);
+
+   return Success();
+}
+
+} // namespace cache
+} // namespace help
+} // namespace modules
+} // namesapce session
@@ -0,0 +1,52 @@
+/*
+ * SessionHelpCache.hpp
+ *
+ * Copyright (C) 2009-12 by RStudio, Inc.
+ *
+ * Unless you have received this program directly from RStudio pursuant
+ * to the terms of a commercial license agreement with RStudio, then
+ * this program is licensed to you under the terms of version 3 of the
+ * GNU Affero General Public License. This program is distributed WITHOUT
+ * ANY EXPRESS OR IMPLIED WARRANTY, INCLUDING THOSE OF NON-INFRINGEMENT,
+ * MERCHANTABILITY OR FITNESS FOR A PARTICULAR PURPOSE. Please refer to the
+ * AGPL (http://www.gnu.org/licenses/agpl-3.0.txt) for more details.
+ *
+ */
+
+#ifndef SESSION_HELP_CACHE_HPP
+#define SESSION_HELP_CACHE_HPP
+
+#include <string>
+
+namespace core {
+   class Error;
+}
+
+// On-disk cache of help topics rendered by R's dynamic help httpd. Entries
+// are stored by package name, package version, and topic so that cached
+// pages can be served without calling into R. Topics for attached packages
+// are rendered ahead of time by a background R process.
+
+namespace session {
+namespace modules { 
+namespace help {
+namespace cache {
+
+core::Error initialize();
+
+// read the cached rendering of a help path (of the form
+// /library/<package>/html/<topic>.html). returns false if the path isn't
+// a package topic or if there is no cached rendering for the installed
+// version of the package. does not call into R (and may be called from
+// any thread).
+bool read(const std::string& path, std::string* pHtml);
+
+// cache the rendering of a help path (called after R renders a topic)
+void write(const std::string& path, const std::string& html);
+
+} // namespace cache
+} // namespace help
+} // namespace modules
+} // namesapce session
+
+#endif // SESSION_HELP_CACHE_HPP
@@ -20,13 +20,26 @@
 
 #include "SessionPackages.hpp"
 
+#include <sstream>
+
 #include <boost/bind.hpp>
 #include <boost/regex.hpp>
+#include <boost/foreach.hpp>
+#include <boost/algorithm/string/predicate.hpp>
+
+#include <boost/iostreams/copy.hpp>
+#include <boost/iostreams/filtering_stream.hpp>
+#ifndef _WIN32
+#include <boost/iostreams/filter/gzip.hpp>
+#endif
 
 #include <core/Error.hpp>
 #include <core/Exec.hpp>
+#include <core/Hash.hpp>
+#include <core/FileSerializer.hpp>
+#include <core/system/System.hpp>
 #include <core/http/URL.hpp>
-#include <core/http/TcpIpBlockingClient.hpp>
+#include <core/http/TcpIpAsyncClient.hpp>
 
 #include <r/RSexp.hpp>
 #include <r/RExec.hpp>
@@ -102,58 +115,361 @@ private:
    std::map<std::string, std::vector<std::string> > cache_;
 };
 
-void downloadAvailablePackages(const std::string& contribUrl,
-                               std::vector<std::string>* pAvailablePackages)
+// PACKAGES index fetched from each repository. we use the gzipped index
+// where we can decompress it (falling back to the plain index for
+// repositories which don't provide one)
+#ifndef _WIN32
+const char * const kPackagesFile = "PACKAGES.gz";
+#else
+const char * const kPackagesFile = "PACKAGES";
+#endif
+const char * const kPlainPackagesFile = "PACKAGES";
+
+// available packages for a repository along with the validators needed to
+// revalidate them (persisted to disk so they are shared between sessions)
+struct CachedAvailablePackages
 {
-   // cache available packages to minimize http round trips
-   static AvailablePackagesCache s_availablePackagesCache;
+   bool empty() const { return file.empty(); }
 
-   // check cache first
-   std::vector<std::string> availablePackages;
-   if (s_availablePackagesCache.lookup(contribUrl, &availablePackages))
+   std::string file;
+   std::string eTag;
+   std::string lastModified;
+   std::vector<std::string> packages;
+};
+
+FilePath availablePackagesCachePath(const std::string& contribUrl)
+{
+   return module_context::userScratchPath()
+                            .childPath("available_packages")
+                            .childPath(core::hash::crc32HexHash(contribUrl));
+}
+
+const char * const kUrlField = "Url: ";
+const char * const kFileField = "File: ";
+const char * const kETagField = "ETag: ";
+const char * const kLastModifiedField = "Last-Modified: ";
+
+bool readField(const std::string& line,
+               const std::string& field,
+               std::string* pValue)
+{
+   if (!boost::algorithm::starts_with(line, field))
+      return false;
+
+   *pValue = line.substr(field.length());
+   return true;
+}
+
+bool readCachedAvailablePackages(const std::string& contribUrl,
+                                 CachedAvailablePackages* pCached)
+{
+   FilePath cachePath = availablePackagesCachePath(contribUrl);
+   if (!cachePath.exists())
+      return false;
+
+   std::vector<std::string> lines;
+   Error error = readStringVectorFromFile(cachePath, &lines);
+   if (error)
    {
-      std::copy(availablePackages.begin(),
-                availablePackages.end(),
-                std::back_inserter(*pAvailablePackages));
+      LOG_ERROR(error);
+      return false;
+   }
+
+   // fields are followed by the package names (which never contain a ':')
+   std::string url;
+   CachedAvailablePackages cached;
+   BOOST_FOREACH(const std::string& line, lines)
+   {
+      if (!readField(line, kUrlField, &url) &&
+          !readField(line, kFileField, &cached.file) &&
+          !readField(line, kETagField, &cached.eTag) &&
+          !readField(line, kLastModifiedField, &cached.lastModified))
+      {
+         cached.packages.push_back(line);
+      }
+   }
+
+   // guard against hash collisions
+   if (url != contribUrl || cached.empty())
+      return false;
+
+   *pCached = cached;
+   return true;
+}
+
+void writeCachedAvailablePackages(const std::string& contribUrl,
+                                  const CachedAvailablePackages& cached)
+{
+   std::vector<std::string> lines;
+   lines.push_back(kUrlField + contribUrl);
+   lines.push_back(kFileField + cached.file);
+   if (!cached.eTag.empty())
+      lines.push_back(kETagField + cached.eTag);
+   if (!cached.lastModified.empty())
+      lines.push_back(kLastModifiedField + cached.lastModified);
+   std::copy(cached.packages.begin(),
+             cached.packages.end(),
+             std::back_inserter(lines));
+
+   // write to a temporary file and then move it into place since other
+   // sessions may be reading the cache concurrently
+   FilePath cachePath = availablePackagesCachePath(contribUrl);
+   Error error = cachePath.parent().ensureDirectory();
+   if (error)
+   {
+      LOG_ERROR(error);
       return;
    }
+   FilePath tempPath = cachePath.parent().childPath(
+                              core::system::generateShortenedUuid());
+   error = writeStringVectorToFile(tempPath, lines);
+   if (!error)
+      error = tempPath.move(cachePath);
+   if (error)
+   {
+      LOG_ERROR(error);
+      tempPath.removeIfExists();
+   }
+}
+
+void parseAvailablePackages(const std::string& body,
+                            std::vector<std::string>* pPackages)
+{
+   boost::regex re("^Package:\\s*([^\\s]+?)\\s*$");
+
+   boost::sregex_iterator matchBegin(body.begin(), body.end(), re);
+   boost::sregex_iterator matchEnd;
+   for (; matchBegin != matchEnd; matchBegin++)
+      pPackages->push_back((*matchBegin)[1]);
+}
 
-   http::URL url(contribUrl + "/PACKAGES");
-   http::Request pkgRequest;
-   pkgRequest.setMethod("GET");
-   pkgRequest.setHost(url.hostname());
-   pkgRequest.setUri(url.path());
-   pkgRequest.setHeader("Accept", "*/*");
-   pkgRequest.setHeader("Connection", "close");
-   http::Response pkgResponse;
+Error decompressPackagesFile(const std::string& body, std::string* pOutput)
+{
+#ifndef _WIN32
+   try
+   {
+      std::istringstream compressedStream(body);
+      boost::iostreams::filtering_istream decompressedStream;
+      decompressedStream.push(boost::iostreams::gzip_decompressor());
+      decompressedStream.push(compressedStream);
+
+      std::ostringstream outputStream;
+      boost::iostreams::copy(decompressedStream, outputStream);
+      *pOutput = outputStream.str();
+      return Success();
+   }
+   catch(const std::exception& e)
+   {
+      Error error = systemError(boost::system::errc::io_error,
+                                ERROR_LOCATION);
+      error.addProperty("what", e.what());
+      return error;
+   }
+#else
+   *pOutput = body;
+   return Success();
+#endif
+}
 
-   Error error = http::sendRequest(url.hostname(),
-                                   safe_convert::numberToString(url.port()),
-                                   pkgRequest,
-                                   &pkgResponse);
+// state for fetching the index of a single repository
+struct AvailablePackagesFetch
+{
+   AvailablePackagesFetch(const std::string& contribUrl)
+      : contribUrl(contribUrl), file(kPackagesFile), status(0), complete(false)
+   {
+   }
 
+   std::string contribUrl;
+   std::string file;
+   CachedAvailablePackages cached;
+   int status;
+   std::string body;
+   std::string eTag;
+   std::string lastModified;
+   Error error;
+   bool complete;
+};
+
+void onFetchResponse(const http::Response& response,
+                     AvailablePackagesFetch* pFetch)
+{
+   pFetch->status = response.statusCode();
+   pFetch->body = response.body();
+   pFetch->eTag = response.headerValue("ETag");
+   pFetch->lastModified = response.headerValue("Last-Modified");
+}
+
+void onFetchError(const Error& error, AvailablePackagesFetch* pFetch)
+{
+   pFetch->error = error;
+}
+
+// fetch the PACKAGES file for all incomplete repositories concurrently
+// (using a single io service on the calling thread)
+void fetchAvailablePackages(std::vector<AvailablePackagesFetch>* pFetches)
+{
+   boost::asio::io_service ioService;
+   std::vector<boost::shared_ptr<http::TcpIpAsyncClient> > clients;
+   BOOST_FOREACH(AvailablePackagesFetch& fetch, *pFetches)
+   {
+      if (fetch.complete)
+         continue;
+
+      http::URL url(fetch.contribUrl + "/" + fetch.file);
+      boost::shared_ptr<http::TcpIpAsyncClient> pClient(
+                  new http::TcpIpAsyncClient(
+                                 ioService,
+                                 url.hostname(),
+                                 safe_convert::numberToString(url.port())));
+
+      http::Request& request = pClient->request();
+      request.setMethod("GET");
+      request.setHost(url.hostname());
+      request.setUri(url.path());
+      request.setHeader("Accept", "*/*");
+      request.setHeader("Connection", "close");
+
+      // revalidate what we already have
+      if (fetch.cached.file == fetch.file)
+      {
+         if (!fetch.cached.eTag.empty())
+            request.setHeader("If-None-Match", fetch.cached.eTag);
+         if (!fetch.cached.lastModified.empty())
+            request.setHeader("If-Modified-Since", fetch.cached.lastModified);
+      }
+
+      fetch.status = 0;
+      fetch.error = Success();
+      pClient->execute(boost::bind(onFetchResponse, _1, &fetch),
+                       boost::bind(onFetchError, _1, &fetch));
+      clients.push_back(pClient);
+   }
+
+   if (clients.empty())
+      return;
+
+   boost::system::error_code ec;
+   ioService.run(ec);
+   if (ec)
+      LOG_ERROR(Error(ec, ERROR_LOCATION));
+}
+
+// process the response for a repository (returns false if the request
+// should be retried using the plain PACKAGES file)
+bool processFetchResult(AvailablePackagesFetch* pFetch)
+{
    // we don't log errors or bad http status codes because we expect these
    // requests will fail frequently due to either being offline or unable to
-   // navigate a proxy server
-   if (!error && (pkgResponse.statusCode() == 200))
+   // navigate a proxy server (in that case we fall back to cached data)
+   pFetch->complete = true;
+   if (pFetch->error)
+      return true;
+
+   if (pFetch->status == http::status::NotModified)
+      return true;
+
+   if (pFetch->status != http::status::Ok)
    {
-      std::string body = pkgResponse.body();
-      boost::regex re("^Package:\\s*([^\\s]+?)\\s*$");
+      // fall back to the uncompressed index if necessary
+      if (pFetch->file != kPlainPackagesFile)
+      {
+         pFetch->file = kPlainPackagesFile;
+         pFetch->complete = false;
+         return false;
+      }
 
-      boost::sregex_iterator matchBegin(body.begin(), body.end(), re);
-      boost::sregex_iterator matchEnd;
-      std::vector<std::string> results;
-      for (; matchBegin != matchEnd; matchBegin++)
+      // neither index could be fetched so anything we have on disk is
+      // stale (it can still be used but mustn't be cached as fresh)
+      pFetch->error = systemError(boost::system::errc::protocol_error,
+                                  ERROR_LOCATION);
+      pFetch->error.addProperty("status", pFetch->status);
+      return true;
+   }
+
+   std::string body;
+   if (pFetch->file != kPlainPackagesFile)
+   {
+      Error error = decompressPackagesFile(pFetch->body, &body);
+      if (error)
       {
-         // copy to temporary list for insertion into cache
-         results.push_back((*matchBegin)[1]);
+         pFetch->error = error;
+         return true;
+      }
+   }
+   else
+   {
+      body.swap(pFetch->body);
+   }
+
+   CachedAvailablePackages updated;
+   updated.file = pFetch->file;
+   updated.eTag = pFetch->eTag;
+   updated.lastModified = pFetch->lastModified;
+   parseAvailablePackages(body, &updated.packages);
+   writeCachedAvailablePackages(pFetch->contribUrl, updated);
+   pFetch->cached = updated;
+   return true;
+}
+
+void downloadAvailablePackages(const std::vector<std::string>& contribUrls,
+                               std::vector<std::string>* pAvailablePackages)
+{
+   // cache available packages to minimize http round trips
+   static AvailablePackagesCache s_availablePackagesCache;
 
-         // append to out param
-         pAvailablePackages->push_back((*matchBegin)[1]);
+   // check cache first then fetch the rest (starting from anything we
+   // have on disk from previous sessions)
+   std::vector<AvailablePackagesFetch> fetches;
+   BOOST_FOREACH(const std::string& contribUrl, contribUrls)
+   {
+      std::vector<std::string> availablePackages;
+      if (s_availablePackagesCache.lookup(contribUrl, &availablePackages))
+      {
+         std::copy(availablePackages.begin(),
+                   availablePackages.end(),
+                   std::back_inserter(*pAvailablePackages));
       }
+      else
+      {
+         // revalidate the same file we fetched last time
+         AvailablePackagesFetch fetch(contribUrl);
+         if (readCachedAvailablePackages(contribUrl, &fetch.cached))
+            fetch.file = fetch.cached.file;
+         fetches.push_back(fetch);
+      }
+   }
+
+   // fetch concurrently (with a second round for repositories which
+   // don't provide a compressed index)
+   for (int round = 0; round < 2; round++)
+   {
+      fetchAvailablePackages(&fetches);
+
+      bool retry = false;
+      BOOST_FOREACH(AvailablePackagesFetch& fetch, fetches)
+      {
+         if (!fetch.complete && !processFetchResult(&fetch))
+            retry = true;
+      }
+
+      if (!retry)
+         break;
+   }
+
+   BOOST_FOREACH(const AvailablePackagesFetch& fetch, fetches)
+   {
+      if (fetch.cached.empty())
+         continue;
+
+      std::copy(fetch.cached.packages.begin(),
+                fetch.cached.packages.end(),
+                std::back_inserter(*pAvailablePackages));
 
-      // add to cache
-      s_availablePackagesCache.insert(contribUrl, results);
+      // only fresh results go into the session cache (cached data used
+      // because we are offline will be revalidated on the next request)
+      if (!fetch.error)
+         s_availablePackagesCache.insert(fetch.contribUrl,
+                                         fetch.cached.packages);
    }
 }
 
@@ -163,9 +479,7 @@ Error availablePackagesEnd(const core::json::JsonRpcRequest& request,
 {
    // download available packages
    std::vector<std::string> availablePackages;
-   std::for_each(contribUrls.begin(),
-                 contribUrls.end(),
-                 boost::bind(&downloadAvailablePackages, _1, &availablePackages));
+   downloadAvailablePackages(contribUrls, &availablePackages);
 
    // order and remove duplicates
    std::stable_sort(availablePackages.begin(), availablePackages.end());
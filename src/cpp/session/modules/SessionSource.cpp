@@ -86,12 +86,18 @@ public:
          return;
       }
 
-      // index the source
-      boost::shared_ptr<r_util::RSourceIndex> pIndex(
-                 new r_util::RSourceIndex(pDoc->path(), pDoc->contents()));
+      // bail if the document hasn't changed since it was last updated
+      Entry& entry = indexes_[pDoc->id()];
+      if (entry.path == pDoc->path() && entry.hash == pDoc->hash())
+         return;
 
-      // insert it
-      indexes_[pDoc->id()] = pIndex;
+      // defer indexing until the indexes are next used (documents are
+      // typically updated many times, e.g. by autosaves, between searches).
+      // we hold a reference to the document rather than copying its
+      // contents (the callers' documents aren't modified once updated)
+      entry.path = pDoc->path();
+      entry.hash = pDoc->hash();
+      entry.pPendingDoc = pDoc;
    }
 
    void remove(const std::string& id)
@@ -107,16 +113,31 @@ public:
    std::vector<boost::shared_ptr<r_util::RSourceIndex> > indexes()
    {
       std::vector<boost::shared_ptr<r_util::RSourceIndex> > indexes;
-      BOOST_FOREACH(const IndexMap::value_type& index, indexes_)
+      BOOST_FOREACH(IndexMap::value_type& index, indexes_)
       {
-         indexes.push_back(index.second);
+         Entry& entry = index.second;
+         if (entry.pPendingDoc)
+         {
+            entry.pIndex.reset(new r_util::RSourceIndex(
+                                          entry.path,
+                                          entry.pPendingDoc->contents()));
+            entry.pPendingDoc.reset();
+         }
+         indexes.push_back(entry.pIndex);
       }
       return indexes;
    }
 
 private:
-   typedef std::map<std::string, boost::shared_ptr<r_util::RSourceIndex> >
-                                                                    IndexMap;
+   struct Entry
+   {
+      std::string path;
+      std::string hash;
+      boost::shared_ptr<r_util::RSourceIndex> pIndex;
+      boost::shared_ptr<SourceDocument> pPendingDoc;
+   };
+
+   typedef std::map<std::string, Entry> IndexMap;
    IndexMap indexes_;
 };
 
@@ -251,6 +272,50 @@ Error openDocument(const json::JsonRpcRequest& request,
    return Success();
 } 
 
+void setDocumentFields(const json::Value& jsonType,
+                       const json::Value& jsonEncoding,
+                       const json::Value& jsonFoldSpec,
+                       boost::shared_ptr<SourceDocument> pDoc)
+{
+   bool hasType = json::isType<std::string>(jsonType);
+   if (hasType)
+   {
+      pDoc->setType(jsonType.get_str());
+   }
+
+   bool hasEncoding = json::isType<std::string>(jsonEncoding);
+   if (hasEncoding)
+   {
+      pDoc->setEncoding(jsonEncoding.get_str());
+   }
+
+   bool hasFoldSpec = json::isType<std::string>(jsonFoldSpec);
+   if (hasFoldSpec)
+   {
+      pDoc->setFolds(jsonFoldSpec.get_str());
+   }
+}
+
+// apply an autosaved edit (offset and length are in bytes) to the document
+// in place. this is the equivalent of saveDocumentCore with no path but
+// avoids copying and comparing the whole document (and lets the source
+// database write just the edited range)
+void autosaveDocumentDiff(std::size_t offset,
+                          std::size_t length,
+                          const std::string& replacement,
+                          const json::Value& jsonType,
+                          const json::Value& jsonEncoding,
+                          const json::Value& jsonFoldSpec,
+                          boost::shared_ptr<SourceDocument> pDoc)
+{
+   // dirty if the edit changed the contents (see saveDocumentCore)
+   pDoc->setDirty(pDoc->contents().compare(offset, length, replacement) != 0);
+
+   setDocumentFields(jsonType, jsonEncoding, jsonFoldSpec, pDoc);
+
+   pDoc->replaceContents(offset, length, replacement);
+}
+
 Error saveDocumentCore(const std::string& contents,
                        const json::Value& jsonPath,
                        const json::Value& jsonType,
@@ -273,25 +338,9 @@ Error saveDocumentCore(const std::string& contents,
    // as distinct from a fold-spec or scroll-position/selection autosave)
    pDoc->setDirty(!hasPath && (contents != pDoc->contents()));
    
-   bool hasType = json::isType<std::string>(jsonType);
-   if (hasType)
-   {
-      pDoc->setType(jsonType.get_str());
-   }
-   
-   Error error;
-   
-   bool hasEncoding = json::isType<std::string>(jsonEncoding);
-   if (hasEncoding)
-   {
-      pDoc->setEncoding(jsonEncoding.get_str());
-   }
+   setDocumentFields(jsonType, jsonEncoding, jsonFoldSpec, pDoc);
 
-   bool hasFoldSpec = json::isType<std::string>(jsonFoldSpec);
-   if (hasFoldSpec)
-   {
-      pDoc->setFolds(jsonFoldSpec.get_str());
-   }
+   Error error;
 
    // handle document (varies depending upon whether we have a path)
    if (hasPath)
@@ -440,27 +489,38 @@ Error saveDocumentDiff(const json::JsonRpcRequest& request,
    // Don't even attempt anything if we're not working off the same original
    if (pDoc->hash() == hash)
    {
-      std::string contents(pDoc->contents());
+      const std::string& contents = pDoc->contents();
 
       // Offset and length are specified in characters, but contents
       // is in UTF8 bytes. Convert before using.
-      std::string::iterator rangeBegin = contents.begin();
+      std::string::const_iterator rangeBegin = contents.begin();
       error = utf8Advance(rangeBegin, offset, contents.end(), &rangeBegin);
       if (error)
          return Success(); // UTF8 decoding failed. Abort differential save.
 
-      std::string::iterator rangeEnd = rangeBegin;
+      std::string::const_iterator rangeEnd = rangeBegin;
       error = utf8Advance(rangeEnd, length, contents.end(), &rangeEnd);
       if (error)
          return Success(); // UTF8 decoding failed. Abort differential save.
 
-      contents.erase(rangeBegin, rangeEnd);
-      contents.insert(rangeBegin, replacement.begin(), replacement.end());
-      
-      error = saveDocumentCore(contents, jsonPath, jsonType, jsonEncoding,
-                               jsonFoldSpec, pDoc);
-      if (error)
-         return error;
+      std::size_t byteOffset = rangeBegin - contents.begin();
+      std::size_t byteLength = rangeEnd - rangeBegin;
+
+      // autosaves (no path) are applied to the document in place
+      if (!hasPath)
+      {
+         autosaveDocumentDiff(byteOffset, byteLength, replacement,
+                              jsonType, jsonEncoding, jsonFoldSpec, pDoc);
+      }
+      else
+      {
+         std::string newContents(contents);
+         newContents.replace(byteOffset, byteLength, replacement);
+         error = saveDocumentCore(newContents, jsonPath, jsonType,
+                                  jsonEncoding, jsonFoldSpec, pDoc);
+         if (error)
+            return error;
+      }
       
       // write to the source_database
       error = sourceDatabasePutWithUpdatedContents(pDoc);
@@ -104,7 +104,9 @@ Error checkSpelling(const json::JsonRpcRequest& request,
    if (error)
       return error;
 
-   json::Array misspelledIndexes;
+   // collect the words so they can be checked as a single batch
+   std::vector<std::string> wordsVector;
+   std::vector<std::size_t> wordsIndexes;
    for (std::size_t i=0; i<words.size(); i++)
    {
       if (!json::isType<std::string>(words[i]))
@@ -113,14 +115,20 @@ Error checkSpelling(const json::JsonRpcRequest& request,
          continue;
       }
 
-      std::string word = words[i].get_str();
-      bool isCorrect = true;
-      error = s_pSpellingEngine->checkSpelling(word, &isCorrect);
-      if (error)
-         return error;
+      wordsVector.push_back(words[i].get_str());
+      wordsIndexes.push_back(i);
+   }
+
+   std::vector<bool> correct;
+   error = s_pSpellingEngine->checkSpelling(wordsVector, &correct);
+   if (error)
+      return error;
 
-      if (!isCorrect)
-         misspelledIndexes.push_back(static_cast<int>(i));
+   json::Array misspelledIndexes;
+   for (std::size_t i=0; i<correct.size(); i++)
+   {
+      if (!correct[i])
+         misspelledIndexes.push_back(static_cast<int>(wordsIndexes[i]));
    }
 
    pResponse->setResult(misspelledIndexes);
@@ -128,6 +136,14 @@ Error checkSpelling(const json::JsonRpcRequest& request,
    return Success();
 }
 
+// check spelling on a background thread so that we never block the console
+// (the spelling engine serializes access to the underlying dictionaries)
+Error checkSpellingAsync(const json::JsonRpcRequest& request,
+                         json::JsonRpcResponse* pResponse)
+{
+   return module_context::executeAsync(checkSpelling, request, pResponse);
+}
+
 Error suggestionList(const json::JsonRpcRequest& request,
                      json::JsonRpcResponse* pResponse)
 {
@@ -312,7 +328,7 @@ Error initialize()
    using namespace module_context;
    ExecBlock initBlock ;
    initBlock.addFunctions()
-      (bind(registerRpcMethod, "check_spelling", checkSpelling))
+      (bind(registerRpcMethod, "check_spelling", checkSpellingAsync))
       (bind(registerRpcMethod, "suggestion_list", suggestionList))
       (bind(registerRpcMethod, "get_word_chars", getWordChars))
       (bind(registerRpcMethod, "add_custom_dictionary", addCustomDictionary))
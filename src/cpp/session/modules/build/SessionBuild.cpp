@@ -138,6 +138,14 @@ namespace build {
 
 namespace {
 
+// maximum size of the build output which is retained (e.g. for clients
+// which reconnect while a build is running)
+const std::size_t kMaxRetainedOutput = 1024 * 1024;
+
+// build output is sent to the client each time the build process is
+// polled (or sooner once this much is pending)
+const std::size_t kMaxPendingOutput = 64 * 1024;
+
 // track whether to force a package rebuild. we do this if the user
 // saves a header file (since the R CMD INSTALL makefile doesn't
 // force a rebuild for those changes)
@@ -216,7 +224,11 @@ public:
 
 private:
    Build()
-      : isRunning_(false), terminationRequested_(false), restartR_(false)
+      : isRunning_(false),
+        terminationRequested_(false),
+        output_(kMaxRetainedOutput),
+        pendingOutputSize_(0),
+        restartR_(false)
    {
    }
 
@@ -818,25 +830,13 @@ public:
    bool isRunning() const { return isRunning_; }
 
    const std::string& errorsBaseDir() const { return errorsBaseDir_; }
-   const json::Array& errorsAsJson() const { return errorsJson_; }
-   json::Array outputAsJson() const
+   json::Array errorsAsJson() const
    {
-      json::Array outputJson;
-      std::transform(output_.begin(),
-                     output_.end(),
-                     std::back_inserter(outputJson),
-                     buildOutputAsJson);
-      return outputJson;
+      return compileErrorsAsJson(errors_);
    }
-
-   std::string outputAsText()
+   json::Array outputAsJson() const
    {
-      std::string output;
-      BOOST_FOREACH(const BuildOutput& buildOutput, output_)
-      {
-         output.append(buildOutput.output);
-      }
-      return output;
+      return output_.asJson();
    }
 
    void terminate()
@@ -848,30 +848,33 @@ public:
 private:
    bool onContinue()
    {
+      // send the output received since we were last polled
+      flushBuildOutput();
+
       return !terminationRequested_;
    }
 
    void outputWithFilter(const std::string& output)
    {
-      // split into lines
-      std::vector<std::string> lines;
-      boost::algorithm::split(lines, output,  boost::algorithm::is_any_of("\n"));
-
       // apply filter to each line
-      int size = lines.size();
-      for (int i=0; i<size; i++)
+      std::size_t start = 0;
+      while (start < output.size())
       {
+         std::size_t end = output.find('\n', start);
+         if (end == std::string::npos)
+            end = output.size();
+
          // apply filter
-         std::string line = lines.at(i);
+         std::string line = output.substr(start, end - start);
          int type = errorOutputFilterFunction_(line) ?
                                  kBuildOutputError : kBuildOutputNormal;
 
-         // add newline if this wasn't the last line
-         if (i != (size-1))
+         // add newline if the line had one
+         if (end != output.size())
             line.append("\n");
 
-         // enque the output
-         enqueBuildOutput(type, line);
+         appendBuildOutput(type, line);
+         start = end + 1;
       }
    }
 
@@ -880,7 +883,7 @@ private:
       if (errorOutputFilterFunction_)
          outputWithFilter(output);
       else
-         enqueBuildOutput(kBuildOutputNormal, output);
+         appendBuildOutput(kBuildOutputNormal, output);
    }
 
    void onStandardError(const std::string& output)
@@ -888,21 +891,20 @@ private:
       if (errorOutputFilterFunction_)
          outputWithFilter(output);
       else
-         enqueBuildOutput(kBuildOutputError, output);
+         appendBuildOutput(kBuildOutputError, output);
    }
 
    void onCompleted(int exitStatus)
    {
-      // call the error parser if one has been specified
-      if (errorParser_)
-      {
-         std::vector<CompileError> errors = errorParser_(outputAsText());
-         if (!errors.empty())
-         {
-            errorsJson_ = compileErrorsAsJson(errors);
-            enqueBuildErrors(errorsJson_);
-         }
-      }
+      // parse any remaining output then send all of the errors (the
+      // client replaces the errors it has received so far with these and
+      // only navigates to errors once the build has completed)
+      if (!errorParser_.empty())
+         addErrors(errorParser_.finish());
+      pendingErrors_.clear();
+      flushBuildOutput();
+      if (!errors_.empty())
+         enqueBuildErrors(compileErrorsAsJson(errors_), false);
 
       if (exitStatus != EXIT_SUCCESS)
       {
@@ -945,14 +947,63 @@ private:
 
    void enqueBuildOutput(int type, const std::string& output)
    {
-      BuildOutput buildOutput(type, output);
+      appendBuildOutput(type, output);
+      flushBuildOutput();
+   }
 
-      output_.push_back(buildOutput);
+   // output is retained and parsed for errors as it is received but it
+   // isn't sent to the client until it is flushed (adjacent output of
+   // the same type is then sent as a single event)
+   void appendBuildOutput(int type, const std::string& output)
+   {
+      if (output.empty())
+         return;
 
-      ClientEvent event(client_events::kBuildOutput,
-                        buildOutputAsJson(buildOutput));
+      output_.append(type, output);
 
-      module_context::enqueClientEvent(event);
+      if (!pendingOutput_.empty() && pendingOutput_.back().type == type)
+         pendingOutput_.back().output.append(output);
+      else
+         pendingOutput_.push_back(BuildOutput(type, output));
+      pendingOutputSize_ += output.size();
+
+      if (!errorParser_.empty())
+         addErrors(errorParser_.parse(output));
+
+      if (pendingOutputSize_ >= kMaxPendingOutput)
+         flushBuildOutput();
+   }
+
+   void flushBuildOutput()
+   {
+      BOOST_FOREACH(const BuildOutput& buildOutput, pendingOutput_)
+      {
+         ClientEvent event(client_events::kBuildOutput,
+                           buildOutputAsJson(buildOutput));
+
+         module_context::enqueClientEvent(event);
+      }
+      pendingOutput_.clear();
+      pendingOutputSize_ = 0;
+
+      // errors found while the build is running are sent along with the
+      // output they were found in (the client appends them to its list)
+      if (!pendingErrors_.empty())
+      {
+         enqueBuildErrors(compileErrorsAsJson(pendingErrors_), true);
+         pendingErrors_.clear();
+      }
+   }
+
+   void addErrors(const std::vector<CompileError>& errors)
+   {
+      if (errors.empty())
+         return;
+
+      std::copy(errors.begin(), errors.end(), std::back_inserter(errors_));
+      std::copy(errors.begin(),
+                errors.end(),
+                std::back_inserter(pendingErrors_));
    }
 
    void enqueCommandString(const std::string& cmd)
@@ -960,11 +1011,12 @@ private:
       enqueBuildOutput(kBuildOutputCommand, "==> " + cmd + "\n\n");
    }
 
-   void enqueBuildErrors(const json::Array& errors)
+   void enqueBuildErrors(const json::Array& errors, bool running)
    {
       json::Object jsonData;
       jsonData["base_dir"] = errorsBaseDir_;
       jsonData["errors"] = errors;
+      jsonData["running"] = running;
 
       ClientEvent event(client_events::kBuildErrors, jsonData);
       module_context::enqueClientEvent(event);
@@ -972,6 +1024,8 @@ private:
 
    void enqueBuildCompleted()
    {
+      flushBuildOutput();
+
       isRunning_ = false;
 
       if (!postBuildWarning_.empty())
@@ -1014,16 +1068,19 @@ private:
          errorsBaseDir_.append("/");
       }
 
-      errorParser_ = parser;
+      errorParser_ = IncrementalCompileErrorParser(parser);
    }
 
 private:
    bool isRunning_;
    bool terminationRequested_;
-   std::vector<BuildOutput> output_;
-   CompileErrorParser errorParser_;
+   BuildOutputBuffer output_;
+   std::vector<BuildOutput> pendingOutput_;
+   std::size_t pendingOutputSize_;
+   IncrementalCompileErrorParser errorParser_;
    std::string errorsBaseDir_;
-   json::Array errorsJson_;
+   std::vector<CompileError> errors_;
+   std::vector<CompileError> pendingErrors_;
    r_util::RPackageInfo pkgInfo_;
    projects::RProjectBuildOptions options_;
    std::string successMessage_;
@@ -37,6 +37,18 @@ namespace build {
 
 namespace {
 
+// the number of preceding lines required to match any of our errors
+const std::size_t kContextLines = 2;
+
+bool isSameError(const CompileError& error1, const CompileError& error2)
+{
+   return error1.type == error2.type &&
+          error1.path == error2.path &&
+          error1.line == error2.line &&
+          error1.column == error2.column &&
+          error1.message == error2.message;
+}
+
 
 bool isRSourceFile(const FilePath& filePath)
 {
@@ -234,6 +246,67 @@ json::Array compileErrorsAsJson(const std::vector<CompileError>& errors)
    return errorsJson;
 }
 
+std::vector<CompileError> IncrementalCompileErrorParser::parse(
+                                                   const std::string& output)
+{
+   pending_.append(output);
+
+   std::size_t pos = pending_.rfind('\n');
+   if (pos == std::string::npos)
+      return std::vector<CompileError>();
+
+   return parsePending(pos + 1);
+}
+
+std::vector<CompileError> IncrementalCompileErrorParser::finish()
+{
+   std::vector<CompileError> errors = parsePending(pending_.size());
+   context_.clear();
+   return errors;
+}
+
+std::vector<CompileError> IncrementalCompileErrorParser::parsePending(
+                                                        std::size_t length)
+{
+   std::vector<CompileError> errors;
+   if (length == 0 || !parser_)
+      return errors;
+
+   // errors within the context were found by an earlier parse and are
+   // found again here. we can't skip them by position since the results
+   // of several parsers are concatenated, so remove them by identity
+   // (once for each time they occur in the context)
+   std::string text = context_ + pending_.substr(0, length);
+   pending_.erase(0, length);
+   std::vector<CompileError> previousErrors;
+   if (!context_.empty())
+      previousErrors = parser_(context_);
+   BOOST_FOREACH(const CompileError& parsed, parser_(text))
+   {
+      std::vector<CompileError>::iterator it =
+                  std::find_if(previousErrors.begin(),
+                               previousErrors.end(),
+                               boost::bind(isSameError, parsed, _1));
+      if (it != previousErrors.end())
+         previousErrors.erase(it);
+      else
+         errors.push_back(parsed);
+   }
+
+   // retain the last few lines as context for the next parse
+   std::size_t start = text.size();
+   for (std::size_t i = 0; i < kContextLines && start > 0; i++)
+   {
+      // find the end of the line before the one ending at start
+      std::size_t pos = start >= 2 ? text.rfind('\n', start - 2) :
+                                     std::string::npos;
+      start = (pos == std::string::npos) ? 0 : pos + 1;
+   }
+   context_ = text.substr(start);
+
+   return errors;
+}
+
 CompileErrorParser gccErrorParser(const FilePath& basePath)
 {
    return boost::bind(parseGccErrors, basePath, _1);
@@ -91,6 +91,42 @@ private:
    std::vector<CompileErrorParser> parsers_;
 };
 
+// applies a parser to output as it is received. output is parsed a line
+// at a time along with the preceding lines needed to match errors which
+// span several lines (errors which were already found are not returned
+// again)
+class IncrementalCompileErrorParser
+{
+public:
+   IncrementalCompileErrorParser()
+   {
+   }
+
+   explicit IncrementalCompileErrorParser(CompileErrorParser parser)
+      : parser_(parser)
+   {
+   }
+
+   // COPYING: via compiler
+
+   bool empty() const { return !parser_; }
+
+   // parse the complete lines of the output received so far and return
+   // any new errors
+   std::vector<CompileError> parse(const std::string& output);
+
+   // parse any remaining output (the last line need not be complete)
+   std::vector<CompileError> finish();
+
+private:
+   std::vector<CompileError> parsePending(std::size_t length);
+
+private:
+   CompileErrorParser parser_;
+   std::string context_;
+   std::string pending_;
+};
+
 CompileErrorParser gccErrorParser(const core::FilePath& basePath);
 
 CompileErrorParser rErrorParser(const core::FilePath& basePath);
@@ -15,12 +15,22 @@
 
 #include "SessionBuildUtils.hpp"
 
+#include <boost/foreach.hpp>
+
 using namespace core;
 
 namespace session {  
 namespace modules {
 namespace build {
 
+namespace {
+
+// output is only merged into entries smaller than this (so that discarding
+// output from the front of the buffer never copies too much)
+const std::size_t kMaxMergeSize = 64 * 1024;
+
+} // anonymous namespace
+
 core::json::Object buildOutputAsJson(const BuildOutput& buildOutput)
 {
    json::Object buildOutputJson;
@@ -29,6 +39,66 @@ core::json::Object buildOutputAsJson(const BuildOutput& buildOutput)
    return buildOutputJson;
 }
 
+BuildOutputBuffer::BuildOutputBuffer(std::size_t maxSize)
+   : maxSize_(maxSize), size_(0), truncated_(false)
+{
+}
+
+void BuildOutputBuffer::append(int type, const std::string& output)
+{
+   if (output.empty())
+      return;
+
+   if (!outputs_.empty() &&
+       outputs_.back().type == type &&
+       outputs_.back().output.size() < kMaxMergeSize)
+   {
+      outputs_.back().output.append(output);
+   }
+   else
+   {
+      outputs_.push_back(BuildOutput(type, output));
+   }
+   size_ += output.size();
+
+   // discard the oldest output (whole lines where possible)
+   while (size_ > maxSize_ && !outputs_.empty())
+   {
+      truncated_ = true;
+
+      std::string& front = outputs_.front().output;
+      std::size_t excess = size_ - maxSize_;
+      std::size_t pos = excess < front.size() ?
+                                 front.find('\n', excess) : std::string::npos;
+      if (pos == std::string::npos || pos + 1 == front.size())
+      {
+         size_ -= front.size();
+         outputs_.pop_front();
+      }
+      else
+      {
+         front.erase(0, pos + 1);
+         size_ -= pos + 1;
+      }
+   }
+}
+
+json::Array BuildOutputBuffer::asJson() const
+{
+   json::Array outputJson;
+   if (truncated_)
+   {
+      outputJson.push_back(buildOutputAsJson(BuildOutput(
+                     kBuildOutputNormal, "[Earlier output not shown]\n\n")));
+   }
+
+   BOOST_FOREACH(const BuildOutput& output, outputs_)
+   {
+      outputJson.push_back(buildOutputAsJson(output));
+   }
+   return outputJson;
+}
+
 } // namespace build
 } // namespace modules
 } // namespace session
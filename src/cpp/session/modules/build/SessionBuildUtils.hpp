@@ -17,6 +17,7 @@
 #define SESSION_BUILD_UTILS_HPP
 
 #include <string>
+#include <deque>
 
 #include <core/json/Json.hpp>
 
@@ -42,6 +43,30 @@ struct BuildOutput
 
 core::json::Object buildOutputAsJson(const BuildOutput& buildOutput);
 
+// retains the most recent build output (older output is discarded once
+// the total size exceeds maxSize). adjacent output of the same type is
+// merged into a single entry.
+class BuildOutputBuffer
+{
+public:
+   explicit BuildOutputBuffer(std::size_t maxSize);
+
+   // COPYING: via compiler
+
+   void append(int type, const std::string& output);
+
+   bool empty() const { return outputs_.empty(); }
+
+   // the retained output (preceded by a notice if output was discarded)
+   core::json::Array asJson() const;
+
+private:
+   std::size_t maxSize_;
+   std::size_t size_;
+   bool truncated_;
+   std::deque<BuildOutput> outputs_;
+};
+
 
 } // namespace build
 } // namespace modules
@@ -16,14 +16,24 @@
 
 #include "SlideRenderer.hpp"
 
+#include <map>
+#include <algorithm>
+
+#include <boost/bind.hpp>
 #include <boost/foreach.hpp>
 #include <boost/format.hpp>
 #include <boost/regex.hpp>
+#include <boost/utility.hpp>
 #include <boost/algorithm/string.hpp>
 
+#include <core/Log.hpp>
+#include <core/Hash.hpp>
 #include <core/Error.hpp>
+#include <core/Thread.hpp>
 #include <core/FilePath.hpp>
+#include <core/BoostThread.hpp>
 #include <core/StringUtils.hpp>
+#include <core/SafeConvert.hpp>
 #include <core/json/Json.hpp>
 
 #include <core/markdown/Markdown.hpp>
@@ -61,10 +71,7 @@ Error renderMarkdown(const std::string& content, std::string* pHTML)
 {
    markdown::Extensions extensions;
    markdown::HTMLOptions htmlOptions;
-   return markdown::markdownToHTML(content,
-                                   extensions,
-                                   htmlOptions,
-                                   pHTML);
+   return markdown::markdownToHTML(content, extensions, htmlOptions, pHTML);
 }
 
 
@@ -127,13 +134,14 @@ void addFragmentClass(const std::string& fragmentClass,
                                    bqWithClass + "\n<p>");
 }
 
-Error slideMarkdownToHtml(const Slide& slide,
+Error slideMarkdownToHtml(const std::string& content,
+                          bool showTitle,
                           const std::string& extraContent,
                           const std::string& incremental,
                           std::string* pHTML)
 {
    // render the markdown
-   Error error = renderMarkdown(slide.content(), pHTML);
+   Error error = renderMarkdown(content, pHTML);
    if (error)
       return error;
 
@@ -142,7 +150,7 @@ Error slideMarkdownToHtml(const Slide& slide,
 
    // slide content classes
    std::string slideClasses = "slideContent";
-   if (!slide.showTitle())
+   if (!showTitle)
       slideClasses += " noTitle";
 
    // look for an <hr/> splitting the html into columns
@@ -188,6 +196,139 @@ Error slideMarkdownToHtml(const Slide& slide,
    return Success();
 }
 
+// the markdown of a slide which needs to be rendered to HTML
+struct SlideRenderJob
+{
+   SlideRenderJob(std::size_t index,
+                  const std::string& key,
+                  const std::string& input,
+                  const Slide& slide,
+                  const std::string& extraContent,
+                  const std::string& incremental)
+      : index(index), key(key), input(input), content(slide.content()),
+        showTitle(slide.showTitle()), extraContent(extraContent),
+        incremental(incremental)
+   {
+   }
+
+   std::size_t index;
+   std::string key;
+   std::string input;
+   std::string content;
+   bool showTitle;
+   std::string extraContent;
+   std::string incremental;
+   std::string html;
+   Error error;
+};
+
+// renders a set of slides on worker threads (as well as on the calling
+// thread). slides are rendered independently so the only shared state is
+// the index of the next job
+class SlideRenderQueue : boost::noncopyable
+{
+public:
+   explicit SlideRenderQueue(std::vector<SlideRenderJob>* pJobs)
+      : pJobs_(pJobs), next_(0)
+   {
+   }
+
+   void run()
+   {
+      std::size_t threads = std::min<std::size_t>(
+                                    boost::thread::hardware_concurrency(),
+                                    pJobs_->size());
+
+      // jobs are also rendered on the calling thread so a failed launch
+      // isn't fatal
+      boost::thread_group workers;
+      for (std::size_t i = 1; i < threads; i++)
+      {
+         boost::thread* pThread = new boost::thread();
+         core::thread::safeLaunchThread(
+                     boost::bind(&SlideRenderQueue::renderJobs, this), pThread);
+         if (pThread->joinable())
+            workers.add_thread(pThread);
+         else
+            delete pThread;
+      }
+
+      renderJobs();
+      workers.join_all();
+   }
+
+private:
+   void renderJobs()
+   {
+      try
+      {
+         SlideRenderJob* pJob;
+         while ((pJob = takeJob()) != NULL)
+         {
+            pJob->error = slideMarkdownToHtml(pJob->content,
+                                              pJob->showTitle,
+                                              pJob->extraContent,
+                                              pJob->incremental,
+                                              &pJob->html);
+         }
+      }
+      CATCH_UNEXPECTED_EXCEPTION
+   }
+
+   SlideRenderJob* takeJob()
+   {
+      LOCK_MUTEX(mutex_)
+      {
+         if (next_ < pJobs_->size())
+            return &pJobs_->at(next_++);
+      }
+      END_LOCK_MUTEX
+
+      return NULL;
+   }
+
+private:
+   std::vector<SlideRenderJob>* pJobs_;
+   std::size_t next_;
+   boost::mutex mutex_;
+};
+
+// rendered slide HTML keyed by a hash of the inputs to slideMarkdownToHtml.
+// only the slides from the most recent render are retained (so slides
+// which were edited or removed are evicted)
+struct RenderedSlide
+{
+   std::string input;
+   std::string html;
+};
+typedef std::map<std::string,RenderedSlide> RenderedSlides;
+RenderedSlides s_renderedSlides;
+
+std::string slideRenderInput(const Slide& slide,
+                             const std::string& extraContent,
+                             const std::string& incremental)
+{
+   std::string input;
+   input.append(slide.showTitle() ? "1" : "0");
+   input.append(incremental + "\n");
+   input.append(safe_convert::numberToString(extraContent.size()) + "\n");
+   input.append(extraContent);
+   input.append(slide.content());
+   return input;
+}
+
+bool lookupRenderedSlide(const std::string& key,
+                         const std::string& input,
+                         std::string* pHTML)
+{
+   RenderedSlides::const_iterator it = s_renderedSlides.find(key);
+   if (it == s_renderedSlides.end() || it->second.input != input)
+      return false;
+
+   *pHTML = it->second.html;
+   return true;
+}
+
 void validateTransitionType(const std::string& type)
 {
    bool isValid = boost::iequals(type, "none") ||
@@ -249,7 +390,13 @@ Error renderSlides(const SlideDeck& slideDeck,
    validateSlideDeckFields(slideDeck);
 
    // render the slides to HTML and slide commands to case statements
-   std::ostringstream ostr, ostrRevealConfig, ostrInitActions, ostrSlideActions;
+   std::ostringstream ostrRevealConfig, ostrInitActions, ostrSlideActions;
+
+   // the opening of each slide's section (title, author, etc.) and its
+   // content. content is taken from the cache of rendered slides where
+   // possible, otherwise the slide's markdown is queued for rendering
+   std::vector<std::string> slideHeaders, slideContents, slideKeys;
+   std::vector<SlideRenderJob> renderJobs;
 
    // track json version of slide list
    SlideNavigationList navigationList(slideDeck.navigation());
@@ -268,6 +415,7 @@ Error renderSlides(const SlideDeck& slideDeck,
       // track slide in list
       navigationList.add(slide);
 
+      std::ostringstream ostr;
       ostr << "<section";
       if (!slide.id().empty())
          ostr << " id=\"" << slide.id() << "\"";
@@ -382,18 +530,21 @@ Error renderSlides(const SlideDeck& slideDeck,
       }
 
 
-      // render markdown
-      std::string htmlContent;
-      Error error = slideMarkdownToHtml(slide,
-                                        ostrMedia.str(),
-                                        incremental,
-                                        &htmlContent);
-      if (error)
-         return error;
-      ostr << htmlContent << "\n";
-
-      // render end section
-      ostr << "</section>" << "\n";
+      // render markdown (or use the previous rendering of the slide)
+      slideHeaders.push_back(ostr.str());
+      std::string input = slideRenderInput(slide, ostrMedia.str(), incremental);
+      std::string key = hash::crc32HexHash(input);
+      slideKeys.push_back(key);
+      slideContents.push_back(std::string());
+      if (!lookupRenderedSlide(key, input, &slideContents.back()))
+      {
+         renderJobs.push_back(SlideRenderJob(i,
+                                             key,
+                                             input,
+                                             slide,
+                                             ostrMedia.str(),
+                                             incremental));
+      }
 
       // reveal config actions
       BOOST_FOREACH(const std::string& config, revealConfig)
@@ -423,6 +574,38 @@ Error renderSlides(const SlideDeck& slideDeck,
    navigationList.complete();
    ostrInitActions << navigationList.asCall() << "\n";
 
+   // render the slides which changed
+   SlideRenderQueue(&renderJobs).run();
+
+   // update the cache so it contains just the slides in this deck
+   RenderedSlides renderedSlides;
+   for (std::size_t i = 0; i < slideKeys.size(); i++)
+   {
+      RenderedSlides::iterator it = s_renderedSlides.find(slideKeys[i]);
+      if (it != s_renderedSlides.end())
+         renderedSlides.insert(*it);
+   }
+   BOOST_FOREACH(const SlideRenderJob& job, renderJobs)
+   {
+      if (job.error)
+         return job.error;
+
+      slideContents[job.index] = job.html;
+      RenderedSlide& rendered = renderedSlides[job.key];
+      rendered.input = job.input;
+      rendered.html = job.html;
+   }
+   s_renderedSlides.swap(renderedSlides);
+
+   // combine the slide sections
+   std::ostringstream ostr;
+   for (std::size_t i = 0; i < slideHeaders.size(); i++)
+   {
+      ostr << slideHeaders[i];
+      ostr << slideContents[i] << "\n";
+      ostr << "</section>" << "\n";
+   }
+
    *pSlides = ostr.str();
    *pRevealConfig = ostrRevealConfig.str();
    *pInitActions = ostrInitActions.str();
@@ -622,13 +622,29 @@ bool createStandalonePresentation(const FilePath& targetFile,
       return false;
    }
 
-   // create image filter
+   // inline images as the presentation is written to the target file
    FilePath dirPath = presentation::state::directory();
-   std::vector<boost::iostreams::regex_filter> filters;
-   filters.push_back(html_utils::Base64ImageFilter(dirPath));
+   boost::iostreams::filtering_ostream imageStream;
+   imageStream.push(html_utils::Base64ImageFilter(dirPath));
+   imageStream.push(*pOfs);
 
    // render presentation
-   return renderPresentation(vars, filters, *pOfs, &errMsg);
+   std::vector<boost::iostreams::regex_filter> filters;
+   if (!renderPresentation(vars, filters, imageStream, &errMsg))
+      return false;
+
+   // flush any output still held by the image filter
+   try
+   {
+      imageStream.reset();
+   }
+   catch(const std::exception& e)
+   {
+      *pErrMsg = e.what();
+      return false;
+   }
+
+   return true;
 }
 
 FilePath viewInBrowserPath()
@@ -18,6 +18,7 @@
 #include <set>
 
 #include <boost/format.hpp>
+#include <boost/scoped_ptr.hpp>
 #include <boost/foreach.hpp>
 #include <boost/enable_shared_from_this.hpp>
 
@@ -384,6 +385,10 @@ void removeExistingLatexAncillaryFiles(const FilePath& texFilePath)
    removeExistingAncillary(texFilePath, ".blg");
    removeExistingAncillary(texFilePath, ".synctex");
    removeExistingAncillary(texFilePath, ".synctex.gz");
+
+   // discard the in-memory synctex index for the previous pdf
+   modules::tex::synctex::invalidateIndex(
+                                 ancillaryFilePath(texFilePath, ".pdf"));
  }
 
 std::string buildIssuesMessage(const core::tex::LogEntries& logEntries)
@@ -688,11 +693,30 @@ private:
       enqueOutputEvent("Running " + texProgramPath_.filename() +
                        " on " + texFilePath.filename() + "...");
 
+      // stream log entries to the issues list while latex is running
+      // (the list is replaced with the entries from the log file once
+      // the compile completes)
+      pdflatex::TexOutputCallbacks callbacks;
+      if (showIssuesList(concordances))
+      {
+         callbacks.onStarted = boost::bind(&AsyncPdfCompiler::onLatexStarted,
+                                           this,
+                                           texFilePath);
+         callbacks.onOutput = boost::bind(&AsyncPdfCompiler::onLatexOutput,
+                                          this,
+                                          _1,
+                                          concordances);
+      }
+
       error = tex::pdflatex::texToPdf(texProgramPath_,
                                       texFilePath,
                                       options,
+                                      callbacks,
                                       &result);
 
+      pLatexLogParser_.reset();
+      streamedLogEntries_.clear();
+
       if (error)
       {
          terminateWithError("Unable to compile pdf: " + error.summary());
@@ -716,19 +740,26 @@ private:
 
       // determine whether they will be shown in the list
       // list or within the console
-      bool showIssuesList = !isTargetRnw() || !concords.empty();
+      bool showIssuesList = this->showIssuesList(concords);
 
       // notify the cleanp context of log entries (so it can
       // preserve any referenced files)
       auxillaryFileCleanupContext_.preserveLogReferencedFiles(
                                                       logEntries);
 
-      // show log entries and build issues message
+      // show log entries and build issues message (the final list is
+      // always sent, even when empty, so that it replaces any entries
+      // streamed while latex was running)
       std::string issuesMsg;
-      if (showIssuesList && !logEntries.empty())
+      if (showIssuesList)
       {
          showLogEntries(logEntries, concords);
-         issuesMsg = buildIssuesMessage(logEntries);
+         if (!logEntries.empty())
+            issuesMsg = buildIssuesMessage(logEntries);
+      }
+      else if (!streamedLogEntries_.empty())
+      {
+         showLogEntries(core::tex::LogEntries());
       }
 
       if (exitStatus == EXIT_SUCCESS)
@@ -778,6 +809,38 @@ private:
       }
    }
 
+   void onLatexStarted(const FilePath& texFilePath)
+   {
+      // each run of latex produces a complete log so start over
+      streamedLogEntries_.clear();
+      pLatexLogParser_.reset(new core::tex::LatexLogParser(
+            ancillaryFilePath(texFilePath, ".log"),
+            boost::bind(&AsyncPdfCompiler::onLatexLogEntry, this, _1)));
+   }
+
+   void onLatexOutput(const std::string& output,
+                      const rnw_concordance::Concordances& concordances)
+   {
+      if (!pLatexLogParser_)
+         return;
+
+      std::size_t previousCount = streamedLogEntries_.size();
+      pLatexLogParser_->parse(output);
+      if (streamedLogEntries_.size() > previousCount)
+         showLogEntries(streamedLogEntries_, concordances);
+   }
+
+   void onLatexLogEntry(const core::tex::LogEntry& logEntry)
+   {
+      if (includeLogEntry(logEntry))
+         streamedLogEntries_.push_back(logEntry);
+   }
+
+   bool showIssuesList(const rnw_concordance::Concordances& concords) const
+   {
+      return !isTargetRnw() || !concords.empty();
+   }
+
    void terminateWithError(const std::string& message)
    {
       enqueOutputEvent(message + "\n");
@@ -803,6 +866,8 @@ private:
    core::tex::TexMagicComments magicComments_;
    FilePath texProgramPath_;
    AuxillaryFileCleanupContext auxillaryFileCleanupContext_;
+   boost::scoped_ptr<core::tex::LatexLogParser> pLatexLogParser_;
+   core::tex::LogEntries streamedLogEntries_;
 };
 
 
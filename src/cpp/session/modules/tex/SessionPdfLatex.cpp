@@ -204,6 +204,33 @@ FilePath programPath(const std::string& name, const std::string& envOverride)
    return module_context::findProgram(program);
 }
 
+Error runLatex(const FilePath& texProgramPath,
+               const FilePath& texFilePath,
+               const PdfLatexOptions& options,
+               const TexOutputCallbacks& callbacks,
+               core::system::ProcessResult* pResult)
+{
+   if (callbacks.onStarted)
+      callbacks.onStarted();
+
+   if (callbacks.onOutput)
+   {
+      return utils::runTexCompile(texProgramPath,
+                                  utils::rTexInputsEnvVars(),
+                                  shellArgs(options),
+                                  texFilePath,
+                                  callbacks.onOutput,
+                                  pResult);
+   }
+   else
+   {
+      return utils::runTexCompile(texProgramPath,
+                                  utils::rTexInputsEnvVars(),
+                                  shellArgs(options),
+                                  texFilePath,
+                                  pResult);
+   }
+}
 
 
 bool lineIncludes(const std::string& line, const boost::regex& regex)
@@ -352,6 +379,7 @@ bool latexProgramForFile(const core::tex::TexMagicComments& magicComments,
 core::Error texToPdf(const core::FilePath& texProgramPath,
                      const core::FilePath& texFilePath,
                      const tex::pdflatex::PdfLatexOptions& options,
+                     const TexOutputCallbacks& callbacks,
                      core::system::ProcessResult* pResult)
 {
    // input file paths
@@ -373,11 +401,11 @@ core::Error texToPdf(const core::FilePath& texProgramPath,
    procOptions.workingDir = texFilePath.parent();
 
    // run the initial compile
-   Error error = utils::runTexCompile(texProgramPath,
-                                      utils::rTexInputsEnvVars(),
-                                      shellArgs(options),
-                                      texFilePath,
-                                      pResult);
+   Error error = runLatex(texProgramPath,
+                          texFilePath,
+                          options,
+                          callbacks,
+                          pResult);
    if (error)
       return error;
 
@@ -421,11 +449,11 @@ core::Error texToPdf(const core::FilePath& texProgramPath,
       }
 
       // re-run latex
-      Error error = utils::runTexCompile(texProgramPath,
-                                         utils::rTexInputsEnvVars(),
-                                         shellArgs(options),
-                                         texFilePath,
-                                         pResult);
+      Error error = runLatex(texProgramPath,
+                             texFilePath,
+                             options,
+                             callbacks,
+                             pResult);
       if (error)
          return error;
 
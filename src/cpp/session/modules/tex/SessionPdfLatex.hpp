@@ -16,6 +16,8 @@
 #ifndef SESSION_MODULES_TEX_PDFLATEX_HPP
 #define SESSION_MODULES_TEX_PDFLATEX_HPP
 
+#include <boost/function.hpp>
+
 #include <core/FilePath.hpp>
 
 #include <core/json/Json.hpp>
@@ -68,9 +70,18 @@ struct PdfLatexOptions
    std::string versionInfo;
 };
 
+// optional callbacks for monitoring the output of each run of the tex
+// program performed by texToPdf (onStarted is called prior to each run)
+struct TexOutputCallbacks
+{
+   boost::function<void()> onStarted;
+   boost::function<void(const std::string&)> onOutput;
+};
+
 core::Error texToPdf(const core::FilePath& texProgramPath,
                      const core::FilePath& texFilePath,
                      const tex::pdflatex::PdfLatexOptions& options,
+                     const TexOutputCallbacks& callbacks,
                      core::system::ProcessResult* pResult);
 
 bool isInstalled();
@@ -43,12 +43,6 @@ namespace rnw_concordance {
 
 namespace {
 
-FilePath concordanceFilePath(const FilePath& rnwFilePath)
-{
-   FilePath parentDir = rnwFilePath.parent();
-   return parentDir.complete(rnwFilePath.stem() + "-concordance.tex");
-}
-
 Error badFormatError(const FilePath& concordanceFile,
                      const std::string& context,
                      const ErrorLocation& location)
@@ -359,6 +353,12 @@ core::tex::LogEntry Concordances::fixup(const core::tex::LogEntry &entry,
    }
 }
 
+FilePath concordanceFilePath(const FilePath& rnwFilePath)
+{
+   FilePath parentDir = rnwFilePath.parent();
+   return parentDir.complete(rnwFilePath.stem() + "-concordance.tex");
+}
+
 void removePrevious(const core::FilePath& rnwFile)
 {
    Error error = concordanceFilePath(rnwFile).removeIfExists();
@@ -169,6 +169,8 @@ private:
    std::vector<Concordance> concordances_;
 };
 
+core::FilePath concordanceFilePath(const core::FilePath& rnwFilePath);
+
 void removePrevious(const core::FilePath& rnwFile);
 
 core::Error readIfExists(const core::FilePath& srcFile,
@@ -15,6 +15,10 @@
 
 #include "SessionSynctex.hpp"
 
+#include <map>
+
+#include <boost/shared_ptr.hpp>
+
 #include <core/Error.hpp>
 #include <core/FilePath.hpp>
 #include <core/Exec.hpp>
@@ -37,6 +41,104 @@ namespace synctex {
 
 namespace {
 
+// identifies a particular version of a file on disk (used to detect
+// when cached data derived from the file is stale)
+struct FileStamp
+{
+   FileStamp() : exists(false), lastWriteTime(0), size(0) {}
+
+   explicit FileStamp(const FilePath& filePath)
+      : exists(filePath.exists()),
+        lastWriteTime(exists ? filePath.lastWriteTime() : 0),
+        size(exists ? filePath.size() : 0)
+   {
+   }
+
+   bool operator==(const FileStamp& other) const
+   {
+      return exists == other.exists &&
+             lastWriteTime == other.lastWriteTime &&
+             size == other.size;
+   }
+
+   bool exists;
+   std::time_t lastWriteTime;
+   uintmax_t size;
+};
+
+FileStamp synctexFileStamp(const FilePath& pdfFile)
+{
+   FilePath parentDir = pdfFile.parent();
+   FilePath synctexFile = parentDir.childPath(pdfFile.stem() + ".synctex.gz");
+   if (!synctexFile.exists())
+      synctexFile = parentDir.childPath(pdfFile.stem() + ".synctex");
+   return FileStamp(synctexFile);
+}
+
+// Parsing the synctex file is by far the most expensive part of a sync
+// lookup, so we keep the parsed synctex data for each pdf in memory
+// (along with the stamp of the synctex file it was parsed from). The
+// data is re-parsed only after the pdf is recompiled.
+struct SynctexIndexEntry
+{
+   FileStamp stamp;
+   boost::shared_ptr<core::tex::Synctex> pSynctex;
+};
+std::map<std::string,SynctexIndexEntry> s_synctexIndex;
+
+boost::shared_ptr<core::tex::Synctex> synctexForPdf(const FilePath& pdfFile)
+{
+   FileStamp stamp = synctexFileStamp(pdfFile);
+   SynctexIndexEntry& entry = s_synctexIndex[pdfFile.absolutePath()];
+   if (!entry.pSynctex || !(entry.stamp == stamp))
+   {
+      boost::shared_ptr<core::tex::Synctex> pSynctex(new core::tex::Synctex());
+      if (!pSynctex->parse(pdfFile))
+         pSynctex.reset();
+
+      entry.stamp = stamp;
+      entry.pSynctex = pSynctex;
+   }
+
+   // if the parse failed then don't keep the entry around
+   boost::shared_ptr<core::tex::Synctex> pSynctex = entry.pSynctex;
+   if (!pSynctex)
+      s_synctexIndex.erase(pdfFile.absolutePath());
+   return pSynctex;
+}
+
+// concordances are likewise cached and re-read only when they change
+struct ConcordanceIndexEntry
+{
+   FileStamp stamp;
+   tex::rnw_concordance::Concordances concordances;
+};
+std::map<std::string,ConcordanceIndexEntry> s_concordanceIndex;
+
+Error readConcordances(const FilePath& srcFile,
+                       tex::rnw_concordance::Concordances* pConcordances)
+{
+   using namespace tex::rnw_concordance;
+   FileStamp stamp(concordanceFilePath(srcFile));
+   std::map<std::string,ConcordanceIndexEntry>::const_iterator it =
+                              s_concordanceIndex.find(srcFile.absolutePath());
+   if (it != s_concordanceIndex.end() && it->second.stamp == stamp)
+   {
+      *pConcordances = it->second.concordances;
+      return Success();
+   }
+
+   ConcordanceIndexEntry entry;
+   entry.stamp = stamp;
+   Error error = readIfExists(srcFile, &entry.concordances);
+   if (error)
+      return error;
+
+   s_concordanceIndex[srcFile.absolutePath()] = entry;
+   *pConcordances = entry.concordances;
+   return Success();
+}
+
 json::Value toJson(const FilePath& pdfFile,
                    const core::tex::PdfLocation& pdfLoc,
                    bool fromClick)
@@ -85,7 +187,7 @@ void applyForwardConcordance(const FilePath& mainFile,
    // try to read concordance
    using namespace tex::rnw_concordance;
    Concordances concordances;
-   Error error = readIfExists(mainFile, &concordances);
+   Error error = readConcordances(mainFile, &concordances);
    if (error)
    {
       LOG_ERROR(error);
@@ -145,7 +247,7 @@ void applyInverseConcordance(core::tex::SourceLocation* pLoc)
     // try to read concordance
    using namespace tex::rnw_concordance;
    Concordances concordances;
-   Error error = readIfExists(pLoc->file(), &concordances);
+   Error error = readConcordances(pLoc->file(), &concordances);
    if (error)
    {
       LOG_ERROR(error);
@@ -244,8 +346,8 @@ Error synctexInverseSearch(const json::JsonRpcRequest& request,
       return error;
    FilePath pdfPath = module_context::resolveAliasedPath(file);
 
-   core::tex::Synctex synctex;
-   if (synctex.parse(pdfPath))
+   boost::shared_ptr<core::tex::Synctex> pSynctex = synctexForPdf(pdfPath);
+   if (pSynctex)
    {
       if (!fromClick)
       {
@@ -253,14 +355,14 @@ Error synctexInverseSearch(const json::JsonRpcRequest& request,
          // the passed x and y coordinates since they represent the
          // top of the user-visible content (in case the page is
          // scrolled down from the top)
-         core::tex::PdfLocation contLoc = synctex.topOfPageContent(page);
+         core::tex::PdfLocation contLoc = pSynctex->topOfPageContent(page);
          x = std::max((float)x, contLoc.x());
          y = std::max((float)y, contLoc.y());
       }
 
       core::tex::PdfLocation pdfLocation(page, x, y, width, height);
 
-      core::tex::SourceLocation srcLoc = synctex.inverseSearch(pdfLocation);
+      core::tex::SourceLocation srcLoc = pSynctex->inverseSearch(pdfLocation);
       applyInverseConcordance(&srcLoc);
 
       pResponse->setResult(toJson(srcLoc));
@@ -323,13 +425,13 @@ Error forwardSearch(const FilePath& rootFile,
    // determine pdf
    FilePath pdfFile = rootFile.parent().complete(rootFile.stem() + ".pdf");
 
-   core::tex::Synctex synctex;
-   if (synctex.parse(pdfFile))
+   boost::shared_ptr<core::tex::Synctex> pSynctex = synctexForPdf(pdfFile);
+   if (pSynctex)
    {
       core::tex::SourceLocation srcLoc(inputFile, line, column);
       applyForwardConcordance(rootFile, &srcLoc);
 
-      core::tex::PdfLocation pdfLoc = synctex.forwardSearch(srcLoc);
+      core::tex::PdfLocation pdfLoc = pSynctex->forwardSearch(srcLoc);
       *pPdfLocation = toJson(pdfFile, pdfLoc, fromClick);
    }
    else
@@ -340,6 +442,11 @@ Error forwardSearch(const FilePath& rootFile,
    return Success();
 }
 
+void invalidateIndex(const FilePath& pdfFile)
+{
+   s_synctexIndex.erase(pdfFile.absolutePath());
+}
+
 Error initialize()
 {
    // register postback handler for sumatra pdf
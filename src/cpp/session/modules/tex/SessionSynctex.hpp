@@ -34,6 +34,10 @@ core::Error forwardSearch(const core::FilePath& rootDocument,
                           const core::json::Object& sourceLocation,
                           core::json::Value* pPdfLocation);
 
+// discard the in-memory synctex index for a pdf (called when the pdf
+// is about to be recompiled)
+void invalidateIndex(const core::FilePath& pdfFile);
+
 core::Error initialize();
 
 } // namespace synctex
@@ -15,6 +15,7 @@
 
 #include "SessionTexUtils.hpp"
 
+#include <boost/bind.hpp>
 #include <boost/foreach.hpp>
 #include <boost/algorithm/string.hpp>
 
@@ -73,6 +74,39 @@ void ignoreOutput(const std::string& output)
 {
 }
 
+void onTexCompileOutput(
+               const boost::function<void(const std::string&)>& onOutput,
+               const std::string& output)
+{
+   onOutput(output);
+}
+
+void onTexCompileExit(int exitStatus, core::system::ProcessResult* pResult)
+{
+   pResult->exitStatus = exitStatus;
+}
+
+core::system::ProcessOptions texCompileOptions(
+                                 const core::system::Options& envVars,
+                                 const FilePath& texFilePath)
+{
+   // copy extra environment variables
+   core::system::Options env;
+   core::system::environment(&env);
+   BOOST_FOREACH(const core::system::Option& var, envVars)
+   {
+      core::system::setenv(&env, var.first, var.second);
+   }
+
+   // set options
+   core::system::ProcessOptions procOptions;
+   procOptions.terminateChildren = true;
+   procOptions.redirectStdErrToStdOut = true;
+   procOptions.environment = env;
+   procOptions.workingDir = texFilePath.parent();
+   return procOptions;
+}
+
 } // anonymous namespace
 
 RTexmfPaths rTexmfPaths()
@@ -138,30 +172,43 @@ Error runTexCompile(const FilePath& texProgramPath,
                     const FilePath& texFilePath,
                     core::system::ProcessResult* pResult)
 {
-   // copy extra environment variables
-   core::system::Options env;
-   core::system::environment(&env);
-   BOOST_FOREACH(const core::system::Option& var, envVars)
-   {
-      core::system::setenv(&env, var.first, var.second);
-   }
-
-   // set options
-   core::system::ProcessOptions procOptions;
-   procOptions.terminateChildren = true;
-   procOptions.redirectStdErrToStdOut = true;
-   procOptions.environment = env;
-   procOptions.workingDir = texFilePath.parent();
-
    // run the program
    return core::system::runProgram(
                string_utils::utf8ToSystem(texProgramPath.absolutePath()),
                buildArgs(args, texFilePath),
                "",
-               procOptions,
+               texCompileOptions(envVars, texFilePath),
                pResult);
 }
 
+Error runTexCompile(const FilePath& texProgramPath,
+                    const core::system::Options& envVars,
+                    const shell_utils::ShellArgs& args,
+                    const FilePath& texFilePath,
+                    const boost::function<void(const std::string&)>& onOutput,
+                    core::system::ProcessResult* pResult)
+{
+   // stream output to the caller as it is produced
+   core::system::ProcessCallbacks cb;
+   cb.onStdout = cb.onStderr = boost::bind(onTexCompileOutput, onOutput, _2);
+   cb.onExit = boost::bind(onTexCompileExit, _1, pResult);
+
+   // run the program using a private supervisor and wait for it to exit
+   pResult->exitStatus = EXIT_FAILURE;
+   core::system::ProcessSupervisor supervisor;
+   Error error = supervisor.runProgram(
+               string_utils::utf8ToSystem(texProgramPath.absolutePath()),
+               buildArgs(args, texFilePath),
+               texCompileOptions(envVars, texFilePath),
+               cb);
+   if (error)
+      return error;
+
+   supervisor.wait(boost::posix_time::milliseconds(100));
+
+   return Success();
+}
+
 core::Error runTexCompile(
               const core::FilePath& texProgramPath,
               const core::system::Options& envVars,
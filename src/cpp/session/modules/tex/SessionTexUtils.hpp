@@ -50,6 +50,16 @@ core::Error runTexCompile(const core::FilePath& texProgramPath,
                           const core::FilePath& texFilePath,
                           core::system::ProcessResult* pResult);
 
+// synchronous compile which passes output to onOutput as it is produced
+// (note that pResult->stdOut is not populated in this case)
+core::Error runTexCompile(
+              const core::FilePath& texProgramPath,
+              const core::system::Options& envVars,
+              const core::shell_utils::ShellArgs& args,
+              const core::FilePath& texFilePath,
+              const boost::function<void(const std::string&)>& onOutput,
+              core::system::ProcessResult* pResult);
+
 core::Error runTexCompile(
               const core::FilePath& texProgramPath,
               const core::system::Options& envVars,
@@ -134,6 +134,11 @@ public class CompilePanel extends Composite
       outputDisplay_.writeOutput(output);
    }
    
+   public void clearErrors()
+   {
+      errorList_.clear();
+   }
+   
    public void showErrors(String basePath, 
                           JsArray<CompileError> errors,
                           int autoSelect)
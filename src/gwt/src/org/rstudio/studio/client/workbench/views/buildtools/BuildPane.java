@@ -120,6 +120,12 @@ public class BuildPane extends WorkbenchPane implements BuildPresenter.Display
       compilePanel_.showOutput(output);
    }
    
+   @Override
+   public void clearErrors()
+   {
+      compilePanel_.clearErrors();
+   }
+   
    @Override
    public void showErrors(String basePath,
                           JsArray<CompileError> errors, 
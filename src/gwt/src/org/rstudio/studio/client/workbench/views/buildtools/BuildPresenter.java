@@ -70,6 +70,7 @@ public class BuildPresenter extends BasePresenter
       void showOutput(CompileOutput output);
       void scrollToBottom();
       
+      void clearErrors();
       void showErrors(String basePath,
                       JsArray<CompileError> errors, 
                       boolean ensureVisible,
@@ -131,14 +132,23 @@ public class BuildPresenter extends BasePresenter
          @Override
          public void onBuildErrors(BuildErrorsEvent event)
          {        
+            // don't navigate to errors until the build has completed
+            boolean navigate = uiPrefs_.navigateToBuildError().getValue() &&
+                               !event.isRunning();
+            
+            // errors found while the build is running are added to the
+            // list, and once it completes the full list replaces them
+            if (!event.isRunning())
+               view_.clearErrors();
+            
             view_.showErrors(event.getBaseDirectory(),
                              event.getErrors(), 
                              true,
-                             uiPrefs_.navigateToBuildError().getValue() ?
+                             navigate ?
                                  CompileErrorList.AUTO_SELECT_FIRST_ERROR :
                                  CompileErrorList.AUTO_SELECT_NONE);
             
-            if (uiPrefs_.navigateToBuildError().getValue())
+            if (navigate)
             {
                CompileError error = CompileError.getFirstError(event.getErrors());
                if (error != null)
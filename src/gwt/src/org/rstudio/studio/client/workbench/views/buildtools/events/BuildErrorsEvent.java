@@ -36,6 +36,10 @@ public class BuildErrorsEvent extends GwtEvent<BuildErrorsEvent.Handler>
       public final native JsArray<CompileError> getErrors() /*-{
          return this.errors;
       }-*/;
+      
+      public final native boolean isRunning() /*-{
+         return !!this.running;
+      }-*/;
    }
 
    
@@ -58,6 +62,13 @@ public class BuildErrorsEvent extends GwtEvent<BuildErrorsEvent.Handler>
    {
       return data_.getErrors();
    }
+   
+   // new errors found while the build is still running (otherwise the
+   // complete list of errors for the build)
+   public boolean isRunning()
+   {
+      return data_.isRunning();
+   }
 
    @Override
    public Type<Handler> getAssociatedType()